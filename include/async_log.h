@@ -0,0 +1,82 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            ESCRITA ASSINCRONA DO LOG DE MENSAGENS DO FDC_MASTER (fdc.log) - ASYNC_LOG
+
+    A master_log() apenas marca o instante da mensagem e a copia, como uma entrada de
+tamanho fixo, para um anel da propria thread que a chamou: nao ha lock nem chamada de
+sistema no caminho de quem chama, de forma que uma thread do save_data() nunca espera pelo
+arquivo de log. Uma thread de escrita esvazia os aneis de todas as threads, formata as
+entradas como a master_log() sempre fez (data, mensagem e, nos erros, o strerror() do errno
+no momento da chamada) e as grava em lotes, a cada ASYNC_LOG_PERIOD_MS ou assim que um erro
+eh enfileirado.
+
+    Quando um anel esta cheio a entrada eh descartada e contada; a contagem eh gravada no
+log mais tarde. A mesma mensagem (mesmo texto) eh gravada no maximo ASYNC_LOG_BURST vezes em
+ASYNC_LOG_WINDOW_S segundos: as outras sao apenas contadas, e uma linha com o seu numero
+fecha a janela, para que um dispositivo falhando a cada amostra nao encha o log.
+
+    Antes de async_log_start() e depois de async_log_stop() as mensagens sao gravadas
+diretamente no stderr, ja que entao nao ha arquivo de log; se a thread de escrita nao puder
+ser criada elas sao gravadas diretamente no arquivo.
+*********************************************************************************************
+********************************************************************************************/
+
+#ifndef _ASYNC_LOG_H
+#define _ASYNC_LOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Bytes de cada entrada, e do texto que ela comporta
+#define ASYNC_LOG_ENTRY_SIZE 256
+#define ASYNC_LOG_TEXT (ASYNC_LOG_ENTRY_SIZE - 24)
+
+// Entradas do anel de cada thread
+#define ASYNC_LOG_RING 128
+
+// Threads que podem ter um anel ao mesmo tempo
+#define ASYNC_LOG_THREADS 32
+
+// Maior espera de uma mensagem de status antes de ser gravada
+#define ASYNC_LOG_PERIOD_MS 200
+
+// Limite de repeticao das mensagens
+#define ASYNC_LOG_BURST 5
+#define ASYNC_LOG_WINDOW_S 10
+
+typedef struct {
+    int64_t time_ns;            // CLOCK_REALTIME da chamada
+    uint32_t id;                // Hash do texto, para o limite de repeticao
+    int16_t type;               // STATUS_LOG ou ERROR_LOG
+    int16_t error;              // errno no momento da chamada
+    uint32_t length;            // Bytes do texto
+    uint32_t reserved;
+    char text[ASYNC_LOG_TEXT];  // Sem terminador
+} async_log_entry_t;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que inicia a thread de escrita no arquivo aberto out. Retorna 0 em caso de
+// sucesso e -1 em caso de falha (as mensagens continuam sendo gravadas, diretamente).
+int async_log_start(FILE *out);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que enfileira uma mensagem do tipo STATUS_LOG ou ERROR_LOG. Retorna 0, ou -1 se
+// a mensagem foi descartada porque o anel da thread estava cheio.
+int async_log_post(int type, const char *msg);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que grava tudo o que esta na fila, termina a thread de escrita e volta a gravar
+// diretamente no stderr. O arquivo continua aberto.
+void async_log_stop(void);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao a ser chamada no filho, logo apos o fork(): a thread de escrita nao eh copiada,
+// entao dai em diante as mensagens do filho sao gravadas diretamente no arquivo (no
+// stderr se nao houver um), e nunca enfileiradas.
+void async_log_forked(void);
+
+#endif
@@ -0,0 +1,224 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            CONTADORES DE ERROS, RESSINCRONIZACOES E PERDAS DOS DISPOSITIVOS - DEV_COUNTERS
+
+    Um bloco de memoria compartilhada do RTAI (rtai_kmalloc() com o mesmo nome em cada
+modulo que conta, rtai_malloc() no fdc_master) guarda uma posicao de contadores por
+dispositivo, na ordem das FIFOs de dados (RT_FIFO_AHRS a RT_FIFO_PITOT, como em
+log_stream_t):
+- o driver do dispositivo conta os bytes que le da sua porta serial, os
+  quadros aceitos, os quadros com checksum errado, os bytes descartados
+  na procura de um cabecalho e as ressincronizacoes (cada sequencia de
+  bytes descartados, ou um quadro rejeitado pelo checksum);
+- o fdc_slave conta as amostras que nao couberam na FIFO de dados (ou no
+  anel do shm_ring.h);
+- o modem conta os quadros de telemetria do dispositivo que enviou, e os
+  que descartou com o buffer de transmissao cheio.
+    Cada contador tem um unico escritor e corre livre (volta a zero em 2^32), entao nenhum
+lado usa lock: o fdc_master le o bloco a qualquer momento e ve cada contador inteiro, ainda
+que nao todos no mesmo instante.
+
+    Um driver zera a sua posicao quando eh carregado. Uma posicao que nunca foi zerada (o
+driver do dispositivo nao esta carregado) nao tem o numero magico e nao eh informada.
+
+    Tudo aqui eh inline, de forma que o mesmo codigo eh compilado nos modulos (__KERNEL__) e
+no espaco de usuario. O dev_counters.c mapeia o bloco no fdc_master, ou um objeto de memoria
+compartilhada POSIX que o substitui com SHM_RING_MMAP, como faz o shm_region.c.
+*********************************************************************************************
+********************************************************************************************/
+
+#ifndef _DEV_COUNTERS_H
+#define _DEV_COUNTERS_H
+
+#ifdef __KERNEL__
+#include <linux/string.h>
+#include <asm/system.h>
+#include <rtai_shm.h>
+#else
+#include <stdio.h>
+#include <string.h>
+#endif
+
+// Nome da memoria compartilhada do RTAI (nam2num(), no maximo 6 caracteres), e do objeto
+// de memoria compartilhada POSIX que a substitui no espaco de usuario
+#define DEV_COUNTERS_NAME "FDCCNT"
+#define DEV_COUNTERS_FILE "/fdc_counters"
+
+// Gravado pelo driver assim que a sua posicao eh zerada
+#define DEV_COUNTERS_MAGIC 0x46444343
+#define DEV_COUNTERS_VERSION 1
+
+// Dispositivos, na ordem das FIFOs de dados
+enum {
+    DEV_AHRS,
+    DEV_DAQ,
+    DEV_GPS,
+    DEV_NAV,
+    DEV_PITOT,
+    DEV_COUNTERS_DEVICES
+};
+
+#define DEV_COUNTERS_NAMES { "ahrs", "daq", "gps", "nav", "pitot" }
+
+#ifdef __KERNEL__
+#define dev_count_load(p) (*(volatile unsigned int *)(p))
+#define dev_count_store(p, v) (*(volatile unsigned int *)(p) = (v))
+#define dev_magic_store(p, v) do { smp_wmb(); *(volatile unsigned int *)(p) = (v); } while (0)
+#define dev_magic_load(p) ({ unsigned int _v = *(volatile unsigned int *)(p); smp_rmb(); _v; })
+#else
+#define dev_count_load(p) __atomic_load_n(p, __ATOMIC_RELAXED)
+#define dev_count_store(p, v) __atomic_store_n(p, v, __ATOMIC_RELAXED)
+#define dev_magic_store(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define dev_magic_load(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#endif
+
+// Somente o escritor de um contador pode soma-lo
+#define dev_count(p, n) dev_count_store(p, dev_count_load(p) + (n))
+
+// Soma a um contador da posicao c, se o bloco foi anexado
+#define DEV_COUNT(c, field, n) do { if ((c) != NULL) dev_count(&(c)->field, n); } while (0)
+
+typedef struct {
+    unsigned int magic;         // DEV_COUNTERS_MAGIC assim que a posicao eh zerada
+
+    // Driver do dispositivo
+    unsigned int rx_bytes;      // Lidos da porta serial
+    unsigned int frames_ok;     // Aceitos (checksum certo, ou sem checksum)
+    unsigned int crc_errors;    // Rejeitados pelo checksum
+    unsigned int discarded;     // Bytes fora de um quadro
+    unsigned int resyncs;       // Sequencias de bytes descartados e quadros rejeitados
+
+    // fdc_slave
+    unsigned int fifo_drops;    // Amostras que nao couberam na FIFO ou no anel
+
+    // Modem
+    unsigned int tx_frames;     // Quadros de telemetria enviados
+    unsigned int tx_drops;      // Quadros de telemetria descartados, buffer de transmissao cheio
+} __attribute__ ((aligned (64))) dev_counters_t;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Driver: n bytes foram descartados na procura de um cabecalho. *discarding indica se o
+// ultimo byte tambem foi descartado, para que uma sequencia de bytes descartados conte
+// como uma unica ressincronizacao; o driver o zera quando um cabecalho eh encontrado.
+static inline void dev_count_discarded(dev_counters_t *c, int *discarding, unsigned int n)
+{
+    if (c != NULL) {
+        dev_count(&c->discarded, n);
+        if (!*discarding)
+            dev_count(&c->resyncs, 1);
+    }
+    *discarding = 1;
+}
+
+typedef struct {
+    unsigned int version;
+    unsigned int size;          // Bytes do bloco
+    unsigned int n_devices;
+    dev_counters_t devices[DEV_COUNTERS_DEVICES];
+} dev_counters_block_t;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que monta o cabecalho do bloco. Todo lado que se anexa a chama: os valores nao
+// mudam, entao ela pode ser chamada mais de uma vez.
+static inline void dev_counters_init(dev_counters_block_t *b)
+{
+    b->version = DEV_COUNTERS_VERSION;
+    b->size = sizeof(dev_counters_block_t);
+    b->n_devices = DEV_COUNTERS_DEVICES;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Driver: zera a posicao do seu dispositivo, quando eh carregado
+static inline void dev_counters_reset(dev_counters_block_t *b, int dev)
+{
+    dev_counters_t *c = &b->devices[dev];
+
+    dev_magic_store(&c->magic, 0);
+    memset((char *)c + sizeof(c->magic), 0, sizeof(*c) - sizeof(c->magic));
+    dev_magic_store(&c->magic, DEV_COUNTERS_MAGIC);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Leitor: copia a posicao de dev, gravada ao mesmo tempo pelos modulos. Retorna 0 se a
+// posicao nunca foi zerada.
+static inline int dev_counters_copy(dev_counters_block_t *b, int dev, dev_counters_t *c)
+{
+    const dev_counters_t *s = &b->devices[dev];
+
+    if ((b->version != DEV_COUNTERS_VERSION) || (dev_magic_load(&s->magic) != DEV_COUNTERS_MAGIC))
+        return 0;
+
+    c->magic = DEV_COUNTERS_MAGIC;
+    c->rx_bytes = dev_count_load(&s->rx_bytes);
+    c->frames_ok = dev_count_load(&s->frames_ok);
+    c->crc_errors = dev_count_load(&s->crc_errors);
+    c->discarded = dev_count_load(&s->discarded);
+    c->resyncs = dev_count_load(&s->resyncs);
+    c->fifo_drops = dev_count_load(&s->fifo_drops);
+    c->tx_frames = dev_count_load(&s->tx_frames);
+    c->tx_drops = dev_count_load(&s->tx_drops);
+
+    return 1;
+}
+
+#ifdef __KERNEL__
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Modulo: anexa-se ao bloco, alocado pelo primeiro lado que o pede. Retorna NULL se nao
+// houver memoria.
+static inline dev_counters_block_t *dev_counters_get(void)
+{
+    dev_counters_block_t *b = rtai_kmalloc(nam2num(DEV_COUNTERS_NAME), sizeof(dev_counters_block_t));
+
+    if (b != NULL)
+        dev_counters_init(b);
+
+    return b;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Modulo: desanexa-se do bloco, na sua finalizacao
+static inline void dev_counters_put(void)
+{
+    rtai_kfree(nam2num(DEV_COUNTERS_NAME));
+}
+
+#else
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que mapeia o bloco no fdc_master. Retorna NULL se ele nao puder ser mapeado.
+dev_counters_block_t *dev_counters_attach(void);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void dev_counters_detach(dev_counters_block_t *b);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que grava uma tabela dos contadores dos dispositivos cuja posicao foi zerada.
+// Com since diferente de NULL (uma copia de todas as posicoes, como a feita por
+// dev_counters_snapshot()), as contagens desde entao tambem sao gravadas.
+void dev_counters_print(FILE *f, dev_counters_block_t *b, const dev_counters_t since[]);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que copia todas as posicoes (zeros nas que nunca foram zeradas)
+void dev_counters_snapshot(dev_counters_block_t *b, dev_counters_t c[]);
+
+#ifdef SHM_RING_MMAP
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que remove o bloco do substituto, depois que todos os lados se desanexaram
+void dev_counters_remove(void);
+#endif
+
+#endif
+
+#endif
@@ -23,6 +23,8 @@
 #define FIFO_CONTROL    "/dev/rtf5"
 #define FIFO_STATUS     "/dev/rtf6"
 #define FIFO_COMMAND    "/dev/rtf7"
+#define FIFO_RINGS      "/dev/rtf8"
+#define FIFO_JITTER     "/dev/rtf9"
 
 #define PARSER_NAME "fdc_cmd_parser"
 
@@ -30,10 +32,26 @@
 
 #define LOG_FILE "./fdc.log"
 
+// Contadores de erros e perdas dos dispositivos, no diretorio do voo
+#define COUNTERS_FILE "contadores.txt"
+
 #define PARSER_TIMEOUT 10
 
+// Periodo (ms) do timer de manutencao do loop principal
+#define HOUSEKEEPING_MS 1000
+
 #define SEM_SIZE 1
 
+// Numero maximo de comandos enviados ao fdc_slave aguardando resposta
+#define CMD_MAX_PENDING 16
+
+// Prazo (ms) para a resposta do fdc_slave a um comando
+#define CMD_TIMEOUT_MS 100
+
+// Funcao chamada quando chega a resposta a um comando, ou com TIMEOUT quando o
+// prazo expira. arg eh o argumento dado em sendcommand_async().
+typedef void (*cmd_done_t)(const cmd_msg_t *cmd, cmd_status_t result, void *arg);
+
 // Define a variavel global do programa
 global_master global;
 
@@ -47,12 +65,20 @@ int load_config_file(void);
 
 void main_loop(void);
 
-void process_message(void);
+int process_message(void);
 
 void terminate(int s);
 
 cmd_status_t sendcommand(parser_cmd_msg_t* parser_msg_to_rt);
 
+int sendcommand_async(parser_cmd_msg_t* parser_msg_to_rt, cmd_done_t done, void *arg);
+
+int receive_replies(void);
+
+int expire_commands(void);
+
+int command_timeout_ms(void);
+
 int fdc_log(int type_message, const char* place);
 
 int load_modules(void);
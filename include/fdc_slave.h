@@ -12,6 +12,16 @@
 // Mensagens de comunicacao
 #include "messages.h"
 
+// Atraso do despertar e estouros do periodo da tarefa de tempo real
+#include "rt_jitter.h"
+
+// Aneis de amostras em memoria compartilhada com o fdc_master, no lugar das FIFOs
+// de dados (make SHM_RINGS=1)
+#ifdef FDC_SHM_RINGS
+#include <rtai_shm.h>
+#include "shm_ring.h"
+#endif
+
 // Define a utilizacao de ponto flutuante dentro do kernel
 #ifndef CONFIG_RTAI_FPU_SUPPORT
     #define CONFIG_RTAI_FPU_SUPPORT
@@ -36,6 +46,11 @@
 #define RT_FIFO_CONTROL 5
 #define RT_FIFO_STATUS     6
 #define RT_FIFO_COMAND     7    // Comandos recebidos via modem
+#define RT_FIFO_RINGS     8    // Aviso de novas amostras nos aneis (FDC_SHM_RINGS)
+#define RT_FIFO_JITTER     9    // Resumos do atraso e dos estouros do periodo (rt_jitter.h)
+
+// Numero maximo de comandos do fdc_master tratados em um mesmo periodo
+#define MAX_CMDS_PER_TICK 16
 
 // Numero maximo de pacotes perdidos na comunicacao via modem
 #define MAX_PACKETS_LOST 100    
@@ -76,6 +91,8 @@ static void rt_func_nav(configure* config);
 
 static void rt_func_pitot(configure* config);
 
+static void rt_put_sample(int fifo, const void* msg, int size);
+
 //static void rt_func_modem(configure* config);
 
 static int  rt_func_control(configure* config);
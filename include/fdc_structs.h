@@ -3,6 +3,8 @@
 #define _FDC_STRUCTS_H
 
 #include "messages.h"
+#include "shm_ring.h"
+#include "dev_counters.h"
 
 #include <time.h>
 #include <stdlib.h>
@@ -35,7 +37,9 @@ typedef struct {
     // Varivel global que indica o fim do programa UAV_PADAWAN
     int theend;
 
-    // Variavel que indica o fim da thread de salvamento dos dados
+    // Variavel que indica o fim da thread de salvamento dos dados. Acessada apenas
+    // atraves de operacoes atomicas (save_data_state(), start_save_data() e
+    // stop_save_data()), sem semaforo
     int end_save_data;
     
     // Nome do arquivo de configuracao.
@@ -44,6 +48,26 @@ typedef struct {
     // Nomes dos arquivos de salvamento de dados
     char file_daq_name[MAX_STRLEN], file_ahrs_name[MAX_STRLEN], file_gps_name[MAX_STRLEN], file_nav_name[MAX_STRLEN], file_pitot_name[MAX_STRLEN];
 
+    // Formato dos arquivos de dados do proximo voo (log_format_t)
+    log_format_t log_format;
+    
+    // Tempo maximo (ms) que um dado permanece no buffer antes de ser escrito em disco
+    int flush_ms;
+    
+    // Se diferente de zero, cada escrita dos buffers eh seguida de fdatasync()
+    int sync_data;
+    
+    // Duracao esperada do voo (min) para a preallocacao dos arquivos mapeados em
+    // memoria. Zero desliga o mapeamento (escrita por buffers).
+    int prealloc_min;
+    
+    // Troca automatica de segmento dos arquivos de dados, apos rotate_min minutos ou
+    // quando um arquivo atinge rotate_mb MB. Zero desliga.
+    int rotate_min, rotate_mb;
+    
+    // Diretorio do voo em andamento
+    char dir_name[MAX_STRLEN];
+
     // Descritor de arquivo da FIFO de controle
     FILE *ctrl_fifo;
     
@@ -68,15 +92,42 @@ typedef struct {
     // Fifo de comandos via modem
     int fifo_cmd;
     
+    // Aneis de amostras na memoria compartilhada com o fdc_slave (FDC_SHM_RINGS), e
+    // FIFO que avisa que ha amostras novas neles. NULL e -1 quando os dados chegam
+    // pelas FIFOs de dados.
+    shm_region_t *rings;
+    int fifo_rings;
+    
+    // Resumos do atraso e dos estouros do periodo da tarefa de tempo real (rt_jitter.h),
+    // gravados no diretorio do voo. -1 se a FIFO nao pode ser aberta.
+    int fifo_jitter;
+    
+    // Contadores de erros e perdas de cada dispositivo (dev_counters.h), na memoria
+    // compartilhada com os modulos, e a sua copia no inicio do ultimo voo. NULL se a
+    // memoria nao pode ser acessada.
+    dev_counters_block_t *counters;
+    dev_counters_t counters_start[DEV_COUNTERS_DEVICES];
+    
+    // Porta UDP (em 127.0.0.1) do servidor de telemetria local (telemetry.h), alem do
+    // socket local. 0 se nao houver (opcao -u da linha de comando).
+    int telem_udp_port;
+    
+    // Segundos das ultimas amostras de cada dispositivo guardados em memoria (history.h),
+    // alocados na partida. 0 se nao houver (opcao -H da linha de comando).
+    int history_seconds;
+    
     // Descricoes de semaforos para as variaveis globais
     // Nomes dos arquivos que armazenam os dados
     sem_t file_names;
     
-    // Finalizar a thread de salvamento de dados
-    sem_t end_thread_save_data;
+    // Pedido de troca de segmento dos arquivos de dados (atomico, ver request_rotation())
+    int rotate_save_data;
+    
+    // eventfd usado para acordar a thread de salvamento de dados, bloqueada em poll()
+    int wakeup_save_data;
     
-    // Semaforo de acesso ao arquivo de log
-    sem_t sem_log_file;
+    // signalfd dos sinais de termino, lido pelo loop principal
+    int signal_fd;
     
     // Estado em que o programa se encontra
     fdc_state_t state;
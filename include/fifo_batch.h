@@ -0,0 +1,54 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            LEITURA EM LOTE DOS REGISTROS DE TAMANHO FIXO DAS FIFOS DE DADOS - FIFO_BATCH
+
+    Em vez de um read() por msg_*_t, cada serie le de uma so vez para o seu proprio buffer
+tantos registros inteiros quantos a FIFO contiver. A FIFO eh uma sequencia de bytes, entao
+uma leitura pode terminar no meio de um registro; o registro parcial eh mantido no inicio do
+buffer e completado pela leitura seguinte.
+*********************************************************************************************
+********************************************************************************************/
+
+#ifndef _FIFO_BATCH_H
+#define _FIFO_BATCH_H
+
+#include <stddef.h>
+
+// Registros lidos por chamada, por serie (cerca da capacidade de uma FIFO de tempo real)
+#define FIFO_BATCH_RECORDS 256
+
+typedef struct {
+    int fd;
+    size_t record_size;
+    char *buf;
+    size_t capacity;            // Bytes de buf (um multiplo de record_size)
+    size_t fill;                // Bytes lidos em buf, os registros completos primeiro
+    size_t ready;               // Registros completos entregues pela ultima leitura
+    unsigned long long records; // Registros completos lidos ate agora
+    unsigned long long reads;   // Chamadas de read() que retornaram dados
+} fifo_batch_t;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que prepara b para ler de fd registros de record_size bytes, max_records de cada
+// vez. Retorna 0 em caso de sucesso, -1 se o buffer nao puder ser alocado.
+int fifo_batch_init(fifo_batch_t *b, int fd, size_t record_size, size_t max_records);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que descarta os registros entregues pela chamada anterior e le o que a FIFO
+// contem. Retorna o numero de registros completos no inicio de b->buf (0 se nao houver),
+// ou -1 em um erro de leitura que nao seja EAGAIN.
+int fifo_batch_read(fifo_batch_t *b);
+
+// Endereco do i-esimo registro entregue pela ultima fifo_batch_read()
+#define fifo_batch_record(b, i) ((const void *)((b)->buf + (size_t)(i)*(b)->record_size))
+
+// Bytes de um registro parcial ainda a espera do seu restante
+#define fifo_batch_pending(b) ((b)->fill - (b)->ready*(b)->record_size)
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void fifo_batch_free(fifo_batch_t *b);
+
+#endif
@@ -0,0 +1,68 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            ULTIMOS SEGUNDOS DE CADA SERIE, MANTIDOS EM MEMORIA - HISTORY
+
+    O fdc_master guarda os registros lidos mais recentemente pelo save_data() em um buffer
+circular por serie, alocado uma unica vez na inicializacao para um numero de segundos na
+maior taxa dos dispositivos (HISTORY_RATE), e que nunca cresce. O historico sobrevive ao
+"stop", de forma que o ultimo minuto de uma gravacao pode ser visto logo depois dela, sem
+ler os arquivos de dados.
+
+    A thread do save_data() que le as FIFOs (ou os aneis) eh o unico escritor e nunca
+espera: o registro mais antigo eh sobrescrito. Como no telemetry.c, cada posicao leva o
+numero do seu registro, gravado antes e depois da copia (um seqlock), de forma que uma
+descarga, feita por outra thread, copia os registros sem lock e pula os que foram
+sobrescritos enquanto ela os lia.
+
+    Uma descarga pega a janela dos ultimos segundos antes do registro mais novo de qualquer
+serie (pelo time_sys), para que as series fiquem alinhadas, e grava cada serie como um log
+binario bruto (LOG_RAW: o cabecalho do log_format.h e os registros), que pode ser lido pelo
+log_convert e pelo tests/le_log_binario.m:
+- em um diretorio, um arquivo por serie (HISTORY_FILE<serie>.bin);
+- em um socket UNIX (SOCK_STREAM) onde um cliente escuta, um log apos o
+  outro, cada um precedido do seu tamanho em bytes (uint64_t).
+*********************************************************************************************
+********************************************************************************************/
+
+#ifndef _HISTORY_H
+#define _HISTORY_H
+
+// Segundos guardados por default, e no maximo
+#define HISTORY_SECONDS 60
+#define HISTORY_MAX_SECONDS 600
+
+// Maior taxa de uma serie (Hz): uma amostra por periodo da tarefa de tempo real
+#define HISTORY_RATE 50
+
+// Prefixo dos arquivos de uma descarga, no seu diretorio
+#define HISTORY_FILE "historico_"
+
+// Maior tempo (ms) que uma descarga para um socket pode levar: o laco de comandos do
+// fdc_master espera por ela, entao um cliente que para de ler eh abandonado
+#define HISTORY_SEND_TIMEOUT_MS 2000
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que aloca o historico de seconds de cada serie (0: sem historico). Retorna 0, ou
+// -1 se nao houver memoria.
+int history_init(int seconds);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que guarda n registros de stream, do tamanho de registro da serie. Chamada
+// somente pela thread do save_data() que le as FIFOs.
+void history_add(int stream, const void *records, int n);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que grava os ultimos seconds de cada serie (tudo o que esta guardado, com
+// seconds 0) em dest, um diretorio ou um socket UNIX. Somente uma thread pode fazer uma
+// descarga de cada vez. Retorna o numero de registros gravados, ou -1 em caso de erro
+// (errno eh ETIMEDOUT se o socket nao foi lido dentro de HISTORY_SEND_TIMEOUT_MS).
+long history_dump(const char *dest, int seconds);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void history_free(void);
+
+#endif
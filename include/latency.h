@@ -0,0 +1,148 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            HISTOGRAMAS DE LATENCIA DAS AMOSTRAS, EM FAIXAS LOGARITMICAS - LATENCY
+
+    Um histograma conta latencias em microssegundos em um vetor fixo de faixas: os valores
+abaixo de LAT_SUB sao contados exatamente, e cada potencia de dois acima eh dividida em
+LAT_SUB faixas de mesma largura, de forma que toda faixa tem no maximo 1/LAT_SUB (6%) de
+largura relativa aos seus valores, de 1 us ate cerca de 71 min. Somar um valor custa poucas
+instrucoes e nenhuma alocacao, e um histograma tem uma unica thread escritora; qualquer
+outra thread pode le-lo ao mesmo tempo (lat_hist_copy), ao preco de ver os ultimos valores
+em alguns campos e nao em outros.
+
+    As amostras sao marcadas pela tarefa de tempo real com o time_sys, do relogio do RTAI,
+que nao eh o relogio de log_now_ns(). Um lat_clock_t guarda a diferenca entre os dois
+relogios como a menor diferenca vista nos ultimos LAT_CLOCK_WINDOW_NS, de forma que as
+idades que ele mede sao relativas a amostra mais rapida dessa janela (sempre >= 0), o que
+acompanha uma deriva lenta entre os relogios.
+
+    Um lat_marks_t acompanha os registros de um arquivo de dados desde o momento em que sao
+entregues ao seu log_writer_t ate que os bytes que os contem saiam do buffer do escritor,
+para medir a idade das amostras quando chegam ao armazenamento.
+*********************************************************************************************
+********************************************************************************************/
+
+#ifndef _LATENCY_H
+#define _LATENCY_H
+
+#include <stdio.h>
+
+// Bits da faixa exata e das faixas de cada potencia de dois
+#define LAT_SUB_BITS 4
+#define LAT_SUB (1 << LAT_SUB_BITS)
+
+// Os valores sao limitados abaixo de 2^LAT_MAX_BITS us
+#define LAT_MAX_BITS 32
+
+#define LAT_BUCKETS ((LAT_MAX_BITS - LAT_SUB_BITS + 1)*LAT_SUB)
+
+// Janela da estimativa da diferenca entre os relogios
+#define LAT_CLOCK_WINDOW_NS 10000000000LL
+
+// Registros de um arquivo acompanhados ao mesmo tempo por um lat_marks_t (uma potencia de
+// dois)
+#define LAT_MARKS 1024
+
+typedef struct {
+    unsigned long long count;
+    unsigned long long sum;             // us
+    unsigned long long min, max;        // us (min nao tem sentido enquanto count for 0)
+    unsigned int buckets[LAT_BUCKETS];
+} lat_hist_t;
+
+typedef struct {
+    long long offset;                   // Relogio menos time_sys da amostra mais rapida
+    long long window_min;               // Menor diferenca na janela atual
+    long long previous_min;             // e na anterior
+    long long window_end;
+    int valid;
+} lat_clock_t;
+
+typedef struct {
+    long long time_sys;
+    unsigned long long end;             // Bytes do arquivo ate o fim do registro
+} lat_mark_t;
+
+typedef struct {
+    lat_mark_t marks[LAT_MARKS];
+    unsigned long head, placed, tail;   // Correm livres: [tail, placed) ja tem o seu fim
+    unsigned long skipped;              // Registros nao acompanhados, com todas as marcas em uso
+} lat_marks_t;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void lat_hist_reset(lat_hist_t *h);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que soma uma latencia em nanossegundos (valores negativos contam como 0)
+void lat_hist_add(lat_hist_t *h, long long ns);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que copia h, que pode estar sendo gravado por outra thread, em dst
+void lat_hist_copy(lat_hist_t *dst, const lat_hist_t *h);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Faixa de um valor em us, e o menor e o maior valores de uma faixa
+int lat_bucket(unsigned long long us);
+/*!*******************************************************************************************
+*********************************************************************************************/
+unsigned long long lat_bucket_low(int bucket);
+/*!*******************************************************************************************
+*********************************************************************************************/
+unsigned long long lat_bucket_high(int bucket);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Limite superior (us) da fracao p (0 a 1) dos menores valores, no maximo o maior valor;
+// 0 se o histograma estiver vazio
+unsigned long long lat_hist_percentile(const lat_hist_t *h, double p);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que grava o resumo e as faixas em uso de h, com o titulo name, como texto
+void lat_hist_print(FILE *f, const char *name, const lat_hist_t *h);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void lat_clock_reset(lat_clock_t *c);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que atualiza a diferenca com uma amostra marcada com time_sys e vista em now
+// (log_now_ns). Somente uma thread pode chama-la.
+void lat_clock_update(lat_clock_t *c, long long time_sys, long long now);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Idade em now de uma amostra marcada com time_sys, para qualquer thread: 0 ate a
+// primeira lat_clock_update()
+long long lat_clock_age(const lat_clock_t *c, long long time_sys, long long now);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void lat_marks_reset(lat_marks_t *m);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que acompanha um registro marcado com time_sys. O seu fim no arquivo eh dado
+// agora, ou mais tarde por lat_marks_place() (end 0) se o registro espera em um
+// codificador. Retorna 0 e conta o registro como pulado se todas as marcas estiverem em
+// uso.
+int lat_marks_add(lat_marks_t *m, long long time_sys, unsigned long long end);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Os registros ainda sem fim foram gravados ate o byte end
+void lat_marks_place(lat_marks_t *m, unsigned long long end);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que soma a h a idade em now dos registros cujo fim esta no maximo em written
+// (bytes que sairam do escritor), e deixa de acompanha-los
+void lat_marks_complete(lat_marks_t *m, unsigned long long written, const lat_clock_t *c,
+                        lat_hist_t *h, long long now);
+
+#endif
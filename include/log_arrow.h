@@ -0,0 +1,93 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            ARQUIVOS ARROW IPC DOS REGISTROS DO LOG DE VOO - LOG_ARROW
+
+    Grava os registros de um log binario como um arquivo Apache Arrow IPC (o formato lido
+por pyarrow.ipc.open_file() e pandas.read_feather()), sem depender das bibliotecas do Arrow.
+Cada elemento de cada campo vira uma coluna sem nulos ("tensao[3]", "time_sys"): inteiros de
+4 e 8 bytes como int32 e int64, floats como float32 (ou float64). Cada chamada de
+log_arrow_batch() gera um record batch, de forma que um arquivo pode ser gravado em pedacos
+convertidos em paralelo, desde que os pedacos sejam gravados em ordem e os seus
+log_arrow_block_t sejam passados para log_arrow_end().
+
+    Os metadados sao gravados como FlatBuffers por um pequeno construtor no log_arrow.c,
+seguindo o Schema.fbs, o Message.fbs e o File.fbs do formato Arrow (versao de metadados V5).
+*********************************************************************************************
+********************************************************************************************/
+
+#ifndef _LOG_ARROW_H
+#define _LOG_ARROW_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "log_format.h"
+
+// Buffer de bytes que cresce e recebe os pedacos codificados de um arquivo
+typedef struct {
+    unsigned char *data;
+    size_t len, cap;
+} log_arrow_buf_t;
+
+// Uma coluna por elemento de cada campo
+typedef struct {
+    char name[LOG_NAME_LEN + 16];
+    uint32_t offset;        // Posicao do elemento no registro
+    uint32_t size;          // 4 ou 8 bytes
+    uint32_t type;          // log_field_type_t
+} log_arrow_column_t;
+
+typedef struct {
+    int n_columns;
+    log_arrow_column_t *columns;
+} log_arrow_schema_t;
+
+// Posicao de um record batch no arquivo, para o rodape
+typedef struct {
+    uint64_t offset;        // Posicao da mensagem do batch no arquivo
+    uint32_t meta_len;      // Bytes dos seus metadados (com prefixo e preenchimento)
+    uint64_t body_len;      // Bytes do seu corpo
+} log_arrow_block_t;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que monta as colunas de uma tabela de campos. Retorna 0 em caso de sucesso e -1
+// em uma falha de alocacao ou em tipos de campo desconhecidos.
+int log_arrow_schema_init(log_arrow_schema_t *s, const log_field_t *fields, int n_fields);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void log_arrow_schema_free(log_arrow_schema_t *s);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que acrescenta o inicio de um arquivo (numero magico e mensagem do esquema) a
+// out. Retorna 0 em caso de sucesso e -1 se faltar memoria.
+int log_arrow_begin(log_arrow_buf_t *out, const log_arrow_schema_t *s);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que acrescenta a out um record batch dos n registros (de record_size bytes
+// cada), preenchendo *block com os seus tamanhos (a posicao fica a cargo de quem chama).
+// Retorna 0 em caso de sucesso e -1 se faltar memoria.
+int log_arrow_batch(log_arrow_buf_t *out, const log_arrow_schema_t *s, const void *records,
+                    size_t record_size, size_t n, log_arrow_block_t *block);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que acrescenta o fim de um arquivo (marca de fim do fluxo, rodape com o esquema
+// e as posicoes dos n_blocks batches, e o numero magico final).
+int log_arrow_end(log_arrow_buf_t *out, const log_arrow_schema_t *s,
+                  const log_arrow_block_t *blocks, size_t n_blocks);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que acrescenta len bytes a um buffer. Retorna 0 em caso de sucesso, -1 se faltar
+// memoria.
+int log_arrow_append(log_arrow_buf_t *out, const void *data, size_t len);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void log_arrow_buf_free(log_arrow_buf_t *out);
+
+#endif
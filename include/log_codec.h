@@ -0,0 +1,184 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            COMPRESSAO EM COLUNAS DOS REGISTROS BINARIOS DO LOG DE VOO - LOG_CODEC
+
+    Um arquivo de log comprimido (codificacao LOG_DELTA) tem o mesmo cabecalho e a mesma
+tabela de campos de um arquivo binario bruto, seguidos de blocos de ate
+LOG_CODEC_BLOCK_RECORDS registros. Cada bloco comeca com um log_block_t e guarda os seus
+registros transpostos em colunas, uma coluna por elemento de cada campo, cada valor gravado
+como um inteiro de tamanho variavel (LEB128):
+
+  - inteiros de 8 bytes (time_sys) como o zigzag do delta do delta
+  - inteiros de 4 bytes como o zigzag do delta
+  - floats como o XOR dos seus bits com o valor anterior
+
+    O primeiro valor de cada coluna em um bloco eh codificado em relacao a zero, de forma
+que cada bloco pode ser decodificado sozinho. Os arquivos em blocos com confirmacao
+(codificacao LOG_JOURNAL) usam os mesmos blocos com os registros copiados sem alteracao.
+
+    Cada cabecalho de bloco leva o numero de sequencia do bloco, o time_sys do seu primeiro
+e do seu ultimo registros e os CRCs dele mesmo e dos dados. A cada LOG_CODEC_COMMIT_MS o
+codificador grava uma marca de confirmacao (um cabecalho de bloco com LOG_COMMIT_MAGIC e sem
+dados) e forca a gravacao do arquivo no disco, de forma que um leitor sabe que tudo o que
+vem antes de uma marca sobreviveu a gravacao. Apos uma queda de energia um arquivo eh valido
+ate o seu ultimo bloco correto; ver o log_recover.c.
+*********************************************************************************************
+********************************************************************************************/
+
+#ifndef _LOG_CODEC_H
+#define _LOG_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "log_format.h"
+#include "log_writer.h"
+#include "log_index.h"
+
+// "FBLK" nos primeiros bytes de todo bloco, "FCMT" nas marcas de confirmacao
+#define LOG_BLOCK_MAGIC 0x4b4c4246u
+#define LOG_COMMIT_MAGIC 0x544d4346u
+
+// Registros por bloco, e o maior tempo que um registro espera pela gravacao do seu bloco,
+// em milissegundos
+#define LOG_CODEC_BLOCK_RECORDS 64
+#define LOG_CODEC_BLOCK_MS 1000
+
+// Intervalo entre as marcas de confirmacao, em milissegundos
+#define LOG_CODEC_COMMIT_MS 1000
+
+// Cabecalho de bloco (40 bytes). Nas marcas de confirmacao n_records eh o numero de
+// registros gravados no arquivo ate entao, size e crc sao 0, e os tempos sao os do
+// primeiro e do ultimo registros do arquivo.
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;           // Blocos e marcas gravados antes deste
+    uint32_t n_records;
+    uint32_t size;          // Bytes de dados codificados depois deste cabecalho
+    int64_t first_time;     // time_sys do primeiro e do ultimo registros
+    int64_t last_time;
+    uint32_t crc;           // CRC-32 dos dados
+    uint32_t header_crc;    // CRC-32 dos membros acima
+} log_block_t;
+
+// Codificacao de uma coluna
+typedef enum {
+    LOG_COL_DELTA,          // Inteiro, delta
+    LOG_COL_DOD,            // Inteiro, delta do delta
+    LOG_COL_XOR             // Float, XOR com o valor anterior
+} log_column_kind_t;
+
+typedef struct {
+    uint32_t offset;        // Posicao do elemento dentro do registro
+    uint32_t size;          // 4 ou 8 bytes
+    log_column_kind_t kind;
+} log_column_t;
+
+// Colunas dos registros de uma serie
+typedef struct {
+    size_t record_size;
+    int n_columns;
+    log_column_t *columns;
+    int time_offset;        // Posicao do time_sys no registro, -1 se nao houver
+} log_layout_t;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que monta as colunas dos registros descritos por uma tabela de campos (a de
+// log_stream_fields() ou a lida do cabecalho de um arquivo). Retorna 0 em caso de
+// sucesso, -1 em uma falha de alocacao ou em tipos de campo desconhecidos.
+int log_layout_init(log_layout_t *layout, const log_field_t *fields, int n_fields, size_t record_size);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void log_layout_free(log_layout_t *layout);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Maior tamanho codificado de n registros
+size_t log_block_bound(const log_layout_t *layout, int n);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que preenche os CRCs de um cabecalho de bloco cujos dados sao data
+void log_block_seal(log_block_t *b, const void *data);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcoes que retornam 0 se o numero magico e o CRC de um cabecalho de bloco, ou o CRC
+// dos seus dados, estao certos, e -1 caso contrario
+int log_block_check_header(const log_block_t *b);
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_block_check_data(const log_block_t *b, const void *data);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que codifica n registros em out (pelo menos log_block_bound() bytes). Retorna o
+// numero de bytes usados.
+size_t log_encode_block(const log_layout_t *layout, const void *records, int n, unsigned char *out);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que decodifica os len bytes de um bloco de n registros em records (n tamanhos de
+// registro). Retorna 0 em caso de sucesso e -1 se os dados estiverem corrompidos.
+int log_decode_block(const log_layout_t *layout, const unsigned char *in, size_t len, int n, void *records);
+
+// Codificador continuo: junta os registros de uma serie e grava um bloco quando
+// LOG_CODEC_BLOCK_RECORDS estao prontos ou o mais antigo tem block_ms de idade, e uma
+// marca de confirmacao commit_ms apos o primeiro bloco nao confirmado
+typedef struct {
+    log_layout_t layout;
+    log_encoding_t encoding;        // LOG_DELTA ou LOG_JOURNAL
+    char *records;
+    int count;                      // Registros esperando em records
+    unsigned char *out;             // Cabecalho de bloco mais o bloco codificado
+    int block_ms;
+    long long deadline;             // Instante (log_now_ns) de gravar o bloco
+    int commit_ms;
+    long long commit_deadline;      // Instante de gravar a marca de confirmacao
+    int uncommitted;                // Blocos gravados depois da ultima marca
+    uint32_t seq;                   // Numero de sequencia do proximo bloco
+    uint32_t n_records;             // Registros gravados no arquivo ate agora
+    int64_t first_time, last_time;  // time_sys do primeiro e do ultimo deles
+    unsigned long long raw_bytes;   // Bytes dos registros codificados ate agora
+    unsigned long long coded_bytes; // Bytes dos blocos gravados ate agora
+    log_index_t *index;             // Recebe uma entrada por bloco, se nao for NULL
+} log_encoder_t;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_encoder_init(log_encoder_t *e, log_stream_t stream, log_encoding_t encoding,
+                     int block_ms, int commit_ms);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que acrescenta um registro, gravando o bloco em w quando ele esta cheio
+int log_encoder_add(log_encoder_t *e, log_writer_t *w, const void *record);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que grava em w os registros que esperam, como um bloco (talvez menor)
+int log_encoder_flush(log_encoder_t *e, log_writer_t *w);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que grava os registros que esperam, depois uma marca de confirmacao, e forca a
+// gravacao do arquivo no disco
+int log_encoder_commit(log_encoder_t *e, log_writer_t *w);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que grava o bloco ou a marca de confirmacao se o seu prazo passou
+int log_encoder_tick(log_encoder_t *e, log_writer_t *w, long long now);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Prazo mais proximo do codificador (log_now_ns), -1 se nada estiver pendente
+long long log_encoder_deadline(const log_encoder_t *e);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void log_encoder_free(log_encoder_t *e);
+
+#endif
@@ -0,0 +1,117 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            FORMATO BINARIO DO LOG DE VOO - LOG_FORMAT
+
+    Um arquivo de log binario comeca com um cabecalho que se descreve (log_header_t),
+seguido de um log_field_t por membro da estrutura, e depois de registros de tamanho fixo
+copiados sem alteracao das estruturas msg_*_t recebidas pelas FIFOs de tempo real. Os
+leitores devem usar as posicoes, os tamanhos e o tamanho de registro gravados no cabecalho,
+em vez de supor o layout da maquina que gravou o arquivo.
+
+    Os arquivos comprimidos (codificacao LOG_DELTA) tem o mesmo cabecalho e a mesma tabela
+de campos, seguidos de blocos de registros codificados em colunas (ver log_codec.h). Os
+arquivos em blocos com confirmacao (codificacao LOG_JOURNAL) usam os mesmos blocos com os
+registros gravados sem alteracao. Todo bloco tem checksum, de forma que um arquivo cortado
+por uma queda de energia pode ser truncado de volta ao seu ultimo bloco completo.
+*********************************************************************************************
+********************************************************************************************/
+
+#ifndef _LOG_FORMAT_H
+#define _LOG_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "messages.h"
+
+// Primeiros bytes de todo arquivo de log binario
+#define LOG_MAGIC "FDCLOG\r\n"
+#define LOG_MAGIC_LEN 8
+
+#define LOG_VERSION 2     // 2: os blocos levam numeros de sequencia, tempos e CRCs
+
+// Extensoes dos arquivos de dados de cada formato de gravacao
+#define LOG_EXT_TEXT   ".dat"
+#define LOG_EXT_BINARY ".bin"
+#define LOG_EXT_COMPRESSED ".fdz"
+#define LOG_EXT_JOURNAL ".fdj"
+
+#define LOG_NAME_LEN 24
+#define LOG_UNIT_LEN 16
+
+// Series de dados, na mesma ordem das FIFOs de dados (/dev/rtf0 a /dev/rtf4)
+typedef enum {
+    STREAM_AHRS,
+    STREAM_DAQ,
+    STREAM_GPS,
+    STREAM_NAV,
+    STREAM_PITOT,
+    N_STREAMS
+} log_stream_t;
+
+// Tipos dos elementos de um campo. O tamanho do elemento eh dado por log_field_t.size
+typedef enum {
+    LOG_INT = 1,    // Inteiro com sinal (4 ou 8 bytes)
+    LOG_FLOAT = 2   // Ponto flutuante IEEE 754 (4 bytes)
+} log_field_type_t;
+
+// Codificacao dos registros que seguem o cabecalho
+typedef enum {
+    LOG_RAW = 0,    // Registros de tamanho fixo, de record_size bytes cada
+    LOG_DELTA = 1,  // Blocos de colunas codificadas com delta/XOR (log_codec.h)
+    LOG_JOURNAL = 2 // Blocos de registros de tamanho fixo (log_codec.h)
+} log_encoding_t;
+
+// Cabecalho do arquivo (64 bytes, cada membro no seu alinhamento natural)
+typedef struct {
+    char magic[LOG_MAGIC_LEN];
+    uint32_t version;
+    uint32_t header_size;   // Cabecalho mais tabela de campos, em bytes
+    uint32_t record_size;   // sizeof(msg_*_t) na maquina que gravou
+    uint32_t n_fields;
+    uint32_t stream;        // log_stream_t
+    uint32_t encoding;      // log_encoding_t
+    int64_t start_time;     // Inicio da gravacao (segundos desde a Epoch)
+    char stream_name[16];
+    uint32_t reserved[2];
+} log_header_t;
+
+// Descricao de um membro da estrutura (56 bytes)
+typedef struct {
+    char name[LOG_NAME_LEN];
+    char unit[LOG_UNIT_LEN];
+    uint32_t type;      // log_field_type_t
+    uint32_t count;     // Numero de elementos (> 1 nos vetores)
+    uint32_t offset;    // Posicao do membro dentro do registro
+    uint32_t size;      // Tamanho de um elemento
+} log_field_t;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Nome curto de uma serie ("daq", "ahrs", ...)
+const char *log_stream_name(log_stream_t stream);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Tamanho dos registros de uma serie (sizeof da msg_*_t correspondente)
+size_t log_record_size(log_stream_t stream);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Tabela de campos de uma serie. O numero de campos eh retornado em *n_fields
+const log_field_t *log_stream_fields(log_stream_t stream, int *n_fields);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que monta em buf o cabecalho completo (log_header_t mais tabela de campos) de
+// uma serie. Retorna o numero de bytes usados, ou 0 se cap for pequeno demais.
+size_t log_build_header(void *buf, size_t cap, log_stream_t stream,
+                        log_encoding_t encoding, time_t start);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// CRC-32 (IEEE 802.3) de len bytes, continuando de crc (0 para comecar)
+uint32_t log_crc32(uint32_t crc, const void *data, size_t len);
+
+#endif
@@ -0,0 +1,152 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            INDICE DE TEMPO DOS ARQUIVOS DE DADOS DO VOO - LOG_INDEX
+
+    Ao lado de cada arquivo de dados o gravador escreve um pequeno arquivo auxiliar (o nome
+do arquivo de dados mais LOG_EXT_INDEX) que associa o time_sys a posicoes no arquivo de
+dados. Ele comeca com um log_index_header_t seguido de log_index_entry_t de tamanho fixo, um
+a cada LOG_INDEX_INTERVAL registros nos arquivos texto e binarios brutos, e um por bloco nos
+arquivos comprimidos e em blocos com confirmacao (os registros dentro de um bloco nao podem
+ser alcancados sem decodifica-lo). Cada entrada aponta para o inicio de uma linha, registro
+ou bloco, de forma que um leitor pode fazer uma busca binaria no indice por uma janela de
+tempo e ler apenas os bytes entre duas entradas.
+
+    O indice de um arquivo do GPS tambem leva o tempo GPS de cada entrada, o que permite a
+log_index_gps_to_sys() converter uma hora GPS do dia em time_sys para os arquivos das outras
+series do mesmo voo.
+
+    Um voo de 3 horas a 50 Hz tem cerca de 11000 entradas (350 kB) por serie.
+*********************************************************************************************
+********************************************************************************************/
+
+#ifndef _LOG_INDEX_H
+#define _LOG_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "log_format.h"
+#include "log_writer.h"
+
+// Primeiros bytes de todo arquivo de indice
+#define LOG_INDEX_MAGIC "FDCIDX\r\n"
+
+#define LOG_INDEX_VERSION 1
+
+// Extensao acrescentada ao nome do arquivo de dados
+#define LOG_EXT_INDEX ".idx"
+
+// Registros entre entradas nos arquivos texto e binarios brutos (1 s a 50 Hz)
+#define LOG_INDEX_INTERVAL 50
+
+// Cabecalho do indice (32 bytes)
+typedef struct {
+    char magic[LOG_MAGIC_LEN];
+    uint32_t version;
+    uint32_t stream;        // log_stream_t
+    uint32_t format;        // log_format_t do arquivo de dados
+    uint32_t interval;      // Registros entre entradas, 0 para uma entrada por bloco
+    uint32_t entry_size;    // sizeof(log_index_entry_t)
+    uint32_t reserved;
+} log_index_header_t;
+
+// Entrada do indice (32 bytes)
+typedef struct {
+    int64_t time_sys;       // time_sys do primeiro registro em offset
+    uint64_t offset;        // Posicao da sua linha, registro ou bloco no arquivo de dados
+    uint64_t record;        // Numero de registros antes dele no arquivo de dados
+    float gps_time;         // GPS_time_gga do registro (arquivos do GPS), NaN nos outros
+    uint32_t reserved;
+} log_index_entry_t;
+
+// Escritor do indice de um arquivo de dados
+typedef struct {
+    log_writer_t out;
+    int open;
+    uint32_t interval;
+    int time_offset;            // Posicoes do time_sys e do GPS_time_gga nos
+    int gps_offset;             // registros, -1 se nao houver
+    size_t record_size;
+    unsigned long long records; // Registros anotados ate agora
+    unsigned long long next;    // Registro que recebe a proxima entrada
+} log_index_t;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que cria o indice do arquivo de dados data_path, para registros de stream
+// gravados em format. Os blocos (LOG_DELTA, LOG_JOURNAL) recebem uma entrada cada.
+// Retorna 0 em caso de sucesso e -1 em caso de falha, com o errno preenchido.
+int log_index_open(log_index_t *x, const char *data_path, log_stream_t stream,
+                   log_format_t format, int flush_ms);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que anota n registros consecutivos (uma linha, um lote de registros brutos ou um
+// bloco) gravados em offset no arquivo de dados; record aponta para o primeiro deles e,
+// nos lotes de registros brutos, os outros o seguem. Grava uma entrada quando ela eh
+// devida. Nao faz nada se o indice nao estiver aberto.
+int log_index_note(log_index_t *x, uint64_t offset, const void *record, unsigned n);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que grava as entradas no buffer se o seu prazo de gravacao passou
+int log_index_tick(log_index_t *x, long long now);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Prazo de gravacao das entradas no buffer (log_now_ns), -1 se nao houver nenhuma
+long long log_index_deadline(const log_index_t *x);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_index_close(log_index_t *x);
+
+// Indice de um arquivo de dados, carregado inteiro
+typedef struct {
+    log_index_header_t header;
+    log_index_entry_t *entries;
+    size_t n;
+} log_index_map_t;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que carrega o indice do arquivo de dados data_path. Retorna 0 em caso de sucesso
+// e -1 se nao houver um indice valido.
+int log_index_load(log_index_map_t *m, const char *data_path);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void log_index_unload(log_index_map_t *m);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Posicao da ultima entrada com time_sys <= t, ou -1 se t for anterior a primeira entrada
+long log_index_find(const log_index_map_t *m, int64_t t);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Faixa de bytes [*start, *end) do arquivo de dados que contem todo registro com time_sys
+// em [from, to]. *end eh UINT64_MAX quando a faixa chega ao fim do arquivo, e *start eh 0
+// (o cabecalho do arquivo) quando from eh anterior a primeira entrada. Nos outros casos
+// eh um limite de linha, registro ou bloco.
+void log_index_range(const log_index_map_t *m, int64_t from, int64_t to,
+                     uint64_t *start, uint64_t *end);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que converte uma hora GPS do dia em time_sys usando o indice de um arquivo do
+// GPS, interpolando entre as entradas. Retorna 0 em caso de sucesso e -1 se gps_time
+// estiver fora da gravacao.
+int log_index_gps_to_sys(const log_index_map_t *m, float gps_time, int64_t *t);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que le os registros com time_sys em [from, to] de um arquivo de dados binario
+// bruto, comprimido ou em blocos com confirmacao, usando o seu indice quando houver um.
+// Em caso de sucesso *records eh um vetor alocado com malloc() com os registros, no
+// layout do arquivo (tamanho de registro em *record_size), e o seu numero eh retornado.
+// Retorna -1 em caso de erro.
+long log_read_window(const char *data_path, int64_t from, int64_t to,
+                     void **records, size_t *record_size);
+
+#endif
@@ -0,0 +1,77 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            LINHAS DOS ARQUIVOS TEXTO (.dat) DE DADOS DO VOO - LOG_TEXT
+
+    Os numeros sao formatados a mao em vez de com printf(): os floats sao escritos como "%f"
+os escreveria (6 casas decimais, arredondados para o par mais proximo a partir do valor
+binario exato), os inteiros como "%d", "%ld" e "%lld", de forma que os arquivos continuam
+iguais byte a byte. Cada funcao monta uma linha inteira no buffer de quem chama, que deve
+comportar LOG_TEXT_LINE_MAX bytes, e retorna o seu tamanho. Toda linha comeca com a quebra
+de linha que termina a anterior.
+
+    Os cabecalhos gravados no inicio de cada arquivo tambem ficam aqui, para que o gravador
+e o log_convert produzam os mesmos arquivos.
+*********************************************************************************************
+********************************************************************************************/
+
+#ifndef _LOG_TEXT_H
+#define _LOG_TEXT_H
+
+#include <stddef.h>
+
+#include "log_format.h"
+
+// Maior linha de qualquer serie (os floats podem ocupar ate 47 caracteres)
+#define LOG_TEXT_LINE_MAX 2048
+
+// Maior cabecalho, com um nome de arquivo de ate 256 caracteres
+#define LOG_TEXT_HEADER_MAX 2048
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcoes que acrescentam um numero a p e retornam o fim do texto (sem o zero final)
+char *log_text_float(char *p, float v);
+/*!*******************************************************************************************
+*********************************************************************************************/
+char *log_text_int(char *p, int v);
+/*!*******************************************************************************************
+*********************************************************************************************/
+char *log_text_long(char *p, long v);
+/*!*******************************************************************************************
+*********************************************************************************************/
+char *log_text_llong(char *p, long long v);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+size_t log_text_daq(char *line, const msg_daq_t *msg);
+/*!*******************************************************************************************
+*********************************************************************************************/
+size_t log_text_ahrs(char *line, const msg_ahrs_t *msg);
+/*!*******************************************************************************************
+*********************************************************************************************/
+size_t log_text_gps(char *line, const msg_gps_t *msg);
+/*!*******************************************************************************************
+*********************************************************************************************/
+size_t log_text_nav(char *line, const msg_nav_t *msg);
+/*!*******************************************************************************************
+*********************************************************************************************/
+size_t log_text_pitot(char *line, const msg_pitot_t *msg);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Linha de um registro (msg_*_t) de cada serie
+size_t log_text_record(char *line, log_stream_t stream, const void *msg);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Cabecalho do arquivo de uma serie, com o nome de arquivo file_name. Retorna o seu
+// tamanho (no maximo cap - 1).
+size_t log_text_header(char *buf, size_t cap, log_stream_t stream, const char *file_name);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Nomes dos n valores das linhas de uma serie, em ordem ("tensao[3]", "time_sys"), como
+// nas tabelas de campos do log_format.h. Usados para ler os arquivos texto de volta.
+const char *const *log_text_columns(log_stream_t stream, int *n);
+
+#endif
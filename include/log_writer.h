@@ -0,0 +1,111 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            ESCRITA COM BUFFER DOS ARQUIVOS DE DADOS DO VOO - LOG_WRITER
+
+    Cada arquivo de dados eh gravado atraves de um buffer grande, alinhado a pagina. O
+buffer vai para o arquivo com um unico write() quando esta cheio ou quando o byte mais
+antigo nele passou do intervalo de gravacao configurado, de forma que a quantidade de dados
+em risco no espaco de usuario eh limitada no tempo. Com sync_data cada gravacao eh seguida
+de um fdatasync(), o que tambem limita os dados em risco no cache de paginas, a um custo
+maior de E/S.
+
+    No modo mapeado (log_writer_open_mapped) o arquivo eh pre-alocado com fallocate() no
+tamanho esperado do voo e mapeado com mmap(); os dados sao copiados direto para o
+mapeamento, que cresce em passos de LOG_WRITER_MAP_CHUNK quando esta cheio, e o arquivo eh
+truncado nos bytes gravados ao ser fechado. As paginas do inicio do arquivo sao carregadas
+na abertura, para que os primeiros segundos de um voo nao parem em faltas de pagina, e os
+LOG_WRITER_PREFAULT bytes seguintes sao carregados de novo cada vez que os dados chegam a
+metade dos ja carregados. O mapeamento em si nao eh populado, o que leria ou zeraria toda a
+pre-alocacao na abertura.
+*********************************************************************************************
+********************************************************************************************/
+
+#ifndef _LOG_WRITER_H
+#define _LOG_WRITER_H
+
+#include <stddef.h>
+
+// Tamanho do buffer de cada arquivo (multiplo do tamanho da pagina)
+#define LOG_WRITER_BUF_SIZE (64*1024)
+
+// Alinhamento dos buffers
+#define LOG_WRITER_ALIGN 4096
+
+// Limite default da idade dos dados no buffer, em milissegundos
+#define LOG_WRITER_FLUSH_MS 250
+
+// Modo mapeado: passo de crescimento de um arquivo cheio e bytes carregados a frente dos
+// dados
+#define LOG_WRITER_MAP_CHUNK (4*1024*1024)
+#define LOG_WRITER_PREFAULT (1024*1024)
+
+typedef struct {
+    int fd;
+    char *buf;
+    size_t size;                // Capacidade de buf
+    size_t fill;                // Bytes esperando em buf (mapeado: bytes ainda nao sincronizados)
+    char *map;                  // Mapeamento do arquivo no modo mapeado, NULL nos outros
+    size_t map_size;            // Bytes do arquivo alocados e mapeados
+    size_t offset;              // Bytes gravados no mapeamento
+    size_t synced;              // Bytes do mapeamento que se sabe estarem no disco
+    size_t prefaulted;          // Bytes do mapeamento ja carregados
+    int flush_ms;               // Idade maxima dos dados no buffer (0 = grava a cada tick)
+    int sync_data;              // Chama fdatasync() depois de cada gravacao
+    long long deadline;         // Instante (log_now_ns) em que buf deve ser gravado
+    unsigned long long bytes;   // Bytes entregues ao escritor desde que foi aberto
+    int error;                  // errno da primeira gravacao que falhou, 0 se nenhuma
+} log_writer_t;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Relogio monotonico, em nanossegundos
+long long log_now_ns(void);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que cria (ou trunca) path e prepara o escritor. Retorna 0 em caso de sucesso e
+// -1 em caso de falha, com o errno preenchido.
+int log_writer_open(log_writer_t *w, const char *path, int flush_ms, int sync_data);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao igual a log_writer_open(), no modo mapeado, pre-alocando prealloc bytes.
+int log_writer_open_mapped(log_writer_t *w, const char *path, size_t prealloc,
+                           int flush_ms, int sync_data);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que acrescenta len bytes ao arquivo. Retorna 0 em caso de sucesso, -1 em erros
+// de gravacao.
+int log_writer_write(log_writer_t *w, const void *data, size_t len);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que acrescenta texto formatado ao arquivo, como fprintf().
+int log_writer_printf(log_writer_t *w, const char *fmt, ...)
+    __attribute__ ((format (printf, 2, 3)));
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que grava agora no arquivo os dados do buffer. No modo mapeado os dados ja estao
+// no cache de paginas; com sync_data eles sao gravados no disco.
+int log_writer_flush(log_writer_t *w);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que grava os dados do buffer e forca agora a gravacao do arquivo no disco,
+// qualquer que seja o sync_data.
+int log_writer_sync(log_writer_t *w);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que grava o buffer se o seu prazo passou. Deve ser chamada periodicamente com o
+// valor atual de log_now_ns().
+int log_writer_tick(log_writer_t *w, long long now);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que grava tudo, sincroniza o arquivo com o disco e o fecha.
+int log_writer_close(log_writer_t *w);
+
+#endif
@@ -26,7 +26,16 @@ typedef enum {
     ASSIGN,
     FILTER_ON,
     FILTER_OFF,
-    IS_ALIVE    // Serve para saber se o modulo de tempo real esta vivo
+    IS_ALIVE,   // Serve para saber se o modulo de tempo real esta vivo
+    CHANGEFORMAT,   // Composicao de change + format (tratado apenas pelo fdc_master)
+    CHANGEFLUSH,    // Composicao de change + flush (tratado apenas pelo fdc_master)
+    CHANGESYNC,     // Composicao de change + sync (tratado apenas pelo fdc_master)
+    CHANGEPREALLOC, // Composicao de change + prealloc (tratado apenas pelo fdc_master)
+    CHANGEROTATE,   // Composicao de change + rotate (tratado apenas pelo fdc_master)
+    CHANGEROTATESIZE,   // Composicao de change + rotate_mb (tratado apenas pelo fdc_master)
+    LATENCY,        // Histogramas de latencia das amostras (tratado apenas pelo fdc_master)
+    COUNTERS,       // Contadores de erros e perdas dos dispositivos (tratado apenas pelo fdc_master)
+    HISTORY         // Ultimos segundos das amostras guardados em memoria (tratado apenas pelo fdc_master)
 } fdc_cmd_t;
 
 // Possiveis opcoes para os comandos.
@@ -48,9 +57,23 @@ typedef enum {
     PSTAT,
     PDYN,
     LOADCELL,
-    ENGINE_RPM
+    ENGINE_RPM,
+    FORMAT,
+    FLUSHTIME,
+    DISKSYNC,
+    PREALLOC,
+    ROTATETIME,
+    ROTATESIZE
 } fdc_cmd_option_t;
 
+// Formatos possiveis para os arquivos de dados de um voo
+typedef enum {
+    FORMAT_TEXT,    // Texto separado por tabulacoes (.dat), lido por processa_dados.m
+    FORMAT_BINARY,      // Cabecalho autodescritivo seguido das estruturas msg_*_t (.bin)
+    FORMAT_COMPRESSED,  // Cabecalho autodescritivo seguido de blocos de colunas comprimidas (.fdz)
+    FORMAT_JOURNAL      // Cabecalho autodescritivo seguido de blocos verificaveis das estruturas (.fdj)
+} log_format_t;
+
 // Valores de retorno para comandos enviados pelo 'fdc_master' para 'fdc_slave'
 typedef enum {
        OK,
@@ -80,8 +103,18 @@ typedef struct {
    fdc_cmd_t cmd;
    fdc_cmd_option_t option;
    fdc_cmd_data_t data;
+   unsigned int seq;    // Numero de sequencia, dado pelo 'fdc_master' no envio
 } cmd_msg_t;
 
+// Resposta do 'fdc_slave' a um comando. Varios comandos podem aguardar resposta
+// ao mesmo tempo: o 'fdc_master' associa a resposta ao comando pelo numero de
+// sequencia (e confere o comando).
+typedef struct {
+   unsigned int seq;
+   fdc_cmd_t cmd;
+   cmd_status_t status;
+} cmd_reply_t;
+
 // Estrutura de mensagem de comando a ser enviada
 // do 'fdc_cmd_parser' para o 'fdc_master'.
 // Obs.: Foi necessario adicionar uma string para conter o nome do arquivo
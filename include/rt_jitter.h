@@ -0,0 +1,153 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            ATRASO DE DESPERTAR E ESTOUROS DE PERIODO DA TAREFA DE TEMPO REAL DO
+            FDC_SLAVE - RT_JITTER
+
+    A func_fdc_slave() eh liberada a cada PERIOD ms pela rt_task_wait_period(). A tarefa
+marca cada despertar e o fim do trabalho de cada periodo:
+- o atraso de um despertar eh o seu instante menos o instante de
+  liberacao em que era devido (a primeira liberacao mais um periodo por
+  despertar, como o RTAI os conta);
+- o trabalho de um periodo eh o tempo do seu despertar ate a chamada de
+  rt_task_wait_period();
+- um periodo estoura quando o seu trabalho termina depois da liberacao do
+  seguinte, que entao desperta atrasado.
+    A cada RT_JITTER_WINDOW periodos a tarefa coloca um rt_jitter_summary_t da janela na
+RT_FIFO_JITTER, lida pelo save_data() no fdc_master, que grava uma linha por resumo no
+diretorio do voo.
+
+    Tudo tem tamanho fixo e eh inline, sem divisao de 64 bits, de forma que o mesmo codigo
+eh compilado no modulo (__KERNEL__) e no fdc_master.
+*********************************************************************************************
+********************************************************************************************/
+
+#ifndef _RT_JITTER_H
+#define _RT_JITTER_H
+
+#ifdef __KERNEL__
+#include <linux/string.h>
+#else
+#include <string.h>
+#endif
+
+// Periodos em cada resumo: 1 s a 50 Hz
+#define RT_JITTER_WINDOW 50
+
+// Faixas do atraso: a faixa 0 conta menos de 1 us, a faixa k de 2^(k-1) a 2^k - 1 us, e a
+// ultima tudo a partir de 16 ms
+#define RT_JITTER_BUCKETS 16
+
+typedef struct {
+    unsigned int seq;           // Numero do resumo desde que o modulo foi carregado
+    unsigned int periods;       // Despertares na janela
+    long long time_sys;         // rt_get_time_ns() no fim da janela
+    int period_ns;
+    int late_min_ns, late_max_ns;
+    long long late_sum_ns;
+    int work_min_ns, work_max_ns;
+    long long work_sum_ns;
+    unsigned int overruns;      // Periodos cujo trabalho passou da liberacao seguinte
+    unsigned int late_hist[RT_JITTER_BUCKETS];
+} rt_jitter_summary_t;
+
+typedef struct {
+    long long release;          // Instante devido do proximo despertar (ns)
+    long long wakeup;           // Instante do ultimo despertar
+    rt_jitter_summary_t s;      // Janela sendo preenchida
+} rt_jitter_t;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que limita um tempo em ns a um int
+static inline int rt_jitter_ns(long long ns)
+{
+    if (ns > 0x7fffffffLL)
+        return 0x7fffffff;
+    if (ns < -0x7fffffffLL)
+        return -0x7fffffff;
+
+    return (int)ns;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que inicia uma janela, mantendo o numero do resumo
+static inline void rt_jitter_next(rt_jitter_t *j)
+{
+    unsigned int seq = j->s.seq + 1;
+    int period_ns = j->s.period_ns;
+
+    memset(&j->s, 0, sizeof(j->s));
+    j->s.seq = seq;
+    j->s.period_ns = period_ns;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// A tarefa eh liberada em first_release e depois a cada period_ns
+static inline void rt_jitter_init(rt_jitter_t *j, long long first_release, int period_ns)
+{
+    memset(j, 0, sizeof(*j));
+    j->release = first_release;
+    j->s.period_ns = period_ns;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Faixa de um atraso em ns
+static inline int rt_jitter_bucket(int late_ns)
+{
+    unsigned int us = (late_ns > 0) ? (unsigned int)late_ns/1000 : 0;
+    int k = 0;
+
+    while ((us > 0) && (k < RT_JITTER_BUCKETS - 1)) {
+        us >>= 1;
+        k++;
+    }
+
+    return k;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// No inicio do trabalho de um periodo
+static inline void rt_jitter_wakeup(rt_jitter_t *j, long long now)
+{
+    int late = rt_jitter_ns(now - j->release);
+
+    j->wakeup = now;
+    j->release += j->s.period_ns;
+
+    if ((j->s.periods == 0) || (late < j->s.late_min_ns))
+        j->s.late_min_ns = late;
+    if ((j->s.periods == 0) || (late > j->s.late_max_ns))
+        j->s.late_max_ns = late;
+    j->s.late_sum_ns += late;
+    j->s.late_hist[rt_jitter_bucket(late)]++;
+    j->s.periods++;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// No fim do trabalho de um periodo, antes de rt_task_wait_period(). Retorna 1 quando o
+// resumo da janela esta completo: ele eh entao publicado e rt_jitter_next() eh chamada.
+static inline int rt_jitter_done(rt_jitter_t *j, long long now)
+{
+    int work = rt_jitter_ns(now - j->wakeup);
+
+    if ((j->s.periods == 1) || (work < j->s.work_min_ns))
+        j->s.work_min_ns = work;
+    if (work > j->s.work_max_ns)
+        j->s.work_max_ns = work;
+    j->s.work_sum_ns += work;
+    if (now > j->release)
+        j->s.overruns++;
+
+    if (j->s.periods < RT_JITTER_WINDOW)
+        return 0;
+
+    j->s.time_sys = now;
+    return 1;
+}
+
+#endif
@@ -21,6 +21,10 @@
 
 #include "rtai_rt_serial.h"
 #include "messages.h"
+#include "dev_counters.h"
+
+//Step (ms) of the waits for the answers of the AHRS during its configuration
+#define AHRS_WAIT_STEP_MS 2
 
 /*--------------------------------------------------------------------------------------------
                     AHRS COMANDS AND RESPONSES
@@ -9,6 +9,9 @@
 // Inclue o cabecalho de mensagens para utilizar msg_daq
 #include "messages.h"
 
+// Contadores do dispositivo, lidos pelo fdc_master
+#include "dev_counters.h"
+
 //#include <sys/io.h>
 #include <stdio.h>
 
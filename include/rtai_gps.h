@@ -21,6 +21,7 @@
 
 #include "rtai_rt_serial.h"
 #include "messages.h"
+#include "dev_counters.h"
 
 //Desired messages commands
 #define NMEA_ALL_MSG "PGRMO,,3"
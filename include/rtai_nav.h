@@ -21,6 +21,7 @@
 
 #include "rtai_rt_serial.h"
 #include "messages.h"
+#include "dev_counters.h"
 
 //Define NAV message's constants
 //The header is composed of 0x5555 (UU) (repeat the NAV_HEADER_CHAR twice)
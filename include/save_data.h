@@ -7,6 +7,14 @@
 #define _SAVE_DATA
 
 #include "fdc_structs.h"
+#include "log_format.h"
+#include "log_writer.h"
+#include "fifo_batch.h"
+#include "log_codec.h"
+#include "log_index.h"
+#include "spsc_ring.h"
+#include "latency.h"
+#include "rt_jitter.h"
 //#include "ioSockets.h"
 
 
@@ -20,9 +28,100 @@
 // Diretoria que abriga os arquivos
 #define FILES_PATH "/tmp/data/"
 
+// Maior sufixo dos diretorios de voos iniciados no mesmo segundo ("Voo_..._2026_999/")
+#define MAX_DIR_SUFFIX 999
+
 // Valor de conversao da tensao nos canais da placa daq
 #define CONV_DATA_CHANNEL (5.0f/4095.0f)
 
+// Frequencia nominal de amostragem dos dispositivos (PERIOD do fdc_slave), usada
+// para estimar o tamanho dos arquivos preallocados
+#define SAMPLE_RATE_HZ 50
+
+// Razao aproximada entre o tamanho de uma linha de texto e o do registro binario
+#define TEXT_EXPANSION 3
+
+// Histogramas de latencia de cada voo, no diretorio do voo
+#define LATENCY_FILE "latencia.txt"
+
+// Resumos do atraso e dos estouros do periodo da tarefa de tempo real, no diretorio do voo
+#define JITTER_FILE "periodo_rt.txt"
+
+// Capacidade (registros) da fila entre a leitura das FIFOs e a escrita de cada arquivo:
+// cerca de 80 s de dados a 50 Hz
+#define SAVE_QUEUE_RECORDS 4096
+
+// Estagio de armazenamento de um dispositivo. A thread save_data() le a FIFO do
+// dispositivo e coloca os registros na fila; uma thread propria (save_stream) tira os
+// registros da fila e os escreve no arquivo, de forma que a escrita lenta de um arquivo
+// nao atrasa a leitura das FIFOs dos outros dispositivos.
+typedef struct {
+    log_stream_t stream;
+    log_format_t formato;
+    spsc_ring_t fila;               // Registros lidos da FIFO e ainda nao escritos
+    log_writer_t* arquivo;
+    log_encoder_t* codificador;     // Usado apenas nos formatos em blocos
+    log_index_t* indice;            // Indice de tempo do arquivo
+    log_writer_t* proximo_arquivo;  // Arquivo do proximo segmento
+    log_encoder_t* proximo_codificador;
+    log_index_t* proximo_indice;
+    unsigned long troca_em;         // Posicao da fila (fila.head) em que o arquivo eh trocado
+    int troca;                      // Troca de segmento pendente (acesso atomico)
+    unsigned long long bytes_registros, bytes_blocos;  // Compressao de todos os segmentos
+    unsigned long descartados;      // Registros perdidos por fila cheia
+    lat_marks_t marcas;             // Registros no buffer do arquivo, para a latencia de escrita
+    int fim;                        // Pedido de fim da thread (acesso atomico)
+    pthread_t thread;
+} save_stage_t;
+
+// Estados de um segmento
+enum {
+    SEGMENT_FREE,       // Sem arquivos
+    SEGMENT_OPENING,    // Arquivos sendo abertos pela thread do segmento
+    SEGMENT_READY,      // Arquivos abertos, esperando pela troca
+    SEGMENT_FAILED,     // Erro na abertura dos arquivos
+    SEGMENT_ACTIVE,     // Em uso pelas threads de escrita
+    SEGMENT_STALE,      // Aberto com os nomes anteriores a "change datfile": a thread do
+                        // segmento descarta os arquivos
+    SEGMENT_DISCARDED   // Arquivos descartados, falta esperar pela thread do segmento
+};
+
+// Resumos do periodo da tarefa de tempo real (rt_jitter.h) recebidos durante um voo
+typedef struct {
+    fifo_batch_t fifo;                  // Leitura da FIFO FIFO_JITTER
+    FILE* arquivo;                      // JITTER_FILE, NULL se nao pode ser criado
+    int recebidos;                      // Algum resumo ja foi recebido neste voo
+    unsigned int proximo;               // Numero esperado do proximo resumo
+    unsigned long resumos, perdidos;
+    unsigned long long periodos, estouros;
+    int atraso_max, trabalho_max;       // ns
+} save_jitter_t;
+
+// Configuracao dos arquivos de um voo, lida no inicio da gravacao
+typedef struct {
+    log_format_t formato;
+    int flush_ms, sync_data, prealloc_min;
+    int rotate_min, rotate_mb;          // Troca automatica de segmento (0 desliga)
+    time_t inicio;                      // Instante de inicio da gravacao
+    char dir[MAX_STRLEN];               // Diretorio do voo
+    char bases[N_STREAMS][MAX_STRLEN];  // Nomes dos arquivos sem diretorio, sufixo e extensao
+} save_config_t;
+
+// Segmento de um voo: um arquivo por dispositivo. A gravacao passa de um segmento para o
+// seguinte sem parar, por "change datfile" ou automaticamente (por tamanho ou tempo); os
+// arquivos do segmento seguinte sao abertos antes da troca por uma thread propria.
+typedef struct {
+    int numero;                         // 0 no inicio do voo
+    save_config_t* config;
+    char nomes[N_STREAMS][MAX_STRLEN];
+    log_writer_t arquivos[N_STREAMS];
+    log_encoder_t codificadores[N_STREAMS];
+    log_index_t indices[N_STREAMS];     // Indices de tempo (arquivo de dados + ".idx")
+    int estado;                         // SEGMENT_* (acesso atomico)
+    long long inicio;                   // Instante da troca para este segmento (log_now_ns)
+    pthread_t thread;
+} save_segment_t;
+
 // Define a variavel global do programa fdc_jedi
 extern global_master global;
 
@@ -31,49 +130,82 @@ extern int master_log(int type_message, const char* place);
 /*!*******************************************************************************************
 *********************************************************************************************/
 // Funcao para escrita dos cabecalhos dos arquivos
-int write_headers (FILE* arq_daq, FILE* arq_imu, FILE* arq_gps, FILE* arq_nav, FILE* arq_pitot);
+int write_headers (log_writer_t* arq_daq, log_writer_t* arq_imu, log_writer_t* arq_gps, log_writer_t* arq_nav, log_writer_t* arq_pitot);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao para escrita do cabecalho autodescritivo de um arquivo binario
+int write_binary_header (log_writer_t* arquivo, log_stream_t stream, log_encoding_t codificacao, time_t inicio);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao para armazenagem de uma mensagem msg_*_t, sem conversao, em um arquivo binario
+int save_binary (log_writer_t* arquivo, const void* msg, size_t size);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao para armazenagem de um registro da placa DAQ no  arquivo da placa daq
+int save_daq(log_writer_t* arquivo_daq, const msg_daq_t* msg);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao para armazenagem de um registro do ahrs no arquivo do ahrs
+int save_ahrs(log_writer_t* arquivo_ahrs, const msg_ahrs_t* msg);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao para armazenagem de um registro do nav no arquivo do nav
+int save_nav(log_writer_t* arquivo_nav, const msg_nav_t* msg);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao para armazenagem de um registro do pitot no arquivo do pitot
+int save_pitot(log_writer_t* arquivo_pitot, const msg_pitot_t* msg);
 
 /*!*******************************************************************************************
- * *********************************************************************************************/
-// Funcao para a leitura dos dados da fifo da placa daq
-int get_daq();
+*********************************************************************************************/
+// Funcao para armazenagem de um registro do GPS no  arquivo do gps
+int save_gps(log_writer_t* arquivo_gps, const msg_gps_t* msg);
 
 /*!*******************************************************************************************
 *********************************************************************************************/
-// Funcao para armazenagem dos dados da placa DAQ no  arquivo da placa daq
-int save_daq(FILE* arquivo_daq);
+// Acorda a thread de salvamento, bloqueada em poll(), apos uma mudanca em global.end_save_data
+void wake_save_data(void);
 
 /*!*******************************************************************************************
 *********************************************************************************************/
-// Funcao para a leitura dos dados da fifo do ahrs imu e armazenagem destes dados no 
-// arquivo da imu
-int get_ahrs();
-int save_ahrs(FILE* arquivo_ahrs);
+// Estado da thread de salvamento (global.end_save_data: STOPPED, SAVE, SEND ou SAVE_SEND)
+int save_data_state(void);
 
 /*!*******************************************************************************************
 *********************************************************************************************/
-// Funcao para a leitura dos dados da fifo do nav e armazenagem destes dados no 
-// arquivo da nav
-int get_nav();
-int save_nav(FILE* arquivo_nav);
+// Lanca a thread de salvamento, se ela esta parada. Retorna -1 se a thread nao pode ser
+// criada. Como stop_save_data(), deve ser chamada sempre pela mesma thread (fdc_master).
+int start_save_data(void);
 
 /*!*******************************************************************************************
 *********************************************************************************************/
-// Funcao para a leitura dos dados da fifo do pitot e armazenagem destes dados no 
-// arquivo do pitot
-int get_pitot();
-int save_pitot(FILE* arquivo_pitot);
+// Para a thread de salvamento, se ela esta ativa, e espera que ela termine de gravar os
+// dados. Retorna -1 se pthread_join() falha.
+int stop_save_data(void);
 
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Pede a troca de segmento dos arquivos de dados (novos nomes em global.file_*_name)
+void request_rotation(void);
 
 /*!*******************************************************************************************
- * *********************************************************************************************/
-// Funcao para a leitura dos dados da fifo do gps
-int get_gps();
+*********************************************************************************************/
+// Copia os histogramas de latencia de um dispositivo no voo atual, ou no ultimo: idade das
+// amostras na leitura da FIFO (fila) e na saida do buffer do arquivo (escrita)
+void save_latency_copy(log_stream_t stream, lat_hist_t* fila, lat_hist_t* escrita);
 
 /*!*******************************************************************************************
 *********************************************************************************************/
-// Funcao para armazenagem dos dados do GPS dados no  arquivo do gps
-int save_gps(FILE* arquivo_gps);
+// Escreve no arquivo nome (se nao for NULL) os histogramas de latencia das amostras do voo
+// atual, ou do ultimo, e os resume no log. Pode ser chamada durante a gravacao. Retorna -1
+// se o arquivo nao pode ser escrito.
+int save_latency_report(const char* nome);
 
 /*!*******************************************************************************************
 *********************************************************************************************/
@@ -0,0 +1,242 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            ANEIS DE AMOSTRAS EM MEMORIA COMPARTILHADA ENTRE O FDC_SLAVE E O
+            FDC_MASTER - SHM_RING
+
+    Com as FIFOs de dados cada amostra eh copiada duas vezes entre o kernel e o espaco de
+usuario: pelo rtf_put() na tarefa de tempo real e pelo read() no save_data(). Quando os dois
+sao compilados com FDC_SHM_RINGS (make SHM_RINGS=1), a tarefa de tempo real grava as
+amostras em uma regiao de memoria compartilhada (shm do RTAI: rtai_kmalloc() no modulo,
+rtai_malloc() no fdc_master) e o save_data() as le onde estao.
+
+    A regiao guarda um anel de um produtor e um consumidor por dispositivo, na ordem das
+FIFOs de dados (RT_FIFO_AHRS a RT_FIFO_PITOT, como em log_stream_t). A cabeca de um anel eh
+gravada somente pelo fdc_slave e a sua cauda somente pelo fdc_master, cada uma na sua
+propria linha de cache, de forma que nenhum lado usa lock ou grava uma linha que o outro
+grava. O produtor nunca espera: uma amostra que nao cabe eh descartada e contada no anel.
+Depois das amostras de cada periodo ele coloca um byte na FIFO de aviso (RT_FIFO_RINGS), na
+qual o save_data() dorme em poll().
+
+    Tudo aqui eh inline e nao usa biblioteca, de forma que o mesmo codigo eh compilado no
+modulo (__KERNEL__) e no espaco de usuario. O shm_region.c mapeia a regiao no espaco de
+usuario, ou um objeto de memoria compartilhada POSIX que a substitui em uma maquina Linux
+comum (SHM_RING_MMAP, ver bench_shm_ring.c).
+*********************************************************************************************
+********************************************************************************************/
+
+#ifndef _SHM_RING_H
+#define _SHM_RING_H
+
+#ifdef __KERNEL__
+#include <linux/string.h>
+#include <asm/system.h>
+#else
+#include <string.h>
+#endif
+
+// Nome da memoria compartilhada do RTAI (nam2num(), no maximo 6 caracteres), e do objeto
+// de memoria compartilhada POSIX que a substitui no espaco de usuario
+#define SHM_RING_NAME "FDCRNG"
+#define SHM_RING_FILE "/fdc_rings"
+
+// Gravado por ultimo pelo produtor, assim que os aneis estao prontos
+#define SHM_RING_MAGIC 0x46444352
+#define SHM_RING_VERSION 1
+
+// Aneis na regiao (um por FIFO de dados)
+#define SHM_RING_STREAMS 5
+
+// Registros em cada anel, uma potencia de dois: 20 s de amostras a 50 Hz
+#define SHM_RING_RECORDS 1024
+
+#define SHM_RING_LINE 64
+
+// Bytes dos registros de cada anel, na ordem das FIFOs de dados
+#define SHM_RING_SIZES { sizeof(msg_ahrs_t), sizeof(msg_daq_t), sizeof(msg_gps_t), \
+                         sizeof(msg_nav_t), sizeof(msg_pitot_t) }
+
+// A cabeca eh publicada depois que o registro eh gravado, e a cauda depois que o registro
+// eh lido
+#ifdef __KERNEL__
+#define shm_ring_load(p) ({ unsigned int _v = *(volatile unsigned int *)(p); smp_rmb(); _v; })
+#define shm_ring_store(p, v) do { smp_mb(); *(volatile unsigned int *)(p) = (v); } while (0)
+#else
+#define shm_ring_load(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define shm_ring_store(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#endif
+
+typedef struct {
+    unsigned int record_size;
+    unsigned int capacity;      // Registros, uma potencia de dois
+    unsigned int offset;        // Dos registros, a partir do inicio da regiao
+
+    // Contadores que correm livres, cada um gravado por um so lado
+    unsigned int head __attribute__ ((aligned (SHM_RING_LINE)));   // Produtor
+    unsigned int dropped;                                           // Produtor
+    unsigned int tail __attribute__ ((aligned (SHM_RING_LINE)));   // Consumidor
+} __attribute__ ((aligned (SHM_RING_LINE))) shm_ring_t;
+
+typedef struct {
+    unsigned int magic;         // SHM_RING_MAGIC assim que os aneis estao prontos
+    unsigned int version;
+    unsigned int size;          // Bytes da regiao
+    unsigned int n_rings;
+    shm_ring_t rings[SHM_RING_STREAMS];
+} shm_region_t;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Bytes de uma regiao com n aneis de capacity registros de sizes[i] bytes
+static inline unsigned int shm_region_size(const unsigned int sizes[], int n, unsigned int capacity)
+{
+    unsigned int size = sizeof(shm_region_t);
+    int i;
+
+    for (i = 0; i < n; i++)
+        size += (sizes[i]*capacity + SHM_RING_LINE - 1) & ~(SHM_RING_LINE - 1);
+
+    return size;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Produtor: monta os aneis em uma regiao de shm_region_size() bytes. Retorna -1 se n ou
+// capacity forem invalidos.
+static inline int shm_region_init(shm_region_t *r, const unsigned int sizes[], int n, unsigned int capacity)
+{
+    unsigned int offset = sizeof(shm_region_t);
+    int i;
+
+    if ((n < 1) || (n > SHM_RING_STREAMS) || (capacity == 0) || (capacity & (capacity - 1)))
+        return -1;
+
+    r->magic = 0;
+    r->version = SHM_RING_VERSION;
+    r->size = shm_region_size(sizes, n, capacity);
+    r->n_rings = n;
+    for (i = 0; i < n; i++) {
+        r->rings[i].record_size = sizes[i];
+        r->rings[i].capacity = capacity;
+        r->rings[i].offset = offset;
+        r->rings[i].head = 0;
+        r->rings[i].dropped = 0;
+        r->rings[i].tail = 0;
+        offset += (sizes[i]*capacity + SHM_RING_LINE - 1) & ~(SHM_RING_LINE - 1);
+    }
+    shm_ring_store(&r->magic, SHM_RING_MAGIC);
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Consumidor: informa se a regiao de size bytes foi montada por um produtor da mesma
+// versao, com os aneis esperados
+static inline int shm_region_valid(shm_region_t *r, unsigned int size, const unsigned int sizes[], int n)
+{
+    int i;
+
+    if ((shm_ring_load(&r->magic) != SHM_RING_MAGIC) || (r->version != SHM_RING_VERSION) ||
+        (r->size != size) || (r->n_rings != (unsigned int)n))
+        return 0;
+    for (i = 0; i < n; i++)
+        if (r->rings[i].record_size != sizes[i])
+            return 0;
+
+    return 1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Produtor: registro livre do anel i, a ser preenchido e depois entregue por
+// shm_ring_commit(), ou NULL se o anel estiver cheio (o registro eh contado como
+// descartado)
+static inline void *shm_ring_slot(shm_region_t *r, int i)
+{
+    shm_ring_t *ring = &r->rings[i];
+    unsigned int head = ring->head;
+
+    if (head - shm_ring_load(&ring->tail) >= ring->capacity) {
+        ring->dropped++;
+        return NULL;
+    }
+
+    return (char *)r + ring->offset + (head & (ring->capacity - 1))*ring->record_size;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Produtor: entrega ao consumidor o registro do ultimo shm_ring_slot()
+static inline void shm_ring_commit(shm_region_t *r, int i)
+{
+    shm_ring_store(&r->rings[i].head, r->rings[i].head + 1);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Produtor: copia um registro para o anel i. Retorna 1, ou 0 se ele foi descartado.
+static inline int shm_ring_put(shm_region_t *r, int i, const void *record)
+{
+    void *slot = shm_ring_slot(r, i);
+
+    if (slot == NULL)
+        return 0;
+    memcpy(slot, record, r->rings[i].record_size);
+    shm_ring_commit(r, i);
+
+    return 1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Consumidor: aponta *records para os registros mais antigos do anel i e retorna quantos
+// estao contiguos ali (0 se o anel estiver vazio)
+static inline unsigned int shm_ring_peek(shm_region_t *r, int i, const void **records)
+{
+    shm_ring_t *ring = &r->rings[i];
+    unsigned int tail = ring->tail, n = shm_ring_load(&ring->head) - tail;
+    unsigned int first = tail & (ring->capacity - 1);
+
+    if (n > ring->capacity - first)
+        n = ring->capacity - first;
+    *records = (const char *)r + ring->offset + first*ring->record_size;
+
+    return n;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Consumidor: devolve ao produtor os n registros mais antigos do anel i
+static inline void shm_ring_release(shm_region_t *r, int i, unsigned int n)
+{
+    shm_ring_store(&r->rings[i].tail, r->rings[i].tail + n);
+}
+
+#ifndef __KERNEL__
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que mapeia no fdc_master a regiao montada pelo fdc_slave (ou pela
+// shm_region_create() com SHM_RING_MMAP). Retorna NULL se ela nao existir ou nao tiver os
+// aneis desta compilacao.
+shm_region_t *shm_region_attach(void);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void shm_region_detach(shm_region_t *r);
+
+#ifdef SHM_RING_MMAP
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Produtor do substituto no espaco de usuario: cria e monta a regiao
+shm_region_t *shm_region_create(void);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que remove a regiao do substituto, depois que os dois lados se desanexaram
+void shm_region_remove(void);
+#endif
+
+#endif
+
+#endif
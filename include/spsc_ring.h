@@ -0,0 +1,75 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            ANEL DE REGISTROS DE TAMANHO FIXO COM UM PRODUTOR E UM CONSUMIDOR - SPSC_RING
+
+    Uma thread insere, uma thread consulta e libera; nenhuma usa lock. O produtor nunca
+bloqueia: quando o anel esta cheio, a spsc_ring_push() guarda o que cabe e informa a quem
+chama quanto foi. O consumidor pode dormir em spsc_ring_wait() ate que o produtor insira
+algo.
+*********************************************************************************************
+********************************************************************************************/
+
+#ifndef _SPSC_RING_H
+#define _SPSC_RING_H
+
+#include <stddef.h>
+#include <semaphore.h>
+
+#define SPSC_CACHE_LINE 64
+
+typedef struct {
+    char *buf;
+    size_t record_size;
+    unsigned long capacity;     // Registros, uma potencia de dois
+
+    // Contadores que correm livres, cada um gravado por um so lado
+    unsigned long head __attribute__ ((aligned (SPSC_CACHE_LINE)));    // Produtor
+    unsigned long tail __attribute__ ((aligned (SPSC_CACHE_LINE)));    // Consumidor
+
+    unsigned long high_water __attribute__ ((aligned (SPSC_CACHE_LINE)));  // Maior numero de registros ja enfileirados
+    sem_t ready;                // Sinalizado depois de cada insercao
+} spsc_ring_t;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que prepara um anel de pelo menos capacity registros de record_size bytes.
+// Retorna 0 em caso de sucesso, -1 em caso de falha.
+int spsc_ring_init(spsc_ring_t *r, size_t record_size, unsigned long capacity);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Produtor: copia ate n registros para o anel e retorna quantos couberam
+unsigned long spsc_ring_push(spsc_ring_t *r, const void *records, unsigned long n);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Consumidor: aponta *records para os registros enfileirados mais antigos e retorna
+// quantos estao contiguos ali (0 se o anel estiver vazio)
+unsigned long spsc_ring_peek(spsc_ring_t *r, const void **records);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Consumidor: descarta os n registros mais antigos, depois de usados
+void spsc_ring_release(spsc_ring_t *r, unsigned long n);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Registros enfileirados agora
+unsigned long spsc_ring_count(spsc_ring_t *r);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Consumidor: dorme ate uma insercao, uma spsc_ring_wake() ou o fim de timeout_ms (-1
+// espera para sempre)
+void spsc_ring_wait(spsc_ring_t *r, int timeout_ms);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que acorda o consumidor sem inserir nada
+void spsc_ring_wake(spsc_ring_t *r);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void spsc_ring_free(spsc_ring_t *r);
+
+#endif
@@ -0,0 +1,90 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            CARGA EM PARALELO DOS MODULOS DO KERNEL DO FDC - STARTUP
+
+    Cada passo carrega um modulo assim que os passos dos quais ele depende terminam. Cada
+passo roda na sua propria thread, de forma que os modulos que nao dependem um do outro sao
+carregados ao mesmo tempo e as configuracoes lentas dos dispositivos nas suas funcoes init
+(handshakes seriais do AHRS, do GPS, ...) se sobrepoem. Um passo cuja dependencia falhou eh
+pulado.
+
+    Nenhum shell eh usado. Os objetos do FDC sao compilados pelo Makefile como arquivos .o
+relocaveis para o kernel 2.4 da instalacao do RTAI, e somente o insmod consegue liga-los ao
+kernel, entao eles sao carregados executando o insmod diretamente (fork e exec). Um arquivo
+.ko, como os compilados para os kernels 2.6 e posteriores, eh carregado com finit_module(2)
+(init_module(2) com o arquivo lido em memoria nos kernels sem ela), recorrendo ao insmod se
+falhar. Um passo sem arquivo eh um modulo do sistema: ele eh carregado da mesma forma quando
+o seu .ko eh encontrado no diretorio de modulos do RTAI ou no modules.dep do kernel em
+execucao, e pelo modprobe nos outros casos. Um modulo ja listado em /proc/modules conta como
+carregado.
+
+    A funcao de carga eh um parametro, de forma que a mesma orquestracao pode ser executada
+com modulos de teste (ver bench_startup.c). O inicio e o fim de cada passo sao guardados em
+uma linha do tempo, relativos ao inicio da execucao.
+*********************************************************************************************
+********************************************************************************************/
+
+#ifndef _STARTUP_H
+#define _STARTUP_H
+
+// Passos de uma execucao, e dependencias de cada passo
+#define STARTUP_MAX_STEPS 32
+#define STARTUP_MAX_DEPS 10
+
+// Onde os modulos do sistema sao procurados, alem do modules.dep
+#define STARTUP_RTAI_MODULES "/usr/realtime/modules"
+
+typedef struct {
+    const char *name;                       // Como no lsmod e no delete_module()
+    const char *path;                       // Arquivo objeto, NULL para um modulo do sistema
+    int keep;                               // Deixado carregado pela startup_unload()
+    const char *deps[STARTUP_MAX_DEPS];     // Nomes dos passos que devem carregar antes
+} startup_step_t;
+
+typedef enum {
+    STARTUP_PENDING,
+    STARTUP_OK,
+    STARTUP_FAILED,
+    STARTUP_SKIPPED                         // Uma dependencia falhou
+} startup_state_t;
+
+typedef struct {
+    startup_state_t state;
+    int error;                              // errno de um passo que falhou
+    long long start_ns, end_ns;             // A partir do inicio da execucao
+} startup_timing_t;
+
+// Funcao que carrega um modulo. Retorna 0 em caso de sucesso (ou se ele ja estava
+// carregado) e um valor de errno em caso de falha.
+typedef int (*startup_load_t)(const startup_step_t *step, void *arg);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que executa os n passos, chamando load para cada um (com arg) assim que as suas
+// dependencias estao carregadas, e preenche timeline[i] para steps[i] e *total_ns com o
+// tempo ate o fim do ultimo passo. Retorna o numero de passos que falharam ou foram
+// pulados, ou -1 se os passos forem invalidos (dependencias demais, desconhecidas ou
+// circulares).
+int startup_run(const startup_step_t *steps, int n, startup_load_t load, void *arg,
+                startup_timing_t *timeline, long long *total_ns);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Carregador dos modulos reais (arg nao eh usado)
+int startup_load_module(const startup_step_t *step, void *arg);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que descarrega os modulos dos n passos na ordem inversa das suas dependencias
+// com delete_module(2). Retorna o numero de falhas.
+int startup_unload(const startup_step_t *steps, int n);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+const char *startup_state_name(startup_state_t state);
+
+// Os modulos do FDC e as suas dependencias (fdc_slave por ultimo)
+extern const startup_step_t startup_fdc_modules[];
+extern const int startup_fdc_n_modules;
+
+#endif
@@ -0,0 +1,87 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            AMOSTRAS AO VIVO PARA CLIENTES LOCAIS (PUBLICACAO/ASSINATURA) - TELEMETRY
+
+    O save_data() publica cada registro que le das FIFOs de dados (ou dos aneis) em um anel
+de posicoes de tamanho fixo, compartilhado por todos os clientes. O anel tem um unico
+produtor e nunca o faz esperar: uma posicao eh simplesmente sobrescrita quando o anel da a
+volta. Cada posicao leva o numero de sequencia do seu registro, gravado antes e depois da
+copia, de forma que um leitor sabe que uma posicao foi sobrescrita enquanto ele a copiava
+(um seqlock).
+
+    Uma thread servidora mantem um cursor no anel por cliente. Um cliente que nao acompanha
+(o seu socket esta cheio) fica para tras; quando o produtor lhe da uma volta, os registros
+que ele perdeu sao pulados e contados somente para esse cliente. Nem a gravacao nem os
+outros clientes esperam por ele. Quando nenhum cliente esta inscrito, publicar custa uma
+leitura atomica.
+
+    Os clientes se conectam a um socket UNIX (SOCK_SEQPACKET, TELEM_SOCKET por default) ou,
+se habilitado, enviam datagramas para uma porta UDP em 127.0.0.1. Um cliente se inscreve
+enviando uma linha de texto com pares de nome de serie e decimacao, ex.: "ahrs 5 gps 1" (um
+a cada 5 registros do AHRS e todos os registros do GPS); "all n" inscreve em todas as
+series. Cada inscricao substitui a anterior, e a decimacao 0 cancela a inscricao em uma
+serie. Um cliente UDP deve repetir a sua inscricao pelo menos a cada TELEM_UDP_TIMEOUT_S.
+
+    Toda mensagem enviada eh um telem_frame_t seguido de size bytes: para TELEM_HEADER, o
+cabecalho da serie como nos arquivos de dados binarios (log_build_header(), enviado apos
+cada inscricao); para TELEM_RECORD, um registro como no messages.h. Os registros so fluem
+enquanto o save_data() roda, entre "start" e "stop".
+*********************************************************************************************
+********************************************************************************************/
+
+#ifndef _TELEMETRY_H
+#define _TELEMETRY_H
+
+#include <stdint.h>
+
+// Socket UNIX default do servidor
+#define TELEM_SOCKET "/tmp/fdc_telem"
+
+// Posicoes do anel (uma potencia de dois): cerca de 8 s de todas as series a 50 Hz
+#define TELEM_RING_RECORDS 2048
+
+// Maior registro de uma serie
+#define TELEM_RECORD_MAX 192
+
+// Clientes ao mesmo tempo, UNIX e UDP juntos
+#define TELEM_MAX_CLIENTS 16
+
+// Um cliente UDP eh esquecido depois de tanto tempo sem uma inscricao
+#define TELEM_UDP_TIMEOUT_S 10
+
+// Maior mensagem: quadro mais cabecalho da serie
+#define TELEM_MESSAGE_MAX 4096
+
+typedef enum {
+    TELEM_HEADER = 1,
+    TELEM_RECORD = 2
+} telem_frame_type_t;
+
+typedef struct {
+    uint16_t type;          // telem_frame_type_t
+    uint16_t stream;        // log_stream_t
+    uint32_t size;          // Bytes depois do quadro
+    uint64_t seq;           // Registros publicados antes deste (todas as series)
+    uint32_t lost;          // Registros pulados para este cliente ate agora (todas as series)
+    uint32_t reserved;
+} telem_frame_t;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que inicia a thread servidora no socket UNIX path e, se udp_port nao for 0,
+// nessa porta UDP de 127.0.0.1. Retorna 0, ou -1 se nao puder iniciar (a gravacao nao eh
+// afetada).
+int telemetry_start(const char *path, int udp_port);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que publica n registros de stream, do tamanho de registro da serie. Chamada
+// somente pela thread do save_data() que le as FIFOs.
+void telemetry_publish(int stream, const void *records, int n);
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que termina a thread servidora e fecha todos os clientes
+void telemetry_stop(void);
+
+#endif
@@ -0,0 +1,440 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            ESCRITA ASSINCRONA DO LOG DE MENSAGENS DO FDC_MASTER (fdc.log) - ASYNC_LOG
+*********************************************************************************************
+********************************************************************************************/
+
+#include "async_log.h"
+#include "messages.h"
+#include "spsc_ring.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Janelas do limite de repeticao mantidas ao mesmo tempo, em uma tabela enderecada pelo
+// id da mensagem com sondagem linear (uma potencia de dois)
+#define RATE_SLOTS 64
+
+typedef struct {
+    spsc_ring_t ring;
+    int in_use;                 // Pertence a uma thread em execucao (sob o lock)
+    unsigned long dropped;      // Entradas que nao couberam (atomico)
+} slot_t;
+
+// Janela do limite de repeticao de uma mensagem
+typedef struct {
+    unsigned count;             // Ocorrencias na janela, 0 se nao usada
+    unsigned long suppressed;   // Delas, as nao gravadas
+    int64_t start_s;
+    async_log_entry_t last;     // Ultima ocorrencia, para a linha de fechamento
+} rate_t;
+
+// Entrada de um lote, ordenada pelo tempo mantendo a ordem de cada anel
+typedef struct {
+    const async_log_entry_t *e;
+    unsigned long seq;
+} batch_t;
+
+static struct {
+    slot_t slots[ASYNC_LOG_THREADS];
+    int n_slots;                // Posicoes com um anel (atomico)
+    unsigned long no_slot;      // Entradas de threads sem posicao (atomico)
+    unsigned long reported;     // Entradas descartadas ja informadas no log
+
+    // Usado para atribuir as posicoes e para gravar; nunca por quem chama
+    // async_log_post() enquanto a thread de escrita roda, depois da sua primeira chamada
+    pthread_mutex_t lock;
+    pthread_key_t key;
+    pthread_once_t once;
+
+    FILE *out;
+    int running;                // Thread de escrita rodando (atomico)
+    pthread_t thread;
+    sem_t wake;
+    batch_t *batch;
+    rate_t rates[RATE_SLOTS];
+} alog = { .lock = PTHREAD_MUTEX_INITIALIZER, .once = PTHREAD_ONCE_INIT };
+
+static __thread slot_t *my_slot;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// FNV-1a do texto
+static uint32_t hash(const char *text, size_t len)
+{
+    uint32_t h = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h ^= (unsigned char)text[i];
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Destrutor da chave especifica da thread: a posicao pode passar para outra thread assim
+// que a thread de escrita a esvaziar, o que ela faz qualquer que seja o dono
+static void release_slot(void *p)
+{
+    slot_t *s = p;
+
+    pthread_mutex_lock(&alog.lock);
+    s->in_use = 0;
+    pthread_mutex_unlock(&alog.lock);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void create_key(void)
+{
+    pthread_key_create(&alog.key, release_slot);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que da a thread que chama uma posicao propria, uma unica vez
+static slot_t *take_slot(void)
+{
+    slot_t *s = NULL;
+    int i;
+
+    pthread_once(&alog.once, create_key);
+
+    pthread_mutex_lock(&alog.lock);
+    for (i = 0; (i < alog.n_slots) && (s == NULL); i++)
+        if (!alog.slots[i].in_use)
+            s = &alog.slots[i];
+    if ((s == NULL) && (alog.n_slots < ASYNC_LOG_THREADS) &&
+        (spsc_ring_init(&alog.slots[alog.n_slots].ring, sizeof(async_log_entry_t), ASYNC_LOG_RING) == 0)) {
+        s = &alog.slots[alog.n_slots];
+        // A thread de escrita pode olhar o anel a partir de agora
+        __atomic_store_n(&alog.n_slots, alog.n_slots + 1, __ATOMIC_RELEASE);
+    }
+    if (s != NULL)
+        s->in_use = 1;
+    pthread_mutex_unlock(&alog.lock);
+
+    if (s != NULL)
+        pthread_setspecific(alog.key, s);
+
+    return s;
+}
+
+/*************************************************************************
+ * Gravacao, com o lock
+ *************************************************************************/
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void write_line(FILE *out, const async_log_entry_t *e, const char *suffix)
+{
+    char date[32];
+    time_t t = (time_t)(e->time_ns/1000000000LL);
+
+    // O mesmo formato que a master_log() sempre teve: ctime(), uma tabulacao e a mensagem
+    if (ctime_r(&t, date) == NULL)
+        strcpy(date, "?\n");
+    fprintf(out, "%s\t", date);
+    fwrite(e->text, 1, e->length, out);
+    if (suffix != NULL)
+        fputs(suffix, out);
+
+    if (e->type == ERROR_LOG)
+        fprintf(out, "> %s.\n\n", strerror(e->error));
+    else
+        fputs("\n\n", out);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que encerra a janela de uma mensagem, com uma linha contando o que nao foi
+// gravado
+static void close_window(FILE *out, rate_t *r)
+{
+    char suffix[64];
+
+    if (r->suppressed > 0) {
+        snprintf(suffix, sizeof(suffix), " [repetida mais %lu vezes em %d s]", r->suppressed, ASYNC_LOG_WINDOW_S);
+        write_line(out, &r->last, suffix);
+    }
+    r->count = 0;
+    r->suppressed = 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Janela do id da mensagem: a sua propria, ou entao a primeira a partir da sua posicao de
+// origem que esteja sem uso ou encerrada. As janelas sao fechadas onde estao, o que deixa
+// buracos nas sequencias de sondagem, entao a busca nao para na primeira sem uso. NULL se
+// todas as RATE_SLOTS janelas forem de outras mensagens e ainda estiverem abertas.
+static rate_t *find_window(uint32_t id, int64_t t)
+{
+    rate_t *r, *reuse = NULL;
+    int k;
+
+    for (k = 0; k < RATE_SLOTS; k++) {
+        r = &alog.rates[(id + k) & (RATE_SLOTS - 1)];
+        if ((r->count > 0) && (r->last.id == id))
+            return r;
+        if ((reuse == NULL) && ((r->count == 0) || (t - r->start_s >= ASYNC_LOG_WINDOW_S)))
+            reuse = r;
+    }
+
+    return reuse;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void write_entry(FILE *out, const async_log_entry_t *e)
+{
+    int64_t t = e->time_ns/1000000000LL;
+    rate_t *r = find_window(e->id, t);
+
+    // Nenhuma janela livre: gravada sem limite em vez de tirar uma que ainda esta
+    // contando
+    if (r == NULL) {
+        write_line(out, e, NULL);
+        return;
+    }
+
+    if ((r->count > 0) && ((r->last.id != e->id) || (t - r->start_s >= ASYNC_LOG_WINDOW_S)))
+        close_window(out, r);
+    if (r->count == 0)
+        r->start_s = t;
+
+    r->count++;
+    r->last = *e;
+    if (r->count <= ASYNC_LOG_BURST)
+        write_line(out, e, NULL);
+    else
+        r->suppressed++;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que fecha as janelas encerradas (todas elas se all estiver ligado)
+static void close_windows(FILE *out, int all)
+{
+    int64_t t = now_ns()/1000000000LL;
+    int i;
+
+    for (i = 0; i < RATE_SLOTS; i++)
+        if ((alog.rates[i].count > 0) && (all || (t - alog.rates[i].start_s >= ASYNC_LOG_WINDOW_S)))
+            close_window(out, &alog.rates[i]);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int compare_batch(const void *a, const void *b)
+{
+    const batch_t *x = a, *y = b;
+
+    if (x->e->time_ns != y->e->time_ns)
+        return (x->e->time_ns < y->e->time_ns) ? -1 : 1;
+    return (x->seq < y->seq) ? -1 : (x->seq > y->seq);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que grava tudo o que esta nos aneis, em ordem de tempo, e o numero de entradas
+// descartadas desde a ultima chamada
+static void drain(FILE *out, int closing)
+{
+    int n_slots = __atomic_load_n(&alog.n_slots, __ATOMIC_ACQUIRE);
+    unsigned long taken[ASYNC_LOG_THREADS], n = 0, k, dropped;
+    const async_log_entry_t *e;
+    async_log_entry_t note;
+    int i;
+
+    // As entradas ficam nos aneis ate serem gravadas: no maximo ASYNC_LOG_RING por anel,
+    // que eh o tamanho de batch
+    for (i = 0; i < n_slots; i++) {
+        spsc_ring_t *r = &alog.slots[i].ring;
+        unsigned long tail = r->tail, count = spsc_ring_count(r);
+
+        taken[i] = count;
+        for (k = 0; k < count; k++) {
+            e = (const async_log_entry_t *)(r->buf + ((tail + k) & (r->capacity - 1))*r->record_size);
+            alog.batch[n].e = e;
+            alog.batch[n].seq = n;
+            n++;
+        }
+    }
+    if (n > 1)
+        qsort(alog.batch, n, sizeof(batch_t), compare_batch);
+    for (k = 0; k < n; k++)
+        write_entry(out, alog.batch[k].e);
+    for (i = 0; i < n_slots; i++) {
+        spsc_ring_release(&alog.slots[i].ring, taken[i]);
+        // Avisos ja atendidos
+        while (sem_trywait(&alog.slots[i].ring.ready) == 0);
+    }
+
+    dropped = __atomic_load_n(&alog.no_slot, __ATOMIC_RELAXED);
+    for (i = 0; i < n_slots; i++)
+        dropped += __atomic_load_n(&alog.slots[i].dropped, __ATOMIC_RELAXED);
+    if (dropped != alog.reported) {
+        memset(&note, 0, sizeof(note));
+        note.time_ns = now_ns();
+        note.type = STATUS_LOG;
+        note.length = snprintf(note.text, sizeof(note.text),
+                               "Log: %lu mensagens descartadas (fila cheia).", dropped - alog.reported);
+        write_line(out, &note, NULL);
+        alog.reported = dropped;
+    }
+
+    close_windows(out, closing);
+    fflush(out);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void *writer(void *arg)
+{
+    struct timespec ts;
+
+    (void)arg;
+    while (__atomic_load_n(&alog.running, __ATOMIC_ACQUIRE)) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += ASYNC_LOG_PERIOD_MS*1000000L;
+        ts.tv_sec += ts.tv_nsec/1000000000L;
+        ts.tv_nsec %= 1000000000L;
+        while ((sem_timedwait(&alog.wake, &ts) < 0) && (errno == EINTR));
+        // Avisos deste mesmo lote
+        while (sem_trywait(&alog.wake) == 0);
+
+        pthread_mutex_lock(&alog.lock);
+        drain(alog.out, 0);
+        pthread_mutex_unlock(&alog.lock);
+    }
+
+    return NULL;
+}
+
+/*************************************************************************
+ * Interface
+ *************************************************************************/
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int async_log_start(FILE *out)
+{
+    pthread_mutex_lock(&alog.lock);
+    alog.out = out;
+    pthread_mutex_unlock(&alog.lock);
+
+    if (__atomic_load_n(&alog.running, __ATOMIC_ACQUIRE))
+        return 0;
+
+    if (alog.batch == NULL)
+        alog.batch = malloc(ASYNC_LOG_THREADS*ASYNC_LOG_RING*sizeof(batch_t));
+    if ((alog.batch == NULL) || (sem_init(&alog.wake, 0, 0) != 0))
+        return -1;
+
+    __atomic_store_n(&alog.running, 1, __ATOMIC_RELEASE);
+    if (pthread_create(&alog.thread, NULL, writer, NULL) != 0) {
+        __atomic_store_n(&alog.running, 0, __ATOMIC_RELEASE);
+        sem_destroy(&alog.wake);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int async_log_post(int type, const char *msg)
+{
+    async_log_entry_t e;
+    int error = errno, ret = 0;
+    size_t len = strnlen(msg, ASYNC_LOG_TEXT);
+
+    e.time_ns = now_ns();
+    e.type = type;
+    e.error = error;
+    e.length = len;
+    e.reserved = 0;
+    memcpy(e.text, msg, len);
+    e.id = hash(e.text, len);
+
+    if (!__atomic_load_n(&alog.running, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&alog.lock);
+        write_entry((alog.out != NULL) ? alog.out : stderr, &e);
+        fflush((alog.out != NULL) ? alog.out : stderr);
+        pthread_mutex_unlock(&alog.lock);
+    }
+    else if ((my_slot == NULL) && ((my_slot = take_slot()) == NULL)) {
+        __atomic_add_fetch(&alog.no_slot, 1, __ATOMIC_RELAXED);
+        ret = -1;
+    }
+    else if (spsc_ring_push(&my_slot->ring, &e, 1) == 0) {
+        __atomic_add_fetch(&my_slot->dropped, 1, __ATOMIC_RELAXED);
+        ret = -1;
+    }
+    // Os erros sao gravados de imediato, as mensagens de status com o proximo lote, a nao
+    // ser que o anel esteja enchendo
+    else if ((type == ERROR_LOG) || (spsc_ring_count(&my_slot->ring) > ASYNC_LOG_RING/2))
+        sem_post(&alog.wake);
+
+    errno = error;
+
+    return ret;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void async_log_stop(void)
+{
+    if (!__atomic_exchange_n(&alog.running, 0, __ATOMIC_ACQ_REL))
+        return;
+
+    sem_post(&alog.wake);
+    pthread_join(alog.thread, NULL);
+    sem_destroy(&alog.wake);
+
+    // O que foi enfileirado depois da ultima passada da thread de escrita, e as janelas
+    // ainda abertas
+    pthread_mutex_lock(&alog.lock);
+    drain(alog.out, 1);
+    alog.out = NULL;
+    pthread_mutex_unlock(&alog.lock);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void async_log_forked(void)
+{
+    int fd;
+
+    // Aqui so existe a thread que chamou fork(): o lock pode estar com outra, e os aneis
+    // nunca sao esvaziados
+    pthread_mutex_init(&alog.lock, NULL);
+    __atomic_store_n(&alog.running, 0, __ATOMIC_RELEASE);
+    my_slot = NULL;
+    memset(alog.rates, 0, sizeof(alog.rates));
+
+    // Um fluxo proprio no mesmo arquivo: o buffer herdado pode conter o que o pai ainda
+    // nao gravou, que seria gravado duas vezes
+    if (alog.out != NULL) {
+        fd = dup(fileno(alog.out));
+        alog.out = (fd >= 0) ? fdopen(fd, "a") : NULL;
+    }
+}
@@ -0,0 +1,381 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            VERIFICACAO E MEDIDA DE TEMPO DA FORMATACAO DAS LINHAS .dat DO
+            LOG_TEXT.C - BENCH_LOG_TEXT
+
+    Primeiro compara log_text_float() com printf("%f") em uma varredura de padroes de bits
+de float, e o montador de linhas de cada serie com as chamadas de fprintf() que as funcoes
+save_* faziam, em registros aleatorios (padroes de bits aleatorios, incluindo infinitos e
+NaNs, e valores tipicos de sensores), informando qualquer diferenca. Depois mede o tempo das
+duas formas de gravar registros do DAQ e do AHRS em /dev/null.
+
+Uso: bench_log_text [registros]
+*********************************************************************************************
+********************************************************************************************/
+
+#include "log_text.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static float random_float(void)
+{
+    uint32_t bits = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+    float v;
+
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Valor tipico de sensor: algumas unidades, 6 casas decimais significativas
+static float sensor_float(void)
+{
+    return (rand() % 2000000 - 1000000)*1e-5f;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Um valor de sensor, ou entao qualquer padrao de bits, com um em 16 nao finito
+static float test_float(int sensor)
+{
+    static const float special[] = { INFINITY, -INFINITY, NAN, -NAN };
+
+    if (sensor)
+        return sensor_float();
+    if ((rand() % 16) == 0)
+        return special[rand() % 4];
+    return random_float();
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int random_int(void)
+{
+    return (int)(((uint32_t)rand() << 16) ^ (uint32_t)rand());
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void fill_daq(msg_daq_t *m, int i, int sensor)
+{
+    int k;
+
+    m->validade = 1;
+    for (k = 0; k < 16; k++)
+        m->tensao[k] = test_float(sensor);
+    m->time_sys = 1234567890123LL + i*20000000LL;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void fill_ahrs(msg_ahrs_t *m, int i, int sensor)
+{
+    int k;
+
+    m->validade = 1;
+    for (k = 0; k < 3; k++) {
+        m->angle[k] = test_float(sensor);
+        m->gyro[k] = test_float(sensor);
+        m->accel[k] = test_float(sensor);
+        m->magnet[k] = test_float(sensor);
+    }
+    m->time_stamp = (i % 10)*5000;
+    m->temp = test_float(sensor);
+    m->time_sys = 1234567890123LL + i*20000000LL;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Todos os membros sao preenchidos, inclusive os que a linha do GPS deixa de fora
+static void fill_gps(msg_gps_t *m, int i, int sensor)
+{
+    m->latitude = test_float(sensor);
+    m->longitude = test_float(sensor);
+    m->altitude = test_float(sensor);
+    m->hdop = test_float(sensor);
+    m->geoid_separation = test_float(sensor);
+    m->north_south = sensor ? 78 : random_int();
+    m->east_west = sensor ? 87 : random_int();
+    m->fix_indicator = random_int();
+    m->n_satellites = sensor ? i % 13 : random_int();
+    m->units_altitude = sensor ? 77 : random_int();
+    m->units_geoid_separation = sensor ? 77 : random_int();
+    m->GPS_time_gga = test_float(sensor);
+    m->GPS_time_rmc = test_float(sensor);
+    m->status = random_int();
+    m->gspeed = test_float(sensor);
+    m->course = test_float(sensor);
+    m->date = sensor ? 170608 : random_int();
+    m->magvar = test_float(sensor);
+    m->magvardir = sensor ? 69 : random_int();
+    m->mode = random_int();
+    m->east_v = test_float(sensor);
+    m->north_v = test_float(sensor);
+    m->up_v = test_float(sensor);
+    m->hpe = test_float(sensor);
+    m->vpe = test_float(sensor);
+    m->epe = test_float(sensor);
+    m->hpe_units = m->vpe_units = m->epe_units = random_int();
+    m->validity = sensor ? 1 : random_int();
+    m->time_sys = sensor ? 1234567890123LL + i*200000000LL : ((long long)random_int() << 32) ^ random_int();
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void fill_nav(msg_nav_t *m, int i, int sensor)
+{
+    int k;
+
+    m->validade = sensor ? 1 : random_int();
+    for (k = 0; k < 3; k++) {
+        m->angle[k] = test_float(sensor);
+        m->gyro[k] = test_float(sensor);
+        m->accel[k] = test_float(sensor);
+    }
+    m->nVel = test_float(sensor);
+    m->eVel = test_float(sensor);
+    m->dVel = test_float(sensor);
+    m->latitude = test_float(sensor);
+    m->longitude = test_float(sensor);
+    m->altitude = test_float(sensor);
+    m->temp = test_float(sensor);
+    m->internal_error = sensor ? 0 : random_int();
+    m->internal_status = sensor ? 0 : random_int();
+    m->time_stamp = sensor ? i*20L : (long)(((unsigned long)random_int() << 31) ^ random_int());
+    m->time_sys = sensor ? 1234567890123LL + i*20000000LL : ((long long)random_int() << 32) ^ random_int();
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void fill_pitot(msg_pitot_t *m, int i, int sensor)
+{
+    m->validade = sensor ? 1 : random_int();
+    m->static_pressure = test_float(sensor);
+    m->temperature = test_float(sensor);
+    m->dynamic_pressure = test_float(sensor);
+    m->attack_angle = test_float(sensor);
+    m->sideslip_angle = test_float(sensor);
+    m->time_sys = sensor ? 1234567890123LL + i*20000000LL : ((long long)random_int() << 32) ^ random_int();
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// As chamadas de fprintf() das antigas save_daq(), save_ahrs(), save_gps(), save_nav() e
+// save_pitot()
+static void print_daq(FILE *f, const msg_daq_t *m)
+{
+    int i;
+
+    fprintf(f, "\n");
+    for (i = 0; i < 16; i++)
+        fprintf(f, "%f\t", (float)(m->tensao[i]));
+    fprintf(f, "%lld\t%d", m->time_sys, m->validade);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void print_ahrs(FILE *f, const msg_ahrs_t *m)
+{
+    fprintf(f, "\n%f\t%f\t%f\t", m->angle[0], m->angle[1], m->angle[2]);
+    fprintf(f, "%f\t%f\t%f\t", m->gyro[0], m->gyro[1], m->gyro[2]);
+    fprintf(f, "%f\t%f\t%f\t", m->accel[0], m->accel[1], m->accel[2]);
+    fprintf(f, "%f\t%f\t%f\t", m->magnet[0], m->magnet[1], m->magnet[2]);
+    fprintf(f, "%f\t%f\t%lld\t%d", m->temp, m->time_stamp, m->time_sys, m->validade);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void print_gps(FILE *f, const msg_gps_t *m)
+{
+    fprintf(f, "\n%f\t%f\t%f\t%f\t%f\t", m->latitude, m->longitude, m->altitude, m->hdop, m->geoid_separation);
+    fprintf(f, "%d\t%d\t%d\t%d\t%d\t", m->north_south, m->east_west, m->n_satellites, m->units_altitude,
+            m->units_geoid_separation);
+    fprintf(f, "%f\t%f\t%f\t%f\t", m->GPS_time_gga, m->east_v, m->north_v, m->up_v);
+    fprintf(f, "%f\t%f\t%f\t", m->hpe, m->vpe, m->epe);
+    fprintf(f, "%f\t%f\t%d\t", m->gspeed, m->course, m->date);
+    fprintf(f, "%f\t%d\t%d\t", m->magvar, m->magvardir, m->mode);
+    fprintf(f, "%lld\t%d", m->time_sys, m->validity);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void print_nav(FILE *f, const msg_nav_t *m)
+{
+    fprintf(f, "\n%f\t%f\t%f\t", m->angle[0], m->angle[1], m->angle[2]);
+    fprintf(f, "%f\t%f\t%f\t", m->gyro[0], m->gyro[1], m->gyro[2]);
+    fprintf(f, "%f\t%f\t%f\t", m->accel[0], m->accel[1], m->accel[2]);
+    fprintf(f, "%f\t%f\t%f\t", m->nVel, m->eVel, m->dVel);
+    fprintf(f, "%f\t%f\t%f\t", m->latitude, m->longitude, m->altitude);
+    fprintf(f, "%f\t%d\t%d\t", m->temp, m->internal_error, m->internal_status);
+    fprintf(f, "%ld\t%lld\t%d", m->time_stamp, m->time_sys, m->validade);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void print_pitot(FILE *f, const msg_pitot_t *m)
+{
+    fprintf(f, "\n%f\t%f\t%f\t", m->static_pressure, m->temperature, m->dynamic_pressure);
+    fprintf(f, "%f\t%f\t", m->attack_angle, m->sideslip_angle);
+    fprintf(f, "%lld\t%d", m->time_sys, m->validade);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int check_floats(void)
+{
+    char a[64], b[64];
+    uint32_t bits;
+    float v;
+    int n, errors = 0;
+    unsigned long long tested = 0;
+
+    // Um a cada 997 padroes de bits, o que cobre todos os expoentes e sinais
+    for (bits = 0; bits < 0xffffffffu - 997; bits += 997) {
+        memcpy(&v, &bits, sizeof(v));
+        n = log_text_float(b, v) - b;
+        b[n] = '\0';
+        sprintf(a, "%f", v);
+        tested++;
+        if (strcmp(a, b) != 0) {
+            if (errors++ < 10)
+                fprintf(stderr, "float %08x: printf \"%s\", log_text \"%s\"\n", bits, a, b);
+        }
+    }
+    printf("floats: %llu checked, %d different\n", tested, errors);
+
+    return errors;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que compara a linha do log_text (n bytes em b) com a do fprintf() (em a)
+static int compare_line(const char *name, const char *a, const char *b, size_t n)
+{
+    if ((strlen(a) == n) && (memcmp(a, b, n) == 0))
+        return 0;
+
+    fprintf(stderr, "%s: fprintf\n%s\nlog_text\n%.*s\n", name, a + 1, (int)n - 1, b + 1);
+    return 1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int check_lines(void)
+{
+    char a[LOG_TEXT_LINE_MAX], b[LOG_TEXT_LINE_MAX];
+    msg_daq_t daq;
+    msg_ahrs_t ahrs;
+    msg_gps_t gps;
+    msg_nav_t nav;
+    msg_pitot_t pitot;
+    FILE *f;
+    int i, errors = 0;
+
+    for (i = 0; i < 100000; i++) {
+        fill_daq(&daq, i, i & 1);
+        f = fmemopen(a, sizeof(a), "w");
+        print_daq(f, &daq);
+        fclose(f);
+        errors += compare_line("daq", a, b, log_text_daq(b, &daq));
+
+        fill_ahrs(&ahrs, i, i & 1);
+        f = fmemopen(a, sizeof(a), "w");
+        print_ahrs(f, &ahrs);
+        fclose(f);
+        errors += compare_line("ahrs", a, b, log_text_ahrs(b, &ahrs));
+
+        fill_gps(&gps, i, i & 1);
+        f = fmemopen(a, sizeof(a), "w");
+        print_gps(f, &gps);
+        fclose(f);
+        errors += compare_line("gps", a, b, log_text_gps(b, &gps));
+
+        fill_nav(&nav, i, i & 1);
+        f = fmemopen(a, sizeof(a), "w");
+        print_nav(f, &nav);
+        fclose(f);
+        errors += compare_line("nav", a, b, log_text_nav(b, &nav));
+
+        fill_pitot(&pitot, i, i & 1);
+        f = fmemopen(a, sizeof(a), "w");
+        print_pitot(f, &pitot);
+        fclose(f);
+        errors += compare_line("pitot", a, b, log_text_pitot(b, &pitot));
+    }
+    printf("lines: %d of each stream checked, %d different\n", i, errors);
+
+    return errors;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int main(int argc, char *argv[])
+{
+    int n = (argc > 1) ? atoi(argv[1]) : 200000;
+    msg_daq_t *daq = malloc(n*sizeof(msg_daq_t));
+    msg_ahrs_t *ahrs = malloc(n*sizeof(msg_ahrs_t));
+    char line[LOG_TEXT_LINE_MAX];
+    double t0, t_print_daq, t_text_daq, t_print_ahrs, t_text_ahrs;
+    FILE *null = fopen("/dev/null", "w");
+    int i, errors;
+
+    if ((daq == NULL) || (ahrs == NULL) || (null == NULL)) {
+        fprintf(stderr, "Setup failed\n");
+        return 1;
+    }
+
+    errors = check_floats() + check_lines();
+
+    for (i = 0; i < n; i++) {
+        fill_daq(&daq[i], i, 1);
+        fill_ahrs(&ahrs[i], i, 1);
+    }
+
+    t0 = now_s();
+    for (i = 0; i < n; i++)
+        print_daq(null, &daq[i]);
+    t_print_daq = now_s() - t0;
+
+    t0 = now_s();
+    for (i = 0; i < n; i++)
+        fwrite(line, 1, log_text_daq(line, &daq[i]), null);
+    t_text_daq = now_s() - t0;
+
+    t0 = now_s();
+    for (i = 0; i < n; i++)
+        print_ahrs(null, &ahrs[i]);
+    t_print_ahrs = now_s() - t0;
+
+    t0 = now_s();
+    for (i = 0; i < n; i++)
+        fwrite(line, 1, log_text_ahrs(line, &ahrs[i]), null);
+    t_text_ahrs = now_s() - t0;
+
+    printf("%d records      fprintf      log_text   speedup\n", n);
+    printf("daq          %8.0f ns   %8.0f ns   %5.1fx\n",
+           t_print_daq*1e9/n, t_text_daq*1e9/n, t_print_daq/t_text_daq);
+    printf("ahrs         %8.0f ns   %8.0f ns   %5.1fx\n",
+           t_print_ahrs*1e9/n, t_text_ahrs*1e9/n, t_print_ahrs/t_text_ahrs);
+
+    fclose(null);
+
+    return errors ? 1 : 0;
+}
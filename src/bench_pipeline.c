@@ -0,0 +1,414 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            VAZAO DO SAVE_DATA() REAL ALIMENTADO EM TAXAS CRESCENTES - BENCH_PIPELINE
+
+    Substitui as FIFOs de dados do fdc_slave por pipes com nome (ou, com -t rings, pelos
+aneis em memoria compartilhada do shm_ring.h com um pipe com nome como FIFO de aviso), do
+tamanho das FIFOs de tempo real, e roda sobre elas a thread save_data() do fdc_master, como
+faz um START. Uma thread produtora faz o papel da tarefa de tempo real: a cada periodo ela
+emite um msg_ahrs_t, msg_daq_t, msg_gps_t, msg_nav_t e msg_pitot_t, sem nunca esperar, de
+forma que um registro que nao cabe eh perdido, como com rtf_put(). Os dispositivos seriais
+ficam atras da tarefa de tempo real e nao participam aqui: so os registros chegam ao
+fdc_master.
+
+    A taxa sobe passo a passo (de 50 Hz a 10 kHz por default). A cada passo o voo eh gravado
+por alguns segundos, parado (o save_data() esvazia o que resta) e lido de volta. Para cada
+taxa sao informados os registros gravados por segundo, o tempo de CPU do fdc_master por
+registro (todas as threads menos a produtora), e os registros perdidos: nas FIFOs ou aneis
+(o leitor ficou para tras) e nas filas das threads de escrita (o disco ficou para tras), com
+o percentil 99 da idade das amostras quando o save_data() as le e quando elas saem dos
+buffers dos arquivos (a pior serie), dos histogramas do save_data(). O produtor marca o
+time_sys com log_now_ns(), entao as idades sao relativas a amostra mais rapida, como no
+fdc_master. A primeira taxa com perdas eh o inicio dos descartes.
+
+Uso: bench_pipeline [-r taxa_hz,...] [-d segundos] [-f text|binary|compressed|journal]
+                    [-t fifo|rings] [-p bytes_fifo]
+*********************************************************************************************
+********************************************************************************************/
+
+#define _GNU_SOURCE
+
+#include "save_data.h"
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// Passos da varredura default (Hz, registros por serie por segundo)
+static const double default_rates[] = { 50, 100, 200, 500, 1000, 2000, 5000, 10000 };
+
+#define MAX_RATES 32
+
+// Capacidade das FIFOs de tempo real criadas pelo fdc_slave
+#define RT_FIFO_BYTES 20000
+
+global_master global;
+
+typedef struct {
+    int fds[N_STREAMS];                 // Lados de escrita (ou o aviso, em fds[0])
+    int rings;
+    double rate_hz;
+    volatile int stop;
+    unsigned long long sent[N_STREAMS]; // Registros gravados
+    unsigned long long lost[N_STREAMS]; // Registros que nao couberam
+    double cpu_s;                       // Tempo de CPU da thread produtora
+    pthread_t thread;
+} producer_t;
+
+static int time_offsets[N_STREAMS];
+static int errors_logged, verbose;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int master_log(int type_message, const char *place)
+{
+    if (type_message == ERROR_LOG)
+        __atomic_add_fetch(&errors_logged, 1, __ATOMIC_RELAXED);
+    if (verbose || (type_message == ERROR_LOG))
+        fprintf(stderr, "%s: %s\n", (type_message == ERROR_LOG) ? "Error logged" : "Log", place);
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static double cpu_s(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void *produce(void *arg)
+{
+    producer_t *p = arg;
+    unsigned char record[256];
+    struct timespec next;
+    long long period_ns = (long long)(1e9/p->rate_hz);
+    int64_t t;
+    int i, new_samples;
+    char aviso = 0;
+
+    memset(record, 0, sizeof(record));
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (!p->stop) {
+        new_samples = 0;
+        for (i = 0; i < N_STREAMS; i++) {
+            t = log_now_ns();
+            memcpy(record + time_offsets[i], &t, sizeof(t));
+            // Os registros sao menores que PIPE_BUF: cada write eh inteiro ou falha
+            if (p->rings ? shm_ring_put(global.rings, i, record) :
+                (write(p->fds[i], record, log_record_size(i)) == (ssize_t)log_record_size(i))) {
+                p->sent[i]++;
+                new_samples = 1;
+            }
+            else
+                p->lost[i]++;
+        }
+        if (p->rings && new_samples && (write(p->fds[0], &aviso, 1) < 0)) {
+            // O aviso esta cheio: o save_data() ja tem bytes para ler
+        }
+
+        // Os periodos perdidos enquanto a thread nao rodava sao compensados de uma vez
+        next.tv_nsec += period_ns;
+        next.tv_sec += next.tv_nsec/1000000000L;
+        next.tv_nsec %= 1000000000L;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+    p->cpu_s = cpu_s(CLOCK_THREAD_CPUTIME_ID);
+
+    return NULL;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int has_ext(const char *name, const char *ext)
+{
+    size_t len = strlen(name), len_ext = strlen(ext);
+
+    return (len >= len_ext) && (strcmp(name + len - len_ext, ext) == 0);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Linhas de registros (nao de comentarios) de um arquivo texto
+static long count_lines(const char *path)
+{
+    char line[4096];
+    long n = 0;
+    int start = 1;
+    FILE *in = fopen(path, "r");
+
+    if (in == NULL)
+        return -1;
+    while (fgets(line, sizeof(line), in) != NULL) {
+        if (start && (line[0] != '%') && (line[0] != '\n'))
+            n++;
+        start = (strchr(line, '\n') != NULL);
+    }
+    fclose(in);
+
+    return n;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que conta os registros de cada serie no voo em dir, e depois remove o voo.
+// Retorna -1 se um arquivo nao puder ser lido.
+static int count_flight(const char *dir_name, unsigned long long saved[])
+{
+    static const char *exts[] = { LOG_EXT_TEXT, LOG_EXT_BINARY, LOG_EXT_COMPRESSED, LOG_EXT_JOURNAL };
+    char path[PATH_MAX];
+    struct dirent *entry;
+    size_t record_size;
+    void *records;
+    long n;
+    int i, k, problems = 0;
+    DIR *dir;
+
+    memset(saved, 0, N_STREAMS*sizeof(saved[0]));
+    if ((dir = opendir(dir_name)) == NULL)
+        return -1;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.')
+            continue;
+        snprintf(path, sizeof(path), "%s%s", dir_name, entry->d_name);
+        for (i = 0; i < N_STREAMS; i++)
+            if (strncmp(entry->d_name, log_stream_name(i), strlen(log_stream_name(i))) == 0)
+                break;
+        for (k = 0; (k < 4) && !has_ext(entry->d_name, exts[k]); k++);
+        if ((i < N_STREAMS) && (k < 4)) {
+            if (k == 0)
+                n = count_lines(path);
+            else {
+                n = log_read_window(path, INT64_MIN, INT64_MAX, &records, &record_size);
+                if (n >= 0)
+                    free(records);
+            }
+            if (n < 0)
+                problems++;
+            else
+                saved[i] += n;
+        }
+        unlink(path);
+    }
+    closedir(dir);
+    rmdir(dir_name);
+
+    return problems ? -1 : 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int parse_rates(char *list, double rates[])
+{
+    char *tok;
+    int n = 0;
+
+    for (tok = strtok(list, ","); (tok != NULL) && (n < MAX_RATES); tok = strtok(NULL, ","))
+        if ((rates[n++] = atof(tok)) <= 0)
+            return -1;
+
+    return n;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-r rate_hz,...] [-d seconds] [-f text|binary|compressed|journal] "
+            "[-t fifo|rings] [-p fifo_bytes] [-v]\n", name);
+    exit(1);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int main(int argc, char *argv[])
+{
+    static const char *formats[] = { "text", "binary", "compressed", "journal" };
+    int *fifos[N_STREAMS] = { &global.fifo_ahrs, &global.fifo_daq, &global.fifo_gps, &global.fifo_nav,
+                              &global.fifo_pitot };
+    double rates[MAX_RATES], seconds = 3, onset = 0, elapsed, cpu0, cpu1;
+    unsigned long long saved[N_STREAMS], sent, lost_fifo, lost_queue, total, read_p99, disk_p99;
+    lat_hist_t read_age, disk_age;
+    char dir[] = "/tmp/bench_pipeline.XXXXXX", path[PATH_MAX];
+    int n_rates = sizeof(default_rates)/sizeof(default_rates[0]), fifo_bytes = RT_FIFO_BYTES;
+    int rings = 0, opt, i, k, n_fields, problems = 0, writers[N_STREAMS];
+    const log_field_t *fields;
+    producer_t producer;
+
+    memcpy(rates, default_rates, sizeof(default_rates));
+    global.log_format = FORMAT_TEXT;
+    while ((opt = getopt(argc, argv, "r:d:f:t:p:v")) != -1) {
+        switch (opt) {
+            case 'r':
+                if ((n_rates = parse_rates(optarg, rates)) <= 0)
+                    usage(argv[0]);
+                break;
+            case 'd': seconds = atof(optarg); break;
+            case 'f':
+                for (k = 0; (k < 4) && (strcmp(optarg, formats[k]) != 0); k++);
+                if (k == 4)
+                    usage(argv[0]);
+                global.log_format = k;
+                break;
+            case 't':
+                if ((strcmp(optarg, "fifo") != 0) && (strcmp(optarg, "rings") != 0))
+                    usage(argv[0]);
+                rings = (strcmp(optarg, "rings") == 0);
+                break;
+            case 'p': fifo_bytes = atoi(optarg); break;
+            case 'v': verbose = 1; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (seconds <= 0)
+        usage(argv[0]);
+#ifndef SHM_RING_MMAP
+    if (rings) {
+        fprintf(stderr, "Built without SHM_RING_MMAP: no rings\n");
+        return 1;
+    }
+#endif
+
+    global.flush_ms = LOG_WRITER_FLUSH_MS;
+    mkdir(FILES_PATH, 0777);
+    if ((sem_init(&global.file_names, 0, 1) != 0) ||
+        ((global.wakeup_save_data = eventfd(0, EFD_NONBLOCK)) < 0) || (mkdtemp(dir) == NULL)) {
+        perror("Setup");
+        return 1;
+    }
+    for (i = 0; i < N_STREAMS; i++) {
+        fields = log_stream_fields(i, &n_fields);
+        for (k = 0; k < n_fields; k++)
+            if (strcmp(fields[k].name, "time_sys") == 0)
+                time_offsets[i] = fields[k].offset;
+    }
+
+    // Pipes com nome no lugar de /dev/rtf0 a /dev/rtf4 (ou de /dev/rtf8 e da memoria
+    // compartilhada), abertos como o fdc_master abre as FIFOs de tempo real
+    for (i = 0; i < N_STREAMS; i++)
+        *fifos[i] = writers[i] = -1;
+    global.fifo_rings = global.fifo_jitter = -1;
+    for (i = 0; i < (rings ? 1 : N_STREAMS); i++) {
+        snprintf(path, sizeof(path), "%s/rtf%d", dir, rings ? 8 : i);
+        if ((mkfifo(path, 0600) != 0) || ((k = open(path, O_RDONLY|O_NONBLOCK)) < 0) ||
+            ((writers[i] = open(path, O_WRONLY|O_NONBLOCK)) < 0)) {
+            perror(path);
+            return 1;
+        }
+        // Os pipes guardam paginas inteiras: o tamanho da FIFO de tempo real eh
+        // arredondado para cima
+        fcntl(writers[i], F_SETPIPE_SZ, fifo_bytes);
+        if (rings)
+            global.fifo_rings = k;
+        else
+            *fifos[i] = k;
+        unlink(path);
+    }
+    rmdir(dir);
+#ifdef SHM_RING_MMAP
+    if (rings) {
+        shm_region_remove();
+        if (((global.rings = shm_region_create()) == NULL)) {
+            perror("shm_region_create");
+            return 1;
+        }
+    }
+#endif
+
+    printf("Format %s, %s, %.1f s per rate, 5 streams at each rate\n", formats[global.log_format],
+           rings ? "shared memory rings" : "FIFOs", seconds);
+    printf("%9s %12s %12s %12s %12s %12s %12s %12s\n", "rate_hz", "offered/s", "saved/s", "cpu_us/rec",
+           "lost_fifo", "lost_queue", "read_p99_us", "disk_p99_us");
+    for (k = 0; k < n_rates; k++) {
+        memset(&producer, 0, sizeof(producer));
+        memcpy(producer.fds, writers, sizeof(writers));
+        producer.rings = rings;
+        producer.rate_hz = rates[k];
+        errors_logged = 0;
+
+        if (start_save_data() != 0) {
+            fprintf(stderr, "start_save_data() failed\n");
+            return 1;
+        }
+        cpu0 = cpu_s(CLOCK_PROCESS_CPUTIME_ID);
+        elapsed = now_s();
+        pthread_create(&producer.thread, NULL, produce, &producer);
+        usleep((useconds_t)(seconds*1e6));
+        producer.stop = 1;
+        pthread_join(producer.thread, NULL);
+        if (stop_save_data() != 0) {
+            fprintf(stderr, "stop_save_data() failed\n");
+            return 1;
+        }
+        elapsed = now_s() - elapsed;
+        // A thread produtora terminou: o seu tempo esta no tempo do processo
+        cpu1 = cpu_s(CLOCK_PROCESS_CPUTIME_ID) - producer.cpu_s;
+
+        if (count_flight(global.dir_name, saved) < 0) {
+            fprintf(stderr, "Cannot read the files of %s\n", global.dir_name);
+            problems++;
+        }
+        sent = lost_fifo = lost_queue = total = read_p99 = disk_p99 = 0;
+        for (i = 0; i < N_STREAMS; i++) {
+            save_latency_copy(i, &read_age, &disk_age);
+            if (lat_hist_percentile(&read_age, 0.99) > read_p99)
+                read_p99 = lat_hist_percentile(&read_age, 0.99);
+            if (lat_hist_percentile(&disk_age, 0.99) > disk_p99)
+                disk_p99 = lat_hist_percentile(&disk_age, 0.99);
+            sent += producer.sent[i];
+            lost_fifo += producer.lost[i];
+            total += saved[i];
+            if (saved[i] > producer.sent[i]) {
+                fprintf(stderr, "%s: %llu records saved, %llu sent\n", log_stream_name(i), saved[i], producer.sent[i]);
+                problems++;
+            }
+            else
+                lost_queue += producer.sent[i] - saved[i];
+        }
+        printf("%9.0f %12.0f %12.0f %12.2f %12llu %12llu %12llu %12llu\n", rates[k], (sent + lost_fifo)/seconds,
+               total/elapsed, (cpu1 - cpu0)*1e6/(total ? total : 1), lost_fifo, lost_queue, read_p99, disk_p99);
+        fflush(stdout);
+        if ((onset == 0) && (lost_fifo + lost_queue > 0))
+            onset = rates[k];
+    }
+
+    if (onset > 0)
+        printf("Drops begin at %.0f Hz per stream\n", onset);
+    else
+        printf("No drops up to %.0f Hz per stream\n", rates[n_rates - 1]);
+
+#ifdef SHM_RING_MMAP
+    if (rings) {
+        shm_region_detach(global.rings);
+        shm_region_remove();
+    }
+#endif
+
+    if (problems > 0) {
+        printf("FAILED: %d problems\n", problems);
+        return 1;
+    }
+
+    return 0;
+}
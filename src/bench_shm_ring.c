@@ -0,0 +1,294 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            AMOSTRAS PELOS ANEIS EM MEMORIA COMPARTILHADA CONTRA AS FIFOS DE
+            DADOS - BENCH_SHM_RING
+
+    Um processo filho faz o papel da tarefa de tempo real do fdc_slave: a cada periodo ele
+coloca um registro de cada dispositivo ou nos aneis da regiao do shm_ring.h (o substituto no
+espaco de usuario do shm_region.c, com um pipe como FIFO de aviso) ou em cinco pipes que
+fazem o papel das FIFOs de dados, gravados com um write() por registro como faz o rtf_put().
+O pai os le como o save_data(): direto dos aneis, ou com fifo_batch_read(). Nenhum lado
+espera pelo outro; um registro que nao cabe eh descartado, como no fdc_slave.
+
+    O time_sys de cada registro eh o seu numero de sequencia; o consumidor verifica que cada
+serie chega em ordem e conta os registros perdidos. Sao informados os registros entregues
+por segundo e o tempo de CPU de cada lado por registro.
+
+Uso: bench_shm_ring [-n periodos] [-r taxa_hz] [-m shm|fifo]
+  (taxa_hz 0, o default, roda o produtor o mais rapido possivel; os dois
+  transportes sao executados quando -m nao eh dado)
+*********************************************************************************************
+********************************************************************************************/
+
+#ifndef SHM_RING_MMAP
+#error "bench_shm_ring uses the user space double of the region: build it with -DSHM_RING_MMAP"
+#endif
+
+#include "messages.h"
+#include "shm_ring.h"
+#include "fifo_batch.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+static const unsigned int sizes[SHM_RING_STREAMS] = SHM_RING_SIZES;
+
+static const size_t time_offsets[SHM_RING_STREAMS] = {
+    offsetof(msg_ahrs_t, time_sys), offsetof(msg_daq_t, time_sys), offsetof(msg_gps_t, time_sys),
+    offsetof(msg_nav_t, time_sys), offsetof(msg_pitot_t, time_sys)
+};
+
+static const char *names[SHM_RING_STREAMS] = { "ahrs", "daq", "gps", "nav", "pitot" };
+
+typedef struct {
+    unsigned long long received;
+    unsigned long long next;        // Numero de sequencia esperado
+    unsigned long long out_of_order;
+} stream_check_t;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static double cpu_s(struct timeval tv)
+{
+    return tv.tv_sec + tv.tv_usec*1e-6;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Produtor: periods registros por serie, a rate_hz periodos por segundo (0: o mais rapido
+// possivel)
+static void produce(int shm, shm_region_t *region, int fds[], int doorbell, long periods, double rate_hz)
+{
+    char record[SHM_RING_STREAMS][256];
+    struct timespec next;
+    long k;
+    int i;
+    char aviso = 0;
+
+    memset(record, 0, sizeof(record));
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (k = 0; k < periods; k++) {
+        for (i = 0; i < SHM_RING_STREAMS; i++) {
+            memcpy(record[i] + time_offsets[i], &(long long){ k }, sizeof(long long));
+            if (shm)
+                shm_ring_put(region, i, record[i]);
+            else if (write(fds[i], record[i], sizes[i]) < 0) {
+                // Cheio, como o rtf_put() quando a FIFO esta cheia: o registro eh perdido
+            }
+        }
+        if (shm && (write(doorbell, &aviso, 1) < 0)) {
+            // O consumidor ja tem um byte para ler
+        }
+
+        if (rate_hz > 0) {
+            next.tv_nsec += (long)(1e9/rate_hz);
+            next.tv_sec += next.tv_nsec/1000000000L;
+            next.tv_nsec %= 1000000000L;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        }
+    }
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void check(stream_check_t *c, const char *records, unsigned long n, int stream)
+{
+    unsigned long j;
+    long long seq;
+
+    for (j = 0; j < n; j++) {
+        memcpy(&seq, records + j*sizes[stream] + time_offsets[stream], sizeof(seq));
+        if ((unsigned long long)seq < c->next)
+            c->out_of_order++;
+        else
+            c->next = seq + 1;
+        c->received++;
+    }
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int run(int shm, long periods, double rate_hz)
+{
+    shm_region_t *region = NULL;
+    fifo_batch_t fifos[SHM_RING_STREAMS];
+    stream_check_t checks[SHM_RING_STREAMS];
+    struct pollfd fds[SHM_RING_STREAMS + 1];
+    int pipes[SHM_RING_STREAMS + 1][2];
+    int i, n_fds, open_fds, problems = 0;
+    unsigned long long total = 0, lost = 0;
+    struct rusage self0, self1, child;
+    double t0, t1;
+    const void *records;
+    unsigned int n;
+    char avisos[64];
+    pid_t pid;
+
+    memset(checks, 0, sizeof(checks));
+    if (shm) {
+        shm_region_remove();
+        if ((region = shm_region_create()) == NULL) {
+            perror("shm_region_create");
+            return 1;
+        }
+        // O fdc_master se anexa ao que o fdc_slave montou
+        shm_region_detach(region);
+        if ((region = shm_region_attach()) == NULL) {
+            perror("shm_region_attach");
+            return 1;
+        }
+    }
+    n_fds = shm ? 1 : SHM_RING_STREAMS;
+    for (i = 0; i < n_fds; i++)
+        if ((pipe(pipes[i]) != 0) || (fcntl(pipes[i][0], F_SETFL, O_NONBLOCK) != 0) ||
+            (fcntl(pipes[i][1], F_SETFL, O_NONBLOCK) != 0)) {
+            perror("pipe");
+            return 1;
+        }
+
+    getrusage(RUSAGE_SELF, &self0);
+    t0 = now_s();
+    if ((pid = fork()) < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0) {
+        int w[SHM_RING_STREAMS];
+
+        for (i = 0; i < n_fds; i++) {
+            close(pipes[i][0]);
+            w[i] = pipes[i][1];
+        }
+        produce(shm, region, w, w[0], periods, rate_hz);
+        _exit(0);
+    }
+
+    for (i = 0; i < n_fds; i++) {
+        close(pipes[i][1]);
+        fds[i].fd = pipes[i][0];
+        fds[i].events = POLLIN;
+        if (!shm)
+            fifo_batch_init(&fifos[i], fds[i].fd, sizes[i], FIFO_BATCH_RECORDS);
+    }
+
+    // Ate o produtor terminar e tudo o que ele gravou ser lido
+    open_fds = n_fds;
+    while (open_fds > 0) {
+        if (poll(fds, n_fds, -1) < 0)
+            continue;
+        for (i = 0; i < n_fds; i++) {
+            if (!(fds[i].revents & (POLLIN|POLLHUP)))
+                continue;
+            if (shm) {
+                while (read(fds[i].fd, avisos, sizeof(avisos)) == sizeof(avisos));
+            }
+            else {
+                int got;
+
+                while ((got = fifo_batch_read(&fifos[i])) > 0)
+                    check(&checks[i], fifos[i].buf, got, i);
+            }
+            if ((fds[i].revents & (POLLHUP|POLLIN)) == POLLHUP) {
+                fds[i].fd = -1;
+                open_fds--;
+            }
+        }
+        if (shm)
+            for (i = 0; i < SHM_RING_STREAMS; i++)
+                while ((n = shm_ring_peek(region, i, &records)) > 0) {
+                    check(&checks[i], records, n, i);
+                    shm_ring_release(region, i, n);
+                }
+    }
+    t1 = now_s();
+    waitpid(pid, NULL, 0);
+    getrusage(RUSAGE_SELF, &self1);
+    getrusage(RUSAGE_CHILDREN, &child);
+
+    for (i = 0; i < SHM_RING_STREAMS; i++) {
+        total += checks[i].received;
+        lost += periods - checks[i].received;
+        if (checks[i].out_of_order > 0) {
+            fprintf(stderr, "%s: %llu records out of order\n", names[i], checks[i].out_of_order);
+            problems++;
+        }
+        if (shm && (region->rings[i].dropped != periods - checks[i].received)) {
+            fprintf(stderr, "%s: %u records dropped by the producer, %llu missing\n", names[i],
+                    region->rings[i].dropped, periods - checks[i].received);
+            problems++;
+        }
+    }
+
+    printf("%-4s %10.0f records/s  consumer %7.1f ns/record  producer %7.1f ns/record  lost %llu (%.2f%%)\n",
+           shm ? "shm" : "fifo", total/(t1 - t0),
+           (cpu_s(self1.ru_utime) + cpu_s(self1.ru_stime) - cpu_s(self0.ru_utime) - cpu_s(self0.ru_stime))*1e9/(total ? total : 1),
+           (cpu_s(child.ru_utime) + cpu_s(child.ru_stime))*1e9/(periods*(double)SHM_RING_STREAMS),
+           lost, 100.0*lost/(periods*(double)SHM_RING_STREAMS));
+
+    for (i = 0; i < n_fds; i++) {
+        close(pipes[i][0]);
+        if (!shm)
+            fifo_batch_free(&fifos[i]);
+    }
+    if (shm) {
+        shm_region_detach(region);
+        shm_region_remove();
+    }
+
+    return problems;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int main(int argc, char *argv[])
+{
+    long periods = 200000;
+    double rate_hz = 0;
+    int opt, modes = 3, problems = 0;
+
+    while ((opt = getopt(argc, argv, "n:r:m:")) != -1) {
+        switch (opt) {
+            case 'n': periods = atol(optarg); break;
+            case 'r': rate_hz = atof(optarg); break;
+            case 'm': modes = (strcmp(optarg, "shm") == 0) ? 1 : (strcmp(optarg, "fifo") == 0) ? 2 : 0; break;
+            default: modes = 0; break;
+        }
+    }
+    if ((modes == 0) || (periods <= 0)) {
+        fprintf(stderr, "Usage: %s [-n periods] [-r rate_hz] [-m shm|fifo]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%ld periods of %d records, %s\n", periods, SHM_RING_STREAMS,
+           (rate_hz > 0) ? "paced" : "producer flat out");
+    if (modes & 2)
+        problems += run(0, periods, rate_hz);
+    if (modes & 1)
+        problems += run(1, periods, rate_hz);
+
+    if (problems > 0) {
+        printf("FAILED\n");
+        return 1;
+    }
+    printf("OK\n");
+
+    return 0;
+}
@@ -0,0 +1,155 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            EXECUCAO DA CARGA DE MODULOS DO STARTUP.C COM MODULOS DE TESTE - BENCH_STARTUP
+
+    Cada modulo do FDC eh substituido por um modulo de teste que demora tanto quanto a sua
+funcao init no computador da aeronave (os defaults abaixo, que -t muda), de forma que a
+orquestracao pode ser verificada e medida em qualquer maquina Linux, sem RTAI: a ordem dos
+passos deve seguir as dependencias, os modulos que dependem de um que falhou (-f) devem ser
+pulados, e o tempo ate ficar pronto eh comparado com a carga de um modulo apos o outro (-s).
+
+Uso: bench_startup [-s] [-t modulo=ms]... [-f modulo]...
+*********************************************************************************************
+********************************************************************************************/
+
+#include "startup.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+// Tempo da funcao init de cada modulo; o AHRS espera as respostas a quatro comandos em
+// rt_cfg_ahrs()
+static struct {
+    const char *name;
+    int ms;
+    int fail;
+} stubs[STARTUP_MAX_STEPS] = {
+    { "rtai_serial", 40 }, { "rtai_fifos", 20 }, { "rtai_shm", 10 }, { "crc8", 5 }, { "rtai_daq", 60 },
+    { "rtai_gps", 250 }, { "rtai_ahrs", 400 }, { "rtai_nav", 150 }, { "rtai_pitot", 100 },
+    { "modem", 80 }, { "epos", 200 }, { "fdc_slave", 30 },
+};
+
+static int serial;
+static pthread_mutex_t one_at_a_time = PTHREAD_MUTEX_INITIALIZER;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int find_stub(const char *name)
+{
+    int i;
+
+    for (i = 0; (i < STARTUP_MAX_STEPS) && (stubs[i].name != NULL); i++)
+        if (strcmp(stubs[i].name, name) == 0)
+            return i;
+
+    return -1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int load_stub(const startup_step_t *step, void *arg)
+{
+    int i = find_stub(step->name);
+    struct timespec ts;
+
+    (void)arg;
+    if (i < 0)
+        return ENOENT;
+
+    if (serial)
+        pthread_mutex_lock(&one_at_a_time);
+    ts.tv_sec = stubs[i].ms/1000;
+    ts.tv_nsec = (stubs[i].ms%1000)*1000000L;
+    nanosleep(&ts, NULL);
+    if (serial)
+        pthread_mutex_unlock(&one_at_a_time);
+
+    return stubs[i].fail ? EIO : 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Cada passo deve comecar depois que todas as suas dependencias terminaram bem
+static int check_order(const startup_timing_t *timeline)
+{
+    const startup_step_t *steps = startup_fdc_modules;
+    int i, j, k, problems = 0;
+
+    for (i = 0; i < startup_fdc_n_modules; i++)
+        for (k = 0; (k < STARTUP_MAX_DEPS) && (steps[i].deps[k] != NULL); k++) {
+            for (j = 0; strcmp(steps[j].name, steps[i].deps[k]) != 0; j++);
+            if ((timeline[i].state == STARTUP_OK) &&
+                ((timeline[j].state != STARTUP_OK) || (timeline[i].start_ns < timeline[j].end_ns))) {
+                fprintf(stderr, "%s started before %s was loaded\n", steps[i].name, steps[j].name);
+                problems++;
+            }
+            if ((timeline[j].state != STARTUP_OK) && (timeline[i].state != STARTUP_SKIPPED)) {
+                fprintf(stderr, "%s was not skipped after %s failed\n", steps[i].name, steps[j].name);
+                problems++;
+            }
+        }
+
+    return problems;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int main(int argc, char *argv[])
+{
+    startup_timing_t timeline[STARTUP_MAX_STEPS];
+    long long total;
+    int i, k, failures, problems, sum = 0;
+    char *eq;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0)
+            serial = 1;
+        else if ((strcmp(argv[i], "-t") == 0) && (i + 1 < argc) && ((eq = strchr(argv[i + 1], '=')) != NULL)) {
+            *eq = '\0';
+            if ((k = find_stub(argv[++i])) < 0) {
+                fprintf(stderr, "Unknown module %s\n", argv[i]);
+                return 1;
+            }
+            stubs[k].ms = atoi(eq + 1);
+        }
+        else if ((strcmp(argv[i], "-f") == 0) && (i + 1 < argc) && ((k = find_stub(argv[i + 1])) >= 0)) {
+            stubs[k].fail = 1;
+            i++;
+        }
+        else {
+            fprintf(stderr, "Usage: %s [-s] [-t module=ms]... [-f module]...\n", argv[0]);
+            return 1;
+        }
+    }
+
+    failures = startup_run(startup_fdc_modules, startup_fdc_n_modules, load_stub, NULL, timeline, &total);
+    if (failures < 0) {
+        fprintf(stderr, "Invalid module dependencies\n");
+        return 1;
+    }
+
+    // Linha do tempo, uma coluna a cada 20 ms
+    for (i = 0; i < startup_fdc_n_modules; i++) {
+        printf("%-12s %7.1f %7.1f ms %-8s ", startup_fdc_modules[i].name, timeline[i].start_ns/1e6,
+               timeline[i].end_ns/1e6, startup_state_name(timeline[i].state));
+        for (k = 0; k < timeline[i].end_ns/20000000; k++)
+            putchar((k < timeline[i].start_ns/20000000) ? ' ' : '#');
+        putchar('\n');
+        sum += stubs[find_stub(startup_fdc_modules[i].name)].ms;
+    }
+
+    problems = check_order(timeline);
+    printf("Ready in %.1f ms (%s), %d ms one after the other, %d failed or skipped\n", total/1e6,
+           serial ? "serial" : "parallel", sum, failures);
+    if (problems > 0) {
+        printf("FAILED: %d problems\n", problems);
+        return 1;
+    }
+    printf("OK\n");
+
+    return 0;
+}
@@ -0,0 +1,122 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            CONTADORES DOS DISPOSITIVOS, DO LADO DO FDC_MASTER - DEV_COUNTERS
+
+    Compilado com SHM_RING_MMAP, o bloco eh um objeto de memoria compartilhada POSIX em vez
+de shm do RTAI, como a regiao dos aneis no shm_region.c.
+*********************************************************************************************
+********************************************************************************************/
+
+#include "dev_counters.h"
+
+#ifdef SHM_RING_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#else
+#include <rtai_shm.h>
+#endif
+
+static const char *names[DEV_COUNTERS_DEVICES] = DEV_COUNTERS_NAMES;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+dev_counters_block_t *dev_counters_attach(void)
+{
+    dev_counters_block_t *b;
+
+#ifdef SHM_RING_MMAP
+    void *p;
+    int fd = shm_open(DEV_COUNTERS_FILE, O_RDWR|O_CREAT, 0600);
+
+    if (fd < 0)
+        return NULL;
+    if (ftruncate(fd, sizeof(dev_counters_block_t)) != 0) {
+        close(fd);
+        return NULL;
+    }
+    p = mmap(NULL, sizeof(dev_counters_block_t), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    b = (p == MAP_FAILED) ? NULL : p;
+#else
+    // Aloca o bloco se nenhum modulo o fez ainda: as suas posicoes sao entao zeradas
+    // pelos drivers a medida que sao carregados
+    b = rtai_malloc(nam2num(DEV_COUNTERS_NAME), sizeof(dev_counters_block_t));
+#endif
+    if (b != NULL)
+        dev_counters_init(b);
+
+    return b;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void dev_counters_detach(dev_counters_block_t *b)
+{
+    if (b == NULL)
+        return;
+
+#ifdef SHM_RING_MMAP
+    munmap(b, sizeof(dev_counters_block_t));
+#else
+    rtai_free(nam2num(DEV_COUNTERS_NAME), b);
+#endif
+}
+
+#ifdef SHM_RING_MMAP
+/*!*******************************************************************************************
+*********************************************************************************************/
+void dev_counters_remove(void)
+{
+    shm_unlink(DEV_COUNTERS_FILE);
+}
+#endif
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void dev_counters_snapshot(dev_counters_block_t *b, dev_counters_t c[])
+{
+    int i;
+
+    for (i = 0; i < DEV_COUNTERS_DEVICES; i++)
+        if ((b == NULL) || !dev_counters_copy(b, i, &c[i]))
+            memset(&c[i], 0, sizeof(c[i]));
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void print_row(FILE *f, const char *name, const char *what, const dev_counters_t *c)
+{
+    fprintf(f, "%-6s %-6s %12u %10u %10u %10u %8u %10u %10u %10u\n", name, what, c->rx_bytes,
+            c->frames_ok, c->crc_errors, c->discarded, c->resyncs, c->fifo_drops, c->tx_frames,
+            c->tx_drops);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void dev_counters_print(FILE *f, dev_counters_block_t *b, const dev_counters_t since[])
+{
+    dev_counters_t c, d;
+    int i;
+
+    fprintf(f, "%-6s %-6s %12s %10s %10s %10s %8s %10s %10s %10s\n", "device", "count", "rx_bytes",
+            "frames_ok", "crc_errors", "discarded", "resyncs", "fifo_drops", "tx_frames", "tx_drops");
+
+    for (i = 0; i < DEV_COUNTERS_DEVICES; i++) {
+        if ((b == NULL) || !dev_counters_copy(b, i, &c))
+            continue;
+        print_row(f, names[i], "total", &c);
+
+        if ((since == NULL) || (since[i].magic != DEV_COUNTERS_MAGIC))
+            continue;
+        d.rx_bytes = c.rx_bytes - since[i].rx_bytes;
+        d.frames_ok = c.frames_ok - since[i].frames_ok;
+        d.crc_errors = c.crc_errors - since[i].crc_errors;
+        d.discarded = c.discarded - since[i].discarded;
+        d.resyncs = c.resyncs - since[i].resyncs;
+        d.fifo_drops = c.fifo_drops - since[i].fifo_drops;
+        d.tx_frames = c.tx_frames - since[i].tx_frames;
+        d.tx_drops = c.tx_drops - since[i].tx_drops;
+        print_row(f, names[i], "since", &d);
+    }
+}
@@ -3,8 +3,8 @@
    interacao com o programa "fdc_master".
 */
 
-/* COMMANDS		start | stop | change | nodata | enable | disable| assign */
-/* OPTIONS		ts | datfile | daqchannel | daq | gps | ahrs | temperature | alpha | beta | pstat | pdyn | nav | pitot */
+/* COMMANDS		start | stop | change | nodata | enable | disable| assign | latency | counters | history */
+/* OPTIONS		ts | datfile | format | flush | sync | prealloc | daqchannel | daq | gps | ahrs | temperature | alpha | beta | pstat | pdyn | nav | pitot */
 
 %option case-insensitive noyywrap
 
@@ -15,8 +15,9 @@
 
 
 /*Definicoes das condies 'captura de string',
-'captura de numero' e 'captura de lista de canais da placa DAQ'.*/
-%x STRING_CAPTURE INTEGER_CAPTURE FLOAT_CAPTURE CHANNEL_LIST COMMENTS
+'captura de numero', 'captura de lista de canais da placa DAQ' e 'captura
+dos argumentos do historico'.*/
+%x STRING_CAPTURE INTEGER_CAPTURE FLOAT_CAPTURE CHANNEL_LIST HISTORY_CAPTURE COMMENTS
 
 %%
 
@@ -153,6 +154,112 @@
 		}
 	}
 
+"format"|"fmt" {
+		if (result.msg.cmd == CHANGE) {
+			result.msg.cmd = CHANGEFORMAT;
+			result.msg.option = FORMAT;
+			if (debug)
+				printf("Formato dos arquivos de dados.\n");
+		}
+		else {
+			clear_msg();
+			fprintf(stderr,"Falha no analisador lexico. Token = %s.\n",yytext);
+		}
+	}
+
+"flush"|"flush_ms" {
+		if (result.msg.cmd == CHANGE) {
+			result.msg.cmd = CHANGEFLUSH;
+			result.msg.option = FLUSHTIME;
+			if (debug)
+				printf("Intervalo de escrita dos arquivos de dados (ms).\n");
+			BEGIN(INTEGER_CAPTURE);
+		}
+		else {
+			clear_msg();
+			fprintf(stderr,"Falha no analisador lexico. Token = %s.\n",yytext);
+		}
+	}
+
+"sync"|"fsync" {
+		if (result.msg.cmd == CHANGE) {
+			result.msg.cmd = CHANGESYNC;
+			result.msg.option = DISKSYNC;
+			if (debug)
+				printf("Sincronizacao dos arquivos de dados (0 ou 1).\n");
+			BEGIN(INTEGER_CAPTURE);
+		}
+		else {
+			clear_msg();
+			fprintf(stderr,"Falha no analisador lexico. Token = %s.\n",yytext);
+		}
+	}
+
+"prealloc"|"mmap" {
+		if (result.msg.cmd == CHANGE) {
+			result.msg.cmd = CHANGEPREALLOC;
+			result.msg.option = PREALLOC;
+			if (debug)
+				printf("Duracao esperada do voo para a preallocacao dos arquivos (min).\n");
+			BEGIN(INTEGER_CAPTURE);
+		}
+		else {
+			clear_msg();
+			fprintf(stderr,"Falha no analisador lexico. Token = %s.\n",yytext);
+		}
+	}
+
+"rotate"|"rotate_min" {
+		if (result.msg.cmd == CHANGE) {
+			result.msg.cmd = CHANGEROTATE;
+			result.msg.option = ROTATETIME;
+			if (debug)
+				printf("Intervalo da troca de segmento dos arquivos (min).\n");
+			BEGIN(INTEGER_CAPTURE);
+		}
+		else {
+			clear_msg();
+			fprintf(stderr,"Falha no analisador lexico. Token = %s.\n",yytext);
+		}
+	}
+
+"rotate_mb"|"rotate_size" {
+		if (result.msg.cmd == CHANGE) {
+			result.msg.cmd = CHANGEROTATESIZE;
+			result.msg.option = ROTATESIZE;
+			if (debug)
+				printf("Tamanho da troca de segmento dos arquivos (MB).\n");
+			BEGIN(INTEGER_CAPTURE);
+		}
+		else {
+			clear_msg();
+			fprintf(stderr,"Falha no analisador lexico. Token = %s.\n",yytext);
+		}
+	}
+
+"binary"|"bin"|"text"|"txt"|"compressed"|"fdz"|"journal"|"fdj" {
+		if (result.msg.cmd == CHANGEFORMAT) {
+			/* O analisador nao diferencia maiusculas de minusculas: o nome
+			tambem nao (ex.: "JOURNAL", "Fdz"). */
+			if ((strcasecmp(yytext, "binary") == 0) || (strcasecmp(yytext, "bin") == 0))
+				result.msg.data = FORMAT_BINARY;
+			else if ((strcasecmp(yytext, "journal") == 0) || (strcasecmp(yytext, "fdj") == 0))
+				result.msg.data = FORMAT_JOURNAL;
+			else if ((strcasecmp(yytext, "compressed") == 0) || (strcasecmp(yytext, "fdz") == 0))
+				result.msg.data = FORMAT_COMPRESSED;
+			else
+				result.msg.data = FORMAT_TEXT;
+			if (debug)
+				printf("Formato = %s.\n",yytext);
+			else
+				write(out,&result,sizeof(parser_cmd_msg_t));
+		}
+		else {
+			clear_msg();
+			fprintf(stderr,"Falha no analisador lexico. Token = %s.\n",yytext);
+		}
+	}
+
 "daqchannel"|"channel"|"ch"|"daqch" {
 		if ((result.msg.cmd == ENABLEDAQ) ||
 		    (result.msg.cmd == DISABLEDAQ)) {
@@ -190,6 +297,40 @@
 		}
 	}
 	
+"latency"|"latencia"	{
+			result.msg.cmd = LATENCY;
+			result.msg.option = NO_OPTION;
+			result.msg.data = 0;
+			result.name[0] = '\0';
+			if (debug)
+				printf("Histogramas de latencia das amostras.\n");
+			else
+				write(out,&result,sizeof(parser_cmd_msg_t));
+	}
+
+"counters"|"contadores"	{
+			result.msg.cmd = COUNTERS;
+			result.msg.option = NO_OPTION;
+			result.msg.data = 0;
+			result.name[0] = '\0';
+			if (debug)
+				printf("Contadores de erros e perdas dos dispositivos.\n");
+			else
+				write(out,&result,sizeof(parser_cmd_msg_t));
+	}
+
+"history"|"historico"	{
+			/* Argumentos opcionais ate o fim da linha: os segundos e o destino
+			(diretorio ou socket local). Ex.: "history 30 /tmp/janela". */
+			result.msg.cmd = HISTORY;
+			result.msg.option = NO_OPTION;
+			result.msg.data = 0;
+			result.name[0] = '\0';
+			if (debug)
+				printf("Historico das amostras em memoria.\n");
+			BEGIN(HISTORY_CAPTURE);
+	}
+
 "reset_gps"	{
 			result.msg.cmd = RESET_GPS;
 			result.msg.option = NO_OPTION;
@@ -457,6 +598,22 @@
 		BEGIN(INITIAL);
 	}
 
+<HISTORY_CAPTURE>[[:digit:]]+ {
+		result.msg.data = atoi(yytext);
+		if (debug) printf("Segundos = %s\n",yytext);
+	}
+<HISTORY_CAPTURE>[^[:blank:][:digit:]\r\n][^[:blank:]\r\n]* {
+		strncpy(result.name,yytext,MAX_STRLEN);
+		result.name[MAX_STRLEN-1]= '\0';
+		if (debug) printf("Destino = %s\n",result.name);
+	}
+<HISTORY_CAPTURE>[[:blank:]\r]+ { }
+<HISTORY_CAPTURE>\n {
+		if (!debug)
+			write(out,&result,sizeof(parser_cmd_msg_t));
+		BEGIN(INITIAL);
+	}
+
 %%
 
 void clear_msg(void)
@@ -15,6 +15,15 @@ por algum motivo.
 *********************************************************************************************
 ********************************************************************************************/
 #include "fdc_master.h"
+#include "async_log.h"
+#include "startup.h"
+#include "telemetry.h"
+#include "history.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 
 int main(int argc,char *argv[])
 { 
@@ -24,6 +33,15 @@ int main(int argc,char *argv[])
     // Interpreta os argumentos passados em linha de comando.
     parse_args(argc,argv);
 
+    // Servidor das amostras ao vivo para clientes locais (telemetry.h). Se ele nao
+    // puder ser iniciado, a gravacao continua sem ele.
+    telemetry_start(TELEM_SOCKET, global.telem_udp_port);
+
+    // Historico dos ultimos segundos de cada dispositivo, com toda a memoria alocada
+    // agora. Sem ele a gravacao continua e o comando "history" apenas reporta o erro.
+    if (history_init(global.history_seconds) != 0)
+        master_log(ERROR_LOG, "Main: Falha ao alocar o historico das amostras.");
+
     // Carrega o arquivo de configuracao.
     if (!load_config_file()) {
         fprintf(stderr,"Falha ao carregar arquivo de configuracao.\n");
@@ -50,6 +68,10 @@ int main(int argc,char *argv[])
 /* Inicializa o programa fdc_master. */
 void initialize(void)
 {
+    sigset_t sinais;
+    long long inicio = log_now_ns();
+    char texto[MAX_STRLEN];
+    
     // Marca o inicio.
     global.theend = 0;
     
@@ -57,6 +79,20 @@ void initialize(void)
     // Zera a mascara de acesso aos arquivos
     umask(0);
     
+    // Os sinais de termino sao bloqueados antes da criacao de qualquer thread, para
+    // que nenhuma os receba, e lidos pelo loop principal atraves de um signalfd, que
+    // chama a funcao 'terminate'.
+    sigemptyset(&sinais);
+    sigaddset(&sinais,SIGQUIT);
+    sigaddset(&sinais,SIGTERM);
+    sigaddset(&sinais,SIGINT);
+    sigaddset(&sinais,SIGTSTP);
+    if ((sigprocmask(SIG_BLOCK,&sinais,NULL) != 0) ||
+        ((global.signal_fd = signalfd(-1,&sinais,SFD_NONBLOCK|SFD_CLOEXEC)) == -1)) {
+        fprintf(stderr,"Erro ao criar o signalfd dos sinais de termino.\n");
+        exit(1);
+    }
+    
     /* Criando o arquivo de log. A partir daqui todas as mensagens de erro e 
     stay=tus serao armazenadas neste arquivo.*/
     if ((global.log_file = fopen(LOG_FILE,"a+")) < 0) {
@@ -64,11 +100,10 @@ void initialize(void)
         exit(1);
     }
     
-    // Inicializa o semaforo da funcao fdc_log
-    if (sem_init(&global.sem_log_file, 0, SEM_SIZE) != 0) {
-        fprintf(stderr,"Erro ao abrir semaforo da funcao fdc_log.\n");
-        exit(1);    
-    }
+    // Inicia a thread de escrita do log. Se ela nao puder ser criada as
+    // mensagens sao escritas diretamente no arquivo, como antes.
+    if (async_log_start(global.log_file) != 0)
+        fprintf(stderr,"Erro ao criar a thread de escrita do log.\n");
 
     
     // Carrega os modulos do kernel
@@ -79,18 +114,24 @@ void initialize(void)
     strncpy(global.config_file,DEFAULT_CONFIG_FILE,MAX_STRLEN-1);
     global.config_file[MAX_STRLEN-1] = '\0';
 
+    // Por padrao os dados sao salvos em texto, compativel com processa_dados.m
+    global.log_format = FORMAT_TEXT;
+    
+    // Politica padrao de escrita dos arquivos de dados
+    global.flush_ms = LOG_WRITER_FLUSH_MS;
+    global.sync_data = 0;
+    global.prealloc_min = 0;
+    global.rotate_min = 0;
+    global.rotate_mb = 0;
+
+    // Historico das amostras em memoria (a opcao -H muda a duracao)
+    global.history_seconds = HISTORY_SECONDS;
+
     // Inicializa os descritores de leitura e escrita, respectivamente,
     // do pipe de comunicacao entre 'fdc_master' e 'fdc_cmd_parser'.
     global.mypipe[0] = 0;
     global.mypipe[1] = 0;
 
-    // Assegura-se de que a funcao 'terminate' serah
-    // chamada quando o processo receber um sinal para terminar.
-    signal(SIGQUIT,terminate);
-    signal(SIGTERM,terminate);
-    signal(SIGINT,terminate);
-    signal(SIGTSTP,terminate);
-
     // Tenta apagar a FIFO de controle, caso tenha ocorrido
     // algum problema anteriormente e a mesma no tenha sido apagada.
     unlink(CTRL_FIFO);
@@ -110,6 +151,24 @@ void initialize(void)
         exit(1);
     }
     
+#ifdef FDC_SHM_RINGS
+    // Os dados chegam pelos aneis da memoria compartilhada criados pelo fdc_slave,
+    // lidos sem copia pela thread de salvamento. A FIFO de aviso eh nao-bloqueante.
+    global.fifo_ahrs = global.fifo_daq = global.fifo_gps = global.fifo_nav = global.fifo_pitot = -1;
+    if ((global.rings = shm_region_attach()) == NULL) {
+        master_log(ERROR_LOG, "Initialize: Erro ao acessar os aneis da memoria compartilhada.(exit)");
+        fprintf(stderr,"Erro ao acessar os aneis da memoria compartilhada\n");
+        exit(1);
+    }
+    if ((global.fifo_rings = open(FIFO_RINGS, O_RDONLY|O_NONBLOCK)) < 0) {
+        master_log(ERROR_LOG, "Initialize: Error opening FIFO dos aneis.(exit)");
+        fprintf(stderr,"Error opening FIFO dos aneis\n");
+        exit(1);
+    }
+#else
+    global.rings = NULL;
+    global.fifo_rings = -1;
+    
     // Abre as fifos para leitura dos dados
     if ((global.fifo_ahrs = open(FIFO_AHRS, O_RDONLY|O_NONBLOCK)) < 0) {
         master_log(ERROR_LOG, "Initialize: Error opening FIFO AHRS.(exit)");
@@ -140,6 +199,22 @@ void initialize(void)
         fprintf(stderr,"Error opening FIFO PITOT\n");
         exit(1);
     }
+#endif
+    // Os resumos do periodo da tarefa de tempo real nao sao essenciais: sem a FIFO a
+    // gravacao continua sem eles
+    if ((global.fifo_jitter = open(FIFO_JITTER, O_RDONLY|O_NONBLOCK)) < 0) {
+        master_log(ERROR_LOG, "Initialize: Error opening FIFO de atraso da tarefa de tempo real.");
+        fprintf(stderr,"Error opening FIFO de atraso da tarefa de tempo real\n");
+    }
+    
+    // Os contadores dos dispositivos tambem nao: sem eles o comando "counters" apenas
+    // reporta o erro
+    memset(global.counters_start, 0, sizeof(global.counters_start));
+    if ((global.counters = dev_counters_attach()) == NULL) {
+        master_log(ERROR_LOG, "Initialize: Erro ao acessar os contadores dos dispositivos.");
+        fprintf(stderr,"Erro ao acessar os contadores dos dispositivos\n");
+    }
+    
     // A fifo de status flui do modulo de tempo real para o programa de modo usuario 
     // Ela eh nao-bloqueante e read_only
     if ((global.fifo_status = open(FIFO_STATUS, O_RDONLY|O_NONBLOCK)) < 0) {
@@ -164,25 +239,26 @@ void initialize(void)
         exit(1);    
     }
     
-    // Inicializa o semaforo de fim da thread save_data()
-    if (sem_init(&global.end_thread_save_data, 0, SEM_SIZE) != 0) {
-        master_log(ERROR_LOG, "Initialize: Erro ao abrir semaforo do fim da Thread Save_data.(exit)");
-        fprintf(stderr,"Erro ao abrir semaforo do fim da Thread Save_data.\n");
-        exit(1);    
+    // Cria o eventfd que acorda a thread save_data() quando global.end_save_data muda
+    // (nao-bloqueante)
+    if ((global.wakeup_save_data = eventfd(0, EFD_NONBLOCK)) == -1) {
+        master_log(ERROR_LOG, "Initialize: Erro ao criar o eventfd de despertar da Thread Save_data.(exit)");
+        fprintf(stderr,"Erro ao criar o eventfd de despertar da Thread Save_data.\n");
+        exit(1);
     }
 
-    
     // O estado do programa eh PARADO.
     global.state = (fdc_state_t)STOPPED;
     
     // Escreve na variavel de fim da thread
     // Indispensavel para a implementacao do primeiro start
-    sem_wait(&global.end_thread_save_data);
-    global.end_save_data = STOPPED;
-    sem_post(&global.end_thread_save_data);
+    __atomic_store_n(&global.end_save_data, STOPPED, __ATOMIC_RELEASE);
     
     master_log(STATUS_LOG,"Initialize: **INICIALIZA FDC_MASTER**.");
     
+    snprintf(texto,sizeof(texto),"Initialize: pronto em %.1f ms.",(log_now_ns() - inicio)/1e6);
+    master_log(STATUS_LOG,texto);
+    
 }
 
 /*!*******************************************************************************************
@@ -194,15 +270,16 @@ void terminate(int s)
     // Escreve na variavel de fim da thread
     if (global.state == RUNNING) {
         // Para a thread de coleta de dados e espera pelo seu fim
-        sem_wait(&global.end_thread_save_data);
-        global.end_save_data = STOPPED;
-        sem_post(&global.end_thread_save_data);
-        
-        pthread_join(global.salva_dados,NULL);
+        stop_save_data();
         
         // Muda a prioridade de 'fdc_master' para o default 0.
         setpriority(PRIO_PROCESS,0,0);    
     }
+
+    // Desconecta os clientes da telemetria local e libera o historico, com a thread de
+    // coleta ja parada
+    telemetry_stop();
+    history_free();
         
     // Fecha as fifos de comunicacao
     close(global.fifo_ahrs);
@@ -210,13 +287,23 @@ void terminate(int s)
     close(global.fifo_gps);
     close(global.fifo_nav);
     close(global.fifo_pitot);
+    if (global.rings != NULL) {
+        close(global.fifo_rings);
+        shm_region_detach(global.rings);
+        global.rings = NULL;
+    }
     close(global.fifo_control);
     close(global.fifo_status);
+    if (global.fifo_jitter >= 0)
+        close(global.fifo_jitter);
+    dev_counters_detach(global.counters);
+    global.counters = NULL;
     //close(global.fifo_cmd);
+    close(global.wakeup_save_data);
+    close(global.signal_fd);
     
     // Destroi todos os semaforos
     sem_destroy(&global.file_names);
-    sem_destroy(&global.end_thread_save_data);
     
     
     if (global.ctrl_fifo != NULL) {
@@ -226,26 +313,28 @@ void terminate(int s)
     
     // Descarrega os modulos do kernel
     unload_modules();    
-    sleep(2);
 
     if (unlink(CTRL_FIFO)==-1){
         master_log(ERROR_LOG,"Terminate:falha ao apagar FIFO de controle criada por fdc_master.(exit)");
         exit(EXIT_FAILURE);
     }
 
-    // Destroi o ultimo semaforo
-    sem_destroy(&global.sem_log_file);
+    if (s) {
+        master_log(ERROR_LOG,"Terminate: **FIM ABRUPTO **. Segue tipo de sinal recebido:");
+        master_log(ERROR_LOG,(const char *) strsignal(s));
+    }
+    else
+        master_log(STATUS_LOG,"Terminate: **FIM SUAVE**.");
+    
+    // Escreve as mensagens que ainda estao na fila e para a thread de log
+    async_log_stop();
     
     fclose(global.log_file);
     
     if (s) {
-        master_log(ERROR_LOG,"Terminate: **FIM ABRUPTO **. Segue tipo de sinal recebido:");
-        master_log(ERROR_LOG,(const char *) strsignal(s));
         psignal(s,"** Fim **.");
         exit(EXIT_FAILURE);
     }
-    
-    master_log(STATUS_LOG,"Terminate: **FIM SUAVE**.");
 }
 
 /*!*******************************************************************************************
@@ -273,6 +362,32 @@ void parse_args(int argc,char *argv[])
                 exit(EXIT_FAILURE);
             }
         }
+        // Porta UDP da telemetria local, alem do socket TELEM_SOCKET
+        else if (strncmp(argv[n],"-u",2) == 0) {
+            if ((n+1) < argc) {
+                n++;
+                global.telem_udp_port = atoi(argv[n]);
+            }
+            else {
+                fprintf(stderr,"Argumento invalido na linha de comando.\n");
+                master_log(ERROR_LOG,"Parse_args: Argumento invalido na linha de comando.(exit)");
+                terminate(0);
+                exit(EXIT_FAILURE);
+            }
+        }
+        // Segundos do historico das amostras em memoria (0 desliga)
+        else if (strncmp(argv[n],"-H",2) == 0) {
+            if ((n+1) < argc) {
+                n++;
+                global.history_seconds = atoi(argv[n]);
+            }
+            else {
+                fprintf(stderr,"Argumento invalido na linha de comando.\n");
+                master_log(ERROR_LOG,"Parse_args: Argumento invalido na linha de comando.(exit)");
+                terminate(0);
+                exit(EXIT_FAILURE);
+            }
+        }
     }
 }
 
@@ -284,27 +399,49 @@ int load_config_file(void)
     int parser_status;
     int theend = 0;
     pid_t parser_pid;
-    time_t t_now;
+    long long prazo;
+    int restante;
+    struct pollfd fds[2];
+    struct signalfd_siginfo sinal;
 
     parser_pid = fdc_cmd_parser(global.config_file);
 
-    // Obtem o instante atual para inicializar a abordagem timeout
-    t_now = time(NULL);
+    // Prazo (ms) para o processamento do arquivo
+    prazo = log_now_ns()/1000000 + PARSER_TIMEOUT*1000;
 
+    // Dorme em poll() ate chegarem mensagens do parser ou um sinal de termino. O
+    // parser fecha o pipe ao terminar (POLLHUP, depois das ultimas mensagens).
     do {
-        process_message();
+        restante = prazo - log_now_ns()/1000000;
+        if (restante <= 0) {
+            theend = 2;
+            break;
+        }
+        
+        fds[0].fd = global.mypipe[0];
+        fds[0].events = POLLIN;
+        fds[1].fd = global.signal_fd;
+        fds[1].events = POLLIN;
+        if (poll(fds,2,restante) < 0)
+            continue;
+
+        if ((fds[1].revents & POLLIN) && (read(global.signal_fd,&sinal,sizeof(sinal)) == sizeof(sinal)))
+            terminate(sinal.ssi_signo);
         
-        // Verifica se fdc_cmd_parser jah terminou.
-        waitpid(parser_pid,&parser_status,WNOHANG);
-        if (WIFEXITED(parser_status)) {
+        if (fds[0].revents & POLLIN)
+            while (process_message());
+        else if (fds[0].revents & (POLLHUP|POLLERR))
             theend = 1;
-        }
-
-        if ((time(NULL) - t_now) > PARSER_TIMEOUT)
-            theend = 2;
+        
+        // Comandos do arquivo de configuracao enviados ao fdc_slave
+        receive_replies();
+        expire_commands();
 
     }while(!theend);
     
+    close(global.mypipe[0]);
+    global.mypipe[0] = -1;
+    
     if (theend == 2) {
         // Mata o processo filho e retorna um erro.
         kill(parser_pid,SIGTERM);
@@ -313,11 +450,12 @@ int load_config_file(void)
         return 0;
     }
 
-    if (WEXITSTATUS(parser_status) != EXIT_SUCCESS) 
+    // Evita que exista um 'zumbi' fdc_cmd_parser.
+    if (waitpid(parser_pid,&parser_status,0) != parser_pid)
         return 0;
     
-    // Evita que exista um 'zumbi' fdc_cmd_parser.
-    waitpid(parser_pid,&parser_status,0);
+    if (!WIFEXITED(parser_status) || (WEXITSTATUS(parser_status) != EXIT_SUCCESS)) 
+        return 0;
         
     return 1;
 }
@@ -375,8 +513,18 @@ pid_t fdc_cmd_parser(const char *args)
 
     // Processo filho.
     if (pid == (pid_t) 0) {
+        sigset_t nenhum;
+        
+        // A thread de log nao existe no filho: as mensagens vao direto ao arquivo.
+        async_log_forked();
+
         // Fecha o acesso de leitura. Somente escreve na pipe.
         close(global.mypipe[0]);
+        
+        // A mascara de sinais passa pelo exec: o parser deve voltar a receber os
+        // sinais de termino, bloqueados em 'initialize'.
+        sigemptyset(&nenhum);
+        sigprocmask(SIG_SETMASK,&nenhum,NULL);
 
         // Associa o descritor de escrita da pipe com
         // o descritor da saida padrao, antes de exec.
@@ -388,11 +536,11 @@ pid_t fdc_cmd_parser(const char *args)
         else
             execl(PARSER_NAME,PARSER_NAME,"-f",global.config_file,NULL);
 
-        // Se o comando acima retornou, entao houve um erro.
+        // Se o comando acima retornou, entao houve um erro. O filho nao chama
+        // terminate(): os recursos e as threads sao do processo pai.
         master_log(ERROR_LOG,"Uav_cmd_parser: (processo filho) falha ao executar 'fdc_cmd_parser'.(exit)");
         perror("Processo filho: Falha ao executar 'fdc_cmd_parser'.");
-        terminate(0);
-        exit(EXIT_FAILURE);
+        _exit(EXIT_FAILURE);
     }
 
     // Processo pai.
@@ -417,54 +565,190 @@ pid_t fdc_cmd_parser(const char *args)
     return pid;
 }
 
+/*!*******************************************************************************************
+*********************************************************************************************/
+/*    Relanca o 'fdc_cmd_parser' se ele terminou sem um QUIT (o pipe foi fechado pelo
+ outro lado). Chamada pelo timer de manutencao, o que limita as tentativas a uma por
+ periodo, caso o parser nao consiga iniciar. */
+static void housekeeping(void)
+{
+    if (global.mypipe[0] >= 0)
+        return;
+    
+    // Espera que o processo termine, para nao deixar um 'zumbi'
+    if (waitpid(global.child,NULL,WNOHANG) == 0)
+        return;
+    
+    master_log(ERROR_LOG,"Housekeeping: 'fdc_cmd_parser' terminou; relancando o processo.");
+    fdc_cmd_parser(NULL);
+}
+
 /*!*******************************************************************************************
 *********************************************************************************************/
 /*    No loop principal, uma thread eh lancada para capturar os dados enviados pela tarefa de tempo real, evitando com isso que o programa fdc_master fique preso em outro ponto, sem salvar os dados.
- Tambem, sao processados os dados enviados pelo parser e pelo modulo rt. */
+ Tambem, sao processados os dados enviados pelo parser e pelo modulo rt.
+    O loop dorme em poll() sobre o pipe do parser, a FIFO de status, o signalfd dos
+ sinais de termino e um timerfd de manutencao (HOUSEKEEPING_MS), e so acorda quando um
+ deles tem algo a tratar (ou no prazo de resposta de um comando enviado ao fdc_slave):
+ sem uso de CPU enquanto nao chegam comandos. */
 void main_loop(void)
 {    
-    time_t led_now = time(NULL); // Verifica se o sistema esta vivo (acende led)
-    
-        /*strncpy(global.file_daq_name,"./teste.txt",MAX_STRLEN-1);
+    struct pollfd fds[4];
+    struct signalfd_siginfo sinal;
+    struct itimerspec periodo;
+    uint64_t expiracoes;
+    int timer_fd, status_ativo = 1;
     
-    FILE *arquivo_daq = NULL;
-    if ((arquivo_daq = fopen(global.file_daq_name,"w")) < 0) {
-        printf("\n Erro na abertura do arquivo");
-        master_log(ERROR_LOG, "Save_data (thread): Erro na abertura do arquivo (DAQ).(exit)");
-        exit(1);
+    // Timer da manutencao periodica
+    periodo.it_interval.tv_sec = HOUSEKEEPING_MS/1000;
+    periodo.it_interval.tv_nsec = (HOUSEKEEPING_MS%1000)*1000000L;
+    periodo.it_value = periodo.it_interval;
+    if (((timer_fd = timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK|TFD_CLOEXEC)) == -1) ||
+        (timerfd_settime(timer_fd,0,&periodo,NULL) == -1)) {
+        master_log(ERROR_LOG,"Main_loop: Erro ao criar o timer de manutencao.(exit)");
+        fprintf(stderr,"Erro ao criar o timer de manutencao.\n");
+        terminate(0);
+        exit(EXIT_FAILURE);
     }
-        
-    fclose(arquivo_daq);
-    */
-
     
     while(!global.theend) {
-
-        /*if ((arquivo_daq = fopen(global.file_daq_name,"at")) < 0) {
-                printf("\n Erro na abertura do arquivo");
-                master_log(ERROR_LOG, "Save_data (thread): Erro na abertura do arquivo (DAQ).(exit)");
-                exit(1);
-        }*/
+        
+        // Descritores negativos sao ignorados por poll() (parser a relancar)
+        fds[0].fd = global.mypipe[0];
+        fds[0].events = POLLIN;
+        fds[1].fd = status_ativo ? global.fifo_status : -1;
+        fds[1].events = POLLIN;
+        fds[2].fd = global.signal_fd;
+        fds[2].events = POLLIN;
+        fds[3].fd = timer_fd;
+        fds[3].events = POLLIN;
+        
+        // Acorda tambem no proximo prazo de resposta de um comando
+        if (poll(fds,4,command_timeout_ms()) < 0) {
+            if (errno == EINTR)
+                continue;
+            master_log(ERROR_LOG,"Main_loop: Falha em poll().(exit)");
+            break;
+        }
+        
+        // Sinal de termino: mesmo tratamento do antigo handler de sinais
+        if ((fds[2].revents & POLLIN) && (read(global.signal_fd,&sinal,sizeof(sinal)) == sizeof(sinal)))
+            terminate(sinal.ssi_signo);
             
-        // Processa mensagens de comando vindas do usuario.
-        process_message();
+        // Processa todas as mensagens de comando vindas do usuario.
+        if (fds[0].revents & POLLIN) {
+            while (!global.theend && process_message());
+        }
+        else if (fds[0].revents & (POLLHUP|POLLERR)) {
+            // O parser terminou: o pipe sai do poll() ate ele ser relancado
+            close(global.mypipe[0]);
+            global.mypipe[0] = -1;
+        }
+        
+        // Respostas do fdc_slave aos comandos enviados, e comandos sem resposta no prazo
+        if (fds[1].revents & POLLIN)
+            receive_replies();
+        else if (fds[1].revents & (POLLHUP|POLLERR)) {
+            // FIFO sem escritor: poll() retornaria sempre, entao ela deixa de ser observada
+            master_log(ERROR_LOG,"Main_loop: FIFO de status sem escritor.");
+            status_ativo = 0;
+        }
+        expire_commands();
+        
+        if ((fds[3].revents & POLLIN) && (read(timer_fd,&expiracoes,sizeof(expiracoes)) == sizeof(expiracoes)))
+            housekeeping();
         
         // Processa mensagens de comando vindas do modulo de tempo real via modem
         //modem_comand();
-        
-        /*if (save_daq(arquivo_daq))
-            printf("Minha Falha de leitura da FIFO.\n"); // Se funcionar, aqui vai o programa de fuso de dados
-        else
-            printf("ok\n");
-        fclose(arquivo_daq);*/    
     }
+    
+    close(timer_fd);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+/*    Reporta (na saida de erro e no log) o resultado de um comando enviado ao fdc_slave,
+ quando chega a sua resposta ou quando o prazo expira. */
+static void report_command(const cmd_msg_t *cmd, cmd_status_t result, void *arg)
+{
+    static const char *resultados[] = { "OK", "NOT_OK", "TIME_OUT" };
+    static const char *dispositivos[] = { [DAQ] = "DAQ", [GPS] = "GPS", [AHRS] = "AHRS",
+                                          [NAV] = "NAV", [PITOT] = "PITOT" };
+    char nome[32], texto[MAX_STRLEN+32];
+    
+    switch (cmd->cmd) {
+        case START:     strcpy(nome,"START");       break;
+        case STOP:      strcpy(nome,"STOP");        break;
+        case QUIT:      strcpy(nome,"QUIT");        break;
+        case FILTER_ON: strcpy(nome,"FILTER_ON");   break;
+        case FILTER_OFF:strcpy(nome,"FILTER_OFF");  break;
+        case RESET_GPS: strcpy(nome,"RESET_GPS");   break;
+        case NODATA:
+            // Como antes, so os dispositivos conhecidos sao reportados
+            if ((cmd->option > PITOT) || (dispositivos[cmd->option] == NULL))
+                return;
+            snprintf(nome,sizeof(nome),"NODATA %s",dispositivos[cmd->option]);
+        break;
+        default:
+            snprintf(nome,sizeof(nome),"%d",(int)cmd->cmd);
+        break;
+    }
+    
+    fprintf(stderr,"Mensagem %s - %s.\n",nome,resultados[result]);
+    snprintf(texto,sizeof(texto),"Process_message: Mensagem %s - %s.",nome,resultados[result]);
+    master_log(STATUS_LOG,texto);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+/*    Escreve no arquivo nome (se nao for NULL) os contadores de erros e perdas de cada
+ dispositivo, desde a carga do seu modulo e desde o inicio do ultimo voo, e os resume no log.
+ Retorna 0, ou -1 se os contadores nao estao disponiveis ou o arquivo nao pode ser escrito. */
+static int write_counters(const char *nome)
+{
+    static const char *dispositivos[DEV_COUNTERS_DEVICES] = DEV_COUNTERS_NAMES;
+    dev_counters_t c;
+    char texto[MAX_STRLEN+192];
+    FILE *arquivo = NULL;
+    int i;
+    
+    if (global.counters == NULL) {
+        master_log(ERROR_LOG, "Write_counters: Contadores dos dispositivos indisponiveis.");
+        return -1;
+    }
+    
+    if ((nome != NULL) && ((arquivo = fopen(nome,"w")) == NULL)) {
+        snprintf(texto,sizeof(texto),"Write_counters: Erro na criacao do arquivo %s.",nome);
+        master_log(ERROR_LOG,texto);
+    }
+    if (arquivo != NULL) {
+        fprintf(arquivo,"# Contadores dos dispositivos desde a carga do modulo (total) e desde o inicio\n"
+                        "# do ultimo voo (since)\n");
+        dev_counters_print(arquivo,global.counters,global.counters_start);
+    }
+    
+    for (i = 0; i < DEV_COUNTERS_DEVICES; i++) {
+        if (!dev_counters_copy(global.counters,i,&c))
+            continue;
+        snprintf(texto,sizeof(texto),"Write_counters: %s - rx %u bytes, %u quadros, %u checksum errado,"
+                 " %u bytes descartados, %u ressincronizacoes; %u perdidas na fifo; tx %u quadros,"
+                 " %u perdidos.",dispositivos[i],c.rx_bytes,c.frames_ok,c.crc_errors,c.discarded,
+                 c.resyncs,c.fifo_drops,c.tx_frames,c.tx_drops);
+        master_log(STATUS_LOG,texto);
+    }
+    
+    if (arquivo == NULL)
+        return (nome != NULL) ? -1 : 0;
+    
+    return (fclose(arquivo) == 0) ? 0 : -1;
 }
 
 /*!*******************************************************************************************
 *********************************************************************************************/
 /*    Esta funcao recebe um comando emviado pelo fdc_cmd_parser, e o processa, repassando ao 
- modulo de tempo real, caso seja necessario. */
-void process_message(void)
+ modulo de tempo real, caso seja necessario. Retorna 1 se uma mensagem foi processada e 0
+ se nao havia mensagem completa no pipe. */
+int process_message(void)
 {
     int n;
     cmd_status_t result;
@@ -475,7 +759,7 @@ void process_message(void)
     // Somente leh os bytes se os mesmos compuserem uma mensagem completa.
     n = read(global.mypipe[0],&from_parser,sizeof(parser_cmd_msg_t));
     if (n != sizeof(parser_cmd_msg_t))
-        return;
+        return 0;
     
     switch (from_parser.msg.cmd) {
     
@@ -489,37 +773,19 @@ void process_message(void)
             // Muda a prioridade de 'fdc_master' para a mais alta possivel.
             setpriority(PRIO_PROCESS,0,-20);        
             
-            // Se a thread nao esta ativa (global.end_save_data = STOPPED);
-            sem_wait(&global.end_thread_save_data);
+            // Os contadores do voo sao contados a partir daqui
+            dev_counters_snapshot(global.counters,global.counters_start);
             
-            if (global.end_save_data == STOPPED) {
-                // Lanca thread para armazenar os dados coletados em arquivos
-                if (pthread_create(&global.salva_dados, NULL, save_data, (void*)0) != 0) {
-                    master_log(ERROR_LOG, "Process_message: Erro ao criar a thread para salvar os dados apos comando START.(exit)");
-                    fprintf(stderr,"Erro ao criar a thread para salvar os dados\n");
-                    terminate(0);
-                    exit(EXIT_FAILURE);
-                }
+            // Lanca thread para armazenar os dados coletados em arquivos, se ela nao
+            // esta ativa (global.end_save_data = STOPPED)
+            if (start_save_data() != 0) {
+                master_log(ERROR_LOG, "Process_message: Erro ao criar a thread para salvar os dados apos comando START.(exit)");
+                fprintf(stderr,"Erro ao criar a thread para salvar os dados\n");
+                terminate(0);
+                exit(EXIT_FAILURE);
             }
-            // Libera o semaforo
-            sem_post(&global.end_thread_save_data);
-            
-            result = sendcommand(&from_parser);    
-            // Libera o semaforo
-            sem_post(&global.end_thread_save_data);
             
-            if (result == OK) {
-                fprintf(stderr,"Mensagem START - OK.\n");
-                master_log(STATUS_LOG, "Process_message: Mensagem START - OK.");
-            }
-            if (result == NOT_OK) {
-                fprintf(stderr,"Mensagem START - NOT_OK.\n");
-                master_log(STATUS_LOG, "Process_message: Mensagem START - NOT_OK.");
-            }
-            if (result == TIMEOUT) {
-                fprintf(stderr,"Mensagem START - TIME_OUT.\n");
-                master_log(STATUS_LOG, "Process_message: Mensagem START - TIME_OUT.");
-            }
+            sendcommand_async(&from_parser, report_command, NULL);
         }
         else {
             fprintf(stderr,"START ja foi implementado.\n");
@@ -535,34 +801,23 @@ void process_message(void)
         if (global.state == RUNNING) {
             global.state =(fdc_state_t) STOPPED;
             
-            // Para a thread de coleta de dados e espera pelo seu fim
-            sem_wait(&global.end_thread_save_data);
-            if (global.end_save_data != STOPPED) { // Se a thread esta viva
-                global.end_save_data = STOPPED;
-                sem_post(&global.end_thread_save_data);// Libera o semaforo
+            // Para a thread de coleta de dados, se ela esta viva, e espera pelo seu fim
+            if (stop_save_data() != 0)
+                master_log(ERROR_LOG,"Process_message: Falha ao terminar a thread durante STOP.");
             
-                if (pthread_join(global.salva_dados,NULL) != 0)
-                    master_log(ERROR_LOG,"Process_message: Falha ao terminar a thread durante STOP.");
+            // Contadores dos dispositivos no fim do voo, no seu diretorio
+            if (global.counters != NULL) {
+                char nome[MAX_STRLEN+16];
+                
+                sem_wait(&global.file_names);
+                snprintf(nome,sizeof(nome),"%s%s",global.dir_name,COUNTERS_FILE);
+                sem_post(&global.file_names);
+                write_counters(nome);
             }
-            else    // Libera o semaforo
-                sem_post(&global.end_thread_save_data);
             
             // Muda a prioridade de 'fdc_master' para o default 0.
             setpriority(PRIO_PROCESS,0,0);    
-            result = sendcommand(&from_parser);    
-            
-            if (result == OK) {
-                fprintf(stderr,"Mensagem STOP - OK.\n");
-                master_log(STATUS_LOG, "Process_message: Mensagem STOP - OK.");
-            }
-            if (result == NOT_OK) {
-                fprintf(stderr,"Mensagem STOP - NOT_OK.\n");
-                master_log(STATUS_LOG, "Process_message: Mensagem STOP - NOT_OK.");
-            }
-            if (result == TIMEOUT) {
-                fprintf(stderr,"Mensagem STOP - TIME_OUT.\n");
-                master_log(STATUS_LOG, "Process_message: Mensagem STOP - TIME_OUT.");
-            }
+            sendcommand_async(&from_parser, report_command, NULL);
         }
         else {
             fprintf(stderr,"STOP ja foi implementado.\n");
@@ -575,62 +830,64 @@ void process_message(void)
         case QUIT:
             // Espera pelo fim da thread
             if (global.state == RUNNING) {
-                // Para a thread de coleta de dados e espera pelo seu fim
-                sem_wait(&global.end_thread_save_data);
-                if (global.end_save_data != STOPPED) { // Se a thread esta viva
-                    global.end_save_data = STOPPED;
-                    sem_post(&global.end_thread_save_data);// Libera o semaforo
-                
-                    if (pthread_join(global.salva_dados,NULL) != 0)
-                        master_log(ERROR_LOG,"Process_message: Falha ao terminar a thread durante STOP.");
-                }
-                else    // Libera o semaforo
-                    sem_post(&global.end_thread_save_data);
+                // Para a thread de coleta de dados, se ela esta viva, e espera pelo seu fim
+                if (stop_save_data() != 0)
+                    master_log(ERROR_LOG,"Process_message: Falha ao terminar a thread durante STOP.");
             }
             
             global.state = QUITTED;
             
             // Muda a prioridade de 'fdc_master' para o default 0.
             setpriority(PRIO_PROCESS,0,0);    
+            // O programa termina em seguida: espera pela resposta (e pelas dos
+            // comandos enviados antes)
             result = sendcommand(&from_parser);
-                
-            if (result == OK) {                
-                fprintf(stderr,"Mensagem QUIT - OK.\n");
-                master_log(STATUS_LOG, "Process_message: Mensagem QUIT - OK.");
-            }
-            if (result == NOT_OK) {
-                fprintf(stderr,"Mensagem QUIT - NOT_OK.\n");
-                master_log(STATUS_LOG, "Process_message: Mensagem QUIT - NOT_OK.");
-            }
-            if (result == TIMEOUT) {
-                fprintf(stderr,"Mensagem QUIT - TIME_OUT.\n");
-                master_log(STATUS_LOG, "Process_message: Mensagem QUIT - TIME_OUT.");
-            }
+            report_command(&from_parser.msg, result, NULL);
         
             global.theend = 1;
-            
-            // Escreve na variavel de fim da thread
-            sem_wait(&global.end_thread_save_data);
-            global.end_save_data = STOPPED;
-            sem_post(&global.end_thread_save_data);
     
         break;
         ///////////////////////////////////////////////////////////////////////
         // Muda o nome do arquivo de dados
         case CHANGEDATFILE:
         
-            // Para a thread de coleta de dados e espera pelo seu fim
-            sem_wait(&global.end_thread_save_data);
-            global.end_save_data = STOPPED;
-            sem_post(&global.end_thread_save_data);
-            
+            // Durante a gravacao o nome eh trocado sem parar a coleta: a thread de
+            // salvamento abre os novos arquivos (um novo segmento, no mesmo diretorio)
+            // e troca de arquivos entre dois registros
             if (global.state == RUNNING) {
-                if (pthread_join(global.salva_dados,NULL)!= 0)
-                    master_log(ERROR_LOG,"Process_message: Falha ao terminar a thread durante CHANGEDATFILE.");
+                char *nome = NULL;
                 
-                global.state =(fdc_state_t) STOPPED;
+                sem_wait(&global.file_names);
+                if (from_parser.msg.option == DAQ)
+                    nome = global.file_daq_name;
+                else if (from_parser.msg.option == AHRS)
+                    nome = global.file_ahrs_name;
+                else if (from_parser.msg.option == GPS)
+                    nome = global.file_gps_name;
+                else if (from_parser.msg.option == NAV)
+                    nome = global.file_nav_name;
+                else if (from_parser.msg.option == PITOT)
+                    nome = global.file_pitot_name;
+                if (nome != NULL) {
+                    strncpy(nome,from_parser.name,MAX_STRLEN-1);
+                    nome[MAX_STRLEN-1] = '\0';
+                }
+                sem_post(&global.file_names);
+                
+                request_rotation();
+                
+                fprintf(stderr,"Novo segmento dos arquivos de dados - %s.\n",from_parser.name);
+                master_log(STATUS_LOG, "Process_message: Mensagem CHANGEDATFILE - novo segmento.");
+                break;
             }
             
+            // Para a thread de coleta de dados e espera pelo seu fim
+            if (stop_save_data() != 0)
+                master_log(ERROR_LOG,"Process_message: Falha ao terminar a thread durante CHANGEDATFILE.");
+            
+            if (global.state == RUNNING)
+                global.state =(fdc_state_t) STOPPED;
+            
             // Espera para poder acessar os nomes de arquivos
             sem_wait(&global.file_names); 
             
@@ -680,8 +937,10 @@ void process_message(void)
             if (global.state == STOPPED) {
                 global.state = RUNNING;
                 
-            // Lanca thread novamente para armazenar os dados coletados no novo arquivo
-                if (pthread_create(&global.salva_dados, NULL, save_data, (void*)0) != 0) {
+            // Lanca thread novamente para armazenar os dados coletados no novo arquivo,
+            // como no START: start_save_data() marca a thread como ativa antes de cria-la,
+            // para que o proximo STOP espere por ela
+                if (start_save_data() != 0) {
                     master_log(ERROR_LOG, "Process_message: Erro ao criar a thread para salvar os dados apos comando CHANGEDATFILE.(exit)");
                     fprintf(stderr,"Erro ao criar novamente a thread para salvar os dados\n");
                     terminate(0);
@@ -695,250 +954,402 @@ void process_message(void)
              
         break;
         ///////////////////////////////////////////////////////////////////////
-        // Cancela a coleta de dados de um dos dispositivos
-        case NODATA:
-            
-            // Envia o comando para o modulo 
-            result = sendcommand(&from_parser);    
+        // Muda o formato dos arquivos de dados (texto ou binario)
+        case CHANGEFORMAT:
+        
+            // Espera para poder acessar a configuracao dos arquivos
+            sem_wait(&global.file_names);
             
-            // Retorna o status de acordo com a option
-            if (from_parser.msg.option == DAQ) { 
-                if (result == OK) {
-                    fprintf(stderr,"Mensagem NODATA DAQ - OK.\n");
-                    master_log(STATUS_LOG, "Process_message: Mensagem NODATA DAQ - OK.");
-                }
-                if (result == NOT_OK) {
-                    fprintf(stderr,"Mensagem NODATA DAQ - NOT_OK.\n");
-                    master_log(STATUS_LOG, "Process_message: Mensagem NODATA DAQ - NOT_OK.");
-                }
-                if (result == TIMEOUT) {
-                    fprintf(stderr,"Mensagem NODATA DAQ - TIME_OUT.\n");
-                    master_log(STATUS_LOG, "Process_message: Mensagem NODATA DAQ - TIME_OUT.");
-                }
+            if (from_parser.msg.data == FORMAT_BINARY) {
+                global.log_format = FORMAT_BINARY;
+                fprintf(stderr,"Formato dos arquivos de dados - BINARIO.\n");
+                master_log(STATUS_LOG, "Process_message: Mudanca de formato dos arquivos de dados (BINARIO).");
             }
-            
-            if (from_parser.msg.option == AHRS) { 
-                if (result == OK) {
-                    fprintf(stderr,"Mensagem NODATA AHRS - OK.\n");
-                    master_log(STATUS_LOG, "Process_message: Mensagem NODATA AHRS - OK.");
-                }
-                if (result == NOT_OK) {
-                    fprintf(stderr,"Mensagem NODATA AHRS - NOT_OK.\n");
-                    master_log(STATUS_LOG, "Process_message: Mensagem NODATA AHRS - NOT_OK.");
-                }
-                if (result == TIMEOUT) {
-                    fprintf(stderr,"Mensagem NODATA AHRS - TIME_OUT.\n");
-                    master_log(STATUS_LOG, "Process_message: Mensagem NODATA AHRS - TIME_OUT.");
-                }
+            else if (from_parser.msg.data == FORMAT_JOURNAL) {
+                global.log_format = FORMAT_JOURNAL;
+                fprintf(stderr,"Formato dos arquivos de dados - BLOCOS.\n");
+                master_log(STATUS_LOG, "Process_message: Mudanca de formato dos arquivos de dados (BLOCOS).");
+            }
+            else if (from_parser.msg.data == FORMAT_COMPRESSED) {
+                global.log_format = FORMAT_COMPRESSED;
+                fprintf(stderr,"Formato dos arquivos de dados - COMPRIMIDO.\n");
+                master_log(STATUS_LOG, "Process_message: Mudanca de formato dos arquivos de dados (COMPRIMIDO).");
+            }
+            else {
+                global.log_format = FORMAT_TEXT;
+                fprintf(stderr,"Formato dos arquivos de dados - TEXTO.\n");
+                master_log(STATUS_LOG, "Process_message: Mudanca de formato dos arquivos de dados (TEXTO).");
             }
             
-            if (from_parser.msg.option == GPS) { 
-                if (result == OK) {
-                    fprintf(stderr,"Mensagem NODATA GPS - OK.\n");
-                    master_log(STATUS_LOG, "Process_message: Mensagem NODATA GPS - OK.");
-                }
-                if (result == NOT_OK) {
-                    fprintf(stderr,"Mensagem NODATA GPS - NOT_OK.\n");
-                    master_log(STATUS_LOG, "Process_message: Mensagem NODATA GPS - NOT_OK.");
-                }
-                if (result == TIMEOUT) {
-                    fprintf(stderr,"Mensagem NODATA GPS - TIME_OUT.\n");
-                    master_log(STATUS_LOG, "Process_message: Mensagem NODATA GPS - TIME_OUT.");
-                }
+            sem_post(&global.file_names); // libera o semaforo
+            
+            // O voo em andamento continua no formato em que foi iniciado
+            if (global.state == RUNNING)
+                fprintf(stderr,"O novo formato sera usado a partir do proximo START.\n");
+            
+        break;
+        ///////////////////////////////////////////////////////////////////////
+        // Muda o tempo maximo de permanencia dos dados nos buffers dos arquivos
+        case CHANGEFLUSH:
+        
+            sem_wait(&global.file_names);
+            global.flush_ms = (from_parser.msg.data < 0) ? 0 : from_parser.msg.data;
+            sem_post(&global.file_names);
+            
+            fprintf(stderr,"Intervalo de escrita dos arquivos de dados - %d ms.\n",global.flush_ms);
+            master_log(STATUS_LOG, "Process_message: Mudanca do intervalo de escrita dos arquivos de dados.");
+            
+        break;
+        ///////////////////////////////////////////////////////////////////////
+        // Liga ou desliga o fdatasync() apos cada escrita dos buffers dos arquivos
+        case CHANGESYNC:
+        
+            sem_wait(&global.file_names);
+            global.sync_data = (from_parser.msg.data != 0);
+            sem_post(&global.file_names);
+            
+            fprintf(stderr,"Sincronizacao dos arquivos de dados a cada escrita - %s.\n",
+                global.sync_data ? "LIGADA" : "DESLIGADA");
+            master_log(STATUS_LOG, "Process_message: Mudanca da sincronizacao dos arquivos de dados.");
+            
+        break;
+        ///////////////////////////////////////////////////////////////////////
+        // Muda a duracao esperada do voo para a preallocacao dos arquivos (0 desliga)
+        case CHANGEPREALLOC:
+        
+            sem_wait(&global.file_names);
+            global.prealloc_min = (from_parser.msg.data < 0) ? 0 : from_parser.msg.data;
+            sem_post(&global.file_names);
+            
+            if (global.prealloc_min > 0)
+                fprintf(stderr,"Arquivos de dados mapeados em memoria, preallocados para %d min.\n",global.prealloc_min);
+            else
+                fprintf(stderr,"Arquivos de dados escritos por buffers (sem preallocacao).\n");
+            master_log(STATUS_LOG, "Process_message: Mudanca da preallocacao dos arquivos de dados.");
+            
+        break;
+        ///////////////////////////////////////////////////////////////////////
+        // Muda o intervalo (min) da troca automatica de segmento dos arquivos (0 desliga)
+        case CHANGEROTATE:
+        
+            sem_wait(&global.file_names);
+            global.rotate_min = (from_parser.msg.data < 0) ? 0 : from_parser.msg.data;
+            sem_post(&global.file_names);
+            
+            if (global.rotate_min > 0)
+                fprintf(stderr,"Novo segmento dos arquivos de dados a cada %d min.\n",global.rotate_min);
+            else
+                fprintf(stderr,"Troca de segmento por tempo desligada.\n");
+            master_log(STATUS_LOG, "Process_message: Mudanca do intervalo de troca de segmento dos arquivos.");
+            
+        break;
+        ///////////////////////////////////////////////////////////////////////
+        // Muda o tamanho (MB) da troca automatica de segmento dos arquivos (0 desliga)
+        case CHANGEROTATESIZE:
+        
+            sem_wait(&global.file_names);
+            global.rotate_mb = (from_parser.msg.data < 0) ? 0 : from_parser.msg.data;
+            sem_post(&global.file_names);
+            
+            if (global.rotate_mb > 0)
+                fprintf(stderr,"Novo segmento dos arquivos de dados a cada %d MB.\n",global.rotate_mb);
+            else
+                fprintf(stderr,"Troca de segmento por tamanho desligada.\n");
+            master_log(STATUS_LOG, "Process_message: Mudanca do tamanho de troca de segmento dos arquivos.");
+            
+        break;
+        ///////////////////////////////////////////////////////////////////////
+        // Escreve os histogramas de latencia das amostras no diretorio do voo atual (ou do
+        // ultimo) e os resume no log
+        case LATENCY:
+        {
+            char nome[MAX_STRLEN+16] = "";
+            
+            sem_wait(&global.file_names);
+            if (global.dir_name[0] != '\0')
+                snprintf(nome,sizeof(nome),"%s%s",global.dir_name,LATENCY_FILE);
+            sem_post(&global.file_names);
+            
+            if (save_latency_report((nome[0] != '\0') ? nome : NULL) == 0)
+                fprintf(stderr,"Latencias das amostras em %s.\n",(nome[0] != '\0') ? nome : LOG_FILE);
+            else
+                fprintf(stderr,"Erro na escrita das latencias das amostras.\n");
+        }
+        break;
+        ///////////////////////////////////////////////////////////////////////
+        // Escreve os contadores de erros e perdas dos dispositivos no diretorio do voo
+        // atual (ou do ultimo), ou apenas no log se ainda nao houve voo
+        case COUNTERS:
+        {
+            char nome[MAX_STRLEN+16] = "";
+            
+            sem_wait(&global.file_names);
+            if (global.dir_name[0] != '\0')
+                snprintf(nome,sizeof(nome),"%s%s",global.dir_name,COUNTERS_FILE);
+            sem_post(&global.file_names);
+            
+            if (write_counters((nome[0] != '\0') ? nome : NULL) == 0)
+                fprintf(stderr,"Contadores dos dispositivos em %s.\n",(nome[0] != '\0') ? nome : LOG_FILE);
+            else
+                fprintf(stderr,"Erro na escrita dos contadores dos dispositivos.\n");
+        }
+        break;
+        ///////////////////////////////////////////////////////////////////////
+        // Escreve os ultimos segundos (data, 0 para todo o historico) das amostras guardadas
+        // em memoria no destino pedido (diretorio ou socket local) ou no diretorio do voo
+        // atual (ou do ultimo). A coleta continua enquanto o historico eh copiado.
+        case HISTORY:
+        {
+            char nome[MAX_STRLEN+16] = "";
+            char texto[2*MAX_STRLEN+64];
+            long n;
+            
+            if (from_parser.name[0] != '\0')
+                strcpy(nome,from_parser.name);
+            else {
+                sem_wait(&global.file_names);
+                strcpy(nome,(global.dir_name[0] != '\0') ? global.dir_name : ".");
+                sem_post(&global.file_names);
             }
             
-            if (from_parser.msg.option == NAV) { 
-                if (result == OK) {
-                    fprintf(stderr,"Mensagem NODATA NAV - OK.\n");
-                    master_log(STATUS_LOG, "Process_message: Mensagem NODATA NAV - OK.");
-                }
-                if (result == NOT_OK) {
-                    fprintf(stderr,"Mensagem NODATA NAV - NOT_OK.\n");
-                    master_log(STATUS_LOG, "Process_message: Mensagem NODATA NAV - NOT_OK.");
-                }
-                if (result == TIMEOUT) {
-                    fprintf(stderr,"Mensagem NODATA NAV - TIME_OUT.\n");
-                    master_log(STATUS_LOG, "Process_message: Mensagem NODATA NAV - TIME_OUT.");
-                }
+            if ((n = history_dump(nome,from_parser.msg.data)) >= 0) {
+                fprintf(stderr,"Historico das amostras em %s (%ld registros).\n",nome,n);
+                snprintf(texto,sizeof(texto),"Process_message: Historico das amostras (%d s) em %s, %ld registros.",
+                         from_parser.msg.data,nome,n);
+                master_log(STATUS_LOG,texto);
             }
-
-            if (from_parser.msg.option == PITOT) { 
-                if (result == OK) {
-                    fprintf(stderr,"Mensagem NODATA PITOT - OK.\n");
-                    master_log(STATUS_LOG, "Process_message: Mensagem NODATA PITOT - OK.");
-                }
-                if (result == NOT_OK) {
-                    fprintf(stderr,"Mensagem NODATA PITOT - NOT_OK.\n");
-                    master_log(STATUS_LOG, "Process_message: Mensagem NODATA PITOT - NOT_OK.");
-                }
-                if (result == TIMEOUT) {
-                    fprintf(stderr,"Mensagem NODATA PITOT - TIME_OUT.\n");
-                    master_log(STATUS_LOG, "Process_message: Mensagem NODATA PITOT - TIME_OUT.");
-                }
+            else {
+                fprintf(stderr,"Erro na escrita do historico das amostras.\n");
+                snprintf(texto,sizeof(texto),"Process_message: Erro na escrita do historico das amostras em %s.",nome);
+                master_log(ERROR_LOG,texto);
             }
+        }
+        break;
+        ///////////////////////////////////////////////////////////////////////
+        // Cancela a coleta de dados de um dos dispositivos
+        case NODATA:
+            
+            // Envia o comando para o modulo; o resultado eh reportado quando chegar
+            // a resposta (report_command)
+            sendcommand_async(&from_parser, report_command, NULL);
 
         break;
         ///////////////////////////////////////////////////////////////////////
         // Inicia a filtragem dos dados
         case FILTER_ON:
         
-            result = sendcommand(&from_parser);    
-            
-            if (result == OK) {
-                fprintf(stderr,"Mensagem FILTER_ON - OK.\n");
-                master_log(STATUS_LOG, "Process_message: Mensagem FILTER_ON - OK.");
-            }
-            if (result == NOT_OK) {
-                fprintf(stderr,"Mensagem FILTER_ON - NOT_OK.\n");
-                master_log(STATUS_LOG, "Process_message: Mensagem FILTER_ON - NOT_OK.");
-            }
-            if (result == TIMEOUT) {
-                fprintf(stderr,"Mensagem FILTER_ON - TIME_OUT.\n");
-                master_log(STATUS_LOG, "Process_message: Mensagem FILTER_ON - TIME_OUT.");
-            }
+            sendcommand_async(&from_parser, report_command, NULL);
         break;
         ///////////////////////////////////////////////////////////////////////
         // Desabilita a filtragem dos dados
         case FILTER_OFF:
         
-            result = sendcommand(&from_parser);    
-            
-            if (result == OK) {
-                fprintf(stderr,"Mensagem FILTER_OFF - OK.\n");
-                master_log(STATUS_LOG, "Process_message: Mensagem FILTER_OFF - OK.");
-            }
-            if (result == NOT_OK) {
-                fprintf(stderr,"Mensagem FILTER_OFF - NOT_OK.\n");
-                master_log(STATUS_LOG, "Process_message: Mensagem FILTER_OFF - NOT_OK.");
-            }
-            if (result == TIMEOUT) {
-                fprintf(stderr,"Mensagem FILTER_OFF - TIME_OUT.\n");
-                master_log(STATUS_LOG, "Process_message: Mensagem FILTER_OFF - TIME_OUT.");
-            }
+            sendcommand_async(&from_parser, report_command, NULL);
         break;
         ///////////////////////////////////////////////////////////////////////
         // Inicia a filtragem dos dados
         case RESET_GPS:
         
-            result = sendcommand(&from_parser);    
-            
-            if (result == OK) {
-                fprintf(stderr,"Mensagem RESET_GPS - OK.\n");
-                master_log(STATUS_LOG, "Process_message: Mensagem RESET_GPS - OK.");
-            }
-            if (result == NOT_OK) {
-                fprintf(stderr,"Mensagem RESET_GPS - NOT_OK.\n");
-                master_log(STATUS_LOG, "Process_message: Mensagem RESET_GPS - NOT_OK.");
-            }
-            if (result == TIMEOUT) {
-                fprintf(stderr,"Mensagem RESET_GPS - TIME_OUT.\n");
-                master_log(STATUS_LOG, "Process_message: Mensagem RESET_GPS - TIME_OUT.");
-            }
+            sendcommand_async(&from_parser, report_command, NULL);
         break;
         ///////////////////////////////////////////////////////////////////////
         default: 
         
         break;
     } // end switch
+    
+    return 1;
 }
 /*!*******************************************************************************************
 *********************************************************************************************/
-/*    Esta funcao envia um comando para o modulo de tempo real e permanece a espera da 
- resposta deste comando de forma bloqueada. */
-cmd_status_t sendcommand(parser_cmd_msg_t* parser_msg_to_rt)
+/*    Comandos enviados ao fdc_slave que aguardam resposta. O numero de sequencia de cada
+ comando volta na resposta, o que permite varios comandos em andamento e impede que uma
+ resposta atrasada seja tomada pela de outro comando. */
+static struct {
+    int usado;
+    cmd_msg_t cmd;
+    long long prazo;    // log_now_ns() em que o comando expira
+    cmd_done_t done;
+    void *arg;
+} pendentes[CMD_MAX_PENDING];
+
+static unsigned int proxima_seq = 1;
+
+/*    Envia um comando para o modulo de tempo real sem esperar pela resposta. A funcao done
+ eh chamada (por receive_replies() ou expire_commands(), no loop principal) com o resultado
+ do comando, ou ja aqui com NOT_OK se o comando nao pode ser enviado. Retorna 0 se o
+ comando foi enviado e -1 caso contrario. */
+int sendcommand_async(parser_cmd_msg_t* parser_msg_to_rt, cmd_done_t done, void *arg)
 {
-    cmd_status_t msg_from_slave;  // Retorna o status de leitura
-    cmd_msg_t cmd_to_slave;    // Mensagem enviada contendo opcoes e comandos 
-    int n, i;
-            
+    int i;
+    
     // Fatora a menssagem recebida do parser, isolando somente a parte de comando (.msg)
-    cmd_to_slave = parser_msg_to_rt->msg;
+    cmd_msg_t cmd_to_slave = parser_msg_to_rt->msg;
+    
+    for (i = 0; (i < CMD_MAX_PENDING) && pendentes[i].usado; i++);
+    if (i == CMD_MAX_PENDING) {
+        master_log(ERROR_LOG,"Sendcommand: Comandos demais aguardando resposta do fdc_slave.");
+        done(&cmd_to_slave, NOT_OK, arg);
+        return -1;
+    }
+    
+    // Zero nao eh usado, para distinguir mensagens que nao passaram por aqui
+    cmd_to_slave.seq = proxima_seq++;
+    if (proxima_seq == 0)
+        proxima_seq = 1;
     
     // Escrita na fifo de controle de modo nao-bloqueante
-    write(global.fifo_control,&cmd_to_slave, sizeof(cmd_to_slave));
-            
-    for (i=0; i<10; i++) {
-        usleep(10000); // Dorme cerca de 10 ms 
+    if (write(global.fifo_control,&cmd_to_slave, sizeof(cmd_to_slave)) != sizeof(cmd_to_slave)) {
+        master_log(ERROR_LOG,"Sendcommand: Falha ao escrever na FIFO de controle.");
+        done(&cmd_to_slave, NOT_OK, arg);
+        return -1;
+    }
+    
+    pendentes[i].usado = 1;
+    pendentes[i].cmd = cmd_to_slave;
+    pendentes[i].prazo = log_now_ns() + CMD_TIMEOUT_MS*1000000LL;
+    pendentes[i].done = done;
+    pendentes[i].arg = arg;
+    
+    return 0;
+}
 
-        // Efetua agora a leitura da resposta de forma nao-bloqueante
-        n = read(global.fifo_status, &msg_from_slave, sizeof(msg_from_slave));
+/*    Le todas as respostas que estao na FIFO de status e completa os comandos a que elas
+ se referem. Retorna o numero de comandos completados. */
+int receive_replies(void)
+{
+    cmd_reply_t reply;
+    char texto[MAX_STRLEN+32];
+    int i, n = 0;
     
-        if (n == sizeof(msg_from_slave))
-            return msg_from_slave; // Retorna a mensagem recebida
+    while (read(global.fifo_status, &reply, sizeof(reply)) == sizeof(reply)) {
+        for (i = 0; i < CMD_MAX_PENDING; i++)
+            if (pendentes[i].usado && (pendentes[i].cmd.seq == reply.seq) && (pendentes[i].cmd.cmd == reply.cmd))
+                break;
+        
+        // Resposta a um comando que ja expirou (ou desconhecido): descartada
+        if (i == CMD_MAX_PENDING) {
+            snprintf(texto,sizeof(texto),"Receive_replies: Resposta atrasada do fdc_slave (seq %u) descartada.",reply.seq);
+            master_log(STATUS_LOG,texto);
+            continue;
+        }
+        
+        // A entrada eh liberada antes da chamada, que pode enviar outro comando
+        pendentes[i].usado = 0;
+        pendentes[i].done(&pendentes[i].cmd, reply.status, pendentes[i].arg);
+        n++;
     }
     
-    // Caso nao tenha conseguido efetuar a leitura, retorna um erro de comunicacao
-    return TIMEOUT;
+    return n;
 }
-/*!*******************************************************************************************
-*********************************************************************************************/
-/*    Efetua o log do sistema, salvando em arquivo as mensagens de erro e status.
-    - type_message = STATUS_LOG (messagem de status) ou ERROR_LOG (mensagem de erro).*/
-int master_log(int type_message, const char* msg)
+
+/*    Completa com TIMEOUT os comandos cujo prazo de resposta expirou. Retorna o numero de
+ comandos expirados. */
+int expire_commands(void)
 {
-    time_t time_log;     
-    char *time_log_char;
-    
-    // Pega o tempo de execussao do sistema e o salva no arquivo de log
-    time_log = time(NULL);
-    time_log_char = ctime(&time_log);
+    long long agora = log_now_ns();
+    cmd_msg_t cmd;
+    int i, n = 0;
     
-    // Requisita o semaforo
-    sem_wait(&global.sem_log_file);
+    for (i = 0; i < CMD_MAX_PENDING; i++)
+        if (pendentes[i].usado && (pendentes[i].prazo <= agora)) {
+            cmd = pendentes[i].cmd;
+            pendentes[i].usado = 0;
+            pendentes[i].done(&cmd, TIMEOUT, pendentes[i].arg);
+            n++;
+        }
     
-    // Imprime o tempo 
-    fprintf(global.log_file,"%s\t",time_log_char);
+    return n;
+}
+
+/*    Tempo (ms) ate o proximo prazo de resposta, para o poll() do loop principal, ou -1 se
+ nenhum comando aguarda resposta. */
+int command_timeout_ms(void)
+{
+    long long agora = log_now_ns(), menor = -1;
+    int i;
     
-    // Imprime mensagem no arquivo de LOG.
-    fprintf(global.log_file,msg);
+    for (i = 0; i < CMD_MAX_PENDING; i++)
+        if (pendentes[i].usado && ((menor < 0) || (pendentes[i].prazo - agora < menor)))
+            menor = (pendentes[i].prazo > agora) ? pendentes[i].prazo - agora : 0;
     
-    if (type_message == STATUS_LOG)
-        fprintf(global.log_file,"\n\n");
+    // Arredonda para cima, para nao acordar antes do prazo
+    return (menor < 0) ? -1 : (int)((menor + 999999)/1000000);
+}
 
-    if (type_message == ERROR_LOG)
-        // Imprime tambem o numero do ultimo erro (errno).
-        fprintf(global.log_file,"> %s.\n\n",strerror(errno));
-        
-    // Forca sempre a escrita dos dados no arquivo
-    fflush(global.log_file);
-        
-    // Libera o semaforo
-    sem_post(&global.sem_log_file);
+static void store_result(const cmd_msg_t *cmd, cmd_status_t result, void *arg)
+{
+    *(cmd_status_t *)arg = result;
+}
+
+/*    Esta funcao envia um comando para o modulo de tempo real e permanece a espera da 
+ resposta deste comando de forma bloqueada. As respostas de outros comandos que chegam
+ durante a espera sao tratadas normalmente. */
+cmd_status_t sendcommand(parser_cmd_msg_t* parser_msg_to_rt)
+{
+    cmd_status_t result = (cmd_status_t)-1;
+    struct pollfd fds;
+    
+    if (sendcommand_async(parser_msg_to_rt, store_result, &result) != 0)
+        return result;
+    
+    while ((int)result == -1) {
+        fds.fd = global.fifo_status;
+        fds.events = POLLIN;
+        poll(&fds,1,command_timeout_ms());
         
-    return 0;
+        receive_replies();
+        expire_commands();
+    }
+    
+    return result;
+}
+/*!*******************************************************************************************
+*********************************************************************************************/
+/*    Efetua o log do sistema, salvando em arquivo as mensagens de erro e status.
+    - type_message = STATUS_LOG (messagem de status) ou ERROR_LOG (mensagem de erro).
+    A mensagem, a hora e o errno atual sao copiados para a fila da thread que chama,
+    sem bloquear; a thread de log os escreve no arquivo em lotes (ver async_log.h).
+    Retorna -1 se a fila estava cheia e a mensagem foi descartada. */
+int master_log(int type_message, const char* msg)
+{
+    return async_log_post(type_message, msg);
 }
 
 /*!*******************************************************************************************
 *********************************************************************************************/
 int load_modules (void) 
 {
-    if (system("modprobe rtai_serial") < 0)
-        master_log(ERROR_LOG, "Inicialize: Falha ao carregar modulo rtai_serial");
-    if (system("modprobe rtai_fifos") < 0)
-        master_log(ERROR_LOG, "Inicialize: Falha ao carregar modulo rtai_fifos");
-    if (system("modprobe crc8") < 0)
-        master_log(ERROR_LOG, "Inicialize: Falha ao carregar modulo crc8");
-    
-    if (system("insmod ./object/rtai_daq.o") < 0)
-        master_log(ERROR_LOG, "Inicialize: Falha ao carregar modulo rtai_daq");
-    if (system("insmod ./object/rtai_gps.o") < 0)
-        master_log(ERROR_LOG, "Inicialize: Falha ao carregar modulo rtai_gps");
-    if (system("insmod ./object/rtai_ahrs.o") < 0)
-        master_log(ERROR_LOG, "Inicialize: Falha ao carregar modulo rtai_ahrs");
-    if (system("insmod ./object/rtai_nav.o") < 0)
-        master_log(ERROR_LOG, "Inicialize: Falha ao carregar modulo rtai_nav");
-    if (system("insmod ./object/rtai_pitot.o") < 0)
-        master_log(ERROR_LOG, "Inicialize: Falha ao carregar modulo rtai_pitot");
-    if (system("insmod ./object/modem.o") < 0)
-        master_log(ERROR_LOG, "Inicialize: Falha ao carregar modulo modem");
-    if (system("insmod ./object/epos.o") < 0)
-        master_log(ERROR_LOG, "Inicialize: Falha ao carregar modulo epos");
-    if (system("insmod ./object/fdc_slave.o") < 0)
-        master_log(ERROR_LOG, "Inicialize: Falha ao carregar modulo fdc_slave");
-    
-    master_log(STATUS_LOG, "Inicialize: modulos carregados.");
+    startup_timing_t linha[STARTUP_MAX_STEPS];
+    long long total;
+    char texto[MAX_STRLEN+64];
+    int i, falhas;
     
-    return 1;
+    // Carrega os modulos em paralelo, cada um assim que os modulos de que ele depende
+    // estao carregados (ver startup.h)
+    falhas = startup_run(startup_fdc_modules, startup_fdc_n_modules, startup_load_module, NULL, linha, &total);
+    if (falhas < 0) {
+        master_log(ERROR_LOG, "Inicialize: Dependencias invalidas entre os modulos.");
+        return 0;
+    }
+    
+    // Linha do tempo da carga dos modulos
+    for (i = 0; i < startup_fdc_n_modules; i++) {
+        snprintf(texto, sizeof(texto), "Inicialize: modulo %s de %.1f a %.1f ms (%s)%s",
+                 startup_fdc_modules[i].name, linha[i].start_ns/1e6, linha[i].end_ns/1e6,
+                 startup_state_name(linha[i].state), (linha[i].state == STARTUP_FAILED) ? ":" : ".");
+        if (linha[i].state == STARTUP_FAILED) {
+            errno = linha[i].error;
+            master_log(ERROR_LOG, texto);
+        }
+        else
+            master_log(STATUS_LOG, texto);
+    }
+    
+    snprintf(texto, sizeof(texto), "Inicialize: modulos carregados em %.1f ms (%d falhas).", total/1e6, falhas);
+    master_log(STATUS_LOG, texto);
+    
+    return (falhas == 0);
 }
 
 /*!*******************************************************************************************
@@ -951,35 +1362,11 @@ int unload_modules (void)
     close(global.fifo_control);
     close(global.fifo_status);
 
-    if (system("rmmod fdc_slave") < 0)
-        master_log(ERROR_LOG, "Terminate: Falha ao descarregar modulo fdc_slave");
-    if (system("rmmod rtai_pitot") < 0)
-        master_log(ERROR_LOG, "Terminate: Falha ao descarregar modulo rtai_pitot");
-    if (system("rmmod rtai_nav") < 0)
-        master_log(ERROR_LOG, "Terminate: Falha ao descarregar modulo rtai_nav");
-    if (system("rmmod rtai_gps") < 0)
-        master_log(ERROR_LOG, "Terminate: Falha ao descarregar modulo rtai_gps");
-    if (system("rmmod rtai_ahrs") < 0)
-        master_log(ERROR_LOG, "Terminate: Falha ao descarregar modulo rtai_ahrs");
-    if (system("rmmod rtai_daq") < 0)
-        master_log(ERROR_LOG, "Terminate: Falha ao descarregar modulo rtai_daq");
-    if (system("rmmod modem") < 0)
-        master_log(ERROR_LOG, "Terminate: Falha ao descarregar modulo modem");
-    if (system("rmmod epos") < 0)
-        master_log(ERROR_LOG, "Terminate: Falha ao descarregar modulo epos");
-    
-    /*
-    if (system("rmmod rtai_fifos") < 0)
-        master_log(ERROR_LOG, "Terminate: Falha ao descarregar modulo rtai_fifos");
-    if (system("rmmod rtai_serial") < 0)
-        master_log(ERROR_LOG, "Terminate: Falha ao descarregar modulo rtai_serial");
-    if (system("rmmod rtai_sem") < 0)
-        master_log(ERROR_LOG, "Terminate: Falha ao descarregar modulo rtai_sem");
-    if (system("rmmod rtai_ksched") < 0)
-        master_log(ERROR_LOG, "Terminate: Falha ao descarregar modulo rtai_ksched");
-    if (system("rmmod rtai_hal") < 0)
-        master_log(ERROR_LOG, "Terminate: Falha ao descarregar modulo rtai_hal");
-    */
+    // Descarrega os modulos na ordem inversa das dependencias; os modulos do sistema
+    // (rtai_fifos, rtai_serial, ...) continuam carregados
+    if (startup_unload(startup_fdc_modules, startup_fdc_n_modules) > 0)
+        master_log(ERROR_LOG, "Terminate: Falha ao descarregar modulos.");
+    
     master_log(STATUS_LOG, "Terminate: modulos descarregados.");
     
     return 1;
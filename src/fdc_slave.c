@@ -41,8 +41,44 @@ struct {
 
     // Sinaliza o fim da tarefa    
     int volatile end_slave;
+
+    // Atraso do despertar e estouros do periodo, resumidos a cada RT_JITTER_WINDOW periodos
+    rt_jitter_t jitter;
+
+    // Contadores dos dispositivos (dev_counters.h): o modulo conta as amostras perdidas
+    // com a FIFO ou o anel cheios. NULL se nao foi possivel aloca-los.
+    dev_counters_block_t* counters;
+
+#ifdef FDC_SHM_RINGS
+    // Aneis de amostras na memoria compartilhada, e amostras postas neste periodo
+    shm_region_t* rings;
+    int new_samples;
+#endif
 } global;
 
+/*!*******************************************************************************************
+*********************************************************************************************/
+///                ENVIO DAS AMOSTRAS
+/*!*******************************************************************************************
+*********************************************************************************************/
+/*    Poe uma amostra de um dispositivo na sua FIFO de dados ou, com FDC_SHM_RINGS, no seu
+anel da memoria compartilhada, de onde o fdc_master a le sem copia. Os aneis estao na ordem
+das FIFOs de dados. Uma amostra que nao cabe eh descartada, como quando a FIFO esta cheia,
+e contada nos contadores do dispositivo, que tambem estao na ordem das FIFOs de dados. */
+static void rt_put_sample(int fifo, const void* msg, int size)
+{
+    int ok;
+
+#ifdef FDC_SHM_RINGS
+    ok = shm_ring_put(global.rings, fifo, msg);
+    global.new_samples += ok;
+#else
+    ok = (rtf_put(fifo, (void*)msg, size) == size);
+#endif
+    if (!ok && (global.counters != NULL))
+        dev_count(&global.counters->devices[fifo].fifo_drops, 1);
+}
+
 /*!*******************************************************************************************
 *********************************************************************************************/
 ///                FUNCAO DA PLACA DAQ
@@ -60,7 +96,7 @@ static void rt_func_daq(configure *config)
 
         daq_msg.time_sys = rt_get_time_ns(); // Pega o tempo de coleta dos dados
      
-        rtf_put(RT_FIFO_DAQ, &daq_msg, sizeof(daq_msg)); //Poem na fila
+        rt_put_sample(RT_FIFO_DAQ, &daq_msg, sizeof(daq_msg)); //Poem na fila
         if (config->modem_enable) modem_send_daq_data(&daq_msg);
     }
 }
@@ -83,7 +119,7 @@ static void rt_func_gps(configure* config)
 
         msg.time_sys = rt_get_time_ns(); // Pega o tempo de coleta dos dados
    
-        rtf_put(RT_FIFO_GPS, &msg, sizeof(msg)); //Poe na fila
+        rt_put_sample(RT_FIFO_GPS, &msg, sizeof(msg)); //Poe na fila
    if (config->modem_enable) modem_send_gps_data(&msg);
     }
 }
@@ -98,7 +134,7 @@ static void rt_func_ahrs(configure* config){
     //Se a coleta de dados do ahrs estiver ativa
     if(config->ahrs_enable) {
         msg.validade = rt_get_ahrs_data(&msg); //Busca os dados do ahrs
-        rtf_put(RT_FIFO_AHRS, &msg, sizeof(msg)); // poe na fila
+        rt_put_sample(RT_FIFO_AHRS, &msg, sizeof(msg)); // poe na fila
    if (config->modem_enable) modem_send_ahrs_data(&msg);
     }
     return (void)0;
@@ -113,7 +149,7 @@ static void rt_func_nav(configure* config){
     //Se a coleta de dados do ahrs estiver ativa
     if(config->nav_enable) {
         nav_msg.validade = rt_get_nav_data(&nav_msg); //Busca os dados do nav
-        rtf_put(RT_FIFO_NAV, &nav_msg, sizeof(nav_msg)); // poe na fila
+        rt_put_sample(RT_FIFO_NAV, &nav_msg, sizeof(nav_msg)); // poe na fila
         if (config->modem_enable) modem_send_nav_data(&nav_msg);
     }
     
@@ -131,7 +167,7 @@ static void rt_func_pitot(configure* config){
     if(config->pitot_enable) {
         msg.validade = rt_get_pitot_data(&msg); //Busca os dados do nav
         msg.time_sys = rt_get_time_ns(); //Pega o tempo de coleta dos dados
-        rtf_put(RT_FIFO_PITOT, &msg, sizeof(msg)); // poe na fila
+        rt_put_sample(RT_FIFO_PITOT, &msg, sizeof(msg)); // poe na fila
    if (config->modem_enable) modem_send_pitot_data(&msg);
     }
     return (void)0;
@@ -198,19 +234,21 @@ static void rt_func_modem(configure *config) {
 /*!*******************************************************************************************
 *********************************************************************************************/
 /*    Esta funcao trata os comandos de controle enviados pelo programa mestre (fdc_master) e
-reporta a este a resposta ao comando por meio da fifo de status.*/
+reporta a este a resposta ao comando por meio da fifo de status. Todos os comandos que
+estao na fifo sao tratados no mesmo periodo (ate MAX_CMDS_PER_TICK), e cada resposta leva
+o numero de sequencia do seu comando. Retorna o numero de comandos tratados.*/
 static int rt_func_control(configure * config)
 {
-    int n;
+    int tratados = 0;
     cmd_status_t result;
+    cmd_reply_t reply;
     cmd_msg_t from_master; // Messagem do tipo parser_cmd_msg_t, porem sem o topico de caracters
 
 
     // Le a fifo de comunicacao entre 'fdc_master' e 'fdc_slave'.
     // Somente leh os bytes se os mesmos compuserem uma mensagem completa.
-    n = rtf_get(RT_FIFO_CONTROL, &from_master, sizeof(from_master)); //Le da fila de controle
-
-    if (n == sizeof(from_master)) { // Trata a mensagem recebida
+    while ((tratados < MAX_CMDS_PER_TICK) &&
+           (rtf_get(RT_FIFO_CONTROL, &from_master, sizeof(from_master)) == sizeof(from_master))) {
         switch (from_master.cmd) {
             case START:
                 // Habilita todas as funcoes do modulo
@@ -276,17 +314,17 @@ static int rt_func_control(configure * config)
             break;
         } // end switch
         
-        //Poe na fila de status o resultado do comando
-        if (rtf_put(RT_FIFO_STATUS, &result, sizeof(result)) == sizeof(result))
-            return 0; // Sucesso
-        else {
-            result = NOT_OK; 
-            rtf_put(RT_FIFO_STATUS, &result, sizeof(result)); 
-            return 1; // Fracasso
-        }
-    } // end if
+        //Poe na fila de status o resultado do comando. Se a fila estiver cheia a
+        //resposta se perde, e o fdc_master acusa TIMEOUT para este comando.
+        reply.seq = from_master.seq;
+        reply.cmd = from_master.cmd;
+        reply.status = result;
+        rtf_put(RT_FIFO_STATUS, &reply, sizeof(reply));
+        
+        tratados++;
+    } // end while
     
-    return 1; // Fracasso
+    return tratados;
 }
 
 int control_action() {
@@ -372,12 +410,15 @@ static void func_fdc_slave(int t)
     
     while (!global.end_slave) { // Enquanto nao for determinado o fim do modulo
 
+        // Instante do despertar, comparado com o instante previsto
+        rt_jitter_wakeup(&global.jitter, rt_get_time_ns());
+
         // Incrementa os contadores do escalonador
         count_gps++;
         //count_modem++;
         //count_modem_recev++;
 
-        // Recebe comandos do fdc_master com uma frequencia maxima de 50 Hz
+        // Recebe todos os comandos pendentes do fdc_master, a cada periodo (50 Hz)
         rt_func_control(&config);
 
         // Acessa a placa daq com uma frequencia maxima de 50 Hz
@@ -403,12 +444,29 @@ static void func_fdc_slave(int t)
         
    //Manda o comando para os servos
    rt_func_servos(&config);
+
+#ifdef FDC_SHM_RINGS
+        // Um unico aviso por periodo acorda o fdc_master para ler todos os aneis
+        if (global.new_samples > 0) {
+            char aviso = 0;
+
+            rtf_put(RT_FIFO_RINGS, &aviso, sizeof(aviso));
+            global.new_samples = 0;
+        }
+#endif
         
         //if (count_modem_recev >= _01_HZ){
         //    rt_func_modem_recev();
         //    count_modem_recev = 0;
         //}
 
+        // Fim do trabalho do periodo. A cada RT_JITTER_WINDOW periodos o resumo vai para o
+        // fdc_master; se a FIFO estiver cheia ele eh perdido, sem esperar.
+        if (rt_jitter_done(&global.jitter, rt_get_time_ns())) {
+            rtf_put(RT_FIFO_JITTER, &global.jitter.s, sizeof(global.jitter.s));
+            rt_jitter_next(&global.jitter);
+        }
+
         //Espera completar o periodo de 20 milisegundos (50 Hz)
         rt_task_wait_period();
     }
@@ -432,14 +490,26 @@ int terminate_module(void)
     //Termina a tarefa de tempo real principal
     rt_task_delete(&global.task_slave);    
 
+#ifdef FDC_SHM_RINGS
+    rtf_destroy(RT_FIFO_RINGS);
+    if (global.rings != NULL)
+        rtai_kfree(nam2num(SHM_RING_NAME));
+    global.rings = NULL;
+#else
     rtf_destroy(RT_FIFO_AHRS);
     rtf_destroy(RT_FIFO_DAQ);
     rtf_destroy(RT_FIFO_GPS);
     rtf_destroy(RT_FIFO_NAV);
     rtf_destroy(RT_FIFO_PITOT);
+#endif
     rtf_destroy(RT_FIFO_CONTROL);
     rtf_destroy(RT_FIFO_STATUS);
+    rtf_destroy(RT_FIFO_JITTER);
     //rtf_destroy(RT_FIFO_COMAND);
+
+    if (global.counters != NULL)
+        dev_counters_put();
+    global.counters = NULL;
     
     return 0;
 }
@@ -457,8 +527,32 @@ int init_module(void)
 
     global.end_slave = 0; // Varaivel global que sinaliza o fim da tarefa de tempo real
     
+    // Os contadores sao zerados pelos modulos dos dispositivos; sem eles o modulo funciona
+    if ((global.counters = dev_counters_get()) == NULL)
+        rt_printk("Falha ao alocar os contadores dos dispositivos\n");
+
     //Cria a fila de mensagens
 
+#ifdef FDC_SHM_RINGS
+    // As amostras vao para os aneis da memoria compartilhada; a FIFO RT_FIFO_RINGS
+    // apenas avisa o fdc_master de que ha amostras novas
+    {
+        static const unsigned int sizes[SHM_RING_STREAMS] = SHM_RING_SIZES;
+        unsigned int size = shm_region_size(sizes, SHM_RING_STREAMS, SHM_RING_RECORDS);
+
+        global.new_samples = 0;
+        if ((global.rings = rtai_kmalloc(nam2num(SHM_RING_NAME), size)) == NULL) {
+            rt_printk("Falha ao alocar a memoria compartilhada dos aneis\n");
+            terminate = 1;
+        }
+        else
+            shm_region_init(global.rings, sizes, SHM_RING_STREAMS, SHM_RING_RECORDS);
+    }
+    if (rtf_create_using_bh(RT_FIFO_RINGS,   20000, 0) < 0) {
+        rt_printk("Falha ao abrir fifo: FIFO_RINGS\n");
+        terminate = 1;
+    }
+#else
     if (rtf_create_using_bh(RT_FIFO_AHRS,   20000, 0) < 0) {
         rt_printk("Falha ao abrir fifo: FIFO_AHRS\n");
         terminate = 1;
@@ -479,6 +573,7 @@ int init_module(void)
         rt_printk("Falha ao abrir fifo: FIFO_PITOT\n");
         terminate = 1;
     }
+#endif
     if (rtf_create_using_bh(RT_FIFO_CONTROL,20000, 0) < 0) {
         rt_printk("Falha ao abrir fifo: FIFO_CONTROL\n");
         terminate = 1;
@@ -487,6 +582,10 @@ int init_module(void)
         rt_printk("Falha ao abrir fifo: FIFO_STATUS\n");
         terminate = 1;
     }
+    if (rtf_create_using_bh(RT_FIFO_JITTER, 20000, 0) < 0) {
+        rt_printk("Falha ao abrir fifo: FIFO_JITTER\n");
+        terminate = 1;
+    }
     /*if (rtf_create_using_bh(RT_FIFO_COMAND, 20000, 0) < 0) {
         rt_printk("Falha ao abrir fifo: FIFO_STATUS\n");
         terminate = 1;
@@ -508,6 +607,9 @@ int init_module(void)
     // Determina o periodo de execucao da tarefa como sendo multiplo de 1 ms (PERIOD* 1 ms)
     tick_period = PERIOD*start_rt_timer(nano2count(UM_MILI_SEGUNDO));
     now = rt_get_time();
+
+    // O primeiro despertar eh em now + tick_period, e os seguintes a cada tick_period
+    rt_jitter_init(&global.jitter, count2nano(now + tick_period), (int)count2nano(tick_period));
     
     //Inicia a tarefa principal periodicamente
     if (rt_task_make_periodic(&global.task_slave, now + tick_period, tick_period) < 0) {
@@ -520,8 +622,6 @@ int init_module(void)
     else    
         rt_printk("\nMODULO FDC_SLAVE\n");
 
-    rt_busy_sleep(1000000000);
-
     return 0;
 } 
 /*!*******************************************************************************************
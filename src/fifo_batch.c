@@ -0,0 +1,69 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            LEITURA EM LOTE DOS REGISTROS DE TAMANHO FIXO DAS FIFOS DE DADOS - FIFO_BATCH
+*********************************************************************************************
+********************************************************************************************/
+
+#include "fifo_batch.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int fifo_batch_init(fifo_batch_t *b, int fd, size_t record_size, size_t max_records)
+{
+    memset(b, 0, sizeof(*b));
+    b->fd = fd;
+    b->record_size = record_size;
+    b->capacity = record_size*max_records;
+
+    b->buf = malloc(b->capacity);
+    if (b->buf == NULL)
+        return -1;
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int fifo_batch_read(fifo_batch_t *b)
+{
+    size_t used = b->ready*b->record_size;
+    ssize_t n;
+
+    // Funcao que move o registro parcial deixado pela ultima leitura para o inicio do
+    // buffer
+    if (used > 0) {
+        memmove(b->buf, b->buf + used, b->fill - used);
+        b->fill -= used;
+        b->ready = 0;
+    }
+
+    do
+        n = read(b->fd, b->buf + b->fill, b->capacity - b->fill);
+    while ((n < 0) && (errno == EINTR));
+
+    if (n < 0)
+        return (errno == EAGAIN) ? 0 : -1;
+
+    if (n > 0) {
+        b->fill += n;
+        b->reads++;
+    }
+
+    b->ready = b->fill/b->record_size;
+    b->records += b->ready;
+
+    return (int)b->ready;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void fifo_batch_free(fifo_batch_t *b)
+{
+    free(b->buf);
+    b->buf = NULL;
+}
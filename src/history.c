@@ -0,0 +1,338 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            ULTIMOS SEGUNDOS DE CADA SERIE, MANTIDOS EM MEMORIA (VER HISTORY.H) - HISTORY
+*********************************************************************************************
+********************************************************************************************/
+
+#include "history.h"
+#include "log_format.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+typedef struct {
+    uint64_t *seq;          // Numero do registro de cada posicao mais um, 0 durante a gravacao
+    char *data;             // capacity registros
+    size_t record_size;
+    size_t time_offset;     // Do time_sys no registro
+    uint64_t head;          // Registros guardados (atomico)
+} ring_t;
+
+static struct {
+    ring_t rings[N_STREAMS];
+    uint64_t capacity;      // Registros de cada anel (uma potencia de dois)
+    char *copy;             // Registros de uma descarga, capacidade do maior
+    char *header;
+    size_t header_cap;
+    int ready;
+} hist;
+
+static const size_t time_sys[N_STREAMS] = {
+    offsetof(msg_ahrs_t, time_sys), offsetof(msg_daq_t, time_sys), offsetof(msg_gps_t, time_sys),
+    offsetof(msg_nav_t, time_sys), offsetof(msg_pitot_t, time_sys)
+};
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static long long record_time(const ring_t *r, const char *record)
+{
+    long long t;
+
+    memcpy(&t, record + r->time_offset, sizeof(t));
+    return t;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int history_init(int seconds)
+{
+    size_t largest = 0;
+    int n_fields, max_fields = 0, i;
+
+    if (seconds <= 0)
+        return 0;
+    if (seconds > HISTORY_MAX_SECONDS)
+        seconds = HISTORY_MAX_SECONDS;
+
+    for (hist.capacity = 1; hist.capacity < (uint64_t)seconds*HISTORY_RATE; hist.capacity <<= 1)
+        ;
+
+    for (i = 0; i < N_STREAMS; i++) {
+        ring_t *r = &hist.rings[i];
+
+        r->record_size = log_record_size(i);
+        r->time_offset = time_sys[i];
+        r->seq = malloc(hist.capacity*sizeof(uint64_t));
+        r->data = malloc(hist.capacity*r->record_size);
+        if ((r->seq == NULL) || (r->data == NULL)) {
+            history_free();
+            return -1;
+        }
+        // Tocados agora, para que nenhuma falta de pagina fique para a ingestao
+        memset(r->seq, 0, hist.capacity*sizeof(uint64_t));
+        memset(r->data, 0, hist.capacity*r->record_size);
+        r->head = 0;
+
+        if (r->record_size > largest)
+            largest = r->record_size;
+        log_stream_fields(i, &n_fields);
+        if (n_fields > max_fields)
+            max_fields = n_fields;
+    }
+
+    hist.header_cap = sizeof(log_header_t) + max_fields*sizeof(log_field_t);
+    hist.copy = malloc(hist.capacity*largest);
+    hist.header = malloc(hist.header_cap);
+    if ((hist.copy == NULL) || (hist.header == NULL)) {
+        history_free();
+        return -1;
+    }
+    memset(hist.copy, 0, hist.capacity*largest);
+
+    __atomic_store_n(&hist.ready, 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void history_add(int stream, const void *records, int n)
+{
+    ring_t *r = &hist.rings[stream];
+    uint64_t head, i;
+    int k;
+
+    if (!__atomic_load_n(&hist.ready, __ATOMIC_ACQUIRE))
+        return;
+
+    head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    for (k = 0; k < n; k++, head++) {
+        i = head & (hist.capacity - 1);
+        __atomic_store_n(&r->seq[i], 0, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        memcpy(r->data + i*r->record_size, (const char *)records + k*r->record_size, r->record_size);
+        __atomic_store_n(&r->seq[i], head + 1, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que copia o registro numero seq em out. Retorna 0 se ele foi sobrescrito.
+static int copy_record(const ring_t *r, uint64_t seq, char *out)
+{
+    uint64_t i = seq & (hist.capacity - 1);
+
+    if (__atomic_load_n(&r->seq[i], __ATOMIC_ACQUIRE) != seq + 1)
+        return 0;
+    memcpy(out, r->data + i*r->record_size, r->record_size);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return __atomic_load_n(&r->seq[i], __ATOMIC_RELAXED) == seq + 1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que copia em hist.copy os registros da janela [from, to], os mais antigos
+// primeiro. Retorna quantos.
+static long copy_window(const ring_t *r, long long from, long long to)
+{
+    uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    uint64_t seq = (head > hist.capacity) ? head - hist.capacity : 0;
+    char *out = hist.copy;
+    long long t;
+    long n = 0;
+
+    for (; seq < head; seq++) {
+        if (!copy_record(r, seq, out))
+            continue;
+        t = record_time(r, out);
+        if ((t < from) || (t > to))
+            continue;
+        out += r->record_size;
+        n++;
+    }
+
+    return n;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Instante do registro mais novo do anel, ou 0 se ele estiver vazio. O registro eh lido
+// de novo se foi sobrescrito nesse meio tempo.
+static long long newest_time(const ring_t *r)
+{
+    uint64_t head;
+    char *out = hist.copy;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        if ((head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)) == 0)
+            return 0;
+        if (copy_record(r, head - 1, out))
+            return record_time(r, out);
+    }
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static long long now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000LL + ts.tv_nsec/1000000;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que envia len bytes ao socket nao bloqueante fd ate o prazo deadline (now_ms()).
+// Um cliente que para de ler a faz falhar com ETIMEDOUT, em vez de prender a thread da
+// descarga.
+static int write_all(int fd, const void *buf, size_t len, long long deadline)
+{
+    const char *p = buf;
+    struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+    long long left;
+    ssize_t w;
+
+    while (len > 0) {
+        w = send(fd, p, len, MSG_NOSIGNAL|MSG_DONTWAIT);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                return -1;
+            if ((left = deadline - now_ms()) <= 0) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+            poll(&pfd, 1, left);
+            continue;
+        }
+        p += w;
+        len -= w;
+    }
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int connect_socket(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+    strcpy(addr.sun_path, path);
+
+    // Nao bloqueante: um ouvinte com a fila cheia falha de imediato
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return -1;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+long history_dump(const char *dest, int seconds)
+{
+    char name[1024];
+    struct stat st;
+    long long to = 0, t;
+    long n, total = 0;
+    uint64_t len;
+    size_t h;
+    FILE *f;
+    int sock = -1, i;
+    long long deadline = now_ms() + HISTORY_SEND_TIMEOUT_MS;
+
+    if (!__atomic_load_n(&hist.ready, __ATOMIC_ACQUIRE) || (dest == NULL))
+        return -1;
+
+    if ((stat(dest, &st) == 0) && S_ISSOCK(st.st_mode)) {
+        if ((sock = connect_socket(dest)) < 0)
+            return -1;
+    }
+    else if ((stat(dest, &st) != 0) || !S_ISDIR(st.st_mode))
+        return -1;
+
+    for (i = 0; i < N_STREAMS; i++)
+        if ((t = newest_time(&hist.rings[i])) > to)
+            to = t;
+
+    for (i = 0; i < N_STREAMS; i++) {
+        const ring_t *r = &hist.rings[i];
+
+        n = copy_window(r, (seconds > 0) ? to - (long long)seconds*1000000000LL : LLONG_MIN, to);
+        h = log_build_header(hist.header, hist.header_cap, i, LOG_RAW, time(NULL));
+
+        if (sock >= 0) {
+            len = h + n*r->record_size;
+            if ((write_all(sock, &len, sizeof(len), deadline) != 0) || (write_all(sock, hist.header, h, deadline) != 0)
+                || (write_all(sock, hist.copy, n*r->record_size, deadline) != 0)) {
+                int erro = errno;
+
+                close(sock);
+                errno = erro;
+                return -1;
+            }
+        }
+        else {
+            snprintf(name, sizeof(name), "%s%s%s%s%s", dest,
+                     (dest[0] && dest[strlen(dest)-1] != '/') ? "/" : "", HISTORY_FILE,
+                     log_stream_name(i), LOG_EXT_BINARY);
+            if ((f = fopen(name, "wb")) == NULL)
+                return -1;
+            fwrite(hist.header, 1, h, f);
+            fwrite(hist.copy, r->record_size, n, f);
+            if (fclose(f) != 0)
+                return -1;
+        }
+        total += n;
+    }
+
+    if ((sock >= 0) && (close(sock) != 0))
+        return -1;
+
+    return total;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void history_free(void)
+{
+    int i;
+
+    __atomic_store_n(&hist.ready, 0, __ATOMIC_RELEASE);
+    for (i = 0; i < N_STREAMS; i++) {
+        free(hist.rings[i].seq);
+        free(hist.rings[i].data);
+        hist.rings[i].seq = NULL;
+        hist.rings[i].data = NULL;
+    }
+    free(hist.copy);
+    free(hist.header);
+    hist.copy = hist.header = NULL;
+}
@@ -0,0 +1,242 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            HISTOGRAMAS DE LATENCIA DAS AMOSTRAS, EM FAIXAS LOGARITMICAS - LATENCY
+*********************************************************************************************
+********************************************************************************************/
+
+#include "latency.h"
+
+#include <string.h>
+
+// O escritor grava cada campo atomicamente, para que um leitor nunca veja metade de um
+// valor; os campos nao sao consistentes entre si
+#define lat_store(p, v) __atomic_store_n(p, v, __ATOMIC_RELAXED)
+#define lat_load(p) __atomic_load_n(p, __ATOMIC_RELAXED)
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void lat_hist_reset(lat_hist_t *h)
+{
+    int i;
+
+    lat_store(&h->count, 0);
+    lat_store(&h->sum, 0);
+    lat_store(&h->min, 0);
+    lat_store(&h->max, 0);
+    for (i = 0; i < LAT_BUCKETS; i++)
+        lat_store(&h->buckets[i], 0);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int lat_bucket(unsigned long long us)
+{
+    int e;
+
+    if (us < LAT_SUB)
+        return (int)us;
+    if (us >= (1ULL << LAT_MAX_BITS))
+        return LAT_BUCKETS - 1;
+
+    // Potencia de dois do valor, depois os seus LAT_SUB_BITS bits abaixo do mais alto
+    e = 63 - __builtin_clzll(us);
+    return (e - LAT_SUB_BITS + 1)*LAT_SUB + (int)((us >> (e - LAT_SUB_BITS)) & (LAT_SUB - 1));
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+unsigned long long lat_bucket_low(int bucket)
+{
+    int e;
+
+    if (bucket < LAT_SUB)
+        return bucket;
+
+    e = bucket/LAT_SUB + LAT_SUB_BITS - 1;
+    return (unsigned long long)(LAT_SUB + bucket%LAT_SUB) << (e - LAT_SUB_BITS);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+unsigned long long lat_bucket_high(int bucket)
+{
+    if (bucket < LAT_SUB)
+        return bucket;
+
+    return lat_bucket_low(bucket) + (1ULL << (bucket/LAT_SUB - 1)) - 1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void lat_hist_add(lat_hist_t *h, long long ns)
+{
+    unsigned long long us = (ns > 0) ? (unsigned long long)ns/1000 : 0;
+    int b = lat_bucket(us);
+
+    if ((h->count == 0) || (us < h->min))
+        lat_store(&h->min, us);
+    if (us > h->max)
+        lat_store(&h->max, us);
+    lat_store(&h->sum, h->sum + us);
+    lat_store(&h->buckets[b], h->buckets[b] + 1);
+    lat_store(&h->count, h->count + 1);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void lat_hist_copy(lat_hist_t *dst, const lat_hist_t *h)
+{
+    int i;
+
+    dst->count = 0;
+    for (i = 0; i < LAT_BUCKETS; i++) {
+        dst->buckets[i] = lat_load(&h->buckets[i]);
+        dst->count += dst->buckets[i];
+    }
+    dst->sum = lat_load(&h->sum);
+    dst->min = lat_load(&h->min);
+    dst->max = lat_load(&h->max);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+unsigned long long lat_hist_percentile(const lat_hist_t *h, double p)
+{
+    unsigned long long rank, seen = 0, high;
+    int i;
+
+    if (h->count == 0)
+        return 0;
+
+    rank = (unsigned long long)(p*h->count + 0.5);
+    if (rank < 1)
+        rank = 1;
+    for (i = 0; i < LAT_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank)
+            break;
+    }
+    if (i == LAT_BUCKETS)
+        return h->max;
+
+    high = lat_bucket_high(i);
+    return (high < h->max) ? high : h->max;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void lat_hist_print(FILE *f, const char *name, const lat_hist_t *h)
+{
+    int i;
+
+    fprintf(f, "%s: %llu samples", name, h->count);
+    if (h->count > 0)
+        fprintf(f, ", min %llu, mean %llu, p50 %llu, p90 %llu, p99 %llu, p99.9 %llu, max %llu us",
+                h->min, h->sum/h->count, lat_hist_percentile(h, 0.5), lat_hist_percentile(h, 0.9),
+                lat_hist_percentile(h, 0.99), lat_hist_percentile(h, 0.999), h->max);
+    fprintf(f, "\n");
+
+    for (i = 0; i < LAT_BUCKETS; i++)
+        if (h->buckets[i] > 0)
+            fprintf(f, "\t%llu\t%llu\t%u\n", lat_bucket_low(i), lat_bucket_high(i), h->buckets[i]);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void lat_clock_reset(lat_clock_t *c)
+{
+    memset(c, 0, sizeof(*c));
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void lat_clock_update(lat_clock_t *c, long long time_sys, long long now)
+{
+    long long d = now - time_sys;
+
+    if (!c->valid) {
+        c->window_min = c->previous_min = d;
+        c->window_end = now + LAT_CLOCK_WINDOW_NS;
+        lat_store(&c->offset, d);
+        __atomic_store_n(&c->valid, 1, __ATOMIC_RELEASE);
+        return;
+    }
+
+    // Uma nova janela esquece o minimo da anterior a anterior
+    if (now >= c->window_end) {
+        c->previous_min = c->window_min;
+        c->window_min = d;
+        c->window_end = now + LAT_CLOCK_WINDOW_NS;
+    }
+    else if (d < c->window_min)
+        c->window_min = d;
+
+    d = (c->window_min < c->previous_min) ? c->window_min : c->previous_min;
+    if (d != c->offset)
+        lat_store(&c->offset, d);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+long long lat_clock_age(const lat_clock_t *c, long long time_sys, long long now)
+{
+    long long age;
+
+    if (!__atomic_load_n(&c->valid, __ATOMIC_ACQUIRE))
+        return 0;
+
+    age = now - time_sys - lat_load(&c->offset);
+    return (age > 0) ? age : 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void lat_marks_reset(lat_marks_t *m)
+{
+    m->head = m->placed = m->tail = 0;
+    m->skipped = 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int lat_marks_add(lat_marks_t *m, long long time_sys, unsigned long long end)
+{
+    lat_mark_t *mark;
+
+    if (m->head - m->tail >= LAT_MARKS) {
+        m->skipped++;
+        return 0;
+    }
+
+    mark = &m->marks[m->head & (LAT_MARKS - 1)];
+    mark->time_sys = time_sys;
+    mark->end = end;
+    m->head++;
+    if ((end != 0) && (m->placed == m->head - 1))
+        m->placed = m->head;
+
+    return 1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void lat_marks_place(lat_marks_t *m, unsigned long long end)
+{
+    for (; m->placed != m->head; m->placed++)
+        m->marks[m->placed & (LAT_MARKS - 1)].end = end;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void lat_marks_complete(lat_marks_t *m, unsigned long long written, const lat_clock_t *c,
+                        lat_hist_t *h, long long now)
+{
+    const lat_mark_t *mark;
+
+    for (; m->tail != m->placed; m->tail++) {
+        mark = &m->marks[m->tail & (LAT_MARKS - 1)];
+        if (mark->end > written)
+            break;
+        lat_hist_add(h, lat_clock_age(c, mark->time_sys, now));
+    }
+}
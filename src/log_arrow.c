@@ -0,0 +1,546 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            ARQUIVOS ARROW IPC DOS REGISTROS DO LOG DE VOO - LOG_ARROW
+
+    O construtor de FlatBuffers abaixo eh o usual, reduzido ao que os metadados do Arrow
+precisam: o buffer eh preenchido do fim para o inicio, os filhos antes dos pais, e cada
+objeto eh referenciado pela sua distancia do fim do buffer. Os numeros sao little endian,
+como as maquinas que leem e gravam os logs.
+*********************************************************************************************
+********************************************************************************************/
+
+#include "log_arrow.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARROW_MAGIC "ARROW1"
+#define ARROW_MAGIC_LEN 6
+
+#define ARROW_CONTINUATION 0xffffffffu
+
+// MetadataVersion.V5
+#define ARROW_VERSION 4
+
+// Uniao MessageHeader
+#define ARROW_HEADER_SCHEMA 1
+#define ARROW_HEADER_RECORD_BATCH 3
+
+// Uniao Type
+#define ARROW_TYPE_INT 2
+#define ARROW_TYPE_FLOAT 3
+
+// Precisao do FloatingPoint
+#define ARROW_SINGLE 1
+#define ARROW_DOUBLE 2
+
+// Campos de uma tabela, no maximo
+#define FB_MAX_FIELDS 8
+
+typedef struct {
+    unsigned char *buf;         // Dados em buf[cap - size, cap)
+    size_t cap, size;
+    size_t minalign;
+    uint32_t fields[FB_MAX_FIELDS];     // Posicao de cada campo da tabela aberta, 0 se ausente
+    int n_fields;
+    size_t table_start;
+    int error;
+} fb_t;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void fb_init(fb_t *b)
+{
+    memset(b, 0, sizeof(*b));
+    b->minalign = 1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int fb_grow(fb_t *b, size_t n)
+{
+    unsigned char *buf;
+    size_t cap;
+
+    if (b->error)
+        return -1;
+    if (b->size + n <= b->cap)
+        return 0;
+
+    cap = 2*b->cap + n + 256;
+    if ((buf = malloc(cap)) == NULL) {
+        b->error = 1;
+        return -1;
+    }
+    if (b->size > 0)
+        memcpy(buf + cap - b->size, b->buf + b->cap - b->size, b->size);
+    free(b->buf);
+    b->buf = buf;
+    b->cap = cap;
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void fb_push(fb_t *b, const void *data, size_t n)
+{
+    if ((n == 0) || (fb_grow(b, n) < 0))
+        return;
+    b->size += n;
+    if (data != NULL)
+        memcpy(b->buf + b->cap - b->size, data, n);
+    else
+        memset(b->buf + b->cap - b->size, 0, n);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que preenche para que, depois de mais extra bytes, os dados fiquem alinhados em
+// align
+static void fb_prep(fb_t *b, size_t align, size_t extra)
+{
+    if (align > b->minalign)
+        b->minalign = align;
+    fb_push(b, NULL, (~(b->size + extra) + 1) & (align - 1));
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que grava uma referencia ao objeto em off
+static uint32_t fb_ref(fb_t *b, uint32_t off)
+{
+    uint32_t v;
+
+    fb_prep(b, 4, 0);
+    v = b->size + 4 - off;
+    fb_push(b, &v, sizeof(v));
+
+    return b->size;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static uint32_t fb_string(fb_t *b, const char *s)
+{
+    uint32_t n = strlen(s);
+
+    fb_prep(b, 4, n + 1);
+    fb_push(b, NULL, 1);
+    fb_push(b, s, n);
+    fb_push(b, &n, sizeof(n));
+
+    return b->size;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Vetores: fb_vector_start(), os elementos inseridos do ultimo para o primeiro, e depois
+// fb_vector_end()
+static void fb_vector_start(fb_t *b, size_t elem_size, size_t n, size_t align)
+{
+    fb_prep(b, 4, elem_size*n);
+    fb_prep(b, align, elem_size*n);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static uint32_t fb_vector_end(fb_t *b, uint32_t n)
+{
+    fb_push(b, &n, sizeof(n));
+
+    return b->size;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void fb_table_start(fb_t *b)
+{
+    memset(b->fields, 0, sizeof(b->fields));
+    b->n_fields = 0;
+    b->table_start = b->size;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void fb_mark(fb_t *b, int field)
+{
+    b->fields[field] = b->size;
+    if (field >= b->n_fields)
+        b->n_fields = field + 1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void fb_scalar(fb_t *b, int field, const void *v, size_t n)
+{
+    fb_prep(b, n, 0);
+    fb_push(b, v, n);
+    fb_mark(b, field);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void fb_field_ref(fb_t *b, int field, uint32_t off)
+{
+    fb_ref(b, off);
+    fb_mark(b, field);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que grava a tabela e a sua vtable, logo antes dela
+static uint32_t fb_table_end(fb_t *b)
+{
+    uint32_t table;
+    uint16_t v;
+    int32_t vtable;
+    int i;
+
+    fb_prep(b, 4, 0);
+    fb_push(b, NULL, sizeof(vtable));
+    table = b->size;
+
+    for (i = b->n_fields - 1; i >= 0; i--) {
+        v = (b->fields[i] != 0) ? table - b->fields[i] : 0;
+        fb_push(b, &v, sizeof(v));
+    }
+    v = table - b->table_start;
+    fb_push(b, &v, sizeof(v));
+    v = (2 + b->n_fields)*sizeof(v);
+    fb_push(b, &v, sizeof(v));
+
+    // Distancia da tabela de volta a sua vtable
+    vtable = b->size - table;
+    if (!b->error)
+        memcpy(b->buf + b->cap - table, &vtable, sizeof(vtable));
+
+    return table;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void fb_finish(fb_t *b, uint32_t root)
+{
+    fb_prep(b, b->minalign > 8 ? b->minalign : 8, 4);
+    fb_ref(b, root);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_arrow_append(log_arrow_buf_t *out, const void *data, size_t len)
+{
+    unsigned char *p;
+    size_t cap;
+
+    if (len == 0)
+        return 0;
+    if (out->len + len > out->cap) {
+        cap = 2*out->cap + len + 4096;
+        if ((p = realloc(out->data, cap)) == NULL)
+            return -1;
+        out->data = p;
+        out->cap = cap;
+    }
+    if (data != NULL)
+        memcpy(out->data + out->len, data, len);
+    else
+        memset(out->data + out->len, 0, len);
+    out->len += len;
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void log_arrow_buf_free(log_arrow_buf_t *out)
+{
+    free(out->data);
+    memset(out, 0, sizeof(*out));
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static size_t pad8(size_t n)
+{
+    return (n + 7) & ~(size_t)7;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_arrow_schema_init(log_arrow_schema_t *s, const log_field_t *fields, int n_fields)
+{
+    log_arrow_column_t *c;
+    int i, n = 0;
+    uint32_t k;
+
+    memset(s, 0, sizeof(*s));
+    for (i = 0; i < n_fields; i++) {
+        if (((fields[i].type != LOG_INT) && (fields[i].type != LOG_FLOAT)) ||
+            ((fields[i].size != 4) && (fields[i].size != 8)))
+            return -1;
+        n += fields[i].count;
+    }
+
+    if ((s->columns = calloc(n > 0 ? n : 1, sizeof(*s->columns))) == NULL)
+        return -1;
+
+    c = s->columns;
+    for (i = 0; i < n_fields; i++)
+        for (k = 0; k < fields[i].count; k++, c++) {
+            if (fields[i].count > 1)
+                snprintf(c->name, sizeof(c->name), "%.*s[%u]", LOG_NAME_LEN, fields[i].name, k);
+            else
+                snprintf(c->name, sizeof(c->name), "%.*s", LOG_NAME_LEN, fields[i].name);
+            c->offset = fields[i].offset + k*fields[i].size;
+            c->size = fields[i].size;
+            c->type = fields[i].type;
+        }
+    s->n_columns = n;
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void log_arrow_schema_free(log_arrow_schema_t *s)
+{
+    free(s->columns);
+    memset(s, 0, sizeof(*s));
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static uint32_t build_schema(fb_t *b, const log_arrow_schema_t *s)
+{
+    uint32_t *fields, name, type, children, list;
+    uint8_t type_type, is_signed = 1;
+    int16_t precision;
+    int32_t width;
+    int i;
+
+    if ((fields = malloc((s->n_columns + 1)*sizeof(*fields))) == NULL) {
+        b->error = 1;
+        return 0;
+    }
+
+    for (i = 0; i < s->n_columns; i++) {
+        const log_arrow_column_t *c = &s->columns[i];
+
+        fb_table_start(b);
+        if (c->type == LOG_FLOAT) {
+            precision = (c->size == 4) ? ARROW_SINGLE : ARROW_DOUBLE;
+            fb_scalar(b, 0, &precision, sizeof(precision));
+            type_type = ARROW_TYPE_FLOAT;
+        }
+        else {
+            width = 8*c->size;
+            fb_scalar(b, 0, &width, sizeof(width));
+            fb_scalar(b, 1, &is_signed, sizeof(is_signed));
+            type_type = ARROW_TYPE_INT;
+        }
+        type = fb_table_end(b);
+
+        name = fb_string(b, c->name);
+        fb_vector_start(b, 4, 0, 4);
+        children = fb_vector_end(b, 0);
+
+        // Field: name, nullable (false), type_type, type, dictionary, children
+        fb_table_start(b);
+        fb_field_ref(b, 0, name);
+        fb_field_ref(b, 3, type);
+        fb_field_ref(b, 5, children);
+        fb_scalar(b, 2, &type_type, sizeof(type_type));
+        fields[i] = fb_table_end(b);
+    }
+
+    fb_vector_start(b, 4, s->n_columns, 4);
+    for (i = s->n_columns - 1; i >= 0; i--)
+        fb_ref(b, fields[i]);
+    list = fb_vector_end(b, s->n_columns);
+    free(fields);
+
+    // Schema: endianness (little), fields
+    fb_table_start(b);
+    fb_field_ref(b, 1, list);
+    return fb_table_end(b);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que acrescenta uma mensagem encapsulada: continuacao, tamanho dos metadados, o
+// flatbuffer Message preenchido ate 8 bytes. Retorna os bytes acrescentados.
+static size_t append_message(log_arrow_buf_t *out, fb_t *b, uint8_t header_type, uint32_t header,
+                             int64_t body_len)
+{
+    int16_t version = ARROW_VERSION;
+    uint32_t prefix[2], message;
+    size_t len;
+
+    // Message: version, header_type, header, bodyLength
+    fb_table_start(b);
+    fb_scalar(b, 3, &body_len, sizeof(body_len));
+    fb_field_ref(b, 2, header);
+    fb_scalar(b, 0, &version, sizeof(version));
+    fb_scalar(b, 1, &header_type, sizeof(header_type));
+    message = fb_table_end(b);
+    fb_finish(b, message);
+
+    if (b->error)
+        return 0;
+
+    len = pad8(b->size);
+    prefix[0] = ARROW_CONTINUATION;
+    prefix[1] = len;
+    if ((log_arrow_append(out, prefix, sizeof(prefix)) < 0) ||
+        (log_arrow_append(out, b->buf + b->cap - b->size, b->size) < 0) ||
+        (log_arrow_append(out, NULL, len - b->size) < 0))
+        return 0;
+
+    return sizeof(prefix) + len;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_arrow_begin(log_arrow_buf_t *out, const log_arrow_schema_t *s)
+{
+    fb_t b;
+    size_t n;
+
+    if (log_arrow_append(out, ARROW_MAGIC "\0\0", ARROW_MAGIC_LEN + 2) < 0)
+        return -1;
+
+    fb_init(&b);
+    n = append_message(out, &b, ARROW_HEADER_SCHEMA, build_schema(&b, s), 0);
+    free(b.buf);
+
+    return (n > 0) ? 0 : -1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_arrow_batch(log_arrow_buf_t *out, const log_arrow_schema_t *s, const void *records,
+                    size_t record_size, size_t n, log_arrow_block_t *block)
+{
+    const unsigned char *r = records;
+    uint64_t body_len = 0, buffer[2], node[2];
+    uint32_t nodes, buffers, batch;
+    int64_t length = n;
+    unsigned char *p;
+    size_t i, start;
+    int c;
+    fb_t b;
+
+    for (c = 0; c < s->n_columns; c++)
+        body_len += pad8(n*s->columns[c].size);
+
+    fb_init(&b);
+
+    // Um no por coluna: tamanho e numero de nulos
+    fb_vector_start(&b, sizeof(node), s->n_columns, 8);
+    for (c = s->n_columns - 1; c >= 0; c--) {
+        node[0] = n;
+        node[1] = 0;
+        fb_push(&b, node, sizeof(node));
+    }
+    nodes = fb_vector_end(&b, s->n_columns);
+
+    // Dois buffers por coluna: validade (vazio) e valores
+    fb_vector_start(&b, sizeof(buffer), 2*s->n_columns, 8);
+    start = body_len;
+    for (c = s->n_columns - 1; c >= 0; c--) {
+        start -= pad8(n*s->columns[c].size);
+        buffer[0] = start;
+        buffer[1] = n*s->columns[c].size;
+        fb_push(&b, buffer, sizeof(buffer));
+        buffer[1] = 0;
+        fb_push(&b, buffer, sizeof(buffer));
+    }
+    buffers = fb_vector_end(&b, 2*s->n_columns);
+
+    // RecordBatch: length, nodes, buffers
+    fb_table_start(&b);
+    fb_scalar(&b, 0, &length, sizeof(length));
+    fb_field_ref(&b, 1, nodes);
+    fb_field_ref(&b, 2, buffers);
+    batch = fb_table_end(&b);
+
+    block->meta_len = append_message(out, &b, ARROW_HEADER_RECORD_BATCH, batch, body_len);
+    block->body_len = body_len;
+    free(b.buf);
+    if (block->meta_len == 0)
+        return -1;
+
+    // Corpo: os registros transpostos em colunas
+    start = out->len;
+    if (log_arrow_append(out, NULL, body_len) < 0)
+        return -1;
+    p = out->data + start;
+    for (c = 0; c < s->n_columns; c++) {
+        const log_arrow_column_t *col = &s->columns[c];
+
+        if (col->size == 4)
+            for (i = 0; i < n; i++)
+                memcpy(p + 4*i, r + i*record_size + col->offset, 4);
+        else
+            for (i = 0; i < n; i++)
+                memcpy(p + 8*i, r + i*record_size + col->offset, 8);
+        p += pad8(n*col->size);
+    }
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_arrow_end(log_arrow_buf_t *out, const log_arrow_schema_t *s,
+                  const log_arrow_block_t *blocks, size_t n_blocks)
+{
+    int16_t version = ARROW_VERSION;
+    uint32_t eos[2] = { ARROW_CONTINUATION, 0 };
+    uint32_t schema, dictionaries, batches, footer, len;
+    unsigned char entry[24];
+    size_t i;
+    fb_t b;
+
+    if (log_arrow_append(out, eos, sizeof(eos)) < 0)
+        return -1;
+
+    fb_init(&b);
+    schema = build_schema(&b, s);
+
+    fb_vector_start(&b, sizeof(entry), 0, 8);
+    dictionaries = fb_vector_end(&b, 0);
+
+    // Block: offset, metaDataLength, preenchimento, bodyLength
+    fb_vector_start(&b, sizeof(entry), n_blocks, 8);
+    for (i = n_blocks; i-- > 0;) {
+        memset(entry, 0, sizeof(entry));
+        memcpy(entry, &blocks[i].offset, 8);
+        memcpy(entry + 8, &blocks[i].meta_len, 4);
+        memcpy(entry + 16, &blocks[i].body_len, 8);
+        fb_push(&b, entry, sizeof(entry));
+    }
+    batches = fb_vector_end(&b, n_blocks);
+
+    // Footer: version, schema, dictionaries, recordBatches
+    fb_table_start(&b);
+    fb_field_ref(&b, 1, schema);
+    fb_field_ref(&b, 2, dictionaries);
+    fb_field_ref(&b, 3, batches);
+    fb_scalar(&b, 0, &version, sizeof(version));
+    footer = fb_table_end(&b);
+    fb_finish(&b, footer);
+
+    len = b.size;
+    if (b.error || (log_arrow_append(out, b.buf + b.cap - b.size, b.size) < 0) ||
+        (log_arrow_append(out, &len, sizeof(len)) < 0) ||
+        (log_arrow_append(out, ARROW_MAGIC, ARROW_MAGIC_LEN) < 0)) {
+        free(b.buf);
+        return -1;
+    }
+    free(b.buf);
+
+    return 0;
+}
@@ -0,0 +1,484 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            COMPRESSAO EM COLUNAS DOS REGISTROS BINARIOS DO LOG DE VOO - LOG_CODEC
+*********************************************************************************************
+********************************************************************************************/
+
+#include "log_codec.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_layout_init(log_layout_t *layout, const log_field_t *fields, int n_fields, size_t record_size)
+{
+    int i, n = 0;
+    uint32_t e;
+
+    memset(layout, 0, sizeof(*layout));
+    layout->record_size = record_size;
+    layout->time_offset = -1;
+
+    for (i = 0; i < n_fields; i++)
+        n += fields[i].count;
+
+    layout->columns = malloc(n*sizeof(log_column_t));
+    if (layout->columns == NULL)
+        return -1;
+
+    for (i = 0; i < n_fields; i++) {
+        const log_field_t *f = &fields[i];
+
+        if (((f->size != 4) && (f->size != 8)) ||
+            ((f->type != LOG_INT) && (f->type != LOG_FLOAT)) ||
+            (f->offset + f->count*f->size > record_size)) {
+            log_layout_free(layout);
+            return -1;
+        }
+
+        if ((strncmp(f->name, "time_sys", LOG_NAME_LEN) == 0) && (f->type == LOG_INT) && (f->size == 8))
+            layout->time_offset = f->offset;
+
+        for (e = 0; e < f->count; e++) {
+            log_column_t *c = &layout->columns[layout->n_columns++];
+
+            c->offset = f->offset + e*f->size;
+            c->size = f->size;
+            if (f->type == LOG_FLOAT)
+                c->kind = LOG_COL_XOR;
+            else if (f->size == 8)
+                c->kind = LOG_COL_DOD;  // Marcas de tempo, que crescem em um passo quase constante
+            else
+                c->kind = LOG_COL_DELTA;
+        }
+    }
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void log_layout_free(log_layout_t *layout)
+{
+    free(layout->columns);
+    layout->columns = NULL;
+    layout->n_columns = 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+size_t log_block_bound(const log_layout_t *layout, int n)
+{
+    size_t per_record = 0;
+    int c;
+
+    // Um varint guarda 7 bits por byte
+    for (c = 0; c < layout->n_columns; c++)
+        per_record += (layout->columns[c].size == 8) ? 10 : 5;
+
+    return per_record*n;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void log_block_seal(log_block_t *b, const void *data)
+{
+    b->crc = log_crc32(0, data, b->size);
+    b->header_crc = log_crc32(0, b, offsetof(log_block_t, header_crc));
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_block_check_header(const log_block_t *b)
+{
+    if ((b->magic != LOG_BLOCK_MAGIC) && (b->magic != LOG_COMMIT_MAGIC))
+        return -1;
+    if (b->header_crc != log_crc32(0, b, offsetof(log_block_t, header_crc)))
+        return -1;
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_block_check_data(const log_block_t *b, const void *data)
+{
+    return (b->crc == log_crc32(0, data, b->size)) ? 0 : -1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static unsigned char *put_varint(unsigned char *p, uint64_t v)
+{
+    while (v >= 0x80) {
+        *p++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (unsigned char)v;
+
+    return p;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static const unsigned char *get_varint(const unsigned char *p, const unsigned char *end, uint64_t *v)
+{
+    int shift = 0;
+
+    *v = 0;
+    while ((p < end) && (shift < 64)) {
+        *v |= (uint64_t)(*p & 0x7f) << shift;
+        if ((*p++ & 0x80) == 0)
+            return p;
+        shift += 7;
+    }
+
+    return NULL;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int64_t unzigzag(uint64_t u)
+{
+    return (int64_t)((u >> 1) ^ (~(u & 1) + 1));
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Valor inteiro de uma coluna, com extensao de sinal
+static int64_t get_int(const char *record, const log_column_t *c)
+{
+    int32_t v32;
+    int64_t v64;
+
+    if (c->size == 8) {
+        memcpy(&v64, record + c->offset, 8);
+        return v64;
+    }
+    memcpy(&v32, record + c->offset, 4);
+    return v32;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void set_int(char *record, const log_column_t *c, int64_t v)
+{
+    int32_t v32 = (int32_t)v;
+
+    if (c->size == 8)
+        memcpy(record + c->offset, &v, 8);
+    else
+        memcpy(record + c->offset, &v32, 4);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Bits de uma coluna de float (4 ou 8 bytes)
+static uint64_t get_bits(const char *record, const log_column_t *c)
+{
+    uint32_t b32;
+    uint64_t b64;
+
+    if (c->size == 8) {
+        memcpy(&b64, record + c->offset, 8);
+        return b64;
+    }
+    memcpy(&b32, record + c->offset, 4);
+    return b32;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void set_bits(char *record, const log_column_t *c, uint64_t b)
+{
+    uint32_t b32 = (uint32_t)b;
+
+    if (c->size == 8)
+        memcpy(record + c->offset, &b, 8);
+    else
+        memcpy(record + c->offset, &b32, 4);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+size_t log_encode_block(const log_layout_t *layout, const void *records, int n, unsigned char *out)
+{
+    const char *r = records;
+    unsigned char *p = out;
+    int c, i;
+
+    for (c = 0; c < layout->n_columns; c++) {
+        const log_column_t *col = &layout->columns[c];
+        int64_t prev = 0, prev_delta = 0, v, delta;
+        uint64_t prev_bits = 0, bits;
+
+        for (i = 0; i < n; i++) {
+            const char *rec = r + i*layout->record_size;
+
+            switch (col->kind) {
+                case LOG_COL_XOR:
+                    bits = get_bits(rec, col);
+                    p = put_varint(p, bits ^ prev_bits);
+                    prev_bits = bits;
+                    break;
+                case LOG_COL_DELTA:
+                    v = get_int(rec, col);
+                    p = put_varint(p, zigzag((int64_t)((uint64_t)v - (uint64_t)prev)));
+                    prev = v;
+                    break;
+                case LOG_COL_DOD:
+                    v = get_int(rec, col);
+                    delta = (int64_t)((uint64_t)v - (uint64_t)prev);
+                    // O primeiro valor vai como esta e o segundo como um delta simples
+                    if (i < 2)
+                        p = put_varint(p, zigzag(delta));
+                    else
+                        p = put_varint(p, zigzag((int64_t)((uint64_t)delta - (uint64_t)prev_delta)));
+                    prev_delta = delta;
+                    prev = v;
+                    break;
+            }
+        }
+    }
+
+    return p - out;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_decode_block(const log_layout_t *layout, const unsigned char *in, size_t len, int n, void *records)
+{
+    const unsigned char *p = in, *end = in + len;
+    char *r = records;
+    uint64_t x;
+    int c, i;
+
+    // Os bytes dos registros nao cobertos por nenhum campo (preenchimento) ficam zerados
+    memset(records, 0, n*layout->record_size);
+
+    for (c = 0; c < layout->n_columns; c++) {
+        const log_column_t *col = &layout->columns[c];
+        int64_t prev = 0, prev_delta = 0, delta;
+        uint64_t prev_bits = 0;
+
+        for (i = 0; i < n; i++) {
+            char *rec = r + i*layout->record_size;
+
+            if ((p = get_varint(p, end, &x)) == NULL)
+                return -1;
+
+            switch (col->kind) {
+                case LOG_COL_XOR:
+                    prev_bits ^= x;
+                    set_bits(rec, col, prev_bits);
+                    break;
+                case LOG_COL_DELTA:
+                    prev = (int64_t)((uint64_t)prev + (uint64_t)unzigzag(x));
+                    set_int(rec, col, prev);
+                    break;
+                case LOG_COL_DOD:
+                    if (i < 2)
+                        delta = unzigzag(x);
+                    else
+                        delta = (int64_t)((uint64_t)prev_delta + (uint64_t)unzigzag(x));
+                    prev = (int64_t)((uint64_t)prev + (uint64_t)delta);
+                    prev_delta = delta;
+                    set_int(rec, col, prev);
+                    break;
+            }
+        }
+    }
+
+    return (p == end) ? 0 : -1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_encoder_init(log_encoder_t *e, log_stream_t stream, log_encoding_t encoding,
+                     int block_ms, int commit_ms)
+{
+    const log_field_t *fields;
+    int n_fields;
+    size_t bound;
+
+    memset(e, 0, sizeof(*e));
+    e->encoding = encoding;
+    e->block_ms = block_ms;
+    e->commit_ms = commit_ms;
+
+    fields = log_stream_fields(stream, &n_fields);
+    if (log_layout_init(&e->layout, fields, n_fields, log_record_size(stream)) < 0)
+        return -1;
+
+    if (encoding == LOG_JOURNAL)
+        bound = LOG_CODEC_BLOCK_RECORDS*e->layout.record_size;
+    else
+        bound = log_block_bound(&e->layout, LOG_CODEC_BLOCK_RECORDS);
+
+    e->records = malloc(LOG_CODEC_BLOCK_RECORDS*e->layout.record_size);
+    e->out = malloc(sizeof(log_block_t) + bound);
+    if ((e->records == NULL) || (e->out == NULL)) {
+        log_encoder_free(e);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// time_sys do registro i dos registros que esperam
+static int64_t record_time(const log_encoder_t *e, int i)
+{
+    int64_t t = 0;
+
+    if (e->layout.time_offset >= 0)
+        memcpy(&t, e->records + i*e->layout.record_size + e->layout.time_offset, sizeof(t));
+
+    return t;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_encoder_flush(log_encoder_t *e, log_writer_t *w)
+{
+    log_block_t block;
+    size_t n;
+
+    if (e->count == 0)
+        return 0;
+
+    if (e->encoding == LOG_JOURNAL) {
+        n = e->count*e->layout.record_size;
+        memcpy(e->out + sizeof(block), e->records, n);
+    }
+    else
+        n = log_encode_block(&e->layout, e->records, e->count, e->out + sizeof(block));
+
+    memset(&block, 0, sizeof(block));
+    block.magic = LOG_BLOCK_MAGIC;
+    block.seq = e->seq++;
+    block.n_records = e->count;
+    block.size = n;
+    block.first_time = record_time(e, 0);
+    block.last_time = record_time(e, e->count - 1);
+    log_block_seal(&block, e->out + sizeof(block));
+    memcpy(e->out, &block, sizeof(block));
+
+    if (e->n_records == 0)
+        e->first_time = block.first_time;
+    e->last_time = block.last_time;
+    e->n_records += e->count;
+
+    if (e->uncommitted++ == 0)
+        e->commit_deadline = log_now_ns() + (long long)e->commit_ms*1000000LL;
+
+    e->raw_bytes += e->count*e->layout.record_size;
+    e->coded_bytes += sizeof(block) + n;
+    if (e->index != NULL)
+        log_index_note(e->index, w->bytes, e->records, e->count);
+
+    e->count = 0;
+    e->deadline = 0;
+
+    return log_writer_write(w, e->out, sizeof(block) + n);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_encoder_commit(log_encoder_t *e, log_writer_t *w)
+{
+    log_block_t marker;
+    int status = 0;
+
+    if (log_encoder_flush(e, w) < 0)
+        status = -1;
+
+    if (e->uncommitted == 0)
+        return status;
+
+    memset(&marker, 0, sizeof(marker));
+    marker.magic = LOG_COMMIT_MAGIC;
+    marker.seq = e->seq++;
+    marker.n_records = e->n_records;
+    marker.first_time = e->first_time;
+    marker.last_time = e->last_time;
+    log_block_seal(&marker, NULL);
+
+    e->uncommitted = 0;
+    e->commit_deadline = 0;
+    e->coded_bytes += sizeof(marker);
+
+    if (log_writer_write(w, &marker, sizeof(marker)) < 0)
+        status = -1;
+    if (log_writer_sync(w) < 0)
+        status = -1;
+
+    return status;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_encoder_add(log_encoder_t *e, log_writer_t *w, const void *record)
+{
+    if (e->count == 0)
+        e->deadline = log_now_ns() + (long long)e->block_ms*1000000LL;
+
+    memcpy(e->records + e->count*e->layout.record_size, record, e->layout.record_size);
+
+    if (++e->count == LOG_CODEC_BLOCK_RECORDS)
+        return log_encoder_flush(e, w);
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_encoder_tick(log_encoder_t *e, log_writer_t *w, long long now)
+{
+    int status = 0;
+
+    if ((e->count > 0) && (now >= e->deadline))
+        status = log_encoder_flush(e, w);
+
+    if ((e->uncommitted > 0) && (now >= e->commit_deadline))
+        if (log_encoder_commit(e, w) < 0)
+            status = -1;
+
+    return status;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+long long log_encoder_deadline(const log_encoder_t *e)
+{
+    long long deadline = -1;
+
+    if (e->count > 0)
+        deadline = e->deadline;
+    if ((e->uncommitted > 0) && ((deadline < 0) || (e->commit_deadline < deadline)))
+        deadline = e->commit_deadline;
+
+    return deadline;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void log_encoder_free(log_encoder_t *e)
+{
+    log_layout_free(&e->layout);
+    free(e->records);
+    free(e->out);
+    e->records = NULL;
+    e->out = NULL;
+    e->count = 0;
+}
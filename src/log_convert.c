@@ -0,0 +1,866 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            CONVERSAO DOS LOGS BINARIOS DO VOO (.bin, .fdz, .fdj) EM ARQUIVOS TEXTO (.dat),
+            CSV OU ARROW IPC, USANDO TODOS OS PROCESSADORES - LOG_CONVERT
+
+Uso: log_convert [-f dat|csv|arrow] [-j threads] [-o dir_saida] arquivo|dir_voo...
+
+    Os registros de cada arquivo sao divididos em pedacos de cerca de CHUNK_RECORDS
+registros (blocos inteiros nos arquivos .fdz e .fdj) e os pedacos de todos os arquivos sao
+convertidos por um conjunto de threads. Cada thread tem uma fila dupla de pedacos: ela pega
+os seus proprios pedacos pela frente, na ordem do arquivo, e quando eles acabam rouba do fim
+das filas das outras, de forma que uma thread presa em um arquivo lento nao segura as
+outras. Um pedaco convertido eh gravado quando todos os pedacos antes dele no seu arquivo ja
+foram gravados.
+
+  dat    Os arquivos texto que o gravador escreve no formato texto, com o
+         mesmo cabecalho e as mesmas linhas, byte a byte (log_text.h). O
+         nome de arquivo no cabecalho eh o nome do novo arquivo.
+  csv    Uma linha de cabecalho com os nomes das colunas ("tensao[3]",
+         como nos arquivos Arrow) e uma linha por registro; os floats sao
+         escritos com 9 digitos significativos, o suficiente para ler de
+         volta o mesmo valor.
+  arrow  Arquivo Arrow IPC, um record batch por pedaco (log_arrow.h); eh
+         lido com pandas.read_feather() ou pyarrow.ipc.open_file().
+
+    A saida vai para o lado de cada arquivo de entrada (ou para dir_saida) com a extensao do
+formato. Um diretorio de voo representa todos os logs binarios dentro dele. A vazao, em
+registros por segundo, eh informada no final.
+*********************************************************************************************
+********************************************************************************************/
+
+#define _FILE_OFFSET_BITS 64
+
+#include "log_codec.h"
+#include "log_text.h"
+#include "log_arrow.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Registros por pedaco nos arquivos binarios brutos, e blocos por pedaco nos arquivos em
+// blocos
+#define CHUNK_RECORDS 4096
+#define CHUNK_BLOCKS (CHUNK_RECORDS/LOG_CODEC_BLOCK_RECORDS)
+
+#define MAX_THREADS 256
+
+// Qualquer msg_*_t local
+typedef union {
+    msg_ahrs_t ahrs;
+    msg_daq_t daq;
+    msg_gps_t gps;
+    msg_nav_t nav;
+    msg_pitot_t pitot;
+} any_msg_t;
+
+// Elementos de uma msg_*_t (um por float ou inteiro dos seus campos)
+#define MAX_ELEMENTS (sizeof(any_msg_t)/4)
+
+typedef enum {
+    OUT_DAT,
+    OUT_CSV,
+    OUT_ARROW
+} out_format_t;
+
+// Copia de um elemento de um campo do arquivo para a msg_*_t local
+typedef struct {
+    uint32_t src, src_size;
+    uint32_t dst, dst_size;
+    uint32_t type;
+} remap_t;
+
+struct job;
+
+typedef struct {
+    struct job *job;
+    size_t index;           // Posicao do pedaco no seu arquivo
+    size_t first, count;    // Registros (bruto) ou blocos (.fdz/.fdj) do pedaco
+    log_arrow_buf_t out;    // Bytes convertidos
+    log_arrow_block_t block;    // Record batch Arrow do pedaco
+    unsigned long long records;
+    int done;
+    int error;
+} chunk_t;
+
+typedef struct job {
+    char in_path[PATH_MAX];
+    char out_path[PATH_MAX];
+    const unsigned char *map;       // Arquivo de entrada, mapeado
+    size_t size;
+    log_header_t header;
+    const log_field_t *fields;
+    log_layout_t layout;
+    int have_layout;
+    size_t *blocks;                 // Posicoes dos blocos de dados (.fdz/.fdj)
+    size_t n_blocks;
+    int direct;                     // Registros no layout da msg_*_t local
+    remap_t *remap;
+    int n_remap;
+    log_arrow_schema_t schema;
+    chunk_t *chunks;
+    size_t n_chunks;
+    FILE *out;
+    pthread_mutex_t lock;           // Protege os membros abaixo
+    size_t next_write;              // Primeiro pedaco ainda nao gravado
+    uint64_t written;               // Bytes gravados em out
+    log_arrow_block_t *batches;     // Record batches Arrow, na ordem do arquivo
+    unsigned long long records;
+    int error;
+} job_t;
+
+// Fila dupla de pedacos de uma thread. A dona pega de head, as ladras de tail.
+typedef struct {
+    pthread_mutex_t lock;
+    chunk_t **chunks;
+    size_t head, tail;
+} deque_t;
+
+typedef struct {
+    int id;
+    deque_t *deques;
+    int n_threads;
+    out_format_t format;
+    unsigned long converted, stolen;
+    unsigned char *scratch;         // Registros decodificados de um pedaco
+    size_t scratch_size;
+    pthread_t thread;
+} worker_t;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static double now_s(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int has_ext(const char *name, const char *ext)
+{
+    size_t len = strlen(name), len_ext = strlen(ext);
+
+    return (len >= len_ext) && (strcmp(name + len - len_ext, ext) == 0);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static const char *format_ext(out_format_t format)
+{
+    switch (format) {
+        case OUT_CSV:
+            return ".csv";
+        case OUT_ARROW:
+            return ".arrow";
+        default:
+            return LOG_EXT_TEXT;
+    }
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que copia os campos de um registro do arquivo para a msg_*_t local pelo nome,
+// convertendo inteiros e floats de outros tamanhos
+static void remap_record(const job_t *job, const unsigned char *src, unsigned char *dst)
+{
+    int64_t i;
+    double d;
+    float f;
+    int k;
+
+    memset(dst, 0, log_record_size(job->header.stream));
+    for (k = 0; k < job->n_remap; k++) {
+        const remap_t *r = &job->remap[k];
+
+        if (r->src_size == r->dst_size)
+            memcpy(dst + r->dst, src + r->src, r->dst_size);
+        else if (r->type == LOG_INT) {
+            int32_t i32;
+
+            if (r->src_size == 4) {
+                memcpy(&i32, src + r->src, 4);
+                i = i32;
+            }
+            else
+                memcpy(&i, src + r->src, 8);
+            i32 = i;
+            memcpy(dst + r->dst, (r->dst_size == 4) ? (void *)&i32 : (void *)&i, r->dst_size);
+        }
+        else {
+            if (r->src_size == 4) {
+                memcpy(&f, src + r->src, 4);
+                d = f;
+            }
+            else
+                memcpy(&d, src + r->src, 8);
+            f = d;
+            memcpy(dst + r->dst, (r->dst_size == 4) ? (void *)&f : (void *)&d, r->dst_size);
+        }
+    }
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que associa os campos do arquivo aos da msg_*_t local, necessarios para as
+// linhas .dat. Retorna -1 se a serie for desconhecida.
+static int build_remap(job_t *job)
+{
+    const log_field_t *local;
+    int n_local, i, j;
+    uint32_t k;
+
+    if (job->header.stream >= N_STREAMS)
+        return -1;
+
+    local = log_stream_fields(job->header.stream, &n_local);
+    job->direct = (job->header.record_size == log_record_size(job->header.stream)) &&
+                  (job->header.n_fields == (uint32_t)n_local);
+    for (i = 0; job->direct && (i < n_local); i++)
+        job->direct = (strncmp(local[i].name, job->fields[i].name, LOG_NAME_LEN) == 0) &&
+                      (local[i].offset == job->fields[i].offset) && (local[i].size == job->fields[i].size) &&
+                      (local[i].count == job->fields[i].count) && (local[i].type == job->fields[i].type);
+    if (job->direct)
+        return 0;
+
+    // Gravado em uma maquina com outro layout
+    job->remap = calloc(MAX_ELEMENTS, sizeof(*job->remap));
+    if (job->remap == NULL)
+        return -1;
+    for (i = 0; i < n_local; i++)
+        for (j = 0; j < (int)job->header.n_fields; j++) {
+            const log_field_t *f = &job->fields[j];
+
+            if ((strncmp(local[i].name, f->name, LOG_NAME_LEN) != 0) || (local[i].type != f->type))
+                continue;
+            for (k = 0; (k < local[i].count) && (k < f->count) && (job->n_remap < (int)MAX_ELEMENTS); k++) {
+                remap_t *r = &job->remap[job->n_remap++];
+
+                r->src = f->offset + k*f->size;
+                r->src_size = f->size;
+                r->dst = local[i].offset + k*local[i].size;
+                r->dst_size = local[i].size;
+                r->type = f->type;
+            }
+            break;
+        }
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que mapeia um log binario e o divide em pedacos. Retorna -1 se o arquivo nao
+// puder ser convertido.
+static int open_job(job_t *job, out_format_t format)
+{
+    struct stat st;
+    size_t pos, n, i;
+    log_block_t b;
+    int fd;
+
+    pthread_mutex_init(&job->lock, NULL);
+
+    if (((fd = open(job->in_path, O_RDONLY)) < 0) || (fstat(fd, &st) < 0)) {
+        perror(job->in_path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    job->size = st.st_size;
+    if (job->size < sizeof(log_header_t)) {
+        fprintf(stderr, "%s: not a flight log file\n", job->in_path);
+        close(fd);
+        return -1;
+    }
+    job->map = mmap(NULL, job->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (job->map == MAP_FAILED) {
+        job->map = NULL;
+        perror(job->in_path);
+        return -1;
+    }
+    madvise((void *)job->map, job->size, MADV_SEQUENTIAL);
+
+    memcpy(&job->header, job->map, sizeof(job->header));
+    if ((memcmp(job->header.magic, LOG_MAGIC, LOG_MAGIC_LEN) != 0) ||
+        (job->header.header_size > job->size) || (job->header.record_size == 0) ||
+        (job->header.header_size < sizeof(log_header_t) + job->header.n_fields*sizeof(log_field_t))) {
+        fprintf(stderr, "%s: not a flight log file\n", job->in_path);
+        return -1;
+    }
+    if ((job->header.encoding != LOG_RAW) && (job->header.version != LOG_VERSION)) {
+        fprintf(stderr, "%s: unsupported version %u\n", job->in_path, job->header.version);
+        return -1;
+    }
+    job->fields = (const log_field_t *)(job->map + sizeof(log_header_t));
+
+    if (log_layout_init(&job->layout, job->fields, job->header.n_fields, job->header.record_size) < 0) {
+        fprintf(stderr, "%s: bad field table\n", job->in_path);
+        return -1;
+    }
+    job->have_layout = 1;
+
+    if ((format == OUT_DAT) && (build_remap(job) < 0)) {
+        fprintf(stderr, "%s: unknown stream %u\n", job->in_path, job->header.stream);
+        return -1;
+    }
+    if ((format == OUT_ARROW) &&
+        (log_arrow_schema_init(&job->schema, job->fields, job->header.n_fields) < 0)) {
+        fprintf(stderr, "%s: bad field table\n", job->in_path);
+        return -1;
+    }
+
+    if (job->header.encoding == LOG_RAW) {
+        // Um ultimo registro parcial fica de fora
+        n = (job->size - job->header.header_size)/job->header.record_size;
+        job->n_chunks = (n + CHUNK_RECORDS - 1)/CHUNK_RECORDS;
+    }
+    else {
+        // Somente os cabecalhos dos blocos sao lidos aqui; os dados sao verificados pelas
+        // threads. O arquivo termina no primeiro bloco danificado, como no log_unpack.
+        n = 0;
+        pos = job->header.header_size;
+        while (pos + sizeof(b) <= job->size) {
+            memcpy(&b, job->map + pos, sizeof(b));
+            if ((log_block_check_header(&b) < 0) || (b.size > job->size - pos - sizeof(b)))
+                break;
+            if (b.magic == LOG_BLOCK_MAGIC) {
+                if ((b.n_records == 0) || (b.n_records > LOG_CODEC_BLOCK_RECORDS))
+                    break;
+                if (job->n_blocks == n) {
+                    size_t *p = realloc(job->blocks, (2*n + 64)*sizeof(*p));
+
+                    if (p == NULL)
+                        return -1;
+                    job->blocks = p;
+                    n = 2*n + 64;
+                }
+                job->blocks[job->n_blocks++] = pos;
+            }
+            pos += sizeof(b) + b.size;
+        }
+        if (pos != job->size)
+            fprintf(stderr, "%s: damaged block at byte %zu, the rest is left out\n", job->in_path, pos);
+        n = job->n_blocks;
+        job->n_chunks = (n + CHUNK_BLOCKS - 1)/CHUNK_BLOCKS;
+    }
+
+    job->chunks = calloc(job->n_chunks + 1, sizeof(chunk_t));
+    job->batches = calloc(job->n_chunks + 1, sizeof(log_arrow_block_t));
+    if ((job->chunks == NULL) || (job->batches == NULL))
+        return -1;
+    for (i = 0; i < job->n_chunks; i++) {
+        chunk_t *c = &job->chunks[i];
+        size_t per_chunk = (job->header.encoding == LOG_RAW) ? CHUNK_RECORDS : CHUNK_BLOCKS;
+
+        c->job = job;
+        c->index = i;
+        c->first = i*per_chunk;
+        c->count = (n - c->first < per_chunk) ? n - c->first : per_chunk;
+    }
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que cria o arquivo de saida e grava o que vem antes dos registros
+static int start_output(job_t *job, out_format_t format)
+{
+    log_arrow_buf_t head;
+    char line[LOG_TEXT_HEADER_MAX];
+    size_t len;
+    int i, status = 0;
+
+    if ((job->out = fopen(job->out_path, "wb")) == NULL) {
+        perror(job->out_path);
+        return -1;
+    }
+
+    memset(&head, 0, sizeof(head));
+    if (format == OUT_DAT) {
+        len = log_text_header(line, sizeof(line), job->header.stream, job->out_path);
+        status = log_arrow_append(&head, line, len);
+    }
+    else if (format == OUT_CSV) {
+        log_arrow_schema_t s;
+
+        if (log_arrow_schema_init(&s, job->fields, job->header.n_fields) < 0)
+            return -1;
+        for (i = 0; (i < s.n_columns) && (status == 0); i++)
+            status = log_arrow_append(&head, s.columns[i].name, strlen(s.columns[i].name)) |
+                     log_arrow_append(&head, (i + 1 < s.n_columns) ? "," : "\n", 1);
+        log_arrow_schema_free(&s);
+    }
+    else
+        status = log_arrow_begin(&head, &job->schema);
+
+    if ((status < 0) || (fwrite(head.data, 1, head.len, job->out) != head.len)) {
+        log_arrow_buf_free(&head);
+        return -1;
+    }
+    job->written = head.len;
+    log_arrow_buf_free(&head);
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Registros de um pedaco: direto do mapeamento nos arquivos brutos, decodificados no
+// buffer de trabalho da thread nos outros. Retorna NULL em dados corrompidos.
+static const unsigned char *chunk_records(worker_t *w, chunk_t *c, size_t *n)
+{
+    const job_t *job = c->job;
+    size_t size = job->header.record_size, i;
+    log_block_t b;
+    unsigned char *p;
+
+    if (job->header.encoding == LOG_RAW) {
+        *n = c->count;
+        return job->map + job->header.header_size + c->first*size;
+    }
+
+    if (w->scratch_size < CHUNK_BLOCKS*LOG_CODEC_BLOCK_RECORDS*size) {
+        free(w->scratch);
+        w->scratch_size = CHUNK_BLOCKS*LOG_CODEC_BLOCK_RECORDS*size;
+        if ((w->scratch = malloc(w->scratch_size)) == NULL) {
+            w->scratch_size = 0;
+            return NULL;
+        }
+    }
+
+    p = w->scratch;
+    *n = 0;
+    for (i = c->first; i < c->first + c->count; i++) {
+        const unsigned char *data = job->map + job->blocks[i] + sizeof(b);
+
+        memcpy(&b, job->map + job->blocks[i], sizeof(b));
+        if (log_block_check_data(&b, data) < 0)
+            return NULL;
+        if (job->header.encoding == LOG_JOURNAL) {
+            if (b.size != b.n_records*size)
+                return NULL;
+            memcpy(p, data, b.size);
+        }
+        else if (log_decode_block(&job->layout, data, b.size, b.n_records, p) < 0)
+            return NULL;
+        p += b.n_records*size;
+        *n += b.n_records;
+    }
+
+    return w->scratch;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int convert_dat(const job_t *job, const unsigned char *records, size_t n, log_arrow_buf_t *out)
+{
+    char line[LOG_TEXT_LINE_MAX];
+    any_msg_t msg;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        const unsigned char *r = records + i*job->header.record_size;
+
+        if (!job->direct) {
+            remap_record(job, r, (unsigned char *)&msg);
+            r = (const unsigned char *)&msg;
+        }
+        if (log_arrow_append(out, line, log_text_record(line, job->header.stream, r)) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int convert_csv(const job_t *job, const unsigned char *records, size_t n, log_arrow_buf_t *out)
+{
+    char line[LOG_TEXT_LINE_MAX*2];
+    char *p, *end = line + sizeof(line) - 64;
+    const log_field_t *f;
+    int32_t i32;
+    int64_t i64;
+    float f32;
+    double f64;
+    size_t i;
+    uint32_t j, k;
+
+    for (i = 0; i < n; i++) {
+        const unsigned char *r = records + i*job->header.record_size;
+
+        p = line;
+        for (j = 0; j < job->header.n_fields; j++) {
+            f = &job->fields[j];
+            for (k = 0; (k < f->count) && (p < end); k++) {
+                const unsigned char *v = r + f->offset + k*f->size;
+
+                if ((f->type == LOG_INT) && (f->size == 4)) {
+                    memcpy(&i32, v, 4);
+                    p = log_text_int(p, i32);
+                }
+                else if (f->type == LOG_INT) {
+                    memcpy(&i64, v, 8);
+                    p = log_text_llong(p, i64);
+                }
+                else if (f->size == 4) {
+                    memcpy(&f32, v, 4);
+                    p += snprintf(p, 32, "%.9g", f32);
+                }
+                else {
+                    memcpy(&f64, v, 8);
+                    p += snprintf(p, 32, "%.17g", f64);
+                }
+                *p++ = ',';
+            }
+        }
+        p[-1] = '\n';
+        if (log_arrow_append(out, line, p - line) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que grava os pedacos de um arquivo que estao prontos, em ordem
+static void write_ready(job_t *job)
+{
+    chunk_t *c;
+
+    while ((job->next_write < job->n_chunks) && job->chunks[job->next_write].done) {
+        c = &job->chunks[job->next_write];
+        if (c->error)
+            job->error = 1;
+        else if (fwrite(c->out.data, 1, c->out.len, job->out) != c->out.len) {
+            perror(job->out_path);
+            job->error = 1;
+        }
+        job->batches[job->next_write] = c->block;
+        job->batches[job->next_write].offset = job->written;
+        job->written += c->out.len;
+        job->records += c->records;
+        log_arrow_buf_free(&c->out);
+        job->next_write++;
+    }
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void convert_chunk(worker_t *w, chunk_t *c)
+{
+    job_t *job = c->job;
+    const unsigned char *records;
+    size_t n = 0;
+    int status = -1;
+
+    if ((records = chunk_records(w, c, &n)) == NULL)
+        fprintf(stderr, "%s: corrupt block in records %zu to %zu\n", job->in_path, c->first,
+                c->first + c->count);
+    else if (w->format == OUT_DAT)
+        status = convert_dat(job, records, n, &c->out);
+    else if (w->format == OUT_CSV)
+        status = convert_csv(job, records, n, &c->out);
+    else
+        status = log_arrow_batch(&c->out, &job->schema, records, job->header.record_size, n, &c->block);
+
+    c->records = n;
+    c->error = (status < 0);
+
+    pthread_mutex_lock(&job->lock);
+    c->done = 1;
+    write_ready(job);
+    pthread_mutex_unlock(&job->lock);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static chunk_t *take_own(deque_t *d)
+{
+    chunk_t *c = NULL;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->head < d->tail)
+        c = d->chunks[d->head++];
+    pthread_mutex_unlock(&d->lock);
+
+    return c;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static chunk_t *steal(deque_t *d)
+{
+    chunk_t *c = NULL;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->head < d->tail)
+        c = d->chunks[--d->tail];
+    pthread_mutex_unlock(&d->lock);
+
+    return c;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void *worker(void *arg)
+{
+    worker_t *w = arg;
+    chunk_t *c;
+    int i;
+
+    while (1) {
+        if ((c = take_own(&w->deques[w->id])) == NULL) {
+            // Nenhum pedaco eh acrescentado depois que as threads comecam, entao o
+            // trabalho acaba quando todas as filas estao vazias
+            for (i = 1; (i < w->n_threads) && (c == NULL); i++)
+                c = steal(&w->deques[(w->id + i) % w->n_threads]);
+            if (c == NULL)
+                break;
+            w->stolen++;
+        }
+        convert_chunk(w, c);
+        w->converted++;
+    }
+
+    return NULL;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int add_file(job_t **jobs, int *n_jobs, const char *path)
+{
+    job_t *p = realloc(*jobs, (*n_jobs + 1)*sizeof(job_t));
+
+    if (p == NULL)
+        return -1;
+    *jobs = p;
+    memset(&p[*n_jobs], 0, sizeof(job_t));
+    snprintf(p[*n_jobs].in_path, PATH_MAX, "%s", path);
+    (*n_jobs)++;
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int is_log(const char *name)
+{
+    return has_ext(name, LOG_EXT_BINARY) || has_ext(name, LOG_EXT_COMPRESSED) ||
+           has_ext(name, LOG_EXT_JOURNAL);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void output_name(job_t *job, const char *out_dir, out_format_t format)
+{
+    char base[PATH_MAX];
+    const char *name = job->in_path;
+    char *dot;
+
+    if (out_dir != NULL) {
+        name = strrchr(job->in_path, '/');
+        name = (name != NULL) ? name + 1 : job->in_path;
+    }
+    snprintf(base, sizeof(base), "%s", name);
+    dot = strrchr(base, '.');
+    if ((dot != NULL) && (strchr(dot, '/') == NULL))
+        *dot = '\0';
+
+    if (out_dir != NULL)
+        snprintf(job->out_path, PATH_MAX, "%.*s/%.*s%s", PATH_MAX/2, out_dir, PATH_MAX/4, base,
+                 format_ext(format));
+    else
+        snprintf(job->out_path, PATH_MAX, "%.*s%s", PATH_MAX - 16, base, format_ext(format));
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void close_job(job_t *job)
+{
+    if (job->map != NULL)
+        munmap((void *)job->map, job->size);
+    if (job->have_layout)
+        log_layout_free(&job->layout);
+    log_arrow_schema_free(&job->schema);
+    free(job->blocks);
+    free(job->remap);
+    free(job->chunks);
+    free(job->batches);
+    pthread_mutex_destroy(&job->lock);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-f dat|csv|arrow] [-j threads] [-o out_dir] file|flight_dir...\n", name);
+    exit(1);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int main(int argc, char *argv[])
+{
+    static worker_t workers[MAX_THREADS];
+    static deque_t deques[MAX_THREADS];
+    out_format_t format = OUT_DAT;
+    const char *out_dir = NULL;
+    job_t *jobs = NULL;
+    int n_jobs = 0, n_threads, opt, i, failed = 0;
+    size_t j, n_chunks = 0;
+    unsigned long long records = 0;
+    unsigned long stolen = 0;
+    double start, elapsed;
+    struct stat st;
+
+    n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    while ((opt = getopt(argc, argv, "f:j:o:")) != -1) {
+        switch (opt) {
+            case 'f':
+                if (strcmp(optarg, "dat") == 0)
+                    format = OUT_DAT;
+                else if (strcmp(optarg, "csv") == 0)
+                    format = OUT_CSV;
+                else if (strcmp(optarg, "arrow") == 0)
+                    format = OUT_ARROW;
+                else
+                    usage(argv[0]);
+                break;
+            case 'j':
+                n_threads = atoi(optarg);
+                break;
+            case 'o':
+                out_dir = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind >= argc)
+        usage(argv[0]);
+    if (n_threads < 1)
+        n_threads = 1;
+    if (n_threads > MAX_THREADS)
+        n_threads = MAX_THREADS;
+
+    // Arquivos dados e logs binarios dos diretorios dados
+    for (i = optind; i < argc; i++) {
+        if ((stat(argv[i], &st) == 0) && S_ISDIR(st.st_mode)) {
+            struct dirent *entry;
+            char path[PATH_MAX];
+            DIR *dir = opendir(argv[i]);
+
+            if (dir == NULL) {
+                perror(argv[i]);
+                return 1;
+            }
+            while ((entry = readdir(dir)) != NULL) {
+                if (!is_log(entry->d_name))
+                    continue;
+                snprintf(path, sizeof(path), "%.*s/%s", PATH_MAX/2, argv[i], entry->d_name);
+                if (add_file(&jobs, &n_jobs, path) < 0)
+                    return 1;
+            }
+            closedir(dir);
+        }
+        else if (add_file(&jobs, &n_jobs, argv[i]) < 0)
+            return 1;
+    }
+
+    start = now_s();
+
+    for (i = 0; i < n_jobs; i++) {
+        output_name(&jobs[i], out_dir, format);
+        if ((open_job(&jobs[i], format) < 0) || (start_output(&jobs[i], format) < 0)) {
+            jobs[i].error = 1;
+            jobs[i].n_chunks = 0;
+        }
+        n_chunks += jobs[i].n_chunks;
+    }
+
+    // Os pedacos sao distribuidos em rodizio, na ordem dos arquivos, para que as threads
+    // trabalhem perto umas das outras e poucos pedacos convertidos esperem para ser
+    // gravados
+    for (i = 0; i < n_threads; i++) {
+        pthread_mutex_init(&deques[i].lock, NULL);
+        deques[i].chunks = malloc((n_chunks/n_threads + 1)*sizeof(chunk_t *));
+        if (deques[i].chunks == NULL)
+            return 1;
+    }
+    opt = 0;
+    for (i = 0; i < n_jobs; i++)
+        for (j = 0; j < jobs[i].n_chunks; j++) {
+            deques[opt].chunks[deques[opt].tail++] = &jobs[i].chunks[j];
+            opt = (opt + 1) % n_threads;
+        }
+
+    for (i = 0; i < n_threads; i++) {
+        workers[i].id = i;
+        workers[i].deques = deques;
+        workers[i].n_threads = n_threads;
+        workers[i].format = format;
+        if (pthread_create(&workers[i].thread, NULL, worker, &workers[i]) != 0) {
+            fprintf(stderr, "Cannot create the threads\n");
+            return 1;
+        }
+    }
+    for (i = 0; i < n_threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        stolen += workers[i].stolen;
+        free(workers[i].scratch);
+        free(deques[i].chunks);
+    }
+
+    for (i = 0; i < n_jobs; i++) {
+        job_t *job = &jobs[i];
+
+        if (job->out != NULL) {
+            if (!job->error && (format == OUT_ARROW)) {
+                log_arrow_buf_t tail;
+
+                memset(&tail, 0, sizeof(tail));
+                if ((log_arrow_end(&tail, &job->schema, job->batches, job->n_chunks) < 0) ||
+                    (fwrite(tail.data, 1, tail.len, job->out) != tail.len))
+                    job->error = 1;
+                log_arrow_buf_free(&tail);
+            }
+            if (fclose(job->out) != 0) {
+                perror(job->out_path);
+                job->error = 1;
+            }
+        }
+        if (job->error) {
+            failed++;
+            fprintf(stderr, "%s: conversion failed\n", job->in_path);
+        }
+        else
+            printf("%s: %llu records -> %s\n", job->in_path, job->records, job->out_path);
+        records += job->records;
+        close_job(job);
+    }
+    elapsed = now_s() - start;
+
+    printf("%llu records in %.3f s: %.0f records/s (%d threads, %zu chunks, %lu stolen)\n", records, elapsed,
+           (elapsed > 0) ? records/elapsed : 0.0, n_threads, n_chunks, stolen);
+
+    free(jobs);
+
+    return (failed > 0) ? 1 : 0;
+}
@@ -0,0 +1,195 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            FORMATO BINARIO DO LOG DE VOO - LOG_FORMAT
+
+    Tabelas de campos das estruturas msg_*_t e montagem do cabecalho autodescritivo gravado
+no inicio de cada arquivo binario de log.
+*********************************************************************************************
+********************************************************************************************/
+
+#include "log_format.h"
+
+#include <string.h>
+
+#define MEMBER_SIZE(type, member) sizeof(((type *)0)->member)
+
+// Descreve um membro escalar de uma estrutura de mensagem
+#define FIELD(type, member, kind, unit) \
+    { #member, unit, kind, 1, offsetof(type, member), MEMBER_SIZE(type, member) }
+
+// Descreve um membro vetor de uma estrutura de mensagem
+#define ARRAY(type, member, kind, n, unit) \
+    { #member, unit, kind, n, offsetof(type, member), MEMBER_SIZE(type, member)/(n) }
+
+static const log_field_t ahrs_fields[] = {
+    FIELD(msg_ahrs_t, validade,   LOG_INT,   ""),
+    ARRAY(msg_ahrs_t, angle,      LOG_FLOAT, 3, "deg"),
+    ARRAY(msg_ahrs_t, gyro,       LOG_FLOAT, 3, "deg/s"),
+    ARRAY(msg_ahrs_t, accel,      LOG_FLOAT, 3, "g"),
+    ARRAY(msg_ahrs_t, magnet,     LOG_FLOAT, 3, "Gauss"),
+    FIELD(msg_ahrs_t, time_stamp, LOG_FLOAT, "us"),
+    FIELD(msg_ahrs_t, temp,       LOG_FLOAT, "C"),
+    FIELD(msg_ahrs_t, time_sys,   LOG_INT,   "ns")
+};
+
+static const log_field_t daq_fields[] = {
+    FIELD(msg_daq_t, validade, LOG_INT,   ""),
+    ARRAY(msg_daq_t, tensao,   LOG_FLOAT, 16, "V"),
+    FIELD(msg_daq_t, time_sys, LOG_INT,   "ns")
+};
+
+static const log_field_t gps_fields[] = {
+    FIELD(msg_gps_t, latitude,               LOG_FLOAT, "ddmm.mmmmm"),
+    FIELD(msg_gps_t, longitude,              LOG_FLOAT, "dddmm.mmmmm"),
+    FIELD(msg_gps_t, altitude,               LOG_FLOAT, "m"),
+    FIELD(msg_gps_t, hdop,                   LOG_FLOAT, ""),
+    FIELD(msg_gps_t, geoid_separation,       LOG_FLOAT, "m"),
+    FIELD(msg_gps_t, north_south,            LOG_INT,   "char"),
+    FIELD(msg_gps_t, east_west,              LOG_INT,   "char"),
+    FIELD(msg_gps_t, fix_indicator,          LOG_INT,   ""),
+    FIELD(msg_gps_t, n_satellites,           LOG_INT,   ""),
+    FIELD(msg_gps_t, units_altitude,         LOG_INT,   "char"),
+    FIELD(msg_gps_t, units_geoid_separation, LOG_INT,   "char"),
+    FIELD(msg_gps_t, GPS_time_gga,           LOG_FLOAT, "s"),
+    FIELD(msg_gps_t, GPS_time_rmc,           LOG_FLOAT, "s"),
+    FIELD(msg_gps_t, status,                 LOG_INT,   "char"),
+    FIELD(msg_gps_t, gspeed,                 LOG_FLOAT, "kts"),
+    FIELD(msg_gps_t, course,                 LOG_FLOAT, "deg"),
+    FIELD(msg_gps_t, date,                   LOG_INT,   "ddmmyy"),
+    FIELD(msg_gps_t, magvar,                 LOG_FLOAT, "deg"),
+    FIELD(msg_gps_t, magvardir,              LOG_INT,   "char"),
+    FIELD(msg_gps_t, mode,                   LOG_INT,   ""),
+    FIELD(msg_gps_t, east_v,                 LOG_FLOAT, "m/s"),
+    FIELD(msg_gps_t, north_v,                LOG_FLOAT, "m/s"),
+    FIELD(msg_gps_t, up_v,                   LOG_FLOAT, "m/s"),
+    FIELD(msg_gps_t, hpe,                    LOG_FLOAT, "m"),
+    FIELD(msg_gps_t, vpe,                    LOG_FLOAT, "m"),
+    FIELD(msg_gps_t, epe,                    LOG_FLOAT, "m"),
+    FIELD(msg_gps_t, hpe_units,              LOG_INT,   "char"),
+    FIELD(msg_gps_t, vpe_units,              LOG_INT,   "char"),
+    FIELD(msg_gps_t, epe_units,              LOG_INT,   "char"),
+    FIELD(msg_gps_t, validity,               LOG_INT,   ""),
+    FIELD(msg_gps_t, time_sys,               LOG_INT,   "ns")
+};
+
+static const log_field_t nav_fields[] = {
+    FIELD(msg_nav_t, validade,        LOG_INT,   ""),
+    ARRAY(msg_nav_t, angle,           LOG_FLOAT, 3, "deg"),
+    ARRAY(msg_nav_t, gyro,            LOG_FLOAT, 3, "deg/s"),
+    ARRAY(msg_nav_t, accel,           LOG_FLOAT, 3, "g"),
+    FIELD(msg_nav_t, nVel,            LOG_FLOAT, "m/s"),
+    FIELD(msg_nav_t, eVel,            LOG_FLOAT, "m/s"),
+    FIELD(msg_nav_t, dVel,            LOG_FLOAT, "m/s"),
+    FIELD(msg_nav_t, latitude,        LOG_FLOAT, "deg"),
+    FIELD(msg_nav_t, longitude,       LOG_FLOAT, "deg"),
+    FIELD(msg_nav_t, altitude,        LOG_FLOAT, "m"),
+    FIELD(msg_nav_t, temp,            LOG_FLOAT, "C"),
+    FIELD(msg_nav_t, internal_error,  LOG_INT,   ""),
+    FIELD(msg_nav_t, internal_status, LOG_INT,   ""),
+    FIELD(msg_nav_t, time_stamp,      LOG_INT,   "ms"),
+    FIELD(msg_nav_t, time_sys,        LOG_INT,   "ns")
+};
+
+static const log_field_t pitot_fields[] = {
+    FIELD(msg_pitot_t, validade,         LOG_INT,   ""),
+    FIELD(msg_pitot_t, static_pressure,  LOG_FLOAT, "Pa"),
+    FIELD(msg_pitot_t, temperature,      LOG_FLOAT, "C"),
+    FIELD(msg_pitot_t, dynamic_pressure, LOG_FLOAT, "raw"),
+    FIELD(msg_pitot_t, attack_angle,     LOG_FLOAT, "raw"),
+    FIELD(msg_pitot_t, sideslip_angle,   LOG_FLOAT, "raw"),
+    FIELD(msg_pitot_t, time_sys,         LOG_INT,   "ns")
+};
+
+#define N_ELEMS(a) ((int)(sizeof(a)/sizeof((a)[0])))
+
+static const struct {
+    const char *name;
+    size_t record_size;
+    const log_field_t *fields;
+    int n_fields;
+} streams[N_STREAMS] = {
+    { "ahrs",  sizeof(msg_ahrs_t),  ahrs_fields,  N_ELEMS(ahrs_fields)  },
+    { "daq",   sizeof(msg_daq_t),   daq_fields,   N_ELEMS(daq_fields)   },
+    { "gps",   sizeof(msg_gps_t),   gps_fields,   N_ELEMS(gps_fields)   },
+    { "nav",   sizeof(msg_nav_t),   nav_fields,   N_ELEMS(nav_fields)   },
+    { "pitot", sizeof(msg_pitot_t), pitot_fields, N_ELEMS(pitot_fields) }
+};
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+const char *log_stream_name(log_stream_t stream)
+{
+    return streams[stream].name;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+size_t log_record_size(log_stream_t stream)
+{
+    return streams[stream].record_size;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+const log_field_t *log_stream_fields(log_stream_t stream, int *n_fields)
+{
+    *n_fields = streams[stream].n_fields;
+    return streams[stream].fields;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+size_t log_build_header(void *buf, size_t cap, log_stream_t stream,
+                        log_encoding_t encoding, time_t start)
+{
+    log_header_t header;
+    size_t fields_size = streams[stream].n_fields * sizeof(log_field_t);
+
+    if (cap < sizeof(header) + fields_size)
+        return 0;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LOG_MAGIC, LOG_MAGIC_LEN);
+    header.version = LOG_VERSION;
+    header.header_size = sizeof(header) + fields_size;
+    header.record_size = streams[stream].record_size;
+    header.n_fields = streams[stream].n_fields;
+    header.stream = stream;
+    header.encoding = encoding;
+    header.start_time = start;
+    strncpy(header.stream_name, streams[stream].name, sizeof(header.stream_name)-1);
+
+    memcpy(buf, &header, sizeof(header));
+    memcpy((char *)buf + sizeof(header), streams[stream].fields, fields_size);
+
+    return header.header_size;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+uint32_t log_crc32(uint32_t crc, const void *data, size_t len)
+{
+    static uint32_t table[256];
+    static int ready;
+    const unsigned char *p = data;
+    uint32_t c;
+    int i, k;
+
+    // Montada no primeiro uso; threads que a montam ao mesmo tempo gravam os mesmos
+    // valores
+    if (!__atomic_load_n(&ready, __ATOMIC_ACQUIRE)) {
+        for (i = 0; i < 256; i++) {
+            c = i;
+            for (k = 0; k < 8; k++)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        __atomic_store_n(&ready, 1, __ATOMIC_RELEASE);
+    }
+
+    crc = ~crc;
+    while (len--)
+        crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+    return ~crc;
+}
@@ -0,0 +1,400 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            INDICE DE TEMPO DOS ARQUIVOS DE DADOS DO VOO - LOG_INDEX
+
+    Gravacao dos arquivos de indice ao lado dos arquivos de dados, e leitura de janelas de
+tempo dos arquivos de dados atraves deles.
+*********************************************************************************************
+********************************************************************************************/
+
+#define _FILE_OFFSET_BITS 64    // fseeko() alem de 2 GB em maquinas de 32 bits
+
+#include "log_index.h"
+#include "log_codec.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Registros brutos lidos de cada vez pela log_read_window()
+#define READ_RECORDS 256
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int index_path(char *path, size_t cap, const char *data_path)
+{
+    if ((size_t)snprintf(path, cap, "%s%s", data_path, LOG_EXT_INDEX) >= cap) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_index_open(log_index_t *x, const char *data_path, log_stream_t stream,
+                   log_format_t format, int flush_ms)
+{
+    char path[PATH_MAX];
+    log_index_header_t header;
+    const log_field_t *fields;
+    int n_fields, i;
+
+    memset(x, 0, sizeof(*x));
+    x->time_offset = -1;
+    x->gps_offset = -1;
+    x->record_size = log_record_size(stream);
+    x->interval = ((format == FORMAT_COMPRESSED) || (format == FORMAT_JOURNAL)) ? 0 : LOG_INDEX_INTERVAL;
+
+    fields = log_stream_fields(stream, &n_fields);
+    for (i = 0; i < n_fields; i++) {
+        if (strcmp(fields[i].name, "time_sys") == 0)
+            x->time_offset = fields[i].offset;
+        else if (strcmp(fields[i].name, "GPS_time_gga") == 0)
+            x->gps_offset = fields[i].offset;
+    }
+
+    if ((index_path(path, sizeof(path), data_path) < 0) ||
+        (log_writer_open(&x->out, path, flush_ms, 0) < 0))
+        return -1;
+    x->open = 1;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LOG_INDEX_MAGIC, LOG_MAGIC_LEN);
+    header.version = LOG_INDEX_VERSION;
+    header.stream = stream;
+    header.format = format;
+    header.interval = x->interval;
+    header.entry_size = sizeof(log_index_entry_t);
+
+    return log_writer_write(&x->out, &header, sizeof(header));
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int write_entry(log_index_t *x, uint64_t offset, const char *record, unsigned long long number)
+{
+    log_index_entry_t entry;
+
+    memset(&entry, 0, sizeof(entry));
+    if (x->time_offset >= 0)
+        memcpy(&entry.time_sys, record + x->time_offset, sizeof(entry.time_sys));
+    if (x->gps_offset >= 0)
+        memcpy(&entry.gps_time, record + x->gps_offset, sizeof(entry.gps_time));
+    else
+        entry.gps_time = NAN;
+    entry.offset = offset;
+    entry.record = number;
+
+    return log_writer_write(&x->out, &entry, sizeof(entry));
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_index_note(log_index_t *x, uint64_t offset, const void *record, unsigned n)
+{
+    unsigned long long i;
+    int status = 0;
+
+    if (!x->open || (n == 0))
+        return 0;
+
+    // Uma entrada por bloco
+    if (x->interval == 0) {
+        status = write_entry(x, offset, record, x->records);
+        x->records += n;
+        return status;
+    }
+
+    while (x->next < x->records + n) {
+        i = x->next - x->records;
+        if (write_entry(x, offset + i*x->record_size, (const char *)record + i*x->record_size, x->next) < 0)
+            status = -1;
+        x->next += x->interval;
+    }
+    x->records += n;
+
+    return status;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_index_tick(log_index_t *x, long long now)
+{
+    return x->open ? log_writer_tick(&x->out, now) : 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+long long log_index_deadline(const log_index_t *x)
+{
+    return (x->open && (x->out.fill > 0)) ? x->out.deadline : -1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_index_close(log_index_t *x)
+{
+    if (!x->open)
+        return 0;
+    x->open = 0;
+
+    return log_writer_close(&x->out);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_index_load(log_index_map_t *m, const char *data_path)
+{
+    char path[PATH_MAX];
+    FILE *f;
+    long size;
+
+    memset(m, 0, sizeof(*m));
+    if ((index_path(path, sizeof(path), data_path) < 0) || ((f = fopen(path, "rb")) == NULL))
+        return -1;
+
+    if ((fread(&m->header, sizeof(m->header), 1, f) != 1) ||
+        (memcmp(m->header.magic, LOG_INDEX_MAGIC, LOG_MAGIC_LEN) != 0) ||
+        (m->header.version != LOG_INDEX_VERSION) ||
+        (m->header.entry_size != sizeof(log_index_entry_t)) ||
+        (fseek(f, 0, SEEK_END) < 0) || ((size = ftell(f)) < 0)) {
+        fclose(f);
+        return -1;
+    }
+
+    // Uma ultima entrada parcial (gravacao interrompida) eh ignorada
+    m->n = (size - sizeof(m->header))/sizeof(log_index_entry_t);
+    m->entries = malloc((m->n > 0 ? m->n : 1)*sizeof(log_index_entry_t));
+    if ((m->entries == NULL) || (fseek(f, sizeof(m->header), SEEK_SET) < 0) ||
+        (fread(m->entries, sizeof(log_index_entry_t), m->n, f) != m->n)) {
+        fclose(f);
+        log_index_unload(m);
+        return -1;
+    }
+    fclose(f);
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void log_index_unload(log_index_map_t *m)
+{
+    free(m->entries);
+    m->entries = NULL;
+    m->n = 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Numero de entradas com time_sys < t (ou <= t, se inclusive)
+static size_t count_before(const log_index_map_t *m, int64_t t, int inclusive)
+{
+    size_t lo = 0, hi = m->n, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo)/2;
+        if ((m->entries[mid].time_sys < t) || (inclusive && (m->entries[mid].time_sys == t)))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+long log_index_find(const log_index_map_t *m, int64_t t)
+{
+    return (long)count_before(m, t, 1) - 1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void log_index_range(const log_index_map_t *m, int64_t from, int64_t to,
+                     uint64_t *start, uint64_t *end)
+{
+    // Os registros antes da ultima entrada mais antiga que from sao todos mais antigos, e
+    // os da primeira entrada mais nova que to em diante sao todos mais novos
+    size_t first = count_before(m, from, 0);
+    size_t last = count_before(m, to, 1);
+
+    *start = (first > 0) ? m->entries[first - 1].offset : 0;
+    *end = (last < m->n) ? m->entries[last].offset : UINT64_MAX;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_index_gps_to_sys(const log_index_map_t *m, float gps_time, int64_t *t)
+{
+    const log_index_entry_t *a, *b;
+    size_t i;
+
+    // O tempo do GPS falta enquanto nao ha fix, entao as entradas sao percorridas em
+    // ordem em vez de por bissecao
+    for (i = 0; i < m->n; i++) {
+        a = &m->entries[i];
+        if (!isfinite(a->gps_time))
+            continue;
+        if (a->gps_time == gps_time) {
+            *t = a->time_sys;
+            return 0;
+        }
+        if ((i + 1 == m->n) || !isfinite(m->entries[i + 1].gps_time))
+            continue;
+        b = &m->entries[i + 1];
+        if ((a->gps_time < gps_time) && (gps_time < b->gps_time)) {
+            *t = a->time_sys + (int64_t)((double)(gps_time - a->gps_time)/(b->gps_time - a->gps_time)*
+                                         (double)(b->time_sys - a->time_sys));
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que acrescenta a *out os registros de buf (n deles) com time_sys em [from, to].
+// Retorna 1 ao encontrar um registro mais novo que to, 0 caso contrario e -1 se faltar
+// memoria.
+static int keep_window(const char *buf, size_t n, size_t size, int time_offset, int64_t from, int64_t to,
+                       char **out, size_t *count, size_t *cap)
+{
+    int64_t t;
+    char *p;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        memcpy(&t, buf + i*size + time_offset, sizeof(t));
+        if (t > to)
+            return 1;
+        if (t < from)
+            continue;
+        if (*count == *cap) {
+            *cap = (*cap > 0) ? 2*(*cap) : READ_RECORDS;
+            if ((p = realloc(*out, *cap*size)) == NULL)
+                return -1;
+            *out = p;
+        }
+        memcpy(*out + (*count)++*size, buf + i*size, size);
+    }
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+long log_read_window(const char *data_path, int64_t from, int64_t to,
+                     void **records, size_t *record_size)
+{
+    log_index_map_t m;
+    log_header_t header;
+    log_field_t *fields = NULL;
+    log_layout_t layout;
+    log_block_t block;
+    unsigned char *payload = NULL;
+    char *buf = NULL, *out = NULL;
+    size_t count = 0, cap = 0, n, bound;
+    uint64_t start = 0, end = UINT64_MAX, pos;
+    int done = 0, have_layout = 0;
+    long result = -1;
+    FILE *in;
+
+    *records = NULL;
+    if ((in = fopen(data_path, "rb")) == NULL)
+        return -1;
+
+    if ((fread(&header, sizeof(header), 1, in) != 1) ||
+        (memcmp(header.magic, LOG_MAGIC, LOG_MAGIC_LEN) != 0) || (header.record_size == 0) ||
+        ((header.encoding != LOG_RAW) && (header.version != LOG_VERSION)))
+        goto out;
+
+    fields = malloc(header.n_fields*sizeof(log_field_t) + 1);
+    if ((fields == NULL) ||
+        (fread(fields, sizeof(log_field_t), header.n_fields, in) != header.n_fields) ||
+        (log_layout_init(&layout, fields, header.n_fields, header.record_size) < 0))
+        goto out;
+    have_layout = 1;
+    if (layout.time_offset < 0)
+        goto out;
+
+    // Sem indice o arquivo inteiro eh lido
+    if (log_index_load(&m, data_path) == 0) {
+        log_index_range(&m, from, to, &start, &end);
+        log_index_unload(&m);
+    }
+    if (start < header.header_size)
+        start = header.header_size;
+    if (fseeko(in, start, SEEK_SET) < 0)
+        goto out;
+    pos = start;
+
+    if (header.encoding == LOG_RAW) {
+        if ((buf = malloc(READ_RECORDS*header.record_size)) == NULL)
+            goto out;
+        while (!done && (pos < end) && ((n = fread(buf, header.record_size, READ_RECORDS, in)) > 0)) {
+            if ((done = keep_window(buf, n, header.record_size, layout.time_offset, from, to,
+                                    &out, &count, &cap)) < 0)
+                goto out;
+            pos += n*header.record_size;
+        }
+    }
+    else {
+        bound = (header.encoding == LOG_JOURNAL) ? header.record_size : log_block_bound(&layout, 1);
+        payload = malloc(bound*LOG_CODEC_BLOCK_RECORDS);
+        buf = malloc(LOG_CODEC_BLOCK_RECORDS*header.record_size);
+        if ((payload == NULL) || (buf == NULL))
+            goto out;
+
+        // Para no primeiro bloco danificado, como o log_unpack
+        while (!done && (pos < end) && (fread(&block, sizeof(block), 1, in) == 1)) {
+            if (log_block_check_header(&block) < 0)
+                break;
+            pos += sizeof(block) + block.size;
+            if (block.magic == LOG_COMMIT_MAGIC)
+                continue;
+            if ((block.n_records == 0) || (block.n_records > LOG_CODEC_BLOCK_RECORDS) ||
+                (block.size > bound*block.n_records) ||
+                (fread(payload, 1, block.size, in) != block.size) ||
+                (log_block_check_data(&block, payload) < 0))
+                break;
+            if (block.last_time < from)
+                continue;
+            if (block.first_time > to)
+                break;
+            if (header.encoding == LOG_JOURNAL) {
+                if (block.size != block.n_records*header.record_size)
+                    break;
+                memcpy(buf, payload, block.size);
+            }
+            else if (log_decode_block(&layout, payload, block.size, block.n_records, buf) < 0)
+                break;
+            if ((done = keep_window(buf, block.n_records, header.record_size, layout.time_offset, from, to,
+                                    &out, &count, &cap)) < 0)
+                goto out;
+        }
+    }
+
+    *records = out;
+    *record_size = header.record_size;
+    out = NULL;
+    result = count;
+
+out:
+    free(out);
+    free(buf);
+    free(payload);
+    if (have_layout)
+        log_layout_free(&layout);
+    free(fields);
+    fclose(in);
+
+    return result;
+}
@@ -0,0 +1,851 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            ALINHAMENTO DAS SERIES DE UM VOO PELO TIME_SYS E GRAVACAO DELAS COMO UMA TABELA
+            EM TAXA FIXA - LOG_MERGE
+
+Uso: log_merge [-r taxa_hz] [-m hold|linear] [-c coluna=hold|linear]...
+               [-s serie=ms]... [-f csv|arrow] [-o arquivo_saida] dir_voo
+
+    Todos os arquivos de dados do voo (cada segmento de cada serie, em qualquer dos
+formatos) sao lidos ao mesmo tempo, registro a registro, de forma que a memoria usada nao
+depende da duracao do voo. Para cada instante t = t0, t0 + 1/taxa, ... (t0 eh o primeiro
+time_sys do voo) cada coluna recebe o valor da sua serie em t:
+
+  hold    o valor do ultimo registro em t ou antes dele
+  linear  interpolado entre os registros em volta de t
+
+    Os floats sao interpolados linearmente e os inteiros (validade, flags) mantidos, a menos
+que -m mude o metodo de todas as colunas ou -c o de uma coluna ("daq.tensao[3]", ou
+"daq.tensao" para todos os seus elementos). Antes do primeiro e depois do ultimo registro de
+uma serie as suas colunas ficam vazias (NaN). -s soma ms milissegundos ao time_sys de uma
+serie ("ahrs=-12"), para compensar um atraso conhecido das suas marcas de tempo.
+
+    A tabela tem uma coluna time_sys (ns) seguida das colunas das series, chamadas
+"serie.campo[k]", como CSV (celulas vazias para valores ausentes) ou como arquivo Arrow IPC
+de colunas float64 (log_arrow.h). A saida padrao eh merge_<taxa>Hz.csv (ou .arrow) no
+diretorio do voo.
+*********************************************************************************************
+********************************************************************************************/
+
+#define _FILE_OFFSET_BITS 64
+
+#include "log_codec.h"
+#include "log_text.h"
+#include "log_arrow.h"
+
+#include <dirent.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Linhas por record batch Arrow
+#define BATCH_ROWS 4096
+
+#define MAX_OPTIONS 64
+
+#define COLUMN_NAME_LEN (LOG_NAME_LEN + 16)
+
+typedef enum {
+    METHOD_DEFAULT,
+    METHOD_HOLD,
+    METHOD_LINEAR
+} method_t;
+
+// Um arquivo de dados de uma serie (a rotacao gera varios por serie)
+typedef struct {
+    char path[PATH_MAX];
+    int text;
+    int64_t first_time;
+} segment_t;
+
+// Leitor de um segmento, que fornece o time_sys e os valores de cada registro
+typedef struct {
+    FILE *in;
+    int text;
+    int n_values;
+    char (*names)[COLUMN_NAME_LEN];     // Nomes dos valores, sem a serie
+    // Arquivos binarios
+    int *types;                         // log_field_type_t de cada valor
+    log_header_t header;
+    log_field_t *fields;
+    log_layout_t layout;
+    int have_layout;
+    uint32_t *offsets, *sizes;          // De cada valor no registro
+    int time_offset;
+    unsigned char *payload, *records;
+    size_t bound;
+    int n, next;                        // Registros decodificados e o proximo a retornar
+    // Arquivos texto
+    int time_column;
+    char line[LOG_TEXT_LINE_MAX];
+} source_t;
+
+typedef struct {
+    log_stream_t stream;
+    segment_t *segments;
+    int n_segments, current;
+    source_t source;
+    int open;
+    int *map;               // Valor da fonte para cada coluna (-1 se nenhum)
+    double *values;         // Valores do ultimo registro lido
+    int first_column, n_columns;
+    int64_t shift;          // Somado ao time_sys
+    // Registros em volta do instante atual
+    int have_prev, have_next;
+    int64_t prev_time, next_time;
+    double *prev, *next;
+} stream_t;
+
+typedef struct {
+    char name[COLUMN_NAME_LEN];
+    method_t method;
+} column_t;
+
+typedef struct {
+    const char *name;
+    method_t method;
+} option_t;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int has_ext(const char *name, const char *ext)
+{
+    size_t len = strlen(name), len_ext = strlen(ext);
+
+    return (len >= len_ext) && (strcmp(name + len - len_ext, ext) == 0);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void source_close(source_t *s)
+{
+    if (s->in != NULL)
+        fclose(s->in);
+    if (s->have_layout)
+        log_layout_free(&s->layout);
+    free(s->names);
+    free(s->types);
+    free(s->fields);
+    free(s->offsets);
+    free(s->sizes);
+    free(s->payload);
+    free(s->records);
+    memset(s, 0, sizeof(*s));
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que identifica a serie de um arquivo texto pelo seu cabecalho. Retorna -1 se
+// desconhecida.
+static int text_stream(FILE *in)
+{
+    char head[LOG_TEXT_HEADER_MAX], expected[LOG_TEXT_HEADER_MAX];
+    size_t len, name;
+    int s;
+
+    len = fread(head, 1, sizeof(head), in);
+    rewind(in);
+    for (s = 0; s < N_STREAMS; s++) {
+        // O cabecalho ate o nome do arquivo
+        log_text_header(expected, sizeof(expected), s, "\001");
+        name = strchr(expected, '\001') - expected;
+        if ((len >= name) && (memcmp(head, expected, name) == 0))
+            return s;
+    }
+
+    return -1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int source_open_text(source_t *s, FILE *in, log_stream_t stream)
+{
+    const char *const *columns;
+    int n, i, k = 0;
+
+    columns = log_text_columns(stream, &n);
+    s->text = 1;
+    s->time_column = -1;
+    if ((s->names = calloc(n, sizeof(*s->names))) == NULL)
+        return -1;
+    for (i = 0; i < n; i++) {
+        if (strcmp(columns[i], "time_sys") == 0) {
+            s->time_column = i;
+            continue;
+        }
+        snprintf(s->names[k++], COLUMN_NAME_LEN, "%s", columns[i]);
+    }
+    s->n_values = k;
+    s->in = in;
+
+    return (s->time_column >= 0) ? 0 : -1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int source_open_binary(source_t *s, FILE *in)
+{
+    uint32_t i, k;
+    int n = 0;
+
+    s->in = in;
+    s->time_offset = -1;
+    if ((fread(&s->header, sizeof(s->header), 1, in) != 1) ||
+        (memcmp(s->header.magic, LOG_MAGIC, LOG_MAGIC_LEN) != 0) || (s->header.record_size == 0) ||
+        ((s->header.encoding != LOG_RAW) && (s->header.version != LOG_VERSION)) ||
+        (s->header.stream >= N_STREAMS))
+        return -1;
+
+    s->fields = malloc(s->header.n_fields*sizeof(log_field_t) + 1);
+    if ((s->fields == NULL) ||
+        (fread(s->fields, sizeof(log_field_t), s->header.n_fields, in) != s->header.n_fields) ||
+        (log_layout_init(&s->layout, s->fields, s->header.n_fields, s->header.record_size) < 0))
+        return -1;
+    s->have_layout = 1;
+    if (((s->time_offset = s->layout.time_offset) < 0) || (fseeko(in, s->header.header_size, SEEK_SET) < 0))
+        return -1;
+
+    for (i = 0; i < s->header.n_fields; i++)
+        n += s->fields[i].count;
+    s->names = calloc(n + 1, sizeof(*s->names));
+    s->types = calloc(n + 1, sizeof(*s->types));
+    s->offsets = calloc(n + 1, sizeof(*s->offsets));
+    s->sizes = calloc(n + 1, sizeof(*s->sizes));
+    if ((s->names == NULL) || (s->types == NULL) || (s->offsets == NULL) || (s->sizes == NULL))
+        return -1;
+    n = 0;
+    for (i = 0; i < s->header.n_fields; i++) {
+        const log_field_t *f = &s->fields[i];
+
+        if (strncmp(f->name, "time_sys", LOG_NAME_LEN) == 0)
+            continue;
+        if (((f->type != LOG_INT) && (f->type != LOG_FLOAT)) || ((f->size != 4) && (f->size != 8)))
+            return -1;
+        for (k = 0; k < f->count; k++, n++) {
+            if (f->count > 1)
+                snprintf(s->names[n], COLUMN_NAME_LEN, "%.*s[%u]", LOG_NAME_LEN, f->name, k);
+            else
+                snprintf(s->names[n], COLUMN_NAME_LEN, "%.*s", LOG_NAME_LEN, f->name);
+            s->types[n] = f->type;
+            s->offsets[n] = f->offset + k*f->size;
+            s->sizes[n] = f->size;
+        }
+    }
+    s->n_values = n;
+
+    s->bound = (s->header.encoding == LOG_DELTA) ? log_block_bound(&s->layout, 1) : s->header.record_size;
+    s->payload = malloc(s->bound*LOG_CODEC_BLOCK_RECORDS);
+    s->records = malloc(s->header.record_size*LOG_CODEC_BLOCK_RECORDS);
+
+    return ((s->payload != NULL) && (s->records != NULL)) ? 0 : -1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que abre um arquivo de dados de qualquer formato. Retorna a sua serie, ou -1 se
+// nao for um arquivo de dados.
+static int source_open(source_t *s, const char *path)
+{
+    FILE *in;
+    int stream;
+
+    memset(s, 0, sizeof(*s));
+    if ((in = fopen(path, "rb")) == NULL)
+        return -1;
+
+    if (has_ext(path, LOG_EXT_TEXT)) {
+        if (((stream = text_stream(in)) < 0) || (source_open_text(s, in, stream) < 0)) {
+            if (s->in == NULL)
+                fclose(in);
+            source_close(s);
+            return -1;
+        }
+        return stream;
+    }
+
+    if (source_open_binary(s, in) < 0) {
+        source_close(s);
+        return -1;
+    }
+
+    return s->header.stream;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int read_text(source_t *s, int64_t *t, double *v)
+{
+    char *p, *end;
+    int i, k;
+
+    while (fgets(s->line, sizeof(s->line), s->in) != NULL) {
+        // As linhas de cabecalho comecam com '%'; uma ultima linha cortada por uma falta
+        // de energia tem menos valores e termina o arquivo
+        if ((s->line[0] == '%') || (strspn(s->line, " \t\r\n") == strlen(s->line)))
+            continue;
+        p = s->line;
+        for (i = 0, k = 0; i <= s->n_values; i++) {
+            if (i == s->time_column)
+                *t = strtoll(p, &end, 10);
+            else
+                v[k++] = strtod(p, &end);
+            if (end == p)
+                return 0;
+            p = end;
+        }
+        return 1;
+    }
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que retorna o proximo registro de um arquivo binario, ou NULL no fim (ou no
+// primeiro bloco danificado, como no log_unpack)
+static const unsigned char *next_record(source_t *s)
+{
+    log_block_t b;
+
+    if (s->header.encoding == LOG_RAW)
+        return (fread(s->records, s->header.record_size, 1, s->in) == 1) ? s->records : NULL;
+
+    while (s->next >= s->n) {
+        if ((fread(&b, sizeof(b), 1, s->in) != 1) || (log_block_check_header(&b) < 0))
+            return NULL;
+        if (b.magic == LOG_COMMIT_MAGIC) {
+            if (fseeko(s->in, b.size, SEEK_CUR) < 0)
+                return NULL;
+            continue;
+        }
+        if ((b.n_records == 0) || (b.n_records > LOG_CODEC_BLOCK_RECORDS) ||
+            (b.size > s->bound*b.n_records) || (fread(s->payload, 1, b.size, s->in) != b.size) ||
+            (log_block_check_data(&b, s->payload) < 0))
+            return NULL;
+        if (s->header.encoding == LOG_JOURNAL) {
+            if (b.size != b.n_records*s->header.record_size)
+                return NULL;
+            memcpy(s->records, s->payload, b.size);
+        }
+        else if (log_decode_block(&s->layout, s->payload, b.size, b.n_records, s->records) < 0)
+            return NULL;
+        s->n = b.n_records;
+        s->next = 0;
+    }
+
+    return s->records + s->next++*s->header.record_size;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que le o tempo e os valores do proximo registro. Retorna 1 se leu, 0 no fim do
+// arquivo.
+static int source_read(source_t *s, int64_t *t, double *v)
+{
+    const unsigned char *r;
+    int32_t i32;
+    int64_t i64;
+    float f;
+    int i;
+
+    if (s->text)
+        return read_text(s, t, v);
+
+    if ((r = next_record(s)) == NULL)
+        return 0;
+    memcpy(t, r + s->time_offset, sizeof(*t));
+    for (i = 0; i < s->n_values; i++) {
+        const unsigned char *p = r + s->offsets[i];
+
+        if ((s->types[i] == LOG_INT) && (s->sizes[i] == 4)) {
+            memcpy(&i32, p, 4);
+            v[i] = i32;
+        }
+        else if (s->types[i] == LOG_INT) {
+            memcpy(&i64, p, 8);
+            v[i] = i64;
+        }
+        else if (s->sizes[i] == 4) {
+            memcpy(&f, p, 4);
+            v[i] = f;
+        }
+        else
+            memcpy(&v[i], p, 8);
+    }
+
+    return 1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int compare_segments(const void *a, const void *b)
+{
+    const segment_t *x = a, *y = b;
+
+    return (x->first_time > y->first_time) - (x->first_time < y->first_time);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que abre o proximo segmento de uma serie, associando os seus valores as colunas
+// pelo nome
+static int open_segment(stream_t *st, column_t *columns)
+{
+    source_t *s = &st->source;
+    int i, j;
+
+    if (st->open)
+        source_close(s);
+    st->open = 0;
+
+    while (st->current < st->n_segments) {
+        segment_t *seg = &st->segments[st->current++];
+
+        if (source_open(s, seg->path) < 0) {
+            fprintf(stderr, "%s: cannot be read, skipped\n", seg->path);
+            continue;
+        }
+        st->open = 1;
+        free(st->values);
+        if ((st->values = calloc(s->n_values + 1, sizeof(double))) == NULL)
+            return -1;
+        for (i = 0; i < st->n_columns; i++) {
+            const char *name = strchr(columns[st->first_column + i].name, '.') + 1;
+
+            st->map[i] = -1;
+            for (j = 0; j < s->n_values; j++)
+                if (strcmp(s->names[j], name) == 0) {
+                    st->map[i] = j;
+                    break;
+                }
+        }
+        return 0;
+    }
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que move o proximo registro de uma serie (atraves dos seus segmentos) para next
+static int advance(stream_t *st, column_t *columns)
+{
+    int64_t t;
+    int i;
+
+    while (st->open) {
+        if (source_read(&st->source, &t, st->values)) {
+            st->next_time = t + st->shift;
+            for (i = 0; i < st->n_columns; i++)
+                st->next[i] = (st->map[i] >= 0) ? st->values[st->map[i]] : NAN;
+            st->have_next = 1;
+            return 0;
+        }
+        if (open_segment(st, columns) < 0)
+            return -1;
+    }
+    st->have_next = 0;
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que grava em row os valores de uma serie em t
+static void sample(const stream_t *st, const column_t *columns, int64_t t, double *row)
+{
+    double x;
+    int i;
+
+    for (i = 0; i < st->n_columns; i++) {
+        if (!st->have_prev || (!st->have_next && (t > st->prev_time)))
+            row[i] = NAN;
+        else if ((columns[st->first_column + i].method == METHOD_LINEAR) && st->have_next &&
+                 (st->next_time > st->prev_time)) {
+            x = (double)(t - st->prev_time)/(st->next_time - st->prev_time);
+            row[i] = st->prev[i] + x*(st->next[i] - st->prev[i]);
+        }
+        else
+            row[i] = st->prev[i];
+    }
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static method_t parse_method(const char *name)
+{
+    if (strcmp(name, "hold") == 0)
+        return METHOD_HOLD;
+    if (strcmp(name, "linear") == 0)
+        return METHOD_LINEAR;
+
+    return METHOD_DEFAULT;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int stream_by_name(const char *name, size_t len)
+{
+    int s;
+
+    for (s = 0; s < N_STREAMS; s++)
+        if ((strlen(log_stream_name(s)) == len) && (strncmp(log_stream_name(s), name, len) == 0))
+            return s;
+
+    return -1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que encontra os arquivos de dados do voo e as suas series
+static int scan_flight(const char *dir_name, stream_t *streams)
+{
+    struct dirent *entry;
+    source_t s;
+    segment_t seg;
+    double *v;
+    DIR *dir;
+    int stream, n = 0;
+
+    if ((dir = opendir(dir_name)) == NULL) {
+        perror(dir_name);
+        return -1;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (!has_ext(entry->d_name, LOG_EXT_TEXT) && !has_ext(entry->d_name, LOG_EXT_BINARY) &&
+            !has_ext(entry->d_name, LOG_EXT_COMPRESSED) && !has_ext(entry->d_name, LOG_EXT_JOURNAL))
+            continue;
+
+        memset(&seg, 0, sizeof(seg));
+        snprintf(seg.path, sizeof(seg.path), "%.*s/%s", PATH_MAX/2, dir_name, entry->d_name);
+        if ((stream = source_open(&s, seg.path)) < 0) {
+            fprintf(stderr, "%s: not a data file, skipped\n", seg.path);
+            continue;
+        }
+        // Arquivos sem registros (series que nao estavam rodando) ficam de fora
+        v = calloc(s.n_values + 1, sizeof(double));
+        if ((v != NULL) && source_read(&s, &seg.first_time, v)) {
+            stream_t *st = &streams[stream];
+            segment_t *p = realloc(st->segments, (st->n_segments + 1)*sizeof(segment_t));
+
+            if (p == NULL) {
+                free(v);
+                source_close(&s);
+                closedir(dir);
+                return -1;
+            }
+            seg.text = s.text;
+            st->segments = p;
+            st->segments[st->n_segments++] = seg;
+            n++;
+        }
+        free(v);
+        source_close(&s);
+    }
+    closedir(dir);
+
+    for (stream = 0; stream < N_STREAMS; stream++)
+        if (streams[stream].n_segments > 1)
+            qsort(streams[stream].segments, streams[stream].n_segments, sizeof(segment_t), compare_segments);
+
+    return n;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-r rate_hz] [-m hold|linear] [-c column=hold|linear]...\n"
+                    "       [-s stream=ms]... [-f csv|arrow] [-o out_file] flight_dir\n", name);
+    exit(1);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int write_csv_header(FILE *out, const column_t *columns, int n)
+{
+    int i;
+
+    fputs("time_sys", out);
+    for (i = 0; i < n; i++)
+        fprintf(out, ",%s", columns[i].name);
+
+    return (fputc('\n', out) == EOF) ? -1 : 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void write_csv_row(FILE *out, int64_t t, const double *row, int n)
+{
+    char line[LOG_TEXT_LINE_MAX*4];
+    char *p = line, *end = line + sizeof(line) - 32;
+    int i;
+
+    p = log_text_llong(p, t);
+    for (i = 0; (i < n) && (p < end); i++) {
+        *p++ = ',';
+        if (!isnan(row[i]))
+            p += snprintf(p, 32, "%.9g", row[i]);
+    }
+    *p++ = '\n';
+    fwrite(line, 1, p - line, out);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que acrescenta as linhas guardadas em batch como um record batch Arrow
+static int write_batch(FILE *out, const log_arrow_schema_t *schema, const void *batch, size_t record_size,
+                       size_t n, log_arrow_block_t **blocks, size_t *n_blocks, uint64_t *written)
+{
+    log_arrow_block_t *b;
+    log_arrow_buf_t buf;
+    int status = 0;
+
+    if (n == 0)
+        return 0;
+    if ((b = realloc(*blocks, (*n_blocks + 1)*sizeof(*b))) == NULL)
+        return -1;
+    *blocks = b;
+
+    memset(&buf, 0, sizeof(buf));
+    if ((log_arrow_batch(&buf, schema, batch, record_size, n, &b[*n_blocks]) < 0) ||
+        (fwrite(buf.data, 1, buf.len, out) != buf.len))
+        status = -1;
+    b[*n_blocks].offset = *written;
+    *written += buf.len;
+    (*n_blocks)++;
+    log_arrow_buf_free(&buf);
+
+    return status;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int main(int argc, char *argv[])
+{
+    static stream_t streams[N_STREAMS];
+    option_t options[MAX_OPTIONS];
+    int n_options = 0, arrow = 0, n_columns = 0, status = 0, opt, s, i, j;
+    double rate = 50.0, ms;
+    method_t method = METHOD_DEFAULT;
+    const char *out_name = NULL, *dir_name;
+    char default_name[PATH_MAX], *eq;
+    column_t *columns = NULL;
+    log_arrow_schema_t schema;
+    log_arrow_block_t *blocks = NULL;
+    log_arrow_buf_t buf;
+    size_t n_blocks = 0, n_batch = 0, record_size;
+    uint64_t written = 0;
+    unsigned long long rows = 0, k;
+    int64_t t0 = INT64_MAX, t;
+    double *batch = NULL, *row;
+    FILE *out;
+
+    while ((opt = getopt(argc, argv, "r:m:c:s:f:o:")) != -1) {
+        switch (opt) {
+            case 'r':
+                if ((rate = atof(optarg)) <= 0)
+                    usage(argv[0]);
+                break;
+            case 'm':
+                if ((method = parse_method(optarg)) == METHOD_DEFAULT)
+                    usage(argv[0]);
+                break;
+            case 'c':
+                if (((eq = strchr(optarg, '=')) == NULL) || (n_options == MAX_OPTIONS) ||
+                    (parse_method(eq + 1) == METHOD_DEFAULT))
+                    usage(argv[0]);
+                *eq = '\0';
+                options[n_options].name = optarg;
+                options[n_options++].method = parse_method(eq + 1);
+                break;
+            case 's':
+                if (((eq = strchr(optarg, '=')) == NULL) || ((s = stream_by_name(optarg, eq - optarg)) < 0))
+                    usage(argv[0]);
+                ms = atof(eq + 1);
+                streams[s].shift = (int64_t)(ms*1e6);
+                break;
+            case 'f':
+                if (strcmp(optarg, "arrow") == 0)
+                    arrow = 1;
+                else if (strcmp(optarg, "csv") != 0)
+                    usage(argv[0]);
+                break;
+            case 'o':
+                out_name = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+        usage(argv[0]);
+    dir_name = argv[optind];
+
+    if (scan_flight(dir_name, streams) <= 0) {
+        fprintf(stderr, "%s: no data files with records\n", dir_name);
+        return 1;
+    }
+
+    // Colunas das series com registros, na ordem das suas tabelas de campos, qualquer que
+    // seja o formato dos arquivos
+    for (s = 0; s < N_STREAMS; s++) {
+        stream_t *st = &streams[s];
+        const log_field_t *fields;
+        int n_fields;
+        uint32_t e;
+
+        st->stream = s;
+        st->first_column = n_columns;
+        if (st->n_segments == 0)
+            continue;
+        fields = log_stream_fields(s, &n_fields);
+        for (i = 0; i < n_fields; i++) {
+            if (strcmp(fields[i].name, "time_sys") == 0)
+                continue;
+            if ((columns = realloc(columns, (n_columns + fields[i].count)*sizeof(column_t))) == NULL)
+                return 1;
+            for (e = 0; e < fields[i].count; e++) {
+                column_t *c = &columns[n_columns++];
+
+                if (fields[i].count > 1)
+                    snprintf(c->name, sizeof(c->name), "%s.%s[%u]", log_stream_name(s), fields[i].name, e);
+                else
+                    snprintf(c->name, sizeof(c->name), "%s.%s", log_stream_name(s), fields[i].name);
+                c->method = (method != METHOD_DEFAULT) ? method :
+                            (fields[i].type == LOG_INT) ? METHOD_HOLD : METHOD_LINEAR;
+                for (j = 0; j < n_options; j++)
+                    if ((strcmp(options[j].name, c->name) == 0) ||
+                        ((strlen(options[j].name) == strlen(log_stream_name(s)) + 1 + strlen(fields[i].name)) &&
+                         (strncmp(options[j].name, c->name, strlen(options[j].name)) == 0)))
+                        c->method = options[j].method;
+            }
+        }
+        st->n_columns = n_columns - st->first_column;
+
+        st->map = calloc(st->n_columns + 1, sizeof(int));
+        st->prev = calloc(st->n_columns + 1, sizeof(double));
+        st->next = calloc(st->n_columns + 1, sizeof(double));
+        if ((st->map == NULL) || (st->prev == NULL) || (st->next == NULL))
+            return 1;
+        if ((open_segment(st, columns) < 0) || (advance(st, columns) < 0))
+            return 1;
+        if (st->have_next && (st->next_time < t0))
+            t0 = st->next_time;
+    }
+    for (j = 0; j < n_options; j++) {
+        for (i = 0; i < n_columns; i++)
+            if (strncmp(options[j].name, columns[i].name, strlen(options[j].name)) == 0)
+                break;
+        if (i == n_columns)
+            fprintf(stderr, "No column %s in the flight\n", options[j].name);
+    }
+
+    if (out_name == NULL) {
+        snprintf(default_name, sizeof(default_name), "%.*s/merge_%gHz%s", PATH_MAX/2, dir_name, rate,
+                 arrow ? ".arrow" : ".csv");
+        out_name = default_name;
+    }
+    if ((out = fopen(out_name, "wb")) == NULL) {
+        perror(out_name);
+        return 1;
+    }
+
+    // Cada linha eh guardada como time_sys (int64) seguido das colunas (float64)
+    record_size = sizeof(double)*(n_columns + 1);
+    if ((batch = malloc(record_size*BATCH_ROWS)) == NULL)
+        return 1;
+    memset(&buf, 0, sizeof(buf));
+    if (arrow) {
+        schema.n_columns = n_columns + 1;
+        if ((schema.columns = calloc(n_columns + 1, sizeof(log_arrow_column_t))) == NULL)
+            return 1;
+        snprintf(schema.columns[0].name, sizeof(schema.columns[0].name), "time_sys");
+        schema.columns[0].size = 8;
+        schema.columns[0].type = LOG_INT;
+        for (i = 0; i < n_columns; i++) {
+            log_arrow_column_t *c = &schema.columns[i + 1];
+
+            snprintf(c->name, sizeof(c->name), "%s", columns[i].name);
+            c->offset = sizeof(double)*(i + 1);
+            c->size = 8;
+            c->type = LOG_FLOAT;
+        }
+        if ((log_arrow_begin(&buf, &schema) < 0) || (fwrite(buf.data, 1, buf.len, out) != buf.len))
+            status = 1;
+        written = buf.len;
+        log_arrow_buf_free(&buf);
+    }
+    else if (write_csv_header(out, columns, n_columns) < 0)
+        status = 1;
+
+    for (k = 0; status == 0; k++) {
+        int running = 0;
+
+        t = t0 + llround(k*1e9/rate);
+        row = batch + n_batch*(n_columns + 1);
+        memcpy(row, &t, sizeof(t));
+        for (s = 0; s < N_STREAMS; s++) {
+            stream_t *st = &streams[s];
+
+            while (st->have_next && (st->next_time <= t)) {
+                double *p = st->prev;
+
+                st->prev = st->next;
+                st->next = p;
+                st->prev_time = st->next_time;
+                st->have_prev = 1;
+                if (advance(st, columns) < 0)
+                    return 1;
+            }
+            running |= st->have_next || (st->have_prev && (st->prev_time == t));
+            sample(st, columns, t, row + 1 + st->first_column);
+        }
+        // Termina depois do ultimo registro de todas as series
+        if (!running)
+            break;
+        rows++;
+
+        if (!arrow)
+            write_csv_row(out, t, row + 1, n_columns);
+        else if (++n_batch == BATCH_ROWS) {
+            if (write_batch(out, &schema, batch, record_size, n_batch, &blocks, &n_blocks, &written) < 0)
+                status = 1;
+            n_batch = 0;
+        }
+    }
+
+    if (arrow) {
+        if ((write_batch(out, &schema, batch, record_size, n_batch, &blocks, &n_blocks, &written) < 0) ||
+            (log_arrow_end(&buf, &schema, blocks, n_blocks) < 0) ||
+            (fwrite(buf.data, 1, buf.len, out) != buf.len))
+            status = 1;
+        log_arrow_buf_free(&buf);
+        log_arrow_schema_free(&schema);
+    }
+    if (fclose(out) != 0)
+        status = 1;
+
+    if (status != 0)
+        fprintf(stderr, "%s: write error\n", out_name);
+    else
+        printf("%s: %llu rows of %d columns at %g Hz\n", out_name, rows, n_columns, rate);
+
+    for (s = 0; s < N_STREAMS; s++) {
+        if (streams[s].open)
+            source_close(&streams[s].source);
+        free(streams[s].segments);
+        free(streams[s].map);
+        free(streams[s].values);
+        free(streams[s].prev);
+        free(streams[s].next);
+    }
+    free(columns);
+    free(batch);
+    free(blocks);
+
+    return status;
+}
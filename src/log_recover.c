@@ -0,0 +1,378 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            REPARO DOS ARQUIVOS DE DADOS DE UM VOO INTERROMPIDO POR UMA FALTA DE ENERGIA,
+            INFORMANDO OS INTERVALOS DE TEMPO PERDIDOS - LOG_RECOVER
+
+Uso: log_recover [-n] /tmp/data/Voo_...
+
+    Os arquivos comprimidos (.fdz) e com journal (.fdj) sao truncados depois do seu ultimo
+bloco valido: magic correto, CRCs do cabecalho e dos dados corretos e o numero de sequencia
+esperado. Blocos validos encontrados depois do dano servem apenas para dizer ate onde vai o
+intervalo perdido; quando nao ha nenhum, o intervalo termina no ultimo registro de qualquer
+arquivo do voo. Os arquivos binarios brutos (.bin) perdem o seu ultimo registro parcial, e
+os registros de zeros depois do ultimo: o resto da pre-alocacao de um arquivo gravado em
+modo mapeado (ver log_writer.h), nunca escrito. Os arquivos texto (.dat) perdem a sua ultima
+linha parcial. O indice de tempo (.idx) de cada arquivo perde a sua ultima entrada parcial e
+as entradas que apontam alem do fim reparado do arquivo. Com -n nada eh alterado, apenas
+informado.
+*********************************************************************************************
+********************************************************************************************/
+
+#include "log_codec.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MAX_FILES 64
+
+typedef struct {
+    char path[PATH_MAX];
+    const char *name;
+    int blocks;                     // 1 para arquivos .fdz/.fdj
+    int raw;                        // 1 para arquivos .bin
+    size_t size;                    // Tamanho do arquivo
+    size_t keep;                    // Bytes que sobram depois do reparo
+    unsigned long long n_records;   // Registros mantidos
+    unsigned long n_blocks;         // Blocos mantidos
+    int committed;                  // Foi encontrado um marcador de commit
+    uint32_t committed_records;     // Registros antes do ultimo marcador
+    int timed;                      // Registros mantidos, com time_sys
+    int64_t first_time, last_time;  // time_sys do primeiro e do ultimo registros mantidos
+    unsigned long lost_blocks;      // Blocos validos depois do dano
+    int64_t lost_until;             // Ultimo time_sys neles (0 se nenhum)
+} file_report_t;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int has_ext(const char *name, const char *ext)
+{
+    size_t len = strlen(name), len_ext = strlen(ext);
+
+    return (len >= len_ext) && (strcmp(name + len - len_ext, ext) == 0);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Posicao do time_sys nos registros, pela tabela de campos do arquivo, ou -1
+static int time_offset(const unsigned char *data, const log_header_t *header)
+{
+    log_field_t f;
+    uint32_t i;
+
+    if (sizeof(*header) + (size_t)header->n_fields*sizeof(f) > header->header_size)
+        return -1;
+    for (i = 0; i < header->n_fields; i++) {
+        memcpy(&f, data + sizeof(*header) + i*sizeof(f), sizeof(f));
+        if ((strncmp(f.name, "time_sys", LOG_NAME_LEN) == 0) && (f.size == sizeof(int64_t)) &&
+            (f.offset + sizeof(int64_t) <= header->record_size))
+            return f.offset;
+    }
+
+    return -1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int all_zero(const unsigned char *p, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        if (p[i] != 0)
+            return 0;
+
+    return 1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que le um cabecalho de bloco em p, se ele estiver inteiro e valido
+static int block_at(const unsigned char *p, const unsigned char *end, log_block_t *b)
+{
+    if ((size_t)(end - p) < sizeof(*b))
+        return -1;
+    memcpy(b, p, sizeof(*b));
+    if (log_block_check_header(b) < 0)
+        return -1;
+    if ((b->magic == LOG_COMMIT_MAGIC) && (b->size != 0))
+        return -1;
+    if ((size_t)(end - p) - sizeof(*b) < b->size)
+        return -1;
+    if (log_block_check_data(b, p + sizeof(*b)) < 0)
+        return -1;
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void scan_blocks(file_report_t *r, const unsigned char *data, const log_header_t *header)
+{
+    const unsigned char *p = data + header->header_size;
+    const unsigned char *end = data + r->size;
+    log_block_t b;
+    uint32_t seq = 0;
+
+    r->keep = header->header_size;
+
+    while ((block_at(p, end, &b) == 0) && (b.seq == seq)) {
+        if (b.magic == LOG_COMMIT_MAGIC) {
+            r->committed = 1;
+            r->committed_records = b.n_records;
+        }
+        else {
+            if (r->n_blocks++ == 0)
+                r->first_time = b.first_time;
+            r->last_time = b.last_time;
+            r->n_records += b.n_records;
+            r->timed = 1;
+        }
+        p += sizeof(b) + b.size;
+        seq++;
+    }
+    r->keep = p - data;
+
+    // Funcao que procura, byte a byte, os blocos gravados depois do danificado
+    for (p++; p + sizeof(b) <= end; p++) {
+        if ((p[0] != (LOG_BLOCK_MAGIC & 0xff)) || (block_at(p, end, &b) < 0) ||
+            (b.magic != LOG_BLOCK_MAGIC))
+            continue;
+        r->lost_blocks++;
+        if (b.last_time > r->lost_until)
+            r->lost_until = b.last_time;
+        p += sizeof(b) + b.size - 1;
+    }
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que descarta as entradas do indice que apontam alem do fim do arquivo reparado
+static int repair_index(const file_report_t *r, int dry_run)
+{
+    log_index_map_t m;
+    char path[PATH_MAX + sizeof(LOG_EXT_INDEX)];
+    struct stat st;
+    size_t n = 0, size;
+
+    snprintf(path, sizeof(path), "%s%s", r->path, LOG_EXT_INDEX);
+    if ((stat(path, &st) < 0) || (log_index_load(&m, r->path) < 0))
+        return 0;
+
+    while ((n < m.n) && (m.entries[n].offset < r->keep))
+        n++;
+    size = sizeof(log_index_header_t) + n*sizeof(log_index_entry_t);
+    log_index_unload(&m);
+
+    if ((size_t)st.st_size == size)
+        return 0;
+
+    printf("    index: %zu damaged bytes at the end, %zu entries left\n", (size_t)st.st_size - size, n);
+    if (!dry_run) {
+        if (truncate(path, size) < 0) {
+            perror(path);
+            return -1;
+        }
+        printf("    index truncated to %zu bytes\n", size);
+    }
+
+    return 1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int scan_file(file_report_t *r)
+{
+    const unsigned char *data = NULL;
+    log_header_t header;
+    int fd;
+
+    fd = open(r->path, O_RDONLY);
+    if (fd < 0) {
+        perror(r->path);
+        return -1;
+    }
+
+    if (r->size > 0) {
+        data = mmap(NULL, r->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror(r->path);
+            close(fd);
+            return -1;
+        }
+    }
+
+    memset(&header, 0, sizeof(header));
+    if (r->size >= sizeof(header))
+        memcpy(&header, data, sizeof(header));
+
+    if (has_ext(r->name, LOG_EXT_TEXT)) {
+        // Ate a ultima linha completa
+        r->keep = r->size;
+        while ((r->keep > 0) && (data[r->keep - 1] != '\n'))
+            r->keep--;
+    }
+    else if ((memcmp(header.magic, LOG_MAGIC, LOG_MAGIC_LEN) != 0) ||
+             (header.header_size < sizeof(header)) || (header.header_size > r->size) ||
+             (header.record_size == 0)) {
+        fprintf(stderr, "%s: no valid header, left as is\n", r->name);
+        r->keep = r->size;
+    }
+    else if (header.encoding == LOG_RAW) {
+        const unsigned char *records = data + header.header_size;
+        int t = time_offset(data, &header);
+
+        // Ate o ultimo registro completo que nao seja de zeros
+        r->raw = 1;
+        r->n_records = (r->size - header.header_size)/header.record_size;
+        while ((r->n_records > 0) && all_zero(records + (r->n_records - 1)*header.record_size, header.record_size))
+            r->n_records--;
+        r->keep = header.header_size + r->n_records*header.record_size;
+
+        if ((r->n_records > 0) && (t >= 0)) {
+            memcpy(&r->first_time, records + t, sizeof(int64_t));
+            memcpy(&r->last_time, records + (r->n_records - 1)*header.record_size + t, sizeof(int64_t));
+            r->timed = 1;
+        }
+    }
+    else if (header.version != LOG_VERSION) {
+        fprintf(stderr, "%s: unsupported version %u, left as is\n", r->name, header.version);
+        r->keep = r->size;
+    }
+    else {
+        r->blocks = 1;
+        scan_blocks(r, data, &header);
+    }
+
+    if (data != NULL)
+        munmap((void *)data, r->size);
+    close(fd);
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int main(int argc, char *argv[])
+{
+    static file_report_t files[MAX_FILES];
+    const char *dir_name;
+    DIR *dir;
+    struct dirent *entry;
+    struct stat st;
+    int n_files = 0, dry_run = 0, damaged = 0, status, i;
+    int64_t start = 0, end = 0;
+
+    if ((argc == 3) && (strcmp(argv[1], "-n") == 0))
+        dry_run = 1;
+    else if (argc != 2) {
+        fprintf(stderr, "Usage: %s [-n] flight_directory\n", argv[0]);
+        return 1;
+    }
+    dir_name = argv[argc - 1];
+
+    if ((dir = opendir(dir_name)) == NULL) {
+        perror(dir_name);
+        return 1;
+    }
+
+    while (((entry = readdir(dir)) != NULL) && (n_files < MAX_FILES)) {
+        file_report_t *r = &files[n_files];
+
+        memset(r, 0, sizeof(*r));
+        if (!has_ext(entry->d_name, LOG_EXT_TEXT) && !has_ext(entry->d_name, LOG_EXT_BINARY) &&
+            !has_ext(entry->d_name, LOG_EXT_COMPRESSED) && !has_ext(entry->d_name, LOG_EXT_JOURNAL))
+            continue;
+
+        snprintf(r->path, sizeof(r->path), "%s/%s", dir_name, entry->d_name);
+        r->name = r->path + strlen(dir_name) + 1;
+        if ((stat(r->path, &st) < 0) || !S_ISREG(st.st_mode))
+            continue;
+        r->size = st.st_size;
+
+        if (scan_file(r) == 0)
+            n_files++;
+    }
+    closedir(dir);
+
+    // Os tempos sao mostrados em relacao ao primeiro registro do voo, e o voo termina no
+    // ultimo registro encontrado em qualquer arquivo
+    for (i = 0; i < n_files; i++) {
+        file_report_t *r = &files[i];
+
+        if (r->timed) {
+            if ((start == 0) || (r->first_time < start))
+                start = r->first_time;
+            if (r->last_time > end)
+                end = r->last_time;
+        }
+        if (r->lost_until > end)
+            end = r->lost_until;
+    }
+
+    for (i = 0; i < n_files; i++) {
+        file_report_t *r = &files[i];
+
+        if (r->blocks) {
+            printf("%s: %llu records in %lu blocks", r->name, r->n_records, r->n_blocks);
+            if (r->n_blocks > 0)
+                printf(", %.3f s to %.3f s", (r->first_time - start)*1e-9, (r->last_time - start)*1e-9);
+            if (r->committed)
+                printf(", %u records committed", r->committed_records);
+            printf("\n");
+        }
+        else if (r->raw) {
+            printf("%s: %llu records", r->name, r->n_records);
+            if (r->timed)
+                printf(", %.3f s to %.3f s", (r->first_time - start)*1e-9, (r->last_time - start)*1e-9);
+            printf("\n");
+        }
+        else
+            printf("%s: %zu bytes\n", r->name, r->size);
+
+        if (r->keep == r->size) {
+            if ((status = repair_index(r, dry_run)) < 0)
+                return 1;
+            damaged += status;
+            continue;
+        }
+
+        damaged++;
+        printf("    %zu damaged bytes at the end (from byte %zu)\n", r->size - r->keep, r->keep);
+
+        if (r->blocks) {
+            int64_t from = (r->n_blocks > 0) ? r->last_time : start;
+            int64_t until = (r->lost_until > 0) ? r->lost_until : end;
+
+            if (r->lost_blocks > 0)
+                printf("    %lu valid blocks after the damage are lost\n", r->lost_blocks);
+            if (until > from)
+                printf("    lost: %.3f s to %.3f s (time_sys %lld to %lld ns)\n", (from - start)*1e-9,
+                       (until - start)*1e-9, (long long)from, (long long)until);
+            else
+                printf("    lost: records after %.3f s (time_sys %lld ns)\n", (from - start)*1e-9,
+                       (long long)from);
+        }
+
+        if (!dry_run) {
+            if (truncate(r->path, r->keep) < 0) {
+                perror(r->path);
+                return 1;
+            }
+            printf("    truncated to %zu bytes\n", r->keep);
+        }
+        if (repair_index(r, dry_run) < 0)
+            return 1;
+    }
+
+    if (damaged == 0)
+        printf("%s: no damaged files\n", dir_name);
+
+    return 0;
+}
@@ -0,0 +1,428 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            LINHAS E CABECALHOS DOS ARQUIVOS TEXTO (.dat) DE DADOS DO VOO - LOG_TEXT
+*********************************************************************************************
+********************************************************************************************/
+
+#include "log_text.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que escreve os digitos de v, o mais significativo primeiro
+static char *put_uint(char *p, unsigned long long v)
+{
+    char tmp[20];
+    int n = 0;
+
+    do {
+        tmp[n++] = '0' + (char)(v % 10);
+        v /= 10;
+    } while (v);
+
+    while (n)
+        *p++ = tmp[--n];
+
+    return p;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+char *log_text_llong(char *p, long long v)
+{
+    if (v < 0) {
+        *p++ = '-';
+        return put_uint(p, 0ULL - (unsigned long long)v);
+    }
+    return put_uint(p, v);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+char *log_text_long(char *p, long v)
+{
+    return log_text_llong(p, v);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+char *log_text_int(char *p, int v)
+{
+    return log_text_llong(p, v);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+char *log_text_float(char *p, float v)
+{
+    uint32_t bits, exponent;
+    uint64_t m, q, r, half;
+    int e, i;
+    unsigned long frac;
+
+    memcpy(&bits, &v, sizeof(bits));
+    exponent = (bits >> 23) & 0xff;
+
+    if (exponent == 0) {            // Zero e subnormais
+        m = bits & 0x7fffff;
+        e = -149;
+    }
+    else {
+        m = (bits & 0x7fffff) | 0x800000;
+        e = (int)exponent - 150;
+    }
+
+    // v = m*2^e. Infinitos, NaNs e valores grandes demais para o inteiro escalado abaixo
+    // (acima de 2^43) ficam para a biblioteca C.
+    if ((exponent == 0xff) || (e > 19))
+        return p + sprintf(p, "%f", v);
+
+    if (bits >> 31)
+        *p++ = '-';
+
+    // q = v*10^6 arredondado para o mais proximo, empates para o par, calculado
+    // exatamente
+    if (e >= 0)
+        q = (m << e)*1000000ULL;
+    else if (e <= -64)
+        q = 0;                      // m*10^6 < 2^44: menos de meia unidade
+    else {
+        m *= 1000000ULL;
+        q = m >> -e;
+        r = m & ((1ULL << -e) - 1);
+        half = 1ULL << (-e - 1);
+        if ((r > half) || ((r == half) && (q & 1)))
+            q++;
+    }
+
+    p = put_uint(p, q/1000000ULL);
+    *p++ = '.';
+    frac = (unsigned long)(q%1000000ULL);
+    for (i = 5; i >= 0; i--) {
+        p[i] = '0' + (char)(frac % 10);
+        frac /= 10;
+    }
+
+    return p + 6;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que escreve um float seguido de uma tabulacao
+static char *put_f(char *p, float v)
+{
+    p = log_text_float(p, v);
+    *p++ = '\t';
+    return p;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static char *put_d(char *p, int v)
+{
+    p = log_text_int(p, v);
+    *p++ = '\t';
+    return p;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+size_t log_text_daq(char *line, const msg_daq_t *msg)
+{
+    char *p = line;
+    int i;
+
+    *p++ = '\n';
+    for (i = 0; i < 16; i++)
+        p = put_f(p, msg->tensao[i]);
+    p = log_text_llong(p, msg->time_sys);
+    *p++ = '\t';
+    p = log_text_int(p, msg->validade);
+
+    return p - line;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+size_t log_text_ahrs(char *line, const msg_ahrs_t *msg)
+{
+    char *p = line;
+    int i;
+
+    *p++ = '\n';
+    for (i = 0; i < 3; i++)
+        p = put_f(p, msg->angle[i]);
+    for (i = 0; i < 3; i++)
+        p = put_f(p, msg->gyro[i]);
+    for (i = 0; i < 3; i++)
+        p = put_f(p, msg->accel[i]);
+    for (i = 0; i < 3; i++)
+        p = put_f(p, msg->magnet[i]);
+    p = put_f(p, msg->temp);
+    p = put_f(p, msg->time_stamp);
+    p = log_text_llong(p, msg->time_sys);
+    *p++ = '\t';
+    p = log_text_int(p, msg->validade);
+
+    return p - line;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+size_t log_text_gps(char *line, const msg_gps_t *msg)
+{
+    char *p = line;
+
+    *p++ = '\n';
+    p = put_f(p, msg->latitude);
+    p = put_f(p, msg->longitude);
+    p = put_f(p, msg->altitude);
+    p = put_f(p, msg->hdop);
+    p = put_f(p, msg->geoid_separation);
+    p = put_d(p, msg->north_south);
+    p = put_d(p, msg->east_west);
+    p = put_d(p, msg->n_satellites);
+    p = put_d(p, msg->units_altitude);
+    p = put_d(p, msg->units_geoid_separation);
+    p = put_f(p, msg->GPS_time_gga);
+    p = put_f(p, msg->east_v);
+    p = put_f(p, msg->north_v);
+    p = put_f(p, msg->up_v);
+    p = put_f(p, msg->hpe);
+    p = put_f(p, msg->vpe);
+    p = put_f(p, msg->epe);
+    p = put_f(p, msg->gspeed);
+    p = put_f(p, msg->course);
+    p = put_d(p, msg->date);
+    p = put_f(p, msg->magvar);
+    p = put_d(p, msg->magvardir);
+    p = put_d(p, msg->mode);
+    p = log_text_llong(p, msg->time_sys);
+    *p++ = '\t';
+    p = log_text_int(p, msg->validity);
+
+    return p - line;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+size_t log_text_nav(char *line, const msg_nav_t *msg)
+{
+    char *p = line;
+    int i;
+
+    *p++ = '\n';
+    for (i = 0; i < 3; i++)
+        p = put_f(p, msg->angle[i]);
+    for (i = 0; i < 3; i++)
+        p = put_f(p, msg->gyro[i]);
+    for (i = 0; i < 3; i++)
+        p = put_f(p, msg->accel[i]);
+    p = put_f(p, msg->nVel);
+    p = put_f(p, msg->eVel);
+    p = put_f(p, msg->dVel);
+    p = put_f(p, msg->latitude);
+    p = put_f(p, msg->longitude);
+    p = put_f(p, msg->altitude);
+    p = put_f(p, msg->temp);
+    p = put_d(p, msg->internal_error);
+    p = put_d(p, msg->internal_status);
+    p = log_text_long(p, msg->time_stamp);
+    *p++ = '\t';
+    p = log_text_llong(p, msg->time_sys);
+    *p++ = '\t';
+    p = log_text_int(p, msg->validade);
+
+    return p - line;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+size_t log_text_pitot(char *line, const msg_pitot_t *msg)
+{
+    char *p = line;
+
+    *p++ = '\n';
+    p = put_f(p, msg->static_pressure);
+    p = put_f(p, msg->temperature);
+    p = put_f(p, msg->dynamic_pressure);
+    p = put_f(p, msg->attack_angle);
+    p = put_f(p, msg->sideslip_angle);
+    p = log_text_llong(p, msg->time_sys);
+    *p++ = '\t';
+    p = log_text_int(p, msg->validade);
+
+    return p - line;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+size_t log_text_record(char *line, log_stream_t stream, const void *msg)
+{
+    switch (stream) {
+        case STREAM_AHRS:
+            return log_text_ahrs(line, msg);
+        case STREAM_DAQ:
+            return log_text_daq(line, msg);
+        case STREAM_GPS:
+            return log_text_gps(line, msg);
+        case STREAM_NAV:
+            return log_text_nav(line, msg);
+        case STREAM_PITOT:
+            return log_text_pitot(line, msg);
+        default:
+            return 0;
+    }
+}
+
+// Cabecalhos dos arquivos texto, com o nome do arquivo no lugar do %s. Eles sao gravados
+// no inicio de cada arquivo .dat e nao devem mudar, para que os arquivos das gravacoes
+// antigas e novas (e do log_convert) fiquem iguais.
+static const char *headers[N_STREAMS] = {
+    // STREAM_AHRS
+    "\n%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%"
+    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%\n"
+    "%% Arquivo do Sistema de Atitude e Referncia de Direo (AHRS) - %s"
+    "\n%% Valores dos ngulos fornecidos pelo filtro de Kalman do AHRS (), Velocidades Angulares(/s),"
+    " Aceleraes nos trs eixos (g), Campo Magntico medido nos trs eixos (Gauss), Temperatura interna do AHRS,"
+    " Tempo do AHRS (us), Tempo do Sistema (nanosegundos) e Validade dos dados"
+
+    "\n%% <phi>\t<theta>\t<psi>\t<p>\t<q>\t<r>\t<x''>\t<y''>\t<z''>\t<x_mag>\t<y_mag>\t"
+    "<z_mag>\t<Temp>\t<time_stamp>\t<time_sys>\t<validade>\n"
+
+    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%"
+    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%\n",
+
+    // STREAM_DAQ
+    "\n%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%"
+    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%\n"
+    "%% Arquivo da Placa de Aquisicao de Dados (DAQ) - %s"
+    "\n%% Valores das tensoes dos canais, Tempo do sistema e Validade dos dados"
+
+    "\n%% <can00>\t<can01>\t<can02>\t<can03>\t<can04>\t<can05>\t<can06>\t<can07>\t"
+    "<can08>\t<can09>\t<can10>\t<can11>\t<can12>\t<can13>\t<can14>\t<can15>\t"
+    "<time_stamp>\t<validade>\n"
+
+    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%"
+    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%\n",
+
+    // STREAM_GPS
+    "\n%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%"
+    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%\n"
+    "%% Arquivo do Sistema de Posicionamento GLOBAL (GPS) - %s"
+    "\n%% Valores de latitude,longitude,altitude,hdop,geoid_separation, north_south,"
+    "east_west, validade, n_satellites, units_altitude, units_geoid_separation, "
+    "GPS_time(tempo em segundos), vel_leste (m/s), vel_norte (m/s), vel_cima (m/s),"
+    "erro_horizontal (m), erro_vertical (m), erro_estimado (m), status, Ground Speed (kts),"
+    "course (deg),data, declinaao magntica (deg), direcao da declinacao, modo de operacao"
+    "Tempo do sistema(em nanosegundos), validade "
+
+    "\n%% <latitude>\t<longitude>\t<altitude>\t<hdop>\t<geoid_separation>\t"
+    "<north_south>\t<east_west>\t<n_satellites>\t<units_altitude>\t<units_geoid_separation>\t"
+    "<GPS_time>\t<east_v>\t<north_v>\t<up_v>\t<hpe>\t<vpe>\t<epe>\t<gspeed>\t<course>\t"
+    "<date>\t<magvar>\t<magvardir>\t<mode>\t<time_stamp>\t<validade>\n"
+
+    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%"
+    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%\n",
+
+    // STREAM_NAV
+    "\n%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%"
+    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%\n"
+    "%% Arquivo do Sistema de Navegao Inercial (NAV) - %s"
+    "\n%% Valores dos ngulos fornecidos pelo filtro de Kalman do AHRS (), Velocidades Angulares(/s),"
+    " Aceleraes nos trs eixos (g), Velocidade norte(m/s), leste(m/s), baixo(m/s), latitude(), longitude(), altitude(m),"
+    "Temperatura interna do NAV(C), byte de erro, byte de status, Tempo do NAV (ms), Tempo do Sistema e Validade dos dados"
+
+    "\n%% <phi>\t<theta>\t<psi>\t<p>\t<q>\t<r>\t<x''>\t<y''>\t<z''>\t<nVel>\t<eVel>\t"
+    "<dVel>\t<Long>\t<Lat>\t<Alt>\t<Temp>\t<erro>\t<status>\t<time_stamp>\t<time_sys>\t<validade>\n"
+
+    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%"
+    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%\n",
+
+    // STREAM_PITOT
+    "\n%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%"
+    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%\n"
+    "%% Arquivo de aquisio do tubo de pitot - %s"
+    "\n%% Presso esttica (Pa), Temperatura (C), Presso dinmica(int), ngulo de ataque (int),"
+    "ngulo de deslizamento (int) , Tempo do Sistema e Validade dos dados"
+
+    "\n%% <static>\t<temperature>\t<dynamic>\t<attack>\t<sideslip>\t<time_sys>\t<validade>\n"
+
+    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%"
+    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%\n"
+};
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+size_t log_text_header(char *buf, size_t cap, log_stream_t stream, const char *file_name)
+{
+    int n = snprintf(buf, cap, headers[stream], file_name);
+
+    if (n < 0)
+        return 0;
+
+    return ((size_t)n < cap) ? (size_t)n : cap - 1;
+}
+
+// Nomes dos valores das linhas, na ordem em que sao escritos, como nas tabelas de campos
+// do log_format.c
+static const char *ahrs_columns[] = {
+    "angle[0]", "angle[1]", "angle[2]", "gyro[0]", "gyro[1]", "gyro[2]",
+    "accel[0]", "accel[1]", "accel[2]", "magnet[0]", "magnet[1]", "magnet[2]",
+    "temp", "time_stamp", "time_sys", "validade"
+};
+
+static const char *daq_columns[] = {
+    "tensao[0]", "tensao[1]", "tensao[2]", "tensao[3]", "tensao[4]", "tensao[5]",
+    "tensao[6]", "tensao[7]", "tensao[8]", "tensao[9]", "tensao[10]", "tensao[11]",
+    "tensao[12]", "tensao[13]", "tensao[14]", "tensao[15]", "time_sys", "validade"
+};
+
+static const char *gps_columns[] = {
+    "latitude", "longitude", "altitude", "hdop", "geoid_separation", "north_south",
+    "east_west", "n_satellites", "units_altitude", "units_geoid_separation", "GPS_time_gga",
+    "east_v", "north_v", "up_v", "hpe", "vpe", "epe", "gspeed", "course", "date", "magvar",
+    "magvardir", "mode", "time_sys", "validity"
+};
+
+static const char *nav_columns[] = {
+    "angle[0]", "angle[1]", "angle[2]", "gyro[0]", "gyro[1]", "gyro[2]",
+    "accel[0]", "accel[1]", "accel[2]", "nVel", "eVel", "dVel", "latitude", "longitude",
+    "altitude", "temp", "internal_error", "internal_status", "time_stamp", "time_sys", "validade"
+};
+
+static const char *pitot_columns[] = {
+    "static_pressure", "temperature", "dynamic_pressure", "attack_angle", "sideslip_angle",
+    "time_sys", "validade"
+};
+
+#define N_COLUMNS(columns) ((int)(sizeof(columns)/sizeof(columns[0])))
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+const char *const *log_text_columns(log_stream_t stream, int *n)
+{
+    switch (stream) {
+        case STREAM_AHRS:
+            *n = N_COLUMNS(ahrs_columns);
+            return ahrs_columns;
+        case STREAM_DAQ:
+            *n = N_COLUMNS(daq_columns);
+            return daq_columns;
+        case STREAM_GPS:
+            *n = N_COLUMNS(gps_columns);
+            return gps_columns;
+        case STREAM_NAV:
+            *n = N_COLUMNS(nav_columns);
+            return nav_columns;
+        case STREAM_PITOT:
+            *n = N_COLUMNS(pitot_columns);
+            return pitot_columns;
+        default:
+            *n = 0;
+            return NULL;
+    }
+}
@@ -0,0 +1,227 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            CONVERSAO DE UM LOG DE VOO COMPRIMIDO (.fdz) OU COM JOURNAL (.fdj) EM UM LOG
+            BINARIO BRUTO (.bin), LEGIVEL PELO TESTS/LE_LOG_BINARIO.M - LOG_UNPACK
+
+Uso: log_unpack [-t de ate] arquivo.fdz [arquivo.bin]
+
+    Com -t apenas os registros entre de e ate segundos depois do primeiro registro do
+arquivo sao gravados, encontrados pelo indice de tempo do arquivo (ver log_index.h);
+arquivos binarios brutos tambem sao aceitos. A saida recebe entao o nome da entrada e da
+janela, p.ex. daq_file_120-150s.bin.
+*********************************************************************************************
+********************************************************************************************/
+
+#include "log_codec.h"
+#include "log_index.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que grava em out_name os registros da janela [from, to] (segundos depois do
+// primeiro registro) de in_name, com o cabecalho e a tabela de campos da entrada
+static int unpack_window(const char *in_name, const char *out_name, log_header_t *header,
+                         const log_field_t *fields, double from, double to)
+{
+    log_index_map_t m;
+    void *records;
+    size_t record_size;
+    int64_t start;
+    long n;
+    FILE *out;
+
+    if ((log_index_load(&m, in_name) < 0) || (m.n == 0)) {
+        fprintf(stderr, "%s: no time index (%s%s)\n", in_name, in_name, LOG_EXT_INDEX);
+        return 1;
+    }
+    start = m.entries[0].time_sys;
+    log_index_unload(&m);
+
+    n = log_read_window(in_name, start + (int64_t)(from*1e9), start + (int64_t)(to*1e9),
+                        &records, &record_size);
+    if (n < 0) {
+        fprintf(stderr, "%s: read error\n", in_name);
+        return 1;
+    }
+
+    if ((out = fopen(out_name, "wb")) == NULL) {
+        perror(out_name);
+        return 1;
+    }
+    header->encoding = LOG_RAW;
+    fwrite(header, sizeof(*header), 1, out);
+    fwrite(fields, sizeof(log_field_t), header->n_fields, out);
+    fwrite(records, record_size, n, out);
+    free(records);
+    if (fclose(out) != 0) {
+        perror(out_name);
+        return 1;
+    }
+
+    printf("%s: %ld records from %g s to %g s -> %s\n", in_name, n, from, to, out_name);
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int main(int argc, char *argv[])
+{
+    FILE *in, *out;
+    log_header_t header;
+    log_field_t *fields;
+    log_layout_t layout;
+    log_block_t block;
+    unsigned char *payload;
+    char *records;
+    char out_name[1024];
+    size_t len, bound;
+    const char *ext;
+    const char *in_name;
+    uint32_t encoding;
+    unsigned long long n_records = 0, n_blocks = 0;
+    double from = 0, to = 0;
+    int window = 0, arg = 1;
+
+    if ((argc >= 4) && (strcmp(argv[1], "-t") == 0)) {
+        window = 1;
+        from = atof(argv[2]);
+        to = atof(argv[3]);
+        arg = 4;
+    }
+    if ((argc < arg + 1) || (argc > arg + 2)) {
+        fprintf(stderr, "Usage: %s [-t from to] file%s|file%s [file%s]\n", argv[0], LOG_EXT_COMPRESSED,
+                LOG_EXT_JOURNAL, LOG_EXT_BINARY);
+        return 1;
+    }
+    in_name = argv[arg];
+
+    if ((in = fopen(in_name, "rb")) == NULL) {
+        perror(in_name);
+        return 1;
+    }
+
+    if ((fread(&header, sizeof(header), 1, in) != 1) ||
+        (memcmp(header.magic, LOG_MAGIC, LOG_MAGIC_LEN) != 0)) {
+        fprintf(stderr, "%s: not a flight log file\n", in_name);
+        return 1;
+    }
+    if ((header.encoding != LOG_DELTA) && (header.encoding != LOG_JOURNAL) &&
+        (!window || (header.encoding != LOG_RAW))) {
+        fprintf(stderr, "%s: not a compressed or journaled flight log file\n", in_name);
+        return 1;
+    }
+    if ((header.encoding != LOG_RAW) && (header.version != LOG_VERSION)) {
+        fprintf(stderr, "%s: unsupported version %u\n", in_name, header.version);
+        return 1;
+    }
+    encoding = header.encoding;
+    if (encoding == LOG_RAW)
+        ext = LOG_EXT_BINARY;
+    else
+        ext = (encoding == LOG_DELTA) ? LOG_EXT_COMPRESSED : LOG_EXT_JOURNAL;
+
+    fields = malloc(header.n_fields*sizeof(log_field_t));
+    if ((fields == NULL) ||
+        (fread(fields, sizeof(log_field_t), header.n_fields, in) != header.n_fields) ||
+        (log_layout_init(&layout, fields, header.n_fields, header.record_size) < 0)) {
+        fprintf(stderr, "%s: bad field table\n", in_name);
+        return 1;
+    }
+
+    // Nome da saida: o nome da entrada com a extensao dos arquivos binarios brutos
+    if (argc == arg + 2)
+        snprintf(out_name, sizeof(out_name), "%s", argv[arg + 1]);
+    else {
+        snprintf(out_name, sizeof(out_name), "%s", in_name);
+        len = strlen(out_name);
+        if ((len >= strlen(ext)) && (strcmp(out_name + len - strlen(ext), ext) == 0))
+            out_name[len - strlen(ext)] = '\0';
+        if (window) {
+            len = strlen(out_name);
+            snprintf(out_name + len, sizeof(out_name) - len, "_%g-%gs", from, to);
+        }
+        strncat(out_name, LOG_EXT_BINARY, sizeof(out_name) - 1 - strlen(out_name));
+    }
+
+    if (window) {
+        int status = unpack_window(in_name, out_name, &header, fields, from, to);
+
+        fclose(in);
+        log_layout_free(&layout);
+        free(fields);
+        return status;
+    }
+
+    if ((out = fopen(out_name, "wb")) == NULL) {
+        perror(out_name);
+        return 1;
+    }
+
+    // Mesmo cabecalho e tabela de campos, registros brutos
+    header.encoding = LOG_RAW;
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(fields, sizeof(log_field_t), header.n_fields, out);
+    fseek(in, header.header_size, SEEK_SET);
+
+    if (encoding == LOG_JOURNAL)
+        bound = header.record_size;
+    else
+        bound = log_block_bound(&layout, 1);
+    payload = malloc(bound*LOG_CODEC_BLOCK_RECORDS);
+    records = malloc(LOG_CODEC_BLOCK_RECORDS*header.record_size);
+    if ((payload == NULL) || (records == NULL)) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    while (fread(&block, sizeof(block), 1, in) == 1) {
+        if (log_block_check_header(&block) < 0) {
+            fprintf(stderr, "%s: bad block after %llu records\n", in_name, n_records);
+            break;
+        }
+        if (block.magic == LOG_COMMIT_MAGIC)
+            continue;
+        if ((block.n_records == 0) || (block.n_records > LOG_CODEC_BLOCK_RECORDS) ||
+            (block.size > bound*block.n_records)) {
+            fprintf(stderr, "%s: bad block after %llu records\n", in_name, n_records);
+            break;
+        }
+        if (fread(payload, 1, block.size, in) != block.size) {
+            // A gravacao foi interrompida no meio de um bloco
+            fprintf(stderr, "%s: incomplete block after %llu records\n", in_name, n_records);
+            break;
+        }
+        if (log_block_check_data(&block, payload) < 0) {
+            fprintf(stderr, "%s: corrupt block after %llu records\n", in_name, n_records);
+            break;
+        }
+        if (encoding == LOG_JOURNAL) {
+            if (block.size != block.n_records*header.record_size) {
+                fprintf(stderr, "%s: bad block after %llu records\n", in_name, n_records);
+                break;
+            }
+            memcpy(records, payload, block.size);
+        }
+        else if (log_decode_block(&layout, payload, block.size, block.n_records, records) < 0) {
+            fprintf(stderr, "%s: corrupt block after %llu records\n", in_name, n_records);
+            break;
+        }
+        fwrite(records, header.record_size, block.n_records, out);
+        n_records += block.n_records;
+        n_blocks++;
+    }
+
+    if (fclose(out) != 0) {
+        perror(out_name);
+        return 1;
+    }
+    fclose(in);
+
+    printf("%s: %llu records in %llu blocks -> %s\n", in_name, n_records, n_blocks, out_name);
+
+    return 0;
+}
@@ -0,0 +1,454 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            GRAVADOR COM BUFFER DOS ARQUIVOS DE DADOS DO VOO - LOG_WRITER
+*********************************************************************************************
+********************************************************************************************/
+
+#define _GNU_SOURCE     // fallocate(), mremap()
+
+#include "log_writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+long long log_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_writer_open(log_writer_t *w, const char *path, int flush_ms, int sync_data)
+{
+    void *buf;
+
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+
+    if (posix_memalign(&buf, LOG_WRITER_ALIGN, LOG_WRITER_BUF_SIZE) != 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    w->fd = open(path, O_WRONLY|O_CREAT|O_TRUNC,
+                 S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH);
+    if (w->fd < 0) {
+        free(buf);
+        return -1;
+    }
+
+    w->buf = buf;
+    w->size = LOG_WRITER_BUF_SIZE;
+    w->flush_ms = flush_ms;
+    w->sync_data = sync_data;
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static size_t round_up(size_t n, size_t to)
+{
+    return (n + to - 1)/to*to;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que aloca os blocos de [from, to) no arquivo. Sistemas de arquivos sem
+// fallocate() ficam apenas com um arquivo esparso do tamanho certo.
+static int allocate(int fd, size_t from, size_t to)
+{
+    if (fallocate(fd, 0, from, to - from) == 0)
+        return 0;
+    if ((errno != EOPNOTSUPP) && (errno != ENOSYS))
+        return -1;
+
+    return ftruncate(fd, to);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que escreve em um byte de cada pagina de [from, to) para que as faltas de pagina
+// acontecam agora e nao no meio do voo. As paginas ainda sao zero, assim como o dado
+// escrito.
+static void prefault(log_writer_t *w, size_t from, size_t to)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t i;
+
+    for (i = from; i < to; i += page)
+        ((volatile char *)w->map)[i] = 0;
+    w->prefaulted = to;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que mantem LOG_WRITER_PREFAULT bytes ja mapeados a frente dos dados, em passos
+// da metade disso, dentro do arquivo alocado. Somente paginas inteiras depois dos dados
+// sao tocadas.
+static void prefault_ahead(log_writer_t *w)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t from = round_up(w->offset, page);
+    size_t to = round_up(w->offset + LOG_WRITER_PREFAULT, page);
+
+    if (w->offset + LOG_WRITER_PREFAULT/2 < w->prefaulted)
+        return;
+    if (from < w->prefaulted)
+        from = w->prefaulted;
+    if (to > w->map_size)
+        to = w->map_size;
+    if (to > from)
+        prefault(w, from, to);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_writer_open_mapped(log_writer_t *w, const char *path, size_t prealloc,
+                           int flush_ms, int sync_data)
+{
+    void *map;
+    int saved;
+
+    memset(w, 0, sizeof(*w));
+
+    if (prealloc == 0)
+        prealloc = LOG_WRITER_MAP_CHUNK;
+    prealloc = round_up(prealloc, sysconf(_SC_PAGESIZE));
+
+    w->fd = open(path, O_RDWR|O_CREAT|O_TRUNC,
+                 S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH);
+    if (w->fd < 0)
+        return -1;
+
+    if (allocate(w->fd, 0, prealloc) < 0)
+        goto fail;
+
+    map = mmap(NULL, prealloc, PROT_READ|PROT_WRITE, MAP_SHARED, w->fd, 0);
+    if (map == MAP_FAILED)
+        goto fail;
+
+    w->map = map;
+    w->map_size = prealloc;
+    w->flush_ms = flush_ms;
+    w->sync_data = sync_data;
+
+    prefault(w, 0, (prealloc < LOG_WRITER_PREFAULT) ? prealloc : LOG_WRITER_PREFAULT);
+
+    return 0;
+
+fail:
+    saved = errno;
+    close(w->fd);
+    w->fd = -1;
+    errno = saved;
+    return -1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que aumenta o arquivo e o seu mapeamento, em passos de LOG_WRITER_MAP_CHUNK, ate
+// caberem mais len bytes
+static int map_reserve(log_writer_t *w, size_t len)
+{
+    size_t new_size;
+    void *map;
+
+    if (w->offset + len <= w->map_size)
+        return 0;
+
+    new_size = w->map_size + round_up(w->offset + len - w->map_size, LOG_WRITER_MAP_CHUNK);
+
+    if (allocate(w->fd, w->map_size, new_size) < 0)
+        goto fail;
+
+    map = mremap(w->map, w->map_size, new_size, MREMAP_MAYMOVE);
+    if (map == MAP_FAILED)
+        goto fail;
+
+    w->map = map;
+    w->map_size = new_size;
+    return 0;
+
+fail:
+    if (!w->error)
+        w->error = errno;
+    return -1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que grava no disco as paginas do mapeamento que podem ter mudado desde o ultimo
+// msync()
+static int map_sync(log_writer_t *w)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t start = w->synced/page*page;
+
+    if (w->offset == w->synced)
+        return 0;
+
+    if (msync(w->map + start, w->offset - start, MS_SYNC) < 0) {
+        if (!w->error)
+            w->error = errno;
+        return -1;
+    }
+    w->synced = w->offset;
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao de flush do modo mapeado: somente sync_data tem algo a fazer
+static int map_flush(log_writer_t *w)
+{
+    int status = 0;
+
+    if (w->sync_data && (w->fill > 0))
+        status = map_sync(w);
+    w->fill = 0;
+    w->deadline = 0;
+
+    return status;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_writer_flush(log_writer_t *w)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    if (w->map)
+        return map_flush(w);
+
+    while (done < w->fill) {
+        n = write(w->fd, w->buf + done, w->fill - done);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (!w->error)
+                w->error = errno;
+            // Os dados sao descartados, senao um disco cheio travaria quem chama para
+            // sempre
+            w->fill = 0;
+            w->deadline = 0;
+            return -1;
+        }
+        done += n;
+    }
+    w->fill = 0;
+    w->deadline = 0;
+
+    if (w->sync_data && done)
+        fdatasync(w->fd);
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Marca o momento em que o primeiro byte entra em um buffer vazio
+static void start_deadline(log_writer_t *w)
+{
+    if (w->fill == 0)
+        w->deadline = log_now_ns() + (long long)w->flush_ms*1000000LL;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_writer_write(log_writer_t *w, const void *data, size_t len)
+{
+    const char *p = data;
+    size_t n;
+    int status = 0;
+
+    // bytes conta somente o que foi copiado, como na log_writer_printf()
+    if (w->map) {
+        if (map_reserve(w, len) < 0)
+            return -1;
+        memcpy(w->map + w->offset, p, len);
+        w->offset += len;
+        w->bytes += len;
+        prefault_ahead(w);
+        // Sem sync_data nao sobra nada para gravar
+        if (w->sync_data) {
+            start_deadline(w);
+            w->fill += len;
+        }
+        return 0;
+    }
+
+    while (len > 0) {
+        start_deadline(w);
+
+        n = w->size - w->fill;
+        if (n > len)
+            n = len;
+        memcpy(w->buf + w->fill, p, n);
+        w->fill += n;
+        w->bytes += n;
+        p += n;
+        len -= n;
+
+        // Buffers cheios sao gravados com um unico write() alinhado
+        if (w->fill == w->size)
+            if (log_writer_flush(w) < 0)
+                status = -1;
+    }
+
+    return status;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_writer_printf(log_writer_t *w, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    if (w->map) {
+        size_t room = w->map_size - w->offset;
+
+        va_start(ap, fmt);
+        n = vsnprintf(w->map + w->offset, room, fmt, ap);
+        va_end(ap);
+        if (n < 0)
+            return -1;
+
+        // Aumenta o mapeamento e formata o texto de novo se ele nao coube
+        if ((size_t)n >= room) {
+            if (map_reserve(w, n + 1) < 0)
+                return -1;
+            va_start(ap, fmt);
+            vsnprintf(w->map + w->offset, n + 1, fmt, ap);
+            va_end(ap);
+        }
+
+        w->offset += n;
+        w->bytes += n;
+        prefault_ahead(w);
+        if (w->sync_data) {
+            start_deadline(w);
+            w->fill += n;
+        }
+        return 0;
+    }
+
+    start_deadline(w);
+
+    // Formata direto no buffer quando o texto cabe nele
+    va_start(ap, fmt);
+    n = vsnprintf(w->buf + w->fill, w->size - w->fill, fmt, ap);
+    va_end(ap);
+
+    if (n < 0)
+        return -1;
+
+    if ((size_t)n < w->size - w->fill) {
+        w->fill += n;
+        w->bytes += n;
+        return 0;
+    }
+
+    // Senao formata em um buffer temporario e o acrescenta
+    {
+        char *tmp = malloc(n + 1);
+        int status;
+
+        if (tmp == NULL)
+            return -1;
+        va_start(ap, fmt);
+        vsnprintf(tmp, n + 1, fmt, ap);
+        va_end(ap);
+        status = log_writer_write(w, tmp, n);
+        free(tmp);
+        return status;
+    }
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_writer_sync(log_writer_t *w)
+{
+    if (w->map) {
+        w->fill = 0;
+        w->deadline = 0;
+        return map_sync(w);
+    }
+
+    if (log_writer_flush(w) < 0)
+        return -1;
+
+    // Com sync_data o flush ja fez isso
+    if (!w->sync_data && (fdatasync(w->fd) < 0) && (errno != EINVAL)) {
+        if (!w->error)
+            w->error = errno;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_writer_tick(log_writer_t *w, long long now)
+{
+    if ((w->fill > 0) && (now >= w->deadline))
+        return log_writer_flush(w);
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int log_writer_close(log_writer_t *w)
+{
+    int status = 0;
+
+    if (w->fd < 0)
+        return 0;
+
+    if (w->map) {
+        // A cauda pre-alocada do arquivo eh cortada
+        if (munmap(w->map, w->map_size) < 0)
+            status = -1;
+        if (ftruncate(w->fd, w->offset) < 0)
+            status = -1;
+        w->map = NULL;
+    }
+    else if (log_writer_flush(w) < 0)
+        status = -1;
+
+    // Qualquer que seja a configuracao de durabilidade, o fim do voo vai para o disco
+    if (fdatasync(w->fd) < 0 && errno != EINVAL)
+        status = -1;
+
+    if (close(w->fd) < 0)
+        status = -1;
+
+    // Erros de escrita anteriores tambem sao informados aqui
+    if (w->error)
+        status = -1;
+
+    free(w->buf);
+    w->buf = NULL;
+    w->fd = -1;
+
+    return status;
+}
@@ -21,6 +21,7 @@
  */
 
 #include "modem.h"
+#include "dev_counters.h"
 
 // The file below defines the default serial port for our application
 #include "rtai_rt_serial.h"
@@ -64,6 +65,10 @@ DECLARE_CRC8_TABLE(crc_table);
 
 /** Internal functions **/
 static void errmsg(char * msg);
+static void count_frame(int dev, int sent);
+
+//Telemetry frames sent and dropped of each device, read by fdc_master
+static dev_counters_block_t *counters;
 
 /** Module code **/
 static int __init modem_init() {
@@ -84,6 +89,9 @@ static int __init modem_init() {
   }
   
   crc8_populate_msb(crc_table, 0xD5);
+
+  if ((counters = dev_counters_get()) == NULL)
+    errmsg("Could not attach the device counters.");
   
  spopen_fail: return err;
 }
@@ -91,6 +99,11 @@ static int __init modem_init() {
 static void __exit modem_cleanup() {
   if (rt_spclose(ser_port) == -ENODEV)
     errmsg("Error closing serial: rtai_serial claims port does not exist.");
+
+  if (counters != NULL) {
+    counters = NULL;
+    dev_counters_put();
+  }
 }
 
 module_init(modem_init);
@@ -103,6 +116,7 @@ void modem_send_ahrs_data(const msg_ahrs_t *ahrs_msg){
 
   if (rt_spget_txfrbs(ser_port) < 2 + 4*3*4 + 4 + 1) {
     errmsg("serial buffer full.");
+    count_frame(DEV_AHRS, 0);
     return;
   }
 
@@ -127,6 +141,7 @@ void modem_send_ahrs_data(const msg_ahrs_t *ahrs_msg){
   crc = crc8(crc_table, (u8*) &timestamp, sizeof(timestamp), crc);
   
   rt_spwrite(ser_port, (char*)&crc, -sizeof(crc));
+  count_frame(DEV_AHRS, 1);
 }
 
 void modem_send_daq_data(const msg_daq_t *daq_msg){
@@ -136,6 +151,7 @@ void modem_send_daq_data(const msg_daq_t *daq_msg){
 
   if (rt_spget_txfrbs(ser_port) < 2 + 4*16 + 4 + 1) {
     errmsg("serial buffer full.");
+    count_frame(DEV_DAQ, 0);
     return;
   }
 
@@ -154,6 +170,7 @@ void modem_send_daq_data(const msg_daq_t *daq_msg){
   crc = crc8(crc_table, (u8*) &timestamp, sizeof(timestamp), crc);
   
   rt_spwrite(ser_port, (char*)&crc, -sizeof(crc));
+  count_frame(DEV_DAQ, 1);
 }
 
 void modem_send_gps_data(const msg_gps_t *gps_msg){
@@ -163,6 +180,7 @@ void modem_send_gps_data(const msg_gps_t *gps_msg){
 
   if (rt_spget_txfrbs(ser_port) < 2 + 4*6 + 4 + 1) {
     errmsg("serial buffer full.");
+    count_frame(DEV_GPS, 0);
     return;
   }
 
@@ -191,6 +209,7 @@ void modem_send_gps_data(const msg_gps_t *gps_msg){
   crc = crc8(crc_table,(u8*)&timestamp, sizeof(timestamp), crc);
   
   rt_spwrite(ser_port, (char*)&crc, -sizeof(crc));
+  count_frame(DEV_GPS, 1);
 }
 
 void modem_send_nav_data(const msg_nav_t *nav_msg){
@@ -200,6 +219,7 @@ void modem_send_nav_data(const msg_nav_t *nav_msg){
 
   if (rt_spget_txfrbs(ser_port) < 2 + 4*3*5 + 4 + 1) {
     errmsg("serial buffer full.");
+    count_frame(DEV_NAV, 0);
     return;
   }
 
@@ -234,6 +254,7 @@ void modem_send_nav_data(const msg_nav_t *nav_msg){
   crc = crc8(crc_table, (u8*) &timestamp, sizeof(timestamp), crc);
   
   rt_spwrite(ser_port, (char*)&crc, -sizeof(crc));
+  count_frame(DEV_NAV, 1);
 }
 
 void modem_send_pitot_data(const msg_pitot_t *pitot_msg){
@@ -243,6 +264,7 @@ void modem_send_pitot_data(const msg_pitot_t *pitot_msg){
 
   if (rt_spget_txfrbs(ser_port) < 2 + 4*5 + 4 + 1) {
     errmsg("serial buffer full.");
+    count_frame(DEV_PITOT, 0);
     return;
   }
 
@@ -279,8 +301,20 @@ void modem_send_pitot_data(const msg_pitot_t *pitot_msg){
   crc = crc8(crc_table, (u8*) &timestamp, sizeof(timestamp), crc);
   
   rt_spwrite(ser_port, (char*)&crc, -sizeof(crc));
+  count_frame(DEV_PITOT, 1);
 }
 
 static void errmsg(char* msg){
   printk("Modem driver: %s\n",msg);
 }
+
+//Counts a telemetry frame of dev as sent or dropped. The send functions
+//are only called by the fdc_slave task, the single writer of these counters.
+static void count_frame(int dev, int sent){
+  if (counters == NULL)
+    return;
+  if (sent)
+    dev_count(&counters->devices[dev].tx_frames, 1);
+  else
+    dev_count(&counters->devices[dev].tx_drops, 1);
+}
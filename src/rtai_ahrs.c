@@ -18,12 +18,18 @@
 
 #include "rtai_ahrs.h"
 
+#include <linux/delay.h>
+
 MODULE_AUTHOR("Victor Costa da Silva Campos");
 MODULE_DESCRIPTION("Real time data acquisition of xbow AHRS400DC-200");
 MODULE_LICENSE("GPL");
 
 static void serial_callback(int rxavail, int txfree);
 
+// Counters of the AHRS, read by fdc_master (NULL if the block could not be attached)
+static dev_counters_block_t *counters_block;
+static dev_counters_t *counters;
+
 /*--------------------------------------------------------------------------------------------
                     AHRS FUNCTIONS
 --------------------------------------------------------------------------------------------*/
@@ -41,6 +47,22 @@ int rt_open_ahrs(void)
     return 0; // Success
 };
 
+//Waits up to timeout_ms for n bytes from the AHRS and returns the bytes available.
+//It sleeps between checks instead of busy waiting, so that the other modules
+//being loaded at the same time can configure their devices meanwhile, and
+//returns as soon as the answer arrives
+static int rt_wait_ahrs(int n, int timeout_ms)
+{
+    int waited = 0;
+
+    while ((rt_bytes_avail_serial(AHRS_PORT) < n) && (waited < timeout_ms)) {
+        msleep(AHRS_WAIT_STEP_MS);
+        waited += AHRS_WAIT_STEP_MS;
+    }
+
+    return rt_bytes_avail_serial(AHRS_PORT);
+}
+
 //Configures the AHRS communication
 int rt_cfg_ahrs(void)
 {
@@ -49,7 +71,7 @@ int rt_cfg_ahrs(void)
     rt_putch_serial(AHRS_PORT,POLLED_MODE);
     rt_flush_serial(AHRS_PORT);//Flush the data out to the serial port
     //Sleeps for 100ms (waiting for it to understand it shouldn't be sending packets anymore)
-    rt_busy_sleep(100000000);
+    msleep(100);
 
     //Discards available messages
     while (rt_bytes_avail_serial(AHRS_PORT)) // Evaluates if there are availa
@@ -60,8 +82,8 @@ int rt_cfg_ahrs(void)
     //Tries to ping the device
     rt_putch_serial(AHRS_PORT,PING);
     rt_flush_serial(AHRS_PORT);
-    //checks if we got the right answer
-    rt_busy_sleep(100000000);
+    //checks if we got the right answer (waits up to 100ms for it)
+    rt_wait_ahrs(1, 100);
     int ch = rt_getch_serial(AHRS_PORT);
     ch = ch&0xFF;
     if (ch != PING_RESPONSE) {
@@ -72,8 +94,8 @@ int rt_cfg_ahrs(void)
     //Gets the AHRS version and print it on the screen
     rt_putch_serial(AHRS_PORT,QUERY_VERSION);
     rt_flush_serial(AHRS_PORT);//Flush the data out to the serial port
-    //Sleeps for 100ms (waiting for it to understand)
-    rt_busy_sleep(100000000);
+    //Waits up to 100ms for the whole answer
+    rt_wait_ahrs(QUERY_VERSION_LENGTH, 100);
 
     //Mounts the message received
     char version_info[QUERY_VERSION_LENGTH+1];
@@ -95,8 +117,8 @@ int rt_cfg_ahrs(void)
     for (count_try=0; count_try<10; ++count_try) {
         rt_putch_serial(AHRS_PORT,ANGLE_MODE); //sends an angle mode msg
         rt_flush_serial(AHRS_PORT);//Flush the data out to the serial port
-        //Sleeps for 50ms (waiting for it to understand)
-        rt_busy_sleep(50000000);
+        //Waits up to 50ms for the answer
+        rt_wait_ahrs(1, 50);
 
         //Checks wether we've got the right answer
         if (rt_bytes_avail_serial(AHRS_PORT)) // Evaluates if there are available bytes
@@ -134,8 +156,8 @@ int rt_cfg_ahrs(void)
     for (count_try=0; count_try<10; ++count_try) {
         rt_putch_serial(AHRS_PORT,CONTINUOUS_MODE); //sends a continuous mode msg
         rt_flush_serial(AHRS_PORT);//Flush the data out to the serial port
-        //Sleeps for 10ms (waiting for it to understand)
-        rt_busy_sleep(10000000);
+        //Waits up to 10ms for any answer
+        rt_wait_ahrs(1, 10);
 
         //Checks wether we've got any answer
         if (rt_bytes_avail_serial(AHRS_PORT)) // Evaluates if there are available bytes
@@ -231,6 +253,8 @@ int rt_process_ahrs_serial(unsigned char* MessageBuffer)
     } state = SEARCHING_HEADER;
     int ch;            // Current byte in the serial port
     int checksum_status;
+    int from_serial;
+    static int discarding = 0;                        // Inside a run of discarded bytes
 
     //unsigned char circBuf[AHRS_MSG_LEN]; //circular buffer for receiving the data
     //static unsigned char BufferOffset = 0; //initial point on the circular buffer
@@ -240,8 +264,11 @@ int rt_process_ahrs_serial(unsigned char* MessageBuffer)
     while (rt_bytes_avail_serial(AHRS_PORT) || RecoverIndex < AHRS_MSG_LEN) // Checks if there are data available
     {
         //Get the next byte
-        ch = RecoverIndex < AHRS_MSG_LEN ? MessageBuffer[RecoverIndex++] : rt_getch_serial(AHRS_PORT);
+        from_serial = RecoverIndex >= AHRS_MSG_LEN;
+        ch = from_serial ? rt_getch_serial(AHRS_PORT) : MessageBuffer[RecoverIndex++];
         ch=ch&0xFF;
+        if (from_serial)
+            DEV_COUNT(counters, rx_bytes, 1);
 
         switch (state)
         {
@@ -249,7 +276,10 @@ int rt_process_ahrs_serial(unsigned char* MessageBuffer)
                 if (ch == AHRS_HEADER)
                 {
                     state = FILLING_BUFFER; //we found it, so we get the rest of the message
+                    discarding = 0;
                 }
+                else if (from_serial)
+                    dev_count_discarded(counters, &discarding, 1); //a byte out of a frame
             break;
             /////////////////////////////////////////////////////////////////////////
             case FILLING_BUFFER:
@@ -259,10 +289,17 @@ int rt_process_ahrs_serial(unsigned char* MessageBuffer)
                     MessageIndex = 0; state = SEARCHING_HEADER; //resets the finite state machine
                     //checks the crc and returns 0 (failure) or 1 (success)
                     checksum_status = rt_chksum_check(MessageBuffer);
-		    if (!checksum_status)
+		    if (!checksum_status) {
+		      //the bytes of the message are searched again for a header
+		      DEV_COUNT(counters, crc_errors, 1);
+		      DEV_COUNT(counters, resyncs, 1);
+		      discarding = 1;
 		      RecoverIndex = 0;
-		    else 
+		    }
+		    else {
+		      DEV_COUNT(counters, frames_ok, 1);
 		      return 1;
+		    }
                 }
             break;
         }
@@ -290,6 +327,14 @@ static int __rtai_ahrs_init(void)
 {    
     int err;
     
+    // Attaches to the counters block and resets the counters of the AHRS
+    if ((counters_block = dev_counters_get()) != NULL) {
+        dev_counters_reset(counters_block, DEV_AHRS);
+        counters = &counters_block->devices[DEV_AHRS];
+    }
+    else
+        rt_printk("[AHRS] Nao alocou os contadores do dispositivo\n");
+
     // Opens the AHRS communication
     if (rt_open_ahrs() < 0) {
         rt_printk("Nao abriu o dispositivo AHRS\n");
@@ -321,6 +366,10 @@ static void __rtai_ahrs_cleanup(void)
     else
         rt_printk("No conseguiu fechar a porta serial do AHRS\n");
 
+    if (counters_block != NULL) {
+        counters = NULL;
+        dev_counters_put();
+    }
 }
 
 module_init(__rtai_ahrs_init);
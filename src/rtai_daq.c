@@ -4,12 +4,25 @@ MODULE_AUTHOR("Guilherme A. S. Pereira and Armando Alves Neto");
 MODULE_DESCRIPTION("Real time data acquisition of PC104 DAC");
 MODULE_LICENSE("GPL");
 
+// Contadores da placa DAQ, lidos pelo fdc_master (NULL se nao foi possivel aloca-los)
+static dev_counters_block_t *counters_block;
+static dev_counters_t *counters;
+
 /*!/////////////////////////////////////////////////////////////////////////////////////////////
  *  Inicio do modulo da daq
  */
 static int __rtai_daq_init(void)
 {
     InitHw(BASE_ADRESS, VCMDAS1_PM5, VCMDAS1_PM5, VCMDAS1_PM5);   
+
+    // Zera os contadores da placa; sem porta serial, ela conta apenas as leituras validas
+    if ((counters_block = dev_counters_get()) != NULL) {
+        dev_counters_reset(counters_block, DEV_DAQ);
+        counters = &counters_block->devices[DEV_DAQ];
+    }
+    else
+        rt_printk("[DAQ] Nao alocou os contadores do dispositivo\n");
+
     return 0;
 }
 
@@ -18,6 +31,10 @@ static int __rtai_daq_init(void)
  */
 static void __rtai_daq_exit(void)
 {
+    if (counters_block != NULL) {
+        counters = NULL;
+        dev_counters_put();
+    }
 }
 
 module_init(__rtai_daq_init);
@@ -48,8 +65,10 @@ int rt_process_daq_16(msg_daq_t* msg)
         
     if (invalido)
         return 0;
-    else
+    else {
+        DEV_COUNT(counters, frames_ok, 1);
         return 1;        
+    }
 }
 
 /*!////////////////////////////////////////////////////////////////////////////////////////////
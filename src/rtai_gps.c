@@ -30,6 +30,10 @@ MODULE_AUTHOR("Victor Costa da Silva Campos");
 MODULE_DESCRIPTION("Real time data acquisition of garmin GPS18x-5Hz");
 MODULE_LICENSE("GPL");
 
+// Counters of the GPS, read by fdc_master (NULL if the block could not be attached)
+static dev_counters_block_t *counters_block;
+static dev_counters_t *counters;
+
 // Sends a GPS command over the serial
 void rt_sendGPScommand(const char *command)
 {    
@@ -564,6 +568,8 @@ void rt_process_gps_serial(unsigned char* msgbuf){
     int ch;
     //msg buffer "pointer"
     unsigned int msgIndex = 0;
+    //inside a run of discarded bytes
+    static int discarding = 0;
 
     //while we still have data on the serial buffer
     while (rt_bytes_avail_serial(GPS_PORT)) // Evaluates if there are available bytes
@@ -571,6 +577,7 @@ void rt_process_gps_serial(unsigned char* msgbuf){
         //Get a byte from the serial port.
         ch = rt_getch_serial(GPS_PORT);
         ch=ch&0xFF;
+        DEV_COUNT(counters, rx_bytes, 1);
 
         //finite state machine
         switch(state) {
@@ -578,7 +585,10 @@ void rt_process_gps_serial(unsigned char* msgbuf){
                 if(ch == GPS_HEADER) {
                     state++; //go to the next state
                     msgIndex = 0; //reset the msg index
-                };
+                    discarding = 0;
+                }
+                else if(ch != 0x0a) //the line feed after the end of a message is not lost
+                    dev_count_discarded(counters, &discarding, 1);
             break;
             case 1: //Filling up the message
                 if(ch != 0x0d) { //if it's not the end of the message
@@ -587,6 +597,12 @@ void rt_process_gps_serial(unsigned char* msgbuf){
                 else { //if it's the end of the message
                     if (checksum(msgbuf)) {//if the checksum is valid
                         rt_parse_msg(msgbuf); // parses the received message
+                        DEV_COUNT(counters, frames_ok, 1);
+                    }
+                    else {
+                        DEV_COUNT(counters, crc_errors, 1);
+                        DEV_COUNT(counters, resyncs, 1);
+                        discarding = 1;
                     };
                     state = 0; //resets the state machine
                     //could go to a state looking for the next end char
@@ -595,6 +611,10 @@ void rt_process_gps_serial(unsigned char* msgbuf){
             break;
         };//end switch
     };
+
+    //the state is not kept between calls: a message still incomplete is lost
+    if (state == 1)
+        dev_count_discarded(counters, &discarding, msgIndex + 1);
 };
 
 // Main function executed by the GPS real time task
@@ -628,9 +648,20 @@ static int __rtai_gps_init(void)
         return -1;
         }
 
+    // Attaches to the counters block and resets the counters of the GPS. It is released
+    // by the destructor, which only runs if this function returns 0.
+    if ((counters_block = dev_counters_get()) != NULL) {
+        dev_counters_reset(counters_block, DEV_GPS);
+        counters = &counters_block->devices[DEV_GPS];
+    }
+    else
+        rt_printk("[GPS] Nao alocou os contadores do dispositivo\n");
+
     // Creates the real time task
     if (rt_task_init(&task_gps, func_gps, 0, 5000, GPS_TASK_PRIORITY, 0, 0) < 0) {
         rt_printk("Falha ao criar a tarefa de tempo real do GPS\n");
+        if (counters_block != NULL)
+            dev_counters_put();
         return -1;
     }
     
@@ -641,6 +672,8 @@ static int __rtai_gps_init(void)
     //Launches the main task as a periodic task
     if (rt_task_make_periodic(&task_gps, now + tick_period, tick_period) < 0) {
         rt_printk("Nao consegui lancar tarefa de tempo real periodicamente\n");
+        if (counters_block != NULL)
+            dev_counters_put();
                 return -1;
     }
     
@@ -662,6 +695,11 @@ static void __rtai_gps_cleanup(void)
         rt_printk("Fechou a serial do GPS\n");
     else
         rt_printk("No conseguiu fechar a serial do GPS\n");    
+
+    if (counters_block != NULL) {
+        counters = NULL;
+        dev_counters_put();
+    }
 };
 
 
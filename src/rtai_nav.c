@@ -22,6 +22,10 @@ MODULE_AUTHOR("Victor Costa da Silva Campos");
 MODULE_DESCRIPTION("Real time data acquisition of xbow NAV440CA-400");
 MODULE_LICENSE("GPL");
 
+// Counters of the NAV, read by fdc_master (NULL if the block could not be attached)
+static dev_counters_block_t *counters_block;
+static dev_counters_t *counters;
+
 /*--------------------------------------------------------------------------------------------
                     NAV FUNCTIONS
 --------------------------------------------------------------------------------------------*/
@@ -165,24 +169,31 @@ int rt_process_nav_serial(unsigned char* MessageBuffer)
 {
     static unsigned char state = 0;      // binary state variable (0 -> waiting for header/ 1 -> filling message)
     unsigned char ch;            // Current byte in the serial port
+    int crc_status;
 
     static unsigned char MessageIndex = 0;            // Current message index
+    static int discarding = 0;                        // Inside a run of discarded bytes
 
     while (rt_bytes_avail_serial(NAV_PORT)) // Checks if there are data available
     {
         //Get a byte from the serial port.
         ch = rt_getch_serial(NAV_PORT);
         ch=ch&0xFF;
+        DEV_COUNT(counters, rx_bytes, 1);
 
         switch (state)
         {
             case 0:  //Look for the 1st header char
                 if (ch == NAV_HEADER_CHAR) state++; //we found it, so we get the rest of the message
+                else dev_count_discarded(counters, &discarding, 1);
             break;
             /////////////////////////////////////////////////////////////////////////
             case 1:  //Look for the 2nd header char
                 if (ch == NAV_HEADER_CHAR) state++; //we found it, so we get the rest of the message
-                else state = 0;
+                else {
+                    state = 0;
+                    dev_count_discarded(counters, &discarding, 2);
+                }
             break;
             /////////////////////////////////////////////////////////////////////////
             case 2: //Look for the first package type char
@@ -190,7 +201,10 @@ int rt_process_nav_serial(unsigned char* MessageBuffer)
                     state++;
                     MessageBuffer[MessageIndex++] = ch; //Save the byte
                 }
-                else state = 0;
+                else {
+                    state = 0;
+                    dev_count_discarded(counters, &discarding, 3);
+                }
             break;
             /////////////////////////////////////////////////////////////////////////
             case 3: //Look for the second package type char
@@ -201,6 +215,7 @@ int rt_process_nav_serial(unsigned char* MessageBuffer)
                 else {
                     state = 0;
                     MessageIndex = 0;
+                    dev_count_discarded(counters, &discarding, 4);
                 }
             break;
             /////////////////////////////////////////////////////////////////////////
@@ -208,10 +223,12 @@ int rt_process_nav_serial(unsigned char* MessageBuffer)
                 if (ch == 42) {
                     state++;
                     MessageBuffer[MessageIndex++] = ch; //Save the byte
+                    discarding = 0;
                 }
                 else {
                     state = 0;
                     MessageIndex = 0;
+                    dev_count_discarded(counters, &discarding, 5);
                 }
             break;
             /////////////////////////////////////////////////////////////////////////
@@ -221,7 +238,15 @@ int rt_process_nav_serial(unsigned char* MessageBuffer)
                 if (MessageIndex == NAV_MSG_LEN) {
                     MessageIndex = 0; state = 0; //resets the finite state machine
                     //checks the crc and returns 0 (failure) or 1 (success)
-                    return rt_crc_check(MessageBuffer);
+                    crc_status = rt_crc_check(MessageBuffer);
+                    if (crc_status)
+                        DEV_COUNT(counters, frames_ok, 1);
+                    else {
+                        DEV_COUNT(counters, crc_errors, 1);
+                        DEV_COUNT(counters, resyncs, 1);
+                        discarding = 1;
+                    }
+                    return crc_status;
                 }
             break;
         };
@@ -258,6 +283,14 @@ int rt_crc_check(unsigned char* MessageBuffer){
 // NAV module initializer
 static int __rtai_nav_init(void)
 {
+    // Attaches to the counters block and resets the counters of the NAV
+    if ((counters_block = dev_counters_get()) != NULL) {
+        dev_counters_reset(counters_block, DEV_NAV);
+        counters = &counters_block->devices[DEV_NAV];
+    }
+    else
+        printk("[NAV] Nao alocou os contadores do dispositivo\n");
+
     // Opens the NAV communication
     if (rt_open_nav() < 0) {
         printk("Nao abriu o dispositivo NAV\n");
@@ -277,6 +310,11 @@ static int __rtai_nav_init(void)
 static void __rtai_nav_cleanup(void)
 {
     rt_close_serial(NAV_PORT);
+
+    if (counters_block != NULL) {
+        counters = NULL;
+        dev_counters_put();
+    }
 }
 
 module_init(__rtai_nav_init);
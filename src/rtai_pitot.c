@@ -22,6 +22,10 @@ MODULE_AUTHOR("Victor Costa da Silva Campos");
 MODULE_DESCRIPTION("Real time data acquisition of the wireless pitot tube");
 MODULE_LICENSE("GPL");
 
+// Counters of the PITOT, read by fdc_master (NULL if the block could not be attached)
+static dev_counters_block_t *counters_block;
+static dev_counters_t *counters;
+
 /*--------------------------------------------------------------------------------------------
                     PITOT FUNCTIONS
 --------------------------------------------------------------------------------------------*/
@@ -115,22 +119,31 @@ int rt_process_pitot_serial(unsigned char* MessageBuffer)
     unsigned char ch;            // Current byte in the serial port
 
     static unsigned char MessageIndex = 0;            // Current message index
+    static int discarding = 0;                        // Inside a run of discarded bytes
 
     while (rt_bytes_avail_serial(PITOT_PORT)) // Checks if there are data available
     {
         //Get a byte from the serial port.
         ch = rt_getch_serial(PITOT_PORT);
         ch=ch&0xFF;
+        DEV_COUNT(counters, rx_bytes, 1);
 
         switch (state)
         {
             case 0:  //Look for the 1st header char
                 if (ch == PITOT_HEADER_CHAR) state++; //we found it, so we get the rest of the message
+                else dev_count_discarded(counters, &discarding, 1);
             break;
             /////////////////////////////////////////////////////////////////////////
             case 1:  //Look for the 2nd header char
-                if (ch == PITOT_HEADER_CHAR) state++; //we found it, so we get the rest of the message
-                else state = 0;
+                if (ch == PITOT_HEADER_CHAR) {
+                    state++; //we found it, so we get the rest of the message
+                    discarding = 0;
+                }
+                else {
+                    state = 0;
+                    dev_count_discarded(counters, &discarding, 2);
+                }
             break;
             /////////////////////////////////////////////////////////////////////////
             case 2: //Fill the message buffer
@@ -138,6 +151,8 @@ int rt_process_pitot_serial(unsigned char* MessageBuffer)
                 //checks to see if we completed the message
                 if (MessageIndex == PITOT_MSG_LEN) {
                     MessageIndex = 0; state = 0; //resets the finite state machine
+                    //the message has no checksum
+                    DEV_COUNT(counters, frames_ok, 1);
                     return 1;
                 }
             break;
@@ -158,9 +173,20 @@ static int __rtai_pitot_init(void)
         return -1;
         }
 
+    // Attaches to the counters block and resets the counters of the PITOT. It is released
+    // by the destructor, which only runs if this function returns 0.
+    if ((counters_block = dev_counters_get()) != NULL) {
+        dev_counters_reset(counters_block, DEV_PITOT);
+        counters = &counters_block->devices[DEV_PITOT];
+    }
+    else
+        rt_printk("[PITOT] Nao alocou os contadores do dispositivo\n");
+
     // Creates the real time task
     if (rt_task_init(&task_pitot, func_pitot, 0, 5000, PITOT_TASK_PRIORITY, 0, 0) < 0) {
         rt_printk("Falha ao criar a tarefa de tempo real do PITOT\n");
+        if (counters_block != NULL)
+            dev_counters_put();
         return -1;
     }
     
@@ -171,6 +197,8 @@ static int __rtai_pitot_init(void)
     //Launches the main task as a periodic task
     if (rt_task_make_periodic(&task_pitot, now + tick_period, tick_period) < 0) {
         rt_printk("[__rtai_pitot_init]:Nao consegui lancar tarefa de tempo real periodicamente\n");
+        if (counters_block != NULL)
+            dev_counters_put();
                 return -1;
     }
     return 0;
@@ -182,6 +210,11 @@ static void __rtai_pitot_cleanup(void)
     //Terminates the real time task
     rt_task_delete(&task_pitot);
     rt_close_serial(PITOT_PORT);    
+
+    if (counters_block != NULL) {
+        counters = NULL;
+        dev_counters_put();
+    }
 };
 
 module_init(__rtai_pitot_init);
@@ -1,281 +1,301 @@
 #include "save_data.h"
+#include "log_text.h"
+#include "telemetry.h"
+#include "history.h"
 
-// Varivel global que contem os dados retirados da FIFO ahrs
- msg_ahrs_t msg_ahrs;
-// Varivel global que contem os dados retirados da FIFO daq
- msg_daq_t msg_daq;
-// Varivel global que contem os dados retirados da FIFO gps
- msg_gps_t msg_gps;
-// Varivel global que contem os dados retirados da FIFO nav
- msg_nav_t msg_nav;
- // Varivel global que contem os dados retirados da FIFO pitot
- msg_pitot_t msg_pitot;
+#include <poll.h>
+#include <stddef.h>
+
+// Posicao do pipe de despertar, da FIFO de aviso dos aneis e da FIFO dos resumos do
+// periodo da tarefa de tempo real no vetor do poll(). As FIFOs de dados ocupam as
+// posicoes STREAM_AHRS a STREAM_PITOT (-1 quando os dados chegam pelos aneis da memoria
+// compartilhada, e vice-versa).
+#define POLL_WAKEUP N_STREAMS
+#define POLL_RINGS  (N_STREAMS+1)
+#define POLL_JITTER (N_STREAMS+2)
+#define N_POLL      (N_STREAMS+3)
+
+// Resumos lidos da FIFO de atraso da tarefa de tempo real por chamada
+#define JITTER_BATCH 16
+
+// Latencia das amostras de cada dispositivo, desde o instante da amostra (time_sys) ate a
+// leitura da FIFO (ou do anel) e ate a saida do buffer do arquivo. Cada histograma eh
+// escrito por uma unica thread (save_data() ou a thread de escrita do dispositivo), e
+// todos sao zerados no inicio de cada voo.
+static lat_hist_t latencia_fila[N_STREAMS], latencia_escrita[N_STREAMS];
+static lat_clock_t relogio;    // Diferenca entre log_now_ns() e o relogio do RTAI
+
+// Posicao de time_sys nos registros de cada dispositivo
+static const size_t tempo_sys[N_STREAMS] = {
+    offsetof(msg_ahrs_t, time_sys), offsetof(msg_daq_t, time_sys), offsetof(msg_gps_t, time_sys),
+    offsetof(msg_nav_t, time_sys), offsetof(msg_pitot_t, time_sys)
+};
+
+static long long record_time(log_stream_t stream, const void* registro)
+{
+    long long t;
+
+    memcpy(&t, (const char*)registro + tempo_sys[stream], sizeof(t));
+    return t;
+}
 
-               
 
 /*!*******************************************************************************************
 *********************************************************************************************/
 // Funcao para escrita dos cabecalhos dos arquivos
-int write_headers (FILE* arq_daq, FILE* arq_ahrs, FILE* arq_gps, FILE* arq_nav, FILE* arq_pitot) {
+int write_headers (log_writer_t* arq_daq, log_writer_t* arq_ahrs, log_writer_t* arq_gps, log_writer_t* arq_nav, log_writer_t* arq_pitot) {
 
-    /// Escreve os cabecalhos dos arquivos
-    fprintf(arq_daq,
-    "\n%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%"
-    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%\n"
-    "%% Arquivo da Placa de Aquisicao de Dados (DAQ) - %s"
-    "\n%% Valores das tensoes dos canais, Tempo do sistema e Validade dos dados"
+    char cabecalho[LOG_TEXT_HEADER_MAX];
 
-    "\n%% <can00>\t<can01>\t<can02>\t<can03>\t<can04>\t<can05>\t<can06>\t<can07>\t"
-           "<can08>\t<can09>\t<can10>\t<can11>\t<can12>\t<can13>\t<can14>\t<can15>\t"
-           "<time_stamp>\t<validade>\n"
+    /// Escreve os cabecalhos dos arquivos (o texto esta em log_text.c, junto com as linhas)
+    log_writer_write(arq_daq, cabecalho, log_text_header(cabecalho, sizeof(cabecalho), STREAM_DAQ, global.file_daq_name));
+    log_writer_write(arq_ahrs, cabecalho, log_text_header(cabecalho, sizeof(cabecalho), STREAM_AHRS, global.file_ahrs_name));
+    log_writer_write(arq_gps, cabecalho, log_text_header(cabecalho, sizeof(cabecalho), STREAM_GPS, global.file_gps_name));
+    log_writer_write(arq_nav, cabecalho, log_text_header(cabecalho, sizeof(cabecalho), STREAM_NAV, global.file_nav_name));
+    log_writer_write(arq_pitot, cabecalho, log_text_header(cabecalho, sizeof(cabecalho), STREAM_PITOT, global.file_pitot_name));
 
-    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%"
-    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%\n" ,global.file_daq_name);
-
-    fflush(arq_daq);
-    
-    fprintf(arq_ahrs,
-    "\n%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%"
-    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%\n"
-    "%% Arquivo do Sistema de Atitude e Referncia de Direo (AHRS) - %s"
-    "\n%% Valores dos ngulos fornecidos pelo filtro de Kalman do AHRS (), Velocidades Angulares(/s),"
-          " Aceleraes nos trs eixos (g), Campo Magntico medido nos trs eixos (Gauss), Temperatura interna do AHRS,"
-    " Tempo do AHRS (us), Tempo do Sistema (nanosegundos) e Validade dos dados"
-
-    "\n%% <phi>\t<theta>\t<psi>\t<p>\t<q>\t<r>\t<x''>\t<y''>\t<z''>\t<x_mag>\t<y_mag>\t"
-         "<z_mag>\t<Temp>\t<time_stamp>\t<time_sys>\t<validade>\n"
-     
-    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%"
-    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%\n", global.file_ahrs_name);
-
-    fflush(arq_ahrs);
-    
-    fprintf(arq_gps,
-    "\n%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%"
-    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%\n"
-    "%% Arquivo do Sistema de Posicionamento GLOBAL (GPS) - %s"
-    "\n%% Valores de latitude,longitude,altitude,hdop,geoid_separation, north_south,"
-    "east_west, validade, n_satellites, units_altitude, units_geoid_separation, "
-    "GPS_time(tempo em segundos), vel_leste (m/s), vel_norte (m/s), vel_cima (m/s),"
-    "erro_horizontal (m), erro_vertical (m), erro_estimado (m), status, Ground Speed (kts),"
-    "course (deg),data, declinaao magntica (deg), direcao da declinacao, modo de operacao"
-    "Tempo do sistema(em nanosegundos), validade "
-    
-    "\n%% <latitude>\t<longitude>\t<altitude>\t<hdop>\t<geoid_separation>\t"
-    "<north_south>\t<east_west>\t<n_satellites>\t<units_altitude>\t<units_geoid_separation>\t"
-    "<GPS_time>\t<east_v>\t<north_v>\t<up_v>\t<hpe>\t<vpe>\t<epe>\t<gspeed>\t<course>\t"
-    "<date>\t<magvar>\t<magvardir>\t<mode>\t<time_stamp>\t<validade>\n"
-    
-    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%"
-    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%\n",  global.file_gps_name);
-
-    fflush(arq_gps);
-
-    fprintf(arq_nav,
-    "\n%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%"
-    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%\n"
-    "%% Arquivo do Sistema de Navegao Inercial (NAV) - %s"
-    "\n%% Valores dos ngulos fornecidos pelo filtro de Kalman do AHRS (), Velocidades Angulares(/s),"
-    " Aceleraes nos trs eixos (g), Velocidade norte(m/s), leste(m/s), baixo(m/s), latitude(), longitude(), altitude(m),"
-    "Temperatura interna do NAV(C), byte de erro, byte de status, Tempo do NAV (ms), Tempo do Sistema e Validade dos dados"
-
-    "\n%% <phi>\t<theta>\t<psi>\t<p>\t<q>\t<r>\t<x''>\t<y''>\t<z''>\t<nVel>\t<eVel>\t"
-         "<dVel>\t<Long>\t<Lat>\t<Alt>\t<Temp>\t<erro>\t<status>\t<time_stamp>\t<time_sys>\t<validade>\n"
-     
-    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%"
-    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%\n", global.file_nav_name);
-
-    fflush(arq_nav);
-
-    fprintf(arq_pitot,
-    "\n%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%"
-    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%\n"
-    "%% Arquivo de aquisio do tubo de pitot - %s"
-    "\n%% Presso esttica (Pa), Temperatura (C), Presso dinmica(int), ngulo de ataque (int),"
-    "ngulo de deslizamento (int) , Tempo do Sistema e Validade dos dados"
-
-    "\n%% <static>\t<temperature>\t<dynamic>\t<attack>\t<sideslip>\t<time_sys>\t<validade>\n"
-     
-    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%"
-    "%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%\n", global.file_pitot_name);
-
-    fflush(arq_pitot);
-
-//    master_log(ERROR_LOG, "Vivo!");
-    
     return 1;
 }
 
 /*!*******************************************************************************************
 *********************************************************************************************/
-// Funcao para a leitura dos dados da fifo da placa daq  
-int get_daq()
+// Funcao para escrita do cabecalho autodescritivo de um arquivo binario (layout da estrutura,
+// nomes e unidades dos campos e instante de inicio da gravacao)
+int write_binary_header (log_writer_t* arquivo, log_stream_t stream, log_encoding_t codificacao, time_t inicio)
 {
+    char cabecalho[4096];
+    size_t n;
 
-    if (read(global.fifo_daq, &msg_daq, sizeof(msg_daq)) == sizeof(msg_daq))  // Leitura efetuada com sucesso
-        return 1;
-    else
+    n = log_build_header(cabecalho, sizeof(cabecalho), stream, codificacao, inicio);
+    if ((n == 0) || (log_writer_write(arquivo, cabecalho, n) < 0)) {
+        master_log(ERROR_LOG, "Write_binary_header: Falha ao escrever o cabecalho do arquivo binario.");
         return 0;
-}    
+    }
+
+    return 1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao para armazenagem de uma mensagem msg_*_t, sem conversao, em um arquivo binario
+int save_binary (log_writer_t* arquivo, const void* msg, size_t size)
+{
+    if (log_writer_write(arquivo, msg, size) < 0)
+        return 0;
+
+    return 1;
+}
 
 /*!*******************************************************************************************
  * *********************************************************************************************/
-// Funcao para armazenagem dos dados no arquivo da placa daq. A funo get_daq deve ser chamada antes
-int save_daq(FILE* arquivo_daq)
+// Funcao para armazenagem de um registro da placa daq no arquivo da placa daq
+int save_daq(log_writer_t* arquivo_daq, const msg_daq_t* msg)
 {
-    int i;
+    char linha[LOG_TEXT_LINE_MAX];
 
-    fprintf(arquivo_daq,"\n");
-        
-    for(i=0;i<16;i++)
-    // Imprime em arquivo o dado convertido em tensao de 0 a 5 volts
-        fprintf(arquivo_daq,"%f\t",(float)(msg_daq.tensao[i]));
+    // Monta a linha inteira e a escreve de uma vez no arquivo
+    if (log_writer_write(arquivo_daq, linha, log_text_daq(linha, msg)) < 0)
+        return 0;
 
-    // Imprime a validade do dado e o tempo de amostragem do sistema
-    fprintf(arquivo_daq,"%lld\t%d", msg_daq.time_sys,msg_daq.validade);
+    return 1;
+}
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao para e armazenagem dos dados calculado no arquivo do ahrs
+int save_ahrs(log_writer_t* arquivo_ahrs, const msg_ahrs_t* msg)
+{
+    char linha[LOG_TEXT_LINE_MAX];
 
-    fflush(arquivo_daq);
-        
-    return 1; // Sucesso de leitura da fifo e escrita no arquivo
+    // Monta a linha inteira e a escreve de uma vez no arquivo
+    if (log_writer_write(arquivo_ahrs, linha, log_text_ahrs(linha, msg)) < 0)
+        return 0;
+
+    return 1;
 }
-/*!*****************************************************************************************
- * ******************************************************************************************/
-// Funo para a leitura dos dados da fifo do AHRS
-int get_ahrs()
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao para armazenagem de um registro do gps no arquivo do gps
+int save_gps(log_writer_t* arquivo_gps, const msg_gps_t* msg)
 {
-    if (read(global.fifo_ahrs, &msg_ahrs, sizeof(msg_ahrs)) == sizeof(msg_ahrs))
-        return 1; //Leitura efetuada com sucesso
-    else
+    char linha[LOG_TEXT_LINE_MAX];
+
+    // Monta a linha inteira e a escreve de uma vez no arquivo
+    if (log_writer_write(arquivo_gps, linha, log_text_gps(linha, msg)) < 0)
         return 0;
+
+    return 1;
 }
 
 /*!*******************************************************************************************
 *********************************************************************************************/
-// Funcao para e armazenagem dos dados calculado no arquivo do ahrs
-int save_ahrs(FILE* arquivo_ahrs)
-{
-    //Imprime os ngulos estimados
-    fprintf(arquivo_ahrs,"\n%f\t%f\t%f\t", msg_ahrs.angle[0],msg_ahrs.angle[1],msg_ahrs.angle[2]);
-    //Imprime as velocidades angulares
-    fprintf(arquivo_ahrs,"%f\t%f\t%f\t", msg_ahrs.gyro[0],msg_ahrs.gyro[1],msg_ahrs.gyro[2]);
-    //Imprime as aceleraes
-    fprintf(arquivo_ahrs,"%f\t%f\t%f\t", msg_ahrs.accel[0],msg_ahrs.accel[1],msg_ahrs.accel[2]);
-    //Imprime os campos magnticos
-    fprintf(arquivo_ahrs,"%f\t%f\t%f\t", msg_ahrs.magnet[0],msg_ahrs.magnet[1],msg_ahrs.magnet[2]);
-    //Imprime a temperatura interna, o tempo do AHRS, o tempo do sistema  e a validade dos dados
-        fprintf(arquivo_ahrs,"%f\t%f\t%lld\t%d", msg_ahrs.temp,msg_ahrs.time_stamp,msg_ahrs.time_sys,msg_ahrs.validade);
-     //Fora a escrita no arquivo
-        fflush(arquivo_ahrs);
-        
+// Funcao para e armazenagem dos dados calculado no arquivo do nav
+int save_nav(log_writer_t* arquivo_nav, const msg_nav_t* msg)
+{
+    char linha[LOG_TEXT_LINE_MAX];
+
+    // Monta a linha inteira e a escreve de uma vez no arquivo
+    if (log_writer_write(arquivo_nav, linha, log_text_nav(linha, msg)) < 0)
+        return 0;
+
     return 1;
 }
 
 /*!*******************************************************************************************
- * *********************************************************************************************/
-// Funcao para a leitura dos dados da fifo do gps
- int get_gps()
- {
-         if (read(global.fifo_gps, &msg_gps, sizeof(msg_gps)) == sizeof(msg_gps)) // Leitura efetuada com sucesso
-             return 1; // Sucesso de leitura da fifo e escrita no arquivo
-     else
-            return 0; // Falha de leitura da fifo e escrita no arquivo         
- }
+*********************************************************************************************/
+// Funcao para e armazenagem dos dados calculado no arquivo do pitot
+int save_pitot(log_writer_t* arquivo_pitot, const msg_pitot_t* msg)
+{
+    char linha[LOG_TEXT_LINE_MAX];
+
+    // Monta a linha inteira e a escreve de uma vez no arquivo
+    if (log_writer_write(arquivo_pitot, linha, log_text_pitot(linha, msg)) < 0)
+        return 0;
+
+    return 1;
+}
 
 /*!*******************************************************************************************
 *********************************************************************************************/
-// Funcao para a leitura dos dados da fifo do gps e armazenagem destes dados no 
-// arquivo do gps
-int save_gps(FILE* arquivo_gps)
+// Funcao para a leitura de todos os registros disponiveis na fifo de um dispositivo, com uma
+// unica chamada de sistema. Retorna o numero de registros completos lidos.
+static int get_records (fifo_batch_t* fifo, log_stream_t stream)
 {
-    //msg_gps_t msg;
-    
-    //if (read(global.fifo_gps, &msg, sizeof(msg)) == sizeof(msg)) { // Leitura efetuada com sucesso
+    char erro[MAX_STRLEN+32];
+    int n = fifo_batch_read(fifo);
 
-        fprintf(arquivo_gps,"\n%f\t%f\t%f\t%f\t%f\t", msg_gps.latitude, msg_gps.longitude, msg_gps.altitude, msg_gps.hdop, msg_gps.geoid_separation);
-        
-        fprintf(arquivo_gps,"%d\t%d\t%d\t%d\t%d\t",msg_gps.north_south, msg_gps.east_west, msg_gps.n_satellites, msg_gps.units_altitude, msg_gps.units_geoid_separation);
-        
-        fprintf(arquivo_gps,"%f\t%f\t%f\t%f\t",msg_gps.GPS_time_gga,msg_gps.east_v,msg_gps.north_v,msg_gps.up_v);
+    if (n < 0) {
+        sprintf(erro, "Save_data (thread): Erro na leitura da FIFO (%s).", log_stream_name(stream));
+        master_log(ERROR_LOG, erro);
+        return 0;
+    }
 
-        fprintf(arquivo_gps,"%f\t%f\t%f\t",msg_gps.hpe,msg_gps.vpe,msg_gps.epe);
-        
-        fprintf(arquivo_gps,"%f\t%f\t%d\t",msg_gps.gspeed,msg_gps.course,msg_gps.date);
-        
-        fprintf(arquivo_gps,"%f\t%d\t%d\t",msg_gps.magvar,msg_gps.magvardir,msg_gps.mode);
-        
-        fprintf(arquivo_gps,"%lld\t%d", msg_gps.time_sys, msg_gps.validity);
-        
-        // Fora a escrita dos dados do gps em disco
-        fflush(arquivo_gps);
+    return n;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Codificacao dos registros nos arquivos de um formato. Nos formatos em blocos (comprimido
+// e em blocos verificaveis) os registros passam por um log_encoder_t.
+static log_encoding_t format_encoding (log_format_t formato)
+{
+    if (formato == FORMAT_COMPRESSED)
+        return LOG_DELTA;
+    if (formato == FORMAT_JOURNAL)
+        return LOG_JOURNAL;
 
-        return 1; // Sucesso de leitura da fifo e escrita no arquivo
-    //}
-    //else
-    //    return 0; // Falha de leitura da fifo e escrita no arquivo
+    return LOG_RAW;
 }
 
-/*!*****************************************************************************************
- * ******************************************************************************************/
-// Funo para a leitura dos dados da fifo do NAV
-int get_nav()
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Extensao dos arquivos de um formato
+static const char* format_extension (log_format_t formato)
 {
-    if (read(global.fifo_nav, &msg_nav, sizeof(msg_nav)) == sizeof(msg_nav))
-        return 1; //Leitura efetuada com sucesso
-    else
-        return 0;
+    if (formato == FORMAT_BINARY)
+        return LOG_EXT_BINARY;
+    if (formato == FORMAT_COMPRESSED)
+        return LOG_EXT_COMPRESSED;
+    if (formato == FORMAT_JOURNAL)
+        return LOG_EXT_JOURNAL;
+
+    return LOG_EXT_TEXT;
 }
 
 /*!*******************************************************************************************
 *********************************************************************************************/
-// Funcao para e armazenagem dos dados calculado no arquivo do nav
-int save_nav(FILE* arquivo_nav)
-{
-    //Imprime os ngulos estimados
-    fprintf(arquivo_nav,"\n%f\t%f\t%f\t", msg_nav.angle[0],msg_nav.angle[1],msg_nav.angle[2]);
-    //Imprime as velocidades angulares
-    fprintf(arquivo_nav,"%f\t%f\t%f\t", msg_nav.gyro[0],msg_nav.gyro[1],msg_nav.gyro[2]);
-    //Imprime as aceleraes
-    fprintf(arquivo_nav,"%f\t%f\t%f\t", msg_nav.accel[0],msg_nav.accel[1],msg_nav.accel[2]);
-    //Imprime as velocidades
-    fprintf(arquivo_nav,"%f\t%f\t%f\t", msg_nav.nVel,msg_nav.eVel,msg_nav.dVel);
-    //Imprime as posies
-    fprintf(arquivo_nav,"%f\t%f\t%f\t", msg_nav.latitude,msg_nav.longitude,msg_nav.altitude);
-    //Imprime a temperatura interna, byte de erro, byte de status
-    fprintf(arquivo_nav,"%f\t%d\t%d\t", msg_nav.temp,msg_nav.internal_error, msg_nav.internal_status);
-    //Imprime o tempo do NAV, o tempo do sistema  e a validade dos dados
-        fprintf(arquivo_nav,"%ld\t%lld\t%d", msg_nav.time_stamp,msg_nav.time_sys,msg_nav.validade);
-     //Fora a escrita no arquivo
-    fflush(arquivo_nav);
-        
-    return 1;
+// Funcao para armazenagem dos n registros lidos por get_records no arquivo do dispositivo.
+// No formato binario o lote inteiro eh copiado de uma vez; nos formatos em blocos os
+// registros passam pelo codificador do dispositivo, que registra cada bloco no indice.
+// Cada registro eh marcado com a posicao do arquivo em que termina (nos formatos em blocos,
+// conhecida quando o bloco eh escrito), para a latencia de escrita.
+static void save_records (log_writer_t* arquivo, log_encoder_t* codificador, log_index_t* indice,
+                          lat_marks_t* marcas, const char* registros, size_t tamanho, log_stream_t stream,
+                          int n, log_format_t formato)
+{
+    unsigned long long inicio = arquivo->bytes;
+    int i;
+
+    if (formato == FORMAT_BINARY) {
+        log_index_note(indice, arquivo->bytes, registros, n);
+        save_binary(arquivo, registros, n*tamanho);
+        for (i = 0; i < n; i++)
+            lat_marks_add(marcas, record_time(stream, registros+i*tamanho), inicio+(i+1)*tamanho);
+        return;
+    }
+
+    if (format_encoding(formato) != LOG_RAW) {
+        for (i = 0; i < n; i++) {
+            lat_marks_add(marcas, record_time(stream, registros+i*tamanho), 0);
+            log_encoder_add(codificador, arquivo, registros+i*tamanho);
+            if (codificador->count == 0)
+                lat_marks_place(marcas, arquivo->bytes);
+        }
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        const void* registro = registros+i*tamanho;
+
+        // A linha comeca na posicao atual do arquivo
+        log_index_note(indice, arquivo->bytes, registro, 1);
+
+        switch (stream) {
+            case STREAM_AHRS:
+                save_ahrs(arquivo, registro);
+                break;
+            case STREAM_DAQ:
+                save_daq(arquivo, registro);
+                break;
+            case STREAM_GPS:
+                save_gps(arquivo, registro);
+                break;
+            case STREAM_NAV:
+                save_nav(arquivo, registro);
+                break;
+            case STREAM_PITOT:
+                save_pitot(arquivo, registro);
+                break;
+            default:
+                break;
+        }
+        lat_marks_add(marcas, record_time(stream, registro), arquivo->bytes);
+    }
 }
 
-/*!*****************************************************************************************
- * ******************************************************************************************/
-// Funo para a leitura dos dados da fifo do PITOT
-int get_pitot()
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Abre o arquivo de dados de um dispositivo. Com prealloc_min positivo o arquivo eh mapeado
+// em memoria e preallocado com o tamanho esperado para um voo de prealloc_min minutos;
+// senao eh escrito pelos buffers normais.
+static int open_data_file (log_writer_t* arquivo, const char* nome, log_stream_t stream, log_format_t formato,
+                           int prealloc_min, int flush_ms, int sync_data)
 {
-    if (read(global.fifo_pitot, &msg_pitot, sizeof(msg_pitot)) == sizeof(msg_pitot))
-        return 1; //Leitura efetuada com sucesso
-    else
-        return 0;
+    size_t tamanho;
+
+    if (prealloc_min <= 0)
+        return log_writer_open(arquivo, nome, flush_ms, sync_data);
+
+    // Um registro por periodo de amostragem
+    tamanho = (size_t)prealloc_min*60*SAMPLE_RATE_HZ*log_record_size(stream);
+    if (formato == FORMAT_TEXT)
+        tamanho *= TEXT_EXPANSION;
+
+    return log_writer_open_mapped(arquivo, nome, tamanho, flush_ms, sync_data);
 }
 
 /*!*******************************************************************************************
 *********************************************************************************************/
-// Funcao para e armazenagem dos dados calculado no arquivo do pitot
-int save_pitot(FILE* arquivo_pitot)
-{
-    //Imprime os valores (raw)
-    fprintf(arquivo_pitot,"\n%f\t%f\t%f\t", msg_pitot.static_pressure,msg_pitot.temperature,msg_pitot.dynamic_pressure);
-    //Imprime os valores (raw)
-    fprintf(arquivo_pitot,"%f\t%f\t", msg_pitot.attack_angle,msg_pitot.sideslip_angle);
-    //Imprime o tempo do sistema  e a validade dos dados
-    fprintf(arquivo_pitot,"%lld\t%d", msg_pitot.time_sys,msg_pitot.validade);
-     //Fora a escrita no arquivo
-    fflush(arquivo_pitot);
-        
-    return 1;
+// Troca a extensao ".dat" de um nome de arquivo pela extensao ext
+static void set_extension (char* name, const char* ext)
+{
+    size_t len = strlen(name);
+    size_t len_ext = strlen(LOG_EXT_TEXT);
+
+    if ((len >= len_ext) && (strcmp(name+len-len_ext, LOG_EXT_TEXT) == 0))
+        name[len-len_ext] = '\0';
+
+    strncat(name, ext, MAX_STRLEN-1-strlen(name));
 }
 
 /*!*******************************************************************************************
@@ -286,6 +306,8 @@ int create_new_dir (void)
     char dir[MAX_STRLEN];    // Armazena o nome do novo diretorio
     char file_daq[MAX_STRLEN], file_ahrs[MAX_STRLEN], file_gps[MAX_STRLEN], file_nav[MAX_STRLEN], file_pitot[MAX_STRLEN];
     char *a;
+    size_t fim;
+    int n, erro;
         
     a = (char*) malloc(24*sizeof(char));
     
@@ -308,6 +330,18 @@ int create_new_dir (void)
 
     strncpy(global.file_pitot_name,ARQ_PITOT,MAX_STRLEN-1);
     global.file_pitot_name[MAX_STRLEN-1] = '\0';
+
+    // Nos formatos binario, comprimido e em blocos os arquivos recebem a extensao ".bin",
+    // ".fdz" ou ".fdj"
+    if (global.log_format != FORMAT_TEXT) {
+        const char* ext = format_extension(global.log_format);
+
+        set_extension(global.file_daq_name, ext);
+        set_extension(global.file_ahrs_name, ext);
+        set_extension(global.file_gps_name, ext);
+        set_extension(global.file_nav_name, ext);
+        set_extension(global.file_pitot_name, ext);
+    }
     
     // Converte os valores de tempo para strings
     sprintf(dir,"%sVoo_%c%c%c_%c%c%c_%c%c_%c%c%c%c%c%c%c%c_%c%c%c%c/",FILES_PATH,
@@ -321,13 +355,21 @@ int create_new_dir (void)
     //a[19],        // espaco
     a[20],a[21],a[22],a[23]); // ano
     
-    // Cria o novo diretorio
-    if (mkdir( dir, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH|S_IXOTH|S_IXUSR|S_IXGRP) == -1){
+    // Cria o novo diretorio. Um voo iniciado no mesmo segundo que o anterior (START logo
+    // apos um STOP) recebe o sufixo "_2", "_3"...
+    fim = strlen(dir) - 1;
+    n = 1;
+    while (((erro = mkdir(dir, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH|S_IXOTH|S_IXUSR|S_IXGRP)) == -1) &&
+           (errno == EEXIST) && (n < MAX_DIR_SUFFIX))
+        sprintf(dir + fim, "_%d/", ++n);
+    if (erro == -1){
         master_log(ERROR_LOG, "Create_new_dir (thread: Falha ao criar o novo diretorio de arquivos.");
         perror("Falha ao criar o novo diretorio de arquivos.");
         exit(EXIT_FAILURE);
     }
     
+    snprintf(global.dir_name, MAX_STRLEN, "%s", dir);
+    
     // Muda o nome do arquivo da placa daq, da imu ou do gps
     strncpy(file_daq, dir, MAX_STRLEN-1);
     strncpy(file_ahrs, dir, MAX_STRLEN-1);
@@ -361,6 +403,767 @@ int create_new_dir (void)
     return 0;    
 }
 
+/*!*******************************************************************************************
+*********************************************************************************************/
+void save_latency_copy(log_stream_t stream, lat_hist_t* fila, lat_hist_t* escrita)
+{
+    lat_hist_copy(fila, &latencia_fila[stream]);
+    lat_hist_copy(escrita, &latencia_escrita[stream]);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Os histogramas sao copiados antes de lidos, pois as threads do voo podem estar escrevendo
+// neles
+int save_latency_report(const char* nome)
+{
+    lat_hist_t fila, escrita;
+    char texto[MAX_STRLEN+192];
+    FILE* arquivo = NULL;
+    int i;
+
+    if ((nome != NULL) && ((arquivo = fopen(nome, "w")) == NULL)) {
+        snprintf(texto, sizeof(texto), "Save_latency_report: Erro na criacao do arquivo %s.", nome);
+        master_log(ERROR_LOG, texto);
+    }
+    if (arquivo != NULL)
+        fprintf(arquivo, "# Idade das amostras (us) na leitura da FIFO (fila) e na saida do buffer do arquivo\n"
+                         "# (escrita), relativa a amostra mais rapida. Faixas: de, ate, amostras.\n");
+
+    for (i = 0; i < N_STREAMS; i++) {
+        save_latency_copy(i, &fila, &escrita);
+        if (fila.count == 0)
+            continue;
+
+        if (arquivo != NULL) {
+            snprintf(texto, sizeof(texto), "%s fila", log_stream_name(i));
+            lat_hist_print(arquivo, texto, &fila);
+            snprintf(texto, sizeof(texto), "%s escrita", log_stream_name(i));
+            lat_hist_print(arquivo, texto, &escrita);
+        }
+
+        snprintf(texto, sizeof(texto), "Save_data: Latencia %s - fila p50 %llu, p99 %llu, max %llu us;"
+                 " escrita p50 %llu, p99 %llu, max %llu us.", log_stream_name(i),
+                 lat_hist_percentile(&fila, 0.5), lat_hist_percentile(&fila, 0.99), fila.max,
+                 lat_hist_percentile(&escrita, 0.5), lat_hist_percentile(&escrita, 0.99), escrita.max);
+        master_log(STATUS_LOG, texto);
+    }
+
+    if (arquivo == NULL)
+        return (nome != NULL) ? -1 : 0;
+
+    return (fclose(arquivo) == 0) ? 0 : -1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Acorda a thread de salvamento, possivelmente bloqueada em poll(), para que ela perceba
+// uma mudanca em global.end_save_data. Deve ser chamada apos cada mudanca desta variavel.
+void wake_save_data(void)
+{
+    uint64_t um = 1;
+
+    // O eventfd soma os despertares pendentes e nunca bloqueia a escrita
+    write(global.wakeup_save_data, &um, sizeof(um));
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// O estado muda poucas vezes por voo e eh lido a cada volta do loop de save_data(): a
+// leitura eh uma carga atomica, sem semaforo, e quem muda o estado nunca espera pela thread
+int save_data_state(void)
+{
+    return __atomic_load_n(&global.end_save_data, __ATOMIC_ACQUIRE);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int start_save_data(void)
+{
+    if (save_data_state() != STOPPED)
+        return 0;
+
+    // O estado eh escrito antes da criacao da thread, de forma que um STOP logo em
+    // seguida sempre encontra a thread ativa e espera por ela
+    __atomic_store_n(&global.rotate_save_data, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&global.end_save_data, SAVE_SEND, __ATOMIC_RELEASE);
+
+    if (pthread_create(&global.salva_dados, NULL, save_data, (void*)0) != 0) {
+        __atomic_store_n(&global.end_save_data, STOPPED, __ATOMIC_RELEASE);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int stop_save_data(void)
+{
+    if (__atomic_exchange_n(&global.end_save_data, STOPPED, __ATOMIC_ACQ_REL) == STOPPED)
+        return 0;
+
+    wake_save_data();
+
+    return (pthread_join(global.salva_dados, NULL) == 0) ? 0 : -1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void request_rotation(void)
+{
+    __atomic_store_n(&global.rotate_save_data, 1, __ATOMIC_RELEASE);
+    wake_save_data();
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Calcula o tempo (ms) ate o proximo prazo de escrita do buffer do arquivo de um estagio,
+// do seu indice ou do bloco e da marca de confirmacao do codificador. Retorna -1 se nada
+// esta pendente (espera indefinida).
+static int flush_timeout(const save_stage_t* estagio, long long agora)
+{
+    long long prazo = -1;
+    long long prazo_bloco = log_encoder_deadline(estagio->codificador);
+    long long prazo_indice = log_index_deadline(estagio->indice);
+
+    if (estagio->arquivo->fill > 0)
+        prazo = estagio->arquivo->deadline;
+    if ((prazo_bloco >= 0) && ((prazo < 0) || (prazo_bloco < prazo)))
+        prazo = prazo_bloco;
+    if ((prazo_indice >= 0) && ((prazo < 0) || (prazo_indice < prazo)))
+        prazo = prazo_indice;
+
+    if (prazo < 0)
+        return -1;
+    if (prazo <= agora)
+        return 0;
+
+    return (int)((prazo - agora + 999999)/1000000);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Bloqueia a thread ate que alguma FIFO de dados tenha dados ou a thread seja acordada
+// por wake_save_data().
+static void wait_for_data(struct pollfd fds[], int timeout)
+{
+    uint64_t despertares;
+    char avisos[64];
+    int i;
+
+    for (i = 0; i < N_POLL; i++)
+        fds[i].revents = 0;
+
+    if (poll(fds, N_POLL, timeout) < 0)
+        return; // Interrompido por um sinal: o loop testa o estado e volta a esperar
+
+    // Zera o contador do eventfd de despertar
+    if (fds[POLL_WAKEUP].revents & POLLIN)
+        read(global.wakeup_save_data, &despertares, sizeof(despertares));
+
+    // Esvazia a FIFO de aviso dos aneis: os aneis sao todos lidos a cada volta
+    if (fds[POLL_RINGS].revents & POLLIN)
+        while (read(fds[POLL_RINGS].fd, avisos, sizeof(avisos)) == sizeof(avisos));
+
+    // Uma FIFO fechada do outro lado (pipes comuns) deixa de ser observada
+    for (i = 0; i < N_POLL; i++)
+        if (((i < N_STREAMS) || (i == POLL_JITTER)) &&
+            (fds[i].revents & (POLLHUP|POLLERR|POLLNVAL)) && !(fds[i].revents & POLLIN))
+            fds[i].fd = -1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Le os resumos do periodo da tarefa de tempo real disponiveis na FIFO e os escreve, um por
+// linha, no arquivo do voo. Com guarda zero os resumos sao apenas descartados.
+static void read_jitter(save_jitter_t* jitter, int guarda)
+{
+    const rt_jitter_summary_t* r;
+    int n, i, k;
+
+    if (jitter->fifo.fd < 0)
+        return;
+
+    while ((n = fifo_batch_read(&jitter->fifo)) > 0) {
+        if (!guarda)
+            continue;
+
+        for (i = 0; i < n; i++) {
+            r = fifo_batch_record(&jitter->fifo, i);
+            if (r->periods == 0)
+                continue;
+
+            // Resumos que nao couberam na FIFO
+            if (jitter->recebidos && (r->seq != jitter->proximo))
+                jitter->perdidos += r->seq - jitter->proximo;
+            jitter->recebidos = 1;
+            jitter->proximo = r->seq + 1;
+
+            jitter->resumos++;
+            jitter->periodos += r->periods;
+            jitter->estouros += r->overruns;
+            if (r->late_max_ns > jitter->atraso_max)
+                jitter->atraso_max = r->late_max_ns;
+            if (r->work_max_ns > jitter->trabalho_max)
+                jitter->trabalho_max = r->work_max_ns;
+
+            if (jitter->arquivo == NULL)
+                continue;
+            fprintf(jitter->arquivo, "%u\t%lld\t%u\t%d\t%lld\t%d\t%d\t%lld\t%d\t%u", r->seq, r->time_sys,
+                r->periods, r->late_min_ns/1000, r->late_sum_ns/r->periods/1000, r->late_max_ns/1000,
+                r->work_min_ns/1000, r->work_sum_ns/r->periods/1000, r->work_max_ns/1000, r->overruns);
+            for (k = 0; k < RT_JITTER_BUCKETS; k++)
+                fprintf(jitter->arquivo, "\t%u", r->late_hist[k]);
+            fprintf(jitter->arquivo, "\n");
+        }
+        if (jitter->arquivo != NULL)
+            fflush(jitter->arquivo);
+    }
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Prepara a gravacao dos resumos do periodo da tarefa de tempo real no diretorio do voo. Os
+// resumos que esperavam na FIFO sao de antes do voo e sao descartados.
+static void open_jitter(save_jitter_t* jitter, const save_config_t* config)
+{
+    char nome[MAX_STRLEN+16];
+
+    memset(jitter, 0, sizeof(*jitter));
+    if ((global.fifo_jitter < 0) ||
+        (fifo_batch_init(&jitter->fifo, global.fifo_jitter, sizeof(rt_jitter_summary_t), JITTER_BATCH) < 0)) {
+        jitter->fifo.fd = -1;
+        return;
+    }
+    read_jitter(jitter, 0);
+
+    snprintf(nome, sizeof(nome), "%s%s", config->dir, JITTER_FILE);
+    if ((jitter->arquivo = fopen(nome, "w")) == NULL) {
+        master_log(ERROR_LOG, "Save_data (thread): Erro na criacao do arquivo do periodo da tarefa de tempo real.");
+        return;
+    }
+    fprintf(jitter->arquivo, "# Tarefa de tempo real: um resumo a cada %d periodos. Atraso do despertar e trabalho\n"
+                             "# de cada periodo em us; faixas do atraso: <1, 1, 2-3, 4-7, ... us.\n"
+                             "# seq\ttime_sys\tperiodos\tatraso_min\tatraso_medio\tatraso_max\ttrabalho_min"
+                             "\ttrabalho_medio\ttrabalho_max\testouros\tfaixas...\n", RT_JITTER_WINDOW);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Le os ultimos resumos, fecha o arquivo e resume o voo no log
+static void close_jitter(save_jitter_t* jitter)
+{
+    char texto[MAX_STRLEN+192];
+
+    if (jitter->fifo.fd < 0)
+        return;
+
+    read_jitter(jitter, 1);
+    if (jitter->arquivo != NULL)
+        fclose(jitter->arquivo);
+    fifo_batch_free(&jitter->fifo);
+
+    if (jitter->resumos == 0)
+        return;
+    sprintf(texto, "Save_data (thread): Tarefa de tempo real - %llu periodos, atraso maximo %d us, trabalho maximo"
+        " %d us, %llu estouros do periodo, %lu resumos perdidos.", jitter->periodos, jitter->atraso_max/1000,
+        jitter->trabalho_max/1000, jitter->estouros, jitter->perdidos);
+    master_log((jitter->estouros > 0) ? ERROR_LOG : STATUS_LOG, texto);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Nome do arquivo de um dispositivo na variavel global
+static char* file_name(log_stream_t stream)
+{
+    switch (stream) {
+        case STREAM_AHRS:
+            return global.file_ahrs_name;
+        case STREAM_DAQ:
+            return global.file_daq_name;
+        case STREAM_GPS:
+            return global.file_gps_name;
+        case STREAM_NAV:
+            return global.file_nav_name;
+        default:
+            return global.file_pitot_name;
+    }
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Atualiza o nome base do arquivo de um dispositivo a partir da variavel global. Um nome
+// fora do diretorio do voo foi dado por "change datfile" durante a gravacao e passa a ser
+// a nova base; os nomes dentro do diretorio foram escritos pela propria gravacao.
+static void update_base(save_config_t* config, log_stream_t stream)
+{
+    const char* nome = file_name(stream);
+    const char* base;
+    char* ponto;
+
+    if ((config->bases[stream][0] != '\0') && (strncmp(nome, config->dir, strlen(config->dir)) == 0))
+        return;
+
+    base = strrchr(nome, '/');
+    base = (base != NULL) ? base+1 : nome;
+    snprintf(config->bases[stream], MAX_STRLEN, "%s", base);
+
+    // Sem a extensao
+    ponto = strrchr(config->bases[stream], '.');
+    if ((ponto != NULL) && (ponto != config->bases[stream]))
+        *ponto = '\0';
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Fecha e apaga os arquivos (e indices) de um segmento que nao chegou a ser usado
+static void discard_files(save_segment_t* segmento, int n)
+{
+    char indice[MAX_STRLEN+8];
+    int i;
+
+    for (i = 0; i < n; i++) {
+        log_writer_close(&segmento->arquivos[i]);
+        unlink(segmento->nomes[i]);
+        log_encoder_free(&segmento->codificadores[i]);
+        if (segmento->indices[i].open) {
+            log_index_close(&segmento->indices[i]);
+            snprintf(indice, sizeof(indice), "%s%s", segmento->nomes[i], LOG_EXT_INDEX);
+            unlink(indice);
+        }
+    }
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Abre os arquivos de um segmento e escreve os seus cabecalhos. O segmento 0 usa os nomes
+// de create_new_dir(); os seguintes recebem o sufixo "_NNN". Retorna 0 em caso de sucesso
+// e -1 em caso de erro, com os arquivos ja abertos fechados e apagados.
+static int open_segment(save_segment_t* segmento)
+{
+    save_config_t* config = segmento->config;
+    log_encoding_t codificacao = format_encoding(config->formato);
+    const char* ext = format_extension(config->formato);
+    char texto[2*MAX_STRLEN];
+    int i;
+
+    // Os nomes sao montados e publicados na variavel global com o semaforo
+    sem_wait(&global.file_names);
+
+    for (i = 0; i < N_STREAMS; i++) {
+        update_base(config, i);
+        if (segmento->numero == 0)
+            snprintf(segmento->nomes[i], MAX_STRLEN, "%s%s%s", config->dir, config->bases[i], ext);
+        else
+            snprintf(segmento->nomes[i], MAX_STRLEN, "%s%s_%03d%s", config->dir, config->bases[i],
+                     segmento->numero, ext);
+    }
+
+    memset(segmento->codificadores, 0, sizeof(segmento->codificadores));
+    memset(segmento->indices, 0, sizeof(segmento->indices));
+    for (i = 0; i < N_STREAMS; i++) {
+        if (open_data_file(&segmento->arquivos[i], segmento->nomes[i], i, config->formato,
+                           config->prealloc_min, config->flush_ms, config->sync_data) < 0)
+            break;
+
+        // Nos formatos em blocos os registros sao agrupados em blocos com numero de sequencia
+        // e CRC (de colunas codificadas, no formato comprimido), seguidos periodicamente de
+        // uma marca de confirmacao escrita em disco
+        if ((codificacao != LOG_RAW) &&
+            (log_encoder_init(&segmento->codificadores[i], i, codificacao,
+                              LOG_CODEC_BLOCK_MS, LOG_CODEC_COMMIT_MS) < 0)) {
+            discard_files(segmento, i+1);
+            i = -1;
+            break;
+        }
+
+        // O indice de tempo nao eh essencial: sem ele a gravacao continua e o arquivo eh
+        // lido inteiro
+        if (log_index_open(&segmento->indices[i], segmento->nomes[i], i, config->formato, config->flush_ms) < 0) {
+            log_index_close(&segmento->indices[i]);
+            sprintf(texto, "Save_data (thread): Erro na abertura do indice (%s).", log_stream_name(i));
+            master_log(ERROR_LOG, texto);
+        }
+        if (codificacao != LOG_RAW)
+            segmento->codificadores[i].index = &segmento->indices[i];
+    }
+
+    if (i < N_STREAMS) {
+        if (i >= 0)
+            discard_files(segmento, i);
+        sem_post(&global.file_names);
+        sprintf(texto, "Save_data (thread): Erro na abertura dos arquivos do segmento %d.", segmento->numero);
+        master_log(ERROR_LOG, texto);
+        return -1;
+    }
+
+    for (i = 0; i < N_STREAMS; i++)
+        snprintf(file_name(i), MAX_STRLEN, "%s", segmento->nomes[i]);
+
+    // Escreve os cabecalhos
+    if (config->formato != FORMAT_TEXT)
+        for (i = 0; i < N_STREAMS; i++)
+            write_binary_header(&segmento->arquivos[i], i, codificacao, config->inicio);
+    else
+        write_headers(&segmento->arquivos[STREAM_DAQ], &segmento->arquivos[STREAM_AHRS],
+                      &segmento->arquivos[STREAM_GPS], &segmento->arquivos[STREAM_NAV],
+                      &segmento->arquivos[STREAM_PITOT]);
+
+    sem_post(&global.file_names);
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Thread que abre os arquivos do proximo segmento enquanto a gravacao continua no atual
+static void *prepare_segment(void *arg)
+{
+    save_segment_t* segmento = arg;
+    int aberto = (open_segment(segmento) == 0);
+    int estado = SEGMENT_OPENING;
+
+    // Se "change datfile" chegou durante a abertura (SEGMENT_STALE), os arquivos sao
+    // descartados aqui mesmo, e nao pela thread save_data()
+    if (!__atomic_compare_exchange_n(&segmento->estado, &estado, aberto ? SEGMENT_READY : SEGMENT_FAILED,
+                                     0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        if (aberto)
+            discard_files(segmento, N_STREAMS);
+        __atomic_store_n(&segmento->estado, SEGMENT_DISCARDED, __ATOMIC_RELEASE);
+    }
+
+    // A troca eh feita pela thread save_data()
+    wake_save_data();
+
+    return NULL;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Thread que descarta os arquivos de um segmento aberto mas nao usado
+static void *drop_segment(void *arg)
+{
+    save_segment_t* segmento = arg;
+
+    discard_files(segmento, N_STREAMS);
+    __atomic_store_n(&segmento->estado, SEGMENT_DISCARDED, __ATOMIC_RELEASE);
+    wake_save_data();
+
+    return NULL;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Comeca a abrir o segmento numero. Retorna 0 em caso de sucesso e -1 se a thread nao pode
+// ser criada.
+static int start_segment(save_segment_t* segmento, int numero)
+{
+    segmento->numero = numero;
+    __atomic_store_n(&segmento->estado, SEGMENT_OPENING, __ATOMIC_RELEASE);
+
+    if (pthread_create(&segmento->thread, NULL, prepare_segment, segmento) != 0) {
+        segmento->estado = SEGMENT_FREE;
+        master_log(ERROR_LOG, "Save_data (thread): Erro na criacao da thread de abertura do segmento.");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Marca como obsoleto o proximo segmento, aberto ou sendo aberto com os nomes anteriores a
+// "change datfile", sem esperar pela abertura: os arquivos sao descartados por outra thread
+// e o segmento passa a SEGMENT_DISCARDED (ou a SEGMENT_FREE, se nada foi aberto).
+static void stale_segment(save_segment_t* segmento)
+{
+    int estado = SEGMENT_OPENING;
+
+    if (__atomic_compare_exchange_n(&segmento->estado, &estado, SEGMENT_STALE, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return;
+
+    // A thread de abertura ja terminou (ou esta retornando)
+    if (estado == SEGMENT_FAILED) {
+        pthread_join(segmento->thread, NULL);
+        segmento->estado = SEGMENT_FREE;
+    }
+    else if (estado == SEGMENT_READY) {
+        pthread_join(segmento->thread, NULL);
+        segmento->estado = SEGMENT_STALE;
+        if (pthread_create(&segmento->thread, NULL, drop_segment, segmento) != 0) {
+            discard_files(segmento, N_STREAMS);
+            segmento->estado = SEGMENT_FREE;
+        }
+    }
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Espera pela thread de um segmento e descarta os arquivos dele, se nao foi usado. Usada
+// apenas no fim da gravacao.
+static void cancel_segment(save_segment_t* segmento)
+{
+    int estado = __atomic_load_n(&segmento->estado, __ATOMIC_ACQUIRE);
+
+    if (estado == SEGMENT_FREE)
+        return;
+
+    pthread_join(segmento->thread, NULL);
+
+    if (__atomic_load_n(&segmento->estado, __ATOMIC_ACQUIRE) == SEGMENT_READY)
+        discard_files(segmento, N_STREAMS);
+
+    segmento->estado = SEGMENT_FREE;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Troca os arquivos de todos os dispositivos para um segmento ja aberto. A troca acontece
+// na posicao atual de cada fila: os registros ja colocados nas filas vao para o segmento
+// antigo, os seguintes para o novo.
+static void switch_segment(save_stage_t estagios[], save_segment_t* segmento)
+{
+    char texto[MAX_STRLEN+64];
+    int i;
+
+    pthread_join(segmento->thread, NULL);
+    segmento->estado = SEGMENT_ACTIVE;
+    segmento->inicio = log_now_ns();
+
+    for (i = 0; i < N_STREAMS; i++) {
+        estagios[i].proximo_arquivo = &segmento->arquivos[i];
+        estagios[i].proximo_codificador = &segmento->codificadores[i];
+        estagios[i].proximo_indice = &segmento->indices[i];
+        estagios[i].troca_em = estagios[i].fila.head;
+        __atomic_store_n(&estagios[i].troca, 1, __ATOMIC_RELEASE);
+        spsc_ring_wake(&estagios[i].fila);
+    }
+
+    sprintf(texto, "Save_data (thread): Troca para o segmento %d.", segmento->numero);
+    master_log(STATUS_LOG, texto);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Retorna 1 quando todas as threads de escrita terminaram a ultima troca de segmento
+static int switch_done(save_stage_t estagios[])
+{
+    int i;
+
+    for (i = 0; i < N_STREAMS; i++)
+        if (__atomic_load_n(&estagios[i].troca, __ATOMIC_ACQUIRE))
+            return 0;
+
+    return 1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Retorna 1 quando o segmento atual atingiu o tamanho ou a duracao da troca automatica
+static int rotation_due(const save_config_t* config, save_segment_t* segmento, long long agora)
+{
+    unsigned long long limite = (unsigned long long)config->rotate_mb*1024*1024;
+    int i;
+
+    if ((config->rotate_min > 0) && (agora - segmento->inicio >= (long long)config->rotate_min*60*1000000000LL))
+        return 1;
+
+    if (config->rotate_mb > 0)
+        for (i = 0; i < N_STREAMS; i++)
+            if (__atomic_load_n(&segmento->arquivos[i].bytes, __ATOMIC_RELAXED) >= limite)
+                return 1;
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Tempo (ms) ate a troca automatica por tempo, ou -1 (espera indefinida) se ela esta desligada
+static int rotation_timeout(const save_config_t* config, save_segment_t* segmento, long long agora)
+{
+    long long prazo;
+
+    if (config->rotate_min <= 0)
+        return -1;
+
+    prazo = segmento->inicio + (long long)config->rotate_min*60*1000000000LL;
+    if (prazo <= agora)
+        return 0;
+
+    return (int)((prazo - agora + 999999)/1000000);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Conta na latencia de escrita os registros do dispositivo cujos bytes ja sairam do buffer
+// do arquivo (ate written)
+static void complete_marks(save_stage_t* estagio, unsigned long long written)
+{
+    // Um bloco escrito por log_encoder_tick() leva todos os registros do codificador
+    if ((format_encoding(estagio->formato) != LOG_RAW) && (estagio->codificador->count == 0))
+        lat_marks_place(&estagio->marcas, estagio->arquivo->bytes);
+
+    lat_marks_complete(&estagio->marcas, written, &relogio, &latencia_escrita[estagio->stream], log_now_ns());
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Fecha o arquivo atual de um dispositivo, depois de escrever o ultimo bloco e a ultima
+// marca de confirmacao
+static void close_stream_file(save_stage_t* estagio)
+{
+    char texto[MAX_STRLEN+64];
+
+    if (format_encoding(estagio->formato) != LOG_RAW) {
+        log_encoder_commit(estagio->codificador, estagio->arquivo);
+        estagio->bytes_registros += estagio->codificador->raw_bytes;
+        estagio->bytes_blocos += estagio->codificador->coded_bytes;
+    }
+    log_encoder_free(estagio->codificador);
+    log_index_close(estagio->indice);
+
+    // Esvazia o buffer, forca a escrita em disco e fecha o arquivo
+    if (log_writer_close(estagio->arquivo) < 0) {
+        sprintf(texto, "Save_data (thread): Erro na escrita do arquivo (%s).", log_stream_name(estagio->stream));
+        master_log(ERROR_LOG, texto);
+    }
+
+    // Todos os registros do arquivo estao em disco
+    lat_marks_place(&estagio->marcas, estagio->arquivo->bytes);
+    complete_marks(estagio, estagio->arquivo->bytes);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Thread de escrita do arquivo de um dispositivo. Dorme ate que a thread save_data()
+// coloque registros na fila ou ate o prazo de escrita do buffer ou do bloco, troca de
+// arquivo quando a fila chega a posicao de troca de segmento e termina, depois de esvaziar
+// a fila e fechar o arquivo, quando estagio->fim eh ligado.
+static void *save_stream(void *arg)
+{
+    save_stage_t* estagio = arg;
+    const void* registros;
+    unsigned long n;
+    long long agora;
+    int fim, troca;
+
+    while (1) {
+        // O pedido de fim eh lido antes de esvaziar a fila, para que todos os
+        // registros colocados antes dele sejam escritos
+        fim = __atomic_load_n(&estagio->fim, __ATOMIC_ACQUIRE);
+        troca = __atomic_load_n(&estagio->troca, __ATOMIC_ACQUIRE);
+
+        while ((n = spsc_ring_peek(&estagio->fila, &registros)) > 0) {
+            // Os registros a partir da posicao de troca vao para o proximo segmento
+            if (troca && (estagio->fila.tail + n > estagio->troca_em))
+                n = estagio->troca_em - estagio->fila.tail;
+            if (n == 0)
+                break;
+            save_records(estagio->arquivo, estagio->codificador, estagio->indice, &estagio->marcas,
+                         registros, estagio->fila.record_size, estagio->stream, n, estagio->formato);
+            spsc_ring_release(&estagio->fila, n);
+        }
+        complete_marks(estagio, estagio->arquivo->bytes - estagio->arquivo->fill);
+
+        if (troca && (estagio->fila.tail == estagio->troca_em)) {
+            close_stream_file(estagio);
+            estagio->arquivo = estagio->proximo_arquivo;
+            estagio->codificador = estagio->proximo_codificador;
+            estagio->indice = estagio->proximo_indice;
+            __atomic_store_n(&estagio->troca, 0, __ATOMIC_RELEASE);
+
+            // O segmento antigo pode ser reaberto como o proximo
+            wake_save_data();
+            continue;
+        }
+
+        if (fim)
+            break;
+
+        // Fecha o bloco e escreve em disco o buffer cujo prazo venceu
+        agora = log_now_ns();
+        log_encoder_tick(estagio->codificador, estagio->arquivo, agora);
+        log_writer_tick(estagio->arquivo, agora);
+        log_index_tick(estagio->indice, agora);
+        complete_marks(estagio, estagio->arquivo->bytes - estagio->arquivo->fill);
+
+        spsc_ring_wait(&estagio->fila, flush_timeout(estagio, log_now_ns()));
+    }
+
+    close_stream_file(estagio);
+
+    return NULL;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Passa n registros lidos da FIFO (ou do anel) para a fila do estagio. Com espera,
+// aguarda que a thread de escrita abra espaco na fila; sem espera, os registros que nao
+// cabem sao descartados e contados, para que a leitura das outras FIFOs nao pare. A idade
+// de cada registro na leitura vai para o histograma de latencia da fila. Os registros
+// tambem sao publicados para os clientes da telemetria local e guardados no historico em
+// memoria, sem nunca esperar por eles.
+static void queue_records(save_stage_t* estagio, const void* registros, int n, int espera)
+{
+    unsigned long feitos = 0;
+    long long agora = log_now_ns(), t;
+    int i;
+
+    // O relogio eh acertado com o lote inteiro antes, pois os registros mais novos sao os
+    // ultimos e dao a menor diferenca entre os relogios
+    for (i = 0; i < n; i++)
+        lat_clock_update(&relogio, record_time(estagio->stream, (const char*)registros + i*estagio->fila.record_size), agora);
+    for (i = 0; i < n; i++) {
+        t = record_time(estagio->stream, (const char*)registros + i*estagio->fila.record_size);
+        lat_hist_add(&latencia_fila[estagio->stream], lat_clock_age(&relogio, t, agora));
+    }
+
+    telemetry_publish(estagio->stream, registros, n);
+    history_add(estagio->stream, registros, n);
+
+    while (1) {
+        feitos += spsc_ring_push(&estagio->fila, (const char*)registros + feitos*estagio->fila.record_size, n - feitos);
+        if ((feitos == (unsigned long)n) || !espera)
+            break;
+        usleep(1000);
+    }
+
+    if (feitos < (unsigned long)n) {
+        char texto[MAX_STRLEN+64];
+
+        // Registra apenas o primeiro descarte de cada voo
+        if (estagio->descartados == 0) {
+            sprintf(texto, "Save_data (thread): Fila cheia (%s), registros descartados.", log_stream_name(estagio->stream));
+            master_log(ERROR_LOG, texto);
+        }
+        estagio->descartados += n - feitos;
+    }
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Passa para a fila do estagio os registros do anel do dispositivo na memoria compartilhada,
+// lidos no proprio anel, sem a copia do read(). Os registros sao devolvidos ao fdc_slave
+// depois de copiados para a fila (ou descartados, se guarda eh zero). Retorna o numero
+// de registros tirados do anel.
+static int get_ring_records(save_stage_t* estagio, shm_region_t* aneis, int guarda, int espera)
+{
+    const void* registros;
+    unsigned int n;
+    int total = 0;
+
+    while ((n = shm_ring_peek(aneis, estagio->stream, &registros)) > 0) {
+        if (guarda)
+            queue_records(estagio, registros, n, espera);
+        shm_ring_release(aneis, estagio->stream, n);
+        total += n;
+    }
+
+    return total;
+}
+
 /*!*******************************************************************************************
 *********************************************************************************************/
 /*    Thread para a coleta dos dados. Primeiramente eh resetada a variavel de fim da thread,
@@ -368,118 +1171,257 @@ int create_new_dir (void)
  arquivos e so entao passasse a captar os dados, ate que a thread seja terminada.*/
 void *save_data(void *arg)
 {
-    // Arquivos de escrita de dados
-    FILE *arquivo_daq = NULL, *arquivo_ahrs = NULL, *arquivo_gps = NULL, *arquivo_nav = NULL, *arquivo_pitot = NULL;
-    int daq_ok=0, gps_ok=0, ahrs_ok=0, nav_ok = 0, pitot_ok = 0;
-      int local_end_save_data; 
-    
-    
-    // Escreve na variavel de fim da thread
-    sem_wait(&global.end_thread_save_data);
-    global.end_save_data = SAVE_SEND;
-    sem_post(&global.end_thread_save_data);
-    
+    save_config_t config;                   // Configuracao dos arquivos deste voo
+    save_segment_t segmentos[2];            // Segmento atual e proximo
+    int atual = 0;                          // Indice do segmento atual
+    int pedido_troca = 0;                   // Troca de segmento pedida por "change datfile"
+    int troca_automatica;
+    fifo_batch_t fifos[N_STREAMS];  // Buffers de leitura das FIFOs de dados
+    int n_registros[N_STREAMS];     // Registros lidos de cada FIFO nesta iteracao
+    int local_end_save_data = SAVE_SEND;    // Estado escrito por start_save_data(): um STOP
+                                            // antes da primeira volta do loop ainda esvazia
+                                            // as FIFOs
+    int estado;
+    int i;
+    struct pollfd fds[N_POLL];  // FIFOs de dados e pipe de despertar
+    save_jitter_t jitter;                   // Resumos do periodo da tarefa de tempo real
+    save_stage_t estagios[N_STREAMS];          // Filas e threads de escrita de cada arquivo
+    char texto[MAX_STRLEN+64];
+
+
+    // O estado (SAVE_SEND) e o pedido de troca (nenhum) ja foram escritos por
+    // start_save_data(), antes da criacao desta thread
+
     sem_wait(&global.file_names); // Espera para poder ler os nomes de arquivos
-    
+
+    // O formato e a politica de escrita escolhidos valem para todo o voo
+    memset(&config, 0, sizeof(config));
+    config.formato = global.log_format;
+    config.flush_ms = global.flush_ms;
+    config.sync_data = global.sync_data;
+    config.prealloc_min = global.prealloc_min;
+    config.rotate_min = global.rotate_min;
+    config.rotate_mb = global.rotate_mb;
+    config.inicio = time(NULL);
+    troca_automatica = (config.rotate_min > 0) || (config.rotate_mb > 0);
+
     /* Cria um novo diretorio para os arquivos dentro de "/tmp/data", cujo nome
     eh funcao do tempo.*/
     create_new_dir();
-    
-    /*     Abre os arquivos para a escrita de dados. Se algum arquivo jah existir,
-    (por exemplo, quando se nomear um novo arquivo e os outros permanecerem com os 
-    mesmos nomes), entao ele serah reaberto para a escrita a partir do ultimo dado 
-    escrito. */
-    if ((arquivo_daq = fopen(global.file_daq_name,"w")) < 0) {
-        printf("\n Erro na abertura do arquivo");
-        master_log(ERROR_LOG, "Save_data (thread): Erro na abertura do arquivo (DAQ).(exit)");
-        exit(1);
-    }
-    if ((arquivo_ahrs = fopen(global.file_ahrs_name,"w")) < 0) {
+    snprintf(config.dir, MAX_STRLEN, "%s", global.dir_name);
+
+    sem_post(&global.file_names); // Libera o semaforo
+
+    /*     Abre os arquivos do primeiro segmento e escreve os cabecalhos. Os dados passam
+    por um buffer de cada arquivo, escrito em disco quando enche ou quando o dado mais
+    antigo atinge flush_ms milisegundos, ou sao copiados direto para o arquivo mapeado
+    em memoria (prealloc_min > 0). */
+    memset(segmentos, 0, sizeof(segmentos));
+    segmentos[0].config = &config;
+    segmentos[1].config = &config;
+    if (open_segment(&segmentos[0]) < 0) {
         printf("\n Erro na abertura do arquivo");
-        master_log(ERROR_LOG, "Save_data (thread): Erro na abertura do arquivo (AHRS).(exit)");
+        master_log(ERROR_LOG, "Save_data (thread): Erro na abertura dos arquivos.(exit)");
         exit(1);
     }
-    if ((arquivo_gps = fopen(global.file_gps_name,"w")) < 0) {
-        printf("\n Erro na abertura do arquivo");
-        master_log(ERROR_LOG, "Save_data (thread): Erro na abertura do arquivo (GPS).(exit)");
-        exit(1);
-    } 
-    if ((arquivo_nav = fopen(global.file_nav_name,"w")) < 0) {
-        printf("\n Erro na abertura do arquivo");
-        master_log(ERROR_LOG, "Save_data (thread): Erro na abertura do arquivo (NAV).(exit)");
-        exit(1);
+    segmentos[0].estado = SEGMENT_ACTIVE;
+    segmentos[0].inicio = log_now_ns();
+
+    // A thread dorme em poll() ate que haja dados em alguma FIFO, em vez de
+    // testar as FIFOs continuamente
+    fds[STREAM_AHRS].fd = global.fifo_ahrs;
+    fds[STREAM_DAQ].fd = global.fifo_daq;
+    fds[STREAM_GPS].fd = global.fifo_gps;
+    fds[STREAM_NAV].fd = global.fifo_nav;
+    fds[STREAM_PITOT].fd = global.fifo_pitot;
+    fds[POLL_WAKEUP].fd = global.wakeup_save_data;
+    fds[POLL_RINGS].fd = global.fifo_rings;
+    fds[POLL_JITTER].fd = global.fifo_jitter;
+    for (i = 0; i < N_POLL; i++)
+        fds[i].events = POLLIN;
+
+    // Cada FIFO eh lida em lotes de ate FIFO_BATCH_RECORDS registros por chamada
+    for (i = 0; i < N_STREAMS; i++) {
+        n_registros[i] = 0;
+        if (fifo_batch_init(&fifos[i], fds[i].fd, log_record_size(i), FIFO_BATCH_RECORDS) < 0) {
+            master_log(ERROR_LOG, "Save_data (thread): Erro na alocacao dos buffers das FIFOs.(exit)");
+            exit(1);
+        }
     }
-    if ((arquivo_pitot = fopen(global.file_pitot_name,"w")) < 0) {
-        printf("\n Erro na abertura do arquivo");
-        master_log(ERROR_LOG, "Save_data (thread): Erro na abertura do arquivo (PITOT).(exit)");
-        exit(1);
+
+    // Os resumos do periodo da tarefa de tempo real sao gravados junto com os dados
+    open_jitter(&jitter, &config);
+
+    // Os histogramas de latencia passam a ser os deste voo
+    for (i = 0; i < N_STREAMS; i++) {
+        lat_hist_reset(&latencia_fila[i]);
+        lat_hist_reset(&latencia_escrita[i]);
     }
+    lat_clock_reset(&relogio);
 
-    // Abre os arquivos e escreve os cabecalhos
-    write_headers(arquivo_daq, arquivo_ahrs, arquivo_gps, arquivo_nav, arquivo_pitot);    
-    sem_post(&global.file_names); // Libera o semaforo
+    // Cada arquivo eh escrito por uma thread propria, alimentada por uma fila; esta
+    // thread apenas le as FIFOs
+    memset(estagios, 0, sizeof(estagios));
+    for (i = 0; i < N_STREAMS; i++) {
+        estagios[i].stream = i;
+        estagios[i].formato = config.formato;
+        estagios[i].arquivo = &segmentos[0].arquivos[i];
+        estagios[i].codificador = &segmentos[0].codificadores[i];
+        estagios[i].indice = &segmentos[0].indices[i];
+        if (spsc_ring_init(&estagios[i].fila, log_record_size(i), SAVE_QUEUE_RECORDS) < 0) {
+            master_log(ERROR_LOG, "Save_data (thread): Erro na alocacao das filas de escrita.(exit)");
+            exit(1);
+        }
+        if (pthread_create(&estagios[i].thread, NULL, save_stream, &estagios[i]) != 0) {
+            master_log(ERROR_LOG, "Save_data (thread): Erro na criacao das threads de escrita.(exit)");
+            exit(1);
+        }
+    }
 
     while(1) { // Salva os dados de todos os dispositivos (placa daq, ahrs e gps)
-    
 
-        // Acessa a variavel global do while
-        sem_wait(&global.end_thread_save_data);
-        
-        if (global.end_save_data==STOPPED) { // Enquanto o programa nao termina de salvar os dados
-            // Libera o semaphoro e sai do loop
-            sem_post(&global.end_thread_save_data);
+        // Espera por dados, por um pedido de parada ou de troca de segmento, ou pelo
+        // prazo da troca automatica, se o proximo segmento ja esta aberto
+        if (__atomic_load_n(&segmentos[1-atual].estado, __ATOMIC_ACQUIRE) == SEGMENT_READY)
+            wait_for_data(fds, rotation_timeout(&config, &segmentos[atual], log_now_ns()));
+        else
+            wait_for_data(fds, -1);
+
+        // Le o estado e o pedido de troca sem bloqueio: apenas cargas atomicas, exceto
+        // quando ha um pedido de troca a consumir
+        estado = save_data_state();
+        if (estado==STOPPED) // Enquanto o programa nao termina de salvar os dados
             break;
+
+        // Pega todos os registros disponiveis nas FIFOS que tem dados
+        for (i = 0; i < N_STREAMS; i++)
+            n_registros[i] = (fds[i].revents & POLLIN) ? get_records(&fifos[i], i) : 0;
+
+        local_end_save_data=estado;
+
+        if (__atomic_load_n(&global.rotate_save_data, __ATOMIC_ACQUIRE) &&
+            __atomic_exchange_n(&global.rotate_save_data, 0, __ATOMIC_ACQ_REL))
+            pedido_troca = 1;
+
+        if ((local_end_save_data==SAVE)||(local_end_save_data==SAVE_SEND)){
+            for (i = 0; i < N_STREAMS; i++)
+                if (n_registros[i] > 0)
+                    queue_records(&estagios[i], fifo_batch_record(&fifos[i], 0), n_registros[i], 0);
         }
-        else { // Pega os dados das FIFOS
-            ahrs_ok=get_ahrs();
-            daq_ok=get_daq();
-            gps_ok=get_gps();
-            nav_ok=get_nav();
-            pitot_ok=get_pitot();
+
+        if (fds[POLL_JITTER].revents & POLLIN)
+            read_jitter(&jitter, 1);
+
+        // Os aneis sao lidos a cada volta, pois um aviso vale para todos eles
+        if (global.rings != NULL)
+            for (i = 0; i < N_STREAMS; i++)
+                get_ring_records(&estagios[i], global.rings,
+                    (local_end_save_data==SAVE)||(local_end_save_data==SAVE_SEND), 0);
+
+        // Troca de segmento. Um segmento aberto antes de "change datfile" tem os nomes
+        // antigos e eh descartado, sem que esta thread espere pela abertura dele.
+        if (pedido_troca == 1) {
+            stale_segment(&segmentos[1-atual]);
+            pedido_troca = 2;
         }
-                
-        local_end_save_data=global.end_save_data;    
-        
-        // Libera o semaphoro
-        sem_post(&global.end_thread_save_data);
-        
-        if ((local_end_save_data==SAVE)||(local_end_save_data==SAVE_SEND)){
-            if (daq_ok) save_daq(arquivo_daq);
-            if (gps_ok) save_gps(arquivo_gps);
-            if (ahrs_ok) save_ahrs(arquivo_ahrs);
-            if (nav_ok) save_nav(arquivo_nav);
-            if (pitot_ok) save_pitot(arquivo_pitot);
+
+        switch (__atomic_load_n(&segmentos[1-atual].estado, __ATOMIC_ACQUIRE)) {
+            case SEGMENT_DISCARDED:
+                // A thread do segmento obsoleto ja terminou; o segmento seguinte eh aberto
+                // em seguida, como em SEGMENT_FREE
+                pthread_join(segmentos[1-atual].thread, NULL);
+                segmentos[1-atual].estado = SEGMENT_FREE;
+                /* FALLTHROUGH */
+            case SEGMENT_FREE:
+                // O proximo segmento eh aberto assim que as threads de escrita fecham os
+                // arquivos da troca anterior
+                if ((pedido_troca || troca_automatica) && switch_done(estagios))
+                    if (start_segment(&segmentos[1-atual], segmentos[atual].numero+1) < 0)
+                        troca_automatica = pedido_troca = 0;
+                break;
+            case SEGMENT_READY:
+                if (pedido_troca || rotation_due(&config, &segmentos[atual], log_now_ns())) {
+                    switch_segment(estagios, &segmentos[1-atual]);
+                    segmentos[atual].estado = SEGMENT_FREE;
+                    atual = 1-atual;
+                    pedido_troca = 0;
+                }
+                break;
+            case SEGMENT_FAILED:
+                // A gravacao continua no segmento atual; a troca automatica eh desligada
+                pthread_join(segmentos[1-atual].thread, NULL);
+                segmentos[1-atual].estado = SEGMENT_FREE;
+                troca_automatica = pedido_troca = 0;
+                break;
+            default:
+                break;
         }
-        
+
     } // end while
-    
+
     // Enquanto as fifos de dados nao estiverem vazias, salva os dados
-    
-    if ((global.end_save_data==SAVE)||(global.end_save_data==SAVE_SEND)){
-        while(get_ahrs()) save_ahrs(arquivo_ahrs);
-        while(get_daq()) save_daq(arquivo_daq);
-        while(get_gps()) save_gps(arquivo_gps);
-        while(get_nav()) save_nav(arquivo_nav);
-        while(get_pitot()) save_pitot(arquivo_pitot);
+    // (global.end_save_data ja vale STOPPED aqui; vale o ultimo estado visto no loop)
+
+    if ((local_end_save_data==SAVE)||(local_end_save_data==SAVE_SEND)){
+        for (i = 0; i < N_STREAMS; i++)
+            while ((fifos[i].fd >= 0) && ((n_registros[i] = get_records(&fifos[i], i)) > 0))
+                queue_records(&estagios[i], fifo_batch_record(&fifos[i], 0), n_registros[i], 1);
+        if (global.rings != NULL)
+            for (i = 0; i < N_STREAMS; i++)
+                get_ring_records(&estagios[i], global.rings, 1, 1);
     }
-    
-    // Fecha os arquivos de armazenamento dos dados e zera os apontadores
-    fclose(arquivo_daq);
-    fclose(arquivo_ahrs);
-    fclose(arquivo_gps);
-    fclose(arquivo_nav);
-    fclose(arquivo_pitot);
-    
-    // Anula os apontadores dos arquivos
-    arquivo_daq = NULL;
-    arquivo_ahrs = NULL;
-    arquivo_gps = NULL;
-    arquivo_nav = NULL;
-    arquivo_pitot = NULL;
-    
+
+    for (i = 0; i < N_STREAMS; i++)
+        fifo_batch_free(&fifos[i]);
+
+    // Espera que as threads de escrita esvaziem as filas, fechem os arquivos e terminem
+    for (i = 0; i < N_STREAMS; i++) {
+        __atomic_store_n(&estagios[i].fim, 1, __ATOMIC_RELEASE);
+        spsc_ring_wake(&estagios[i].fila);
+    }
+    for (i = 0; i < N_STREAMS; i++) {
+        pthread_join(estagios[i].thread, NULL);
+
+        // Ocupacao maxima de cada fila, para dimensionar SAVE_QUEUE_RECORDS
+        sprintf(texto, "Save_data (thread): Fila %s - maximo de %lu de %lu registros, %lu descartados.",
+            log_stream_name(i), estagios[i].fila.high_water, estagios[i].fila.capacity, estagios[i].descartados);
+        master_log((estagios[i].descartados > 0) ? ERROR_LOG : STATUS_LOG, texto);
+        spsc_ring_free(&estagios[i].fila);
+
+        // Amostras que o fdc_slave nao pode por no anel (desde a carga do modulo)
+        if ((global.rings != NULL) && (global.rings->rings[i].dropped > 0)) {
+            sprintf(texto, "Save_data (thread): Anel %s - %u amostras descartadas pelo fdc_slave.",
+                log_stream_name(i), global.rings->rings[i].dropped);
+            master_log(ERROR_LOG, texto);
+        }
+
+        // Registros sem marca livre para a latencia de escrita
+        if (estagios[i].marcas.skipped > 0) {
+            sprintf(texto, "Save_data (thread): Latencia %s - %lu registros nao medidos na escrita.",
+                log_stream_name(i), estagios[i].marcas.skipped);
+            master_log(STATUS_LOG, texto);
+        }
+
+        // Taxa de compressao de cada arquivo
+        if ((config.formato == FORMAT_COMPRESSED) && (estagios[i].bytes_blocos > 0)) {
+            sprintf(texto, "Save_data (thread): Compressao %s - %llu para %llu bytes.", log_stream_name(i),
+                estagios[i].bytes_registros, estagios[i].bytes_blocos);
+            master_log(STATUS_LOG, texto);
+        }
+    }
+
+    // O segmento aberto para a proxima troca nao chegou a ser usado
+    cancel_segment(&segmentos[1-atual]);
+
+    close_jitter(&jitter);
+
+    // Histogramas de latencia do voo, junto com os arquivos
+    snprintf(texto, sizeof(texto), "%s%s", config.dir, LATENCY_FILE);
+    save_latency_report(texto);
+
     master_log(STATUS_LOG, "Save_data (thread): Fim da thread.");
     // Retorno da thread (Apaga o descritor)
     pthread_exit(NULL);
-    
+
     return (void*)0;
 }
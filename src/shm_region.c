@@ -0,0 +1,113 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            MEMORIA COMPARTILHADA DOS ANEIS DE AMOSTRAS, DO LADO DO FDC_MASTER - SHM_REGION
+
+    Compilada com SHM_RING_MMAP, a regiao eh um objeto de memoria compartilhada POSIX em vez
+de shm do RTAI, para que um produtor em espaco de usuario possa fazer o papel do fdc_slave
+em uma maquina sem RTAI.
+*********************************************************************************************
+********************************************************************************************/
+
+#include "messages.h"
+#include "shm_ring.h"
+
+#include <errno.h>
+
+#ifdef SHM_RING_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#else
+#include <rtai_shm.h>
+#endif
+
+static const unsigned int sizes[SHM_RING_STREAMS] = SHM_RING_SIZES;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static unsigned int region_size(void)
+{
+    return shm_region_size(sizes, SHM_RING_STREAMS, SHM_RING_RECORDS);
+}
+
+#ifdef SHM_RING_MMAP
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static shm_region_t *map(int flags)
+{
+    void *p;
+    int fd = shm_open(SHM_RING_FILE, flags, 0600);
+
+    if (fd < 0)
+        return NULL;
+    if ((flags & O_CREAT) && (ftruncate(fd, region_size()) != 0)) {
+        close(fd);
+        return NULL;
+    }
+    p = mmap(NULL, region_size(), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    return (p == MAP_FAILED) ? NULL : p;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+shm_region_t *shm_region_create(void)
+{
+    shm_region_t *r = map(O_RDWR|O_CREAT);
+
+    if ((r != NULL) && (shm_region_init(r, sizes, SHM_RING_STREAMS, SHM_RING_RECORDS) != 0)) {
+        munmap(r, region_size());
+        return NULL;
+    }
+
+    return r;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void shm_region_remove(void)
+{
+    shm_unlink(SHM_RING_FILE);
+}
+
+#endif
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+shm_region_t *shm_region_attach(void)
+{
+    shm_region_t *r;
+
+#ifdef SHM_RING_MMAP
+    r = map(O_RDWR);
+#else
+    // Aloca a memoria se o modulo nao alocou: o numero magico eh entao 0
+    r = rtai_malloc(nam2num(SHM_RING_NAME), region_size());
+#endif
+    if (r == NULL)
+        return NULL;
+
+    if (!shm_region_valid(r, region_size(), sizes, SHM_RING_STREAMS)) {
+        shm_region_detach(r);
+        errno = EPROTO;
+        return NULL;
+    }
+
+    return r;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void shm_region_detach(shm_region_t *r)
+{
+    if (r == NULL)
+        return;
+
+#ifdef SHM_RING_MMAP
+    munmap(r, region_size());
+#else
+    rtai_free(nam2num(SHM_RING_NAME), r);
+#endif
+}
@@ -0,0 +1,142 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            ANEL DE UM PRODUTOR E UM CONSUMIDOR COM REGISTROS DE TAMANHO FIXO - SPSC_RING
+*********************************************************************************************
+********************************************************************************************/
+
+#include "spsc_ring.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int spsc_ring_init(spsc_ring_t *r, size_t record_size, unsigned long capacity)
+{
+    unsigned long n = 1;
+
+    memset(r, 0, sizeof(*r));
+
+    // Potencia de dois, para que os indices sejam contadores mascarados por capacity-1
+    while (n < capacity)
+        n <<= 1;
+
+    r->record_size = record_size;
+    r->capacity = n;
+    r->buf = malloc(n*record_size);
+    if (r->buf == NULL)
+        return -1;
+
+    if (sem_init(&r->ready, 0, 0) < 0) {
+        free(r->buf);
+        r->buf = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+unsigned long spsc_ring_push(spsc_ring_t *r, const void *records, unsigned long n)
+{
+    unsigned long head = r->head;
+    unsigned long tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    unsigned long used = head - tail;
+    unsigned long index, first;
+
+    if (n > r->capacity - used)
+        n = r->capacity - used;
+    if (n == 0)
+        return 0;
+
+    // Ate duas copias, quando os registros dao a volta no fim de buf
+    index = head & (r->capacity - 1);
+    first = r->capacity - index;
+    if (first > n)
+        first = n;
+    memcpy(r->buf + index*r->record_size, records, first*r->record_size);
+    memcpy(r->buf, (const char *)records + first*r->record_size, (n - first)*r->record_size);
+
+    __atomic_store_n(&r->head, head + n, __ATOMIC_RELEASE);
+
+    if (used + n > r->high_water)
+        r->high_water = used + n;
+
+    sem_post(&r->ready);
+
+    return n;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+unsigned long spsc_ring_peek(spsc_ring_t *r, const void **records)
+{
+    unsigned long tail = r->tail;
+    unsigned long head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    unsigned long index = tail & (r->capacity - 1);
+    unsigned long n = head - tail;
+
+    if (n > r->capacity - index)
+        n = r->capacity - index;
+
+    *records = r->buf + index*r->record_size;
+
+    return n;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void spsc_ring_release(spsc_ring_t *r, unsigned long n)
+{
+    __atomic_store_n(&r->tail, r->tail + n, __ATOMIC_RELEASE);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+unsigned long spsc_ring_count(spsc_ring_t *r)
+{
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void spsc_ring_wait(spsc_ring_t *r, int timeout_ms)
+{
+    struct timespec ts;
+
+    if (timeout_ms < 0) {
+        while ((sem_wait(&r->ready) < 0) && (errno == EINTR));
+    }
+    else {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += timeout_ms/1000;
+        ts.tv_nsec += (long)(timeout_ms%1000)*1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        while ((sem_timedwait(&r->ready, &ts) < 0) && (errno == EINTR));
+    }
+
+    // Um unico despertar basta para tudo o que foi inserido ate agora
+    while (sem_trywait(&r->ready) == 0);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void spsc_ring_wake(spsc_ring_t *r)
+{
+    sem_post(&r->ready);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void spsc_ring_free(spsc_ring_t *r)
+{
+    sem_destroy(&r->ready);
+    free(r->buf);
+    r->buf = NULL;
+}
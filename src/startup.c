@@ -0,0 +1,441 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            CARGA EM PARALELO DOS MODULOS DO KERNEL DO FDC - STARTUP
+*********************************************************************************************
+********************************************************************************************/
+
+#define _GNU_SOURCE
+
+#include "startup.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+
+// Modulos do sistema (portas seriais, FIFOs RT, memoria compartilhada dos contadores dos
+// dispositivos e dos aneis, CRC do modem) primeiro, depois os dispositivos, depois a
+// tarefa RT, que usa todos eles. Os modulos do sistema continuam carregados no final,
+// como sempre ficaram.
+const startup_step_t startup_fdc_modules[] = {
+    { "rtai_serial", NULL,                      1, { NULL } },
+    { "rtai_fifos",  NULL,                      1, { NULL } },
+    { "rtai_shm",    NULL,                      1, { NULL } },
+    { "crc8",        NULL,                      1, { NULL } },
+    { "rtai_daq",    "./object/rtai_daq.o",     0, { "rtai_shm", NULL } },
+    { "rtai_gps",    "./object/rtai_gps.o",     0, { "rtai_serial", "rtai_shm", NULL } },
+    { "rtai_ahrs",   "./object/rtai_ahrs.o",    0, { "rtai_serial", "rtai_shm", NULL } },
+    { "rtai_nav",    "./object/rtai_nav.o",     0, { "rtai_serial", "rtai_shm", NULL } },
+    { "rtai_pitot",  "./object/rtai_pitot.o",   0, { "rtai_serial", "rtai_shm", NULL } },
+    { "modem",       "./object/modem.o",        0, { "rtai_serial", "crc8", "rtai_shm", NULL } },
+    { "epos",        "./object/epos.o",         0, { "rtai_serial", NULL } },
+    { "fdc_slave",   "./object/fdc_slave.o",    0, { "rtai_fifos", "rtai_shm", "rtai_daq", "rtai_gps", "rtai_ahrs",
+                                                     "rtai_nav", "rtai_pitot", "modem", "epos", NULL } },
+};
+
+const int startup_fdc_n_modules = sizeof(startup_fdc_modules)/sizeof(startup_fdc_modules[0]);
+
+typedef struct {
+    const startup_step_t *steps;
+    int n;
+    int deps[STARTUP_MAX_STEPS][STARTUP_MAX_DEPS];   // Indices das dependencias
+    int n_deps[STARTUP_MAX_STEPS];
+    int order[STARTUP_MAX_STEPS];                   // Dependencias antes dos dependentes
+    startup_load_t load;
+    void *arg;
+    startup_timing_t *timeline;
+    long long t0;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;                         // Um passo terminou
+} run_t;
+
+typedef struct {
+    run_t *run;
+    int step;
+} worker_t;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int find_step(const startup_step_t *steps, int n, const char *name)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        if (strcmp(steps[i].name, name) == 0)
+            return i;
+
+    return -1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que resolve as dependencias e ordena os passos para que cada um venha depois das
+// suas dependencias. Retorna -1 se um nome for desconhecido ou se houver um ciclo.
+static int plan(run_t *run)
+{
+    int remaining[STARTUP_MAX_STEPS], placed = 0, i, j, k, progress;
+
+    for (i = 0; i < run->n; i++) {
+        run->n_deps[i] = 0;
+        for (k = 0; (k < STARTUP_MAX_DEPS) && (run->steps[i].deps[k] != NULL); k++) {
+            if ((j = find_step(run->steps, run->n, run->steps[i].deps[k])) < 0)
+                return -1;
+            run->deps[i][run->n_deps[i]++] = j;
+        }
+        remaining[i] = 1;
+    }
+
+    while (placed < run->n) {
+        progress = 0;
+        for (i = 0; i < run->n; i++) {
+            if (!remaining[i])
+                continue;
+            for (k = 0; (k < run->n_deps[i]) && !remaining[run->deps[i][k]]; k++);
+            if (k == run->n_deps[i]) {
+                run->order[placed++] = i;
+                remaining[i] = 0;
+                progress = 1;
+            }
+        }
+        if (!progress)
+            return -1;
+    }
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void *worker(void *p)
+{
+    worker_t *w = p;
+    run_t *run = w->run;
+    startup_timing_t *t = &run->timeline[w->step];
+    int k, waiting, failed = 0, error;
+    long long start;
+
+    // Espera as dependencias terminarem
+    pthread_mutex_lock(&run->lock);
+    do {
+        waiting = 0;
+        for (k = 0; k < run->n_deps[w->step]; k++) {
+            startup_state_t state = run->timeline[run->deps[w->step][k]].state;
+
+            if (state == STARTUP_PENDING)
+                waiting = 1;
+            else if (state != STARTUP_OK)
+                failed = 1;
+        }
+        if (waiting)
+            pthread_cond_wait(&run->changed, &run->lock);
+    } while (waiting);
+    pthread_mutex_unlock(&run->lock);
+
+    start = now_ns() - run->t0;
+    error = failed ? 0 : run->load(&run->steps[w->step], run->arg);
+
+    pthread_mutex_lock(&run->lock);
+    t->start_ns = start;
+    t->end_ns = now_ns() - run->t0;
+    t->error = error;
+    t->state = failed ? STARTUP_SKIPPED : (error != 0) ? STARTUP_FAILED : STARTUP_OK;
+    pthread_cond_broadcast(&run->changed);
+    pthread_mutex_unlock(&run->lock);
+
+    return NULL;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int startup_run(const startup_step_t *steps, int n, startup_load_t load, void *arg,
+                startup_timing_t *timeline, long long *total_ns)
+{
+    run_t run;
+    worker_t workers[STARTUP_MAX_STEPS];
+    pthread_t threads[STARTUP_MAX_STEPS];
+    int started[STARTUP_MAX_STEPS], i, step, problems = 0;
+
+    if ((n < 0) || (n > STARTUP_MAX_STEPS))
+        return -1;
+
+    memset(&run, 0, sizeof(run));
+    run.steps = steps;
+    run.n = n;
+    run.load = load;
+    run.arg = arg;
+    run.timeline = timeline;
+    if (plan(&run) != 0)
+        return -1;
+
+    memset(timeline, 0, n*sizeof(startup_timing_t));
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.changed, NULL);
+    run.t0 = now_ns();
+
+    // Em ordem de dependencia: um passo que nao pode ter uma thread roda aqui, e as suas
+    // dependencias ja tem threads (ou ja terminaram)
+    for (i = 0; i < n; i++) {
+        step = run.order[i];
+        workers[step].run = &run;
+        workers[step].step = step;
+        started[step] = (pthread_create(&threads[step], NULL, worker, &workers[step]) == 0);
+        if (!started[step])
+            worker(&workers[step]);
+    }
+
+    *total_ns = 0;
+    for (i = 0; i < n; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        if (timeline[i].end_ns > *total_ns)
+            *total_ns = timeline[i].end_ns;
+        if (timeline[i].state != STARTUP_OK)
+            problems++;
+    }
+
+    pthread_cond_destroy(&run.changed);
+    pthread_mutex_destroy(&run.lock);
+
+    return problems;
+}
+
+/*************************************************************************
+ * Modulos reais
+ *************************************************************************/
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que compara nomes de modulos, tratando '-' e '_' como o mesmo caractere
+static int same_module(const char *a, const char *b, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        if ((a[i] != b[i]) && !(((a[i] == '-') || (a[i] == '_')) && ((b[i] == '-') || (b[i] == '_'))))
+            return 0;
+
+    return 1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que procura o arquivo (nao comprimido) de um modulo do sistema
+static int find_module(const char *name, char *path, size_t size)
+{
+    struct utsname u;
+    char line[1024], *colon, *base;
+    size_t len = strlen(name);
+    FILE *dep;
+    int found = 0;
+
+    snprintf(path, size, "%s/%s.ko", STARTUP_RTAI_MODULES, name);
+    if (access(path, R_OK) == 0)
+        return 0;
+
+    if (uname(&u) != 0)
+        return -1;
+    snprintf(line, sizeof(line), "/lib/modules/%s/modules.dep", u.release);
+    if ((dep = fopen(line, "r")) == NULL)
+        return -1;
+
+    while (!found && (fgets(line, sizeof(line), dep) != NULL)) {
+        if ((colon = strchr(line, ':')) == NULL)
+            continue;
+        *colon = '\0';
+        base = strrchr(line, '/');
+        base = (base != NULL) ? base + 1 : line;
+        if ((strlen(base) == len + 3) && same_module(base, name, len) && (strcmp(base + len, ".ko") == 0)) {
+            if (line[0] == '/')
+                snprintf(path, size, "%s", line);
+            else
+                snprintf(path, size, "/lib/modules/%s/%s", u.release, line);
+            found = 1;
+        }
+    }
+    fclose(dep);
+
+    return found ? 0 : -1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que diz se o modulo esta em /proc/modules (igual nos kernels 2.4 e 2.6)
+static int module_loaded(const char *name)
+{
+    char line[256];
+    size_t len = strlen(name);
+    FILE *f;
+    int found = 0;
+
+    if ((f = fopen("/proc/modules", "r")) == NULL)
+        return 0;
+    while (!found && (fgets(line, sizeof(line), f) != NULL))
+        found = (strlen(line) > len) && (line[len] == ' ') && same_module(line, name, len);
+    fclose(f);
+
+    return found;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que executa uma ferramenta de modulos (insmod, modprobe) diretamente, sem shell
+static int run_tool(char *const argv[])
+{
+    int status;
+    pid_t pid = fork();
+
+    if (pid < 0)
+        return errno;
+    if (pid == 0) {
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    if (waitpid(pid, &status, 0) != pid)
+        return errno;
+    if (WIFEXITED(status) && (WEXITSTATUS(status) == 0))
+        return 0;
+
+    return (WIFEXITED(status) && (WEXITSTATUS(status) == 127)) ? ENOENT : EIO;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Somente arquivos .ko sao imagens que o kernel liga sozinho
+static int is_ko(const char *path)
+{
+    size_t len = strlen(path);
+
+    return (len > 3) && (strcmp(path + len - 3, ".ko") == 0);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que carrega um arquivo .ko com finit_module(2), ou com init_module(2) e o
+// arquivo lido em memoria nos kernels sem ela. Retorna 0 ou um valor de errno.
+static int load_image(const char *path)
+{
+    struct stat st;
+    void *image;
+    ssize_t got;
+    size_t done = 0;
+    int fd, error = ENOSYS;
+
+    if ((fd = open(path, O_RDONLY|O_CLOEXEC)) < 0)
+        return errno;
+
+#ifdef SYS_finit_module
+    if (syscall(SYS_finit_module, fd, "", 0) == 0) {
+        close(fd);
+        return 0;
+    }
+    error = errno;
+#endif
+
+    // Kernels sem finit_module(2): a imagem passa pela memoria
+    if ((error == ENOSYS) && (fstat(fd, &st) == 0) && ((image = malloc(st.st_size)) != NULL)) {
+        while ((done < (size_t)st.st_size) && ((got = read(fd, (char *)image + done, st.st_size - done)) > 0))
+            done += got;
+        if (done != (size_t)st.st_size)
+            error = EIO;
+        else
+            error = (syscall(SYS_init_module, image, done, "") == 0) ? 0 : errno;
+        free(image);
+    }
+    close(fd);
+
+    return error;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int startup_load_module(const startup_step_t *step, void *arg)
+{
+    char path[PATH_MAX];
+    char *insmod[] = { "insmod", path, NULL };
+    char *modprobe[] = { "modprobe", "-q", (char *)step->name, NULL };
+    int error;
+
+    (void)arg;
+
+    // Carregado antes (a mao, ou por uma execucao anterior que nao o descarregou)
+    if (module_loaded(step->name))
+        return 0;
+
+    // Os objetos do FDC sao arquivos .o relocaveis, ligados ao kernel pelo insmod (2.4);
+    // um .ko eh tentado primeiro com as chamadas de sistema
+    if (step->path != NULL) {
+        snprintf(path, sizeof(path), "%s", step->path);
+        error = is_ko(path) ? load_image(path) : ENOEXEC;
+        if ((error == 0) || (error == EEXIST))
+            return 0;
+        return run_tool(insmod);
+    }
+
+    // Um modulo do sistema encontrado como .ko eh carregado diretamente; qualquer outro
+    // (e um que falhe, p.ex. por falta de uma dependencia) vai para o modprobe
+    if ((find_module(step->name, path, sizeof(path)) == 0) && is_ko(path)) {
+        error = load_image(path);
+        if ((error == 0) || (error == EEXIST))
+            return 0;
+    }
+
+    return run_tool(modprobe);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int startup_unload(const startup_step_t *steps, int n)
+{
+    run_t run;
+    int i, step, failures = 0;
+
+    memset(&run, 0, sizeof(run));
+    run.steps = steps;
+    run.n = n;
+    if ((n > STARTUP_MAX_STEPS) || (plan(&run) != 0))
+        return n;
+
+    for (i = n - 1; i >= 0; i--) {
+        step = run.order[i];
+        if (steps[step].keep)
+            continue;
+        // As flags sao ignoradas pela delete_module(2) do 2.4, que so recebe o nome
+        if ((syscall(SYS_delete_module, steps[step].name, O_NONBLOCK) != 0) && (errno != ENOENT))
+            failures++;
+    }
+
+    return failures;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+const char *startup_state_name(startup_state_t state)
+{
+    switch (state) {
+        case STARTUP_PENDING: return "pending";
+        case STARTUP_OK:      return "ok";
+        case STARTUP_FAILED:  return "failed";
+        case STARTUP_SKIPPED: return "skipped";
+    }
+
+    return "?";
+}
@@ -0,0 +1,356 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            PARTIDA E PARADA DA THREAD SAVE_DATA() MILHARES DE VEZES SOB
+            CARGA - STRESS_SAVE_DATA
+
+    Uma thread produtora por serie escreve registros em um pipe que faz o papel da sua FIFO
+de tempo real, a taxa_hz registros por segundo, enquanto a thread principal faz o que os
+comandos START e STOP do fdc_master fazem (start_save_data() e stop_save_data()) com pausas
+aleatorias entre eles, as vezes pedindo um novo segmento (request_rotation()) como o "change
+datfile" faz durante a gravacao, de vez em quando duas vezes seguidas, para que um segmento
+ainda sendo aberto seja descartado. Alguns voos sao iniciados pelo "change datfile" em vez
+do "start", como o fdc_master faz quando nao esta gravando (change_datfile()). O time_sys de
+cada registro eh o seu numero de sequencia na sua serie. Depois de cada parada os arquivos
+binarios do voo sao lidos de volta e removidos, e o programa falha se:
+
+  - uma parada nao retorna em STOP_TIMEOUT_S (watchdog);
+  - um registro falta, esta duplicado ou fora de ordem: os registros de
+    todos os voos, em ordem, devem ser 0, 1, 2, ... de cada serie ate o
+    ultimo escrito no pipe;
+  - a save_data() registra um erro.
+
+    A partida e a parada mais longas sao informadas: uma partida apenas guarda o estado e
+cria a thread, e nunca espera pela que esta rodando.
+
+Uso: stress_save_data [ciclos] [taxa_hz]
+*********************************************************************************************
+********************************************************************************************/
+
+#include "save_data.h"
+
+#include <dirent.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// Maior tempo que uma parada pode levar antes de o programa ser considerado travado
+#define STOP_TIMEOUT_S 10
+
+// Maior pausa (us) depois de uma partida e depois de uma parada
+#define MAX_PAUSE_US 2000
+
+// Um em cada ROTATE_EVERY ciclos pede um novo segmento
+#define ROTATE_EVERY 8
+
+// Um em cada CHANGE_EVERY ciclos comeca com "change datfile" em vez de "start"
+#define CHANGE_EVERY 5
+
+#define MAX_FILES 256
+
+global_master global;
+
+typedef struct {
+    int stream;
+    int fd;                     // Ponta de escrita do pipe
+    int time_offset;            // Do time_sys no registro
+    double rate_hz;
+    volatile int stop;
+    unsigned long long written; // Registros escritos no pipe
+    pthread_t thread;
+} producer_t;
+
+static int errors_logged;
+static volatile int cycle;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int master_log(int type_message, const char *place)
+{
+    if (type_message == ERROR_LOG) {
+        __atomic_add_fetch(&errors_logged, 1, __ATOMIC_RELAXED);
+        fprintf(stderr, "Error logged: %s\n", place);
+    }
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void watchdog(int sig)
+{
+    static const char msg[] = "stop_save_data() did not return: hung\n";
+
+    (void)sig;
+    write(2, msg, sizeof(msg) - 1);
+    _exit(2);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void *produce(void *arg)
+{
+    producer_t *p = arg;
+    size_t size = log_record_size(p->stream);
+    unsigned char record[256];
+    int64_t seq;
+    double start = now_s(), due;
+
+    memset(record, 0, sizeof(record));
+    while (!p->stop) {
+        // Mantem a taxa, recuperando o atraso depois que o pipe ficou cheio
+        due = start + p->written/p->rate_hz;
+        if (now_s() < due) {
+            usleep(200);
+            continue;
+        }
+        seq = p->written;
+        memcpy(record + p->time_offset, &seq, sizeof(seq));
+        // Os registros sao menores que PIPE_BUF: cada write eh inteiro ou falha
+        if (write(p->fd, record, size) == (ssize_t)size)
+            p->written++;
+        else
+            usleep(200);
+    }
+
+    return NULL;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que faz o que o "change datfile daq" faz no fdc_master quando nao esta gravando:
+// para a thread (nao ha nenhuma), muda o nome e a inicia de novo
+static int change_datfile(int n)
+{
+    if (stop_save_data() != 0)
+        return -1;
+
+    sem_wait(&global.file_names);
+    snprintf(global.file_daq_name, MAX_STRLEN, "%s/daq_change_%d.dat", FILES_PATH, n % 2);
+    sem_post(&global.file_names);
+
+    return start_save_data();
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int has_ext(const char *name, const char *ext)
+{
+    size_t len = strlen(name), len_ext = strlen(ext);
+
+    return (len >= len_ext) && (strcmp(name + len - len_ext, ext) == 0);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que confere os registros do voo em dir com os numeros de sequencia esperados a
+// seguir em cada serie, e depois remove o voo. Retorna o numero de problemas encontrados.
+static int check_flight(const char *dir_name, unsigned long long expected[])
+{
+    char *names[MAX_FILES], path[PATH_MAX];
+    unsigned char record[256];
+    log_header_t header;
+    struct dirent *entry;
+    int n = 0, i, problems = 0;
+    int64_t seq;
+    FILE *in;
+    DIR *dir;
+
+    if ((dir = opendir(dir_name)) == NULL) {
+        perror(dir_name);
+        return 1;
+    }
+    while (((entry = readdir(dir)) != NULL) && (n < MAX_FILES))
+        if (entry->d_name[0] != '.')
+            names[n++] = strdup(entry->d_name);
+    closedir(dir);
+
+    // Os segmentos sao ordenados pelo nome: "daq_file.bin", "daq_file_001.bin", ...
+    qsort(names, n, sizeof(char *), compare_names);
+
+    for (i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "%s%s", dir_name, names[i]);
+        if (has_ext(names[i], LOG_EXT_BINARY)) {
+            if (((in = fopen(path, "rb")) == NULL) || (fread(&header, sizeof(header), 1, in) != 1) ||
+                (fseek(in, header.header_size, SEEK_SET) < 0) || (header.stream >= N_STREAMS)) {
+                fprintf(stderr, "Cycle %d: bad file %s\n", cycle, path);
+                problems++;
+            }
+            else {
+                int time_offset = -1, n_fields, k;
+                const log_field_t *fields = log_stream_fields(header.stream, &n_fields);
+
+                for (k = 0; k < n_fields; k++)
+                    if (strcmp(fields[k].name, "time_sys") == 0)
+                        time_offset = fields[k].offset;
+                while (fread(record, header.record_size, 1, in) == 1) {
+                    memcpy(&seq, record + time_offset, sizeof(seq));
+                    if ((unsigned long long)seq != expected[header.stream]) {
+                        if (problems++ < 10)
+                            fprintf(stderr, "Cycle %d: %s: record %lld where %llu was expected\n", cycle,
+                                    path, (long long)seq, expected[header.stream]);
+                        expected[header.stream] = seq;
+                    }
+                    expected[header.stream]++;
+                }
+            }
+            if (in != NULL)
+                fclose(in);
+        }
+        unlink(path);
+        free(names[i]);
+    }
+    rmdir(dir_name);
+
+    return problems;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int main(int argc, char *argv[])
+{
+    int cycles = (argc > 1) ? atoi(argv[1]) : 2000;
+    double rate = (argc > 2) ? atof(argv[2]) : 2000.0;
+    int *fifos[N_STREAMS] = { &global.fifo_ahrs, &global.fifo_daq, &global.fifo_gps, &global.fifo_nav,
+                              &global.fifo_pitot };
+    producer_t producers[N_STREAMS];
+    unsigned long long expected[N_STREAMS], records = 0;
+    double t0, t, max_start = 0, max_stop = 0, total_stop = 0, elapsed;
+    int problems = 0, rotations = 0, changes = 0, r, p[2], i, k, n_fields;
+    const log_field_t *fields;
+
+    if ((cycles < 1) || (rate <= 0)) {
+        fprintf(stderr, "Usage: %s [cycles] [rate_hz]\n", argv[0]);
+        return 1;
+    }
+
+    global.log_format = FORMAT_BINARY;
+    global.flush_ms = 250;
+    // Sem aneis e sem tarefa RT: os pipes fazem o papel apenas das FIFOs de dados
+    global.fifo_rings = global.fifo_jitter = -1;
+    mkdir(FILES_PATH, 0777);
+    if ((sem_init(&global.file_names, 0, 1) != 0) ||
+        ((global.wakeup_save_data = eventfd(0, EFD_NONBLOCK)) < 0)) {
+        perror("Setup");
+        return 1;
+    }
+
+    for (i = 0; i < N_STREAMS; i++) {
+        if ((pipe(p) < 0) || (fcntl(p[0], F_SETFL, O_NONBLOCK) < 0) || (fcntl(p[1], F_SETFL, O_NONBLOCK) < 0)) {
+            perror("pipe");
+            return 1;
+        }
+        *fifos[i] = p[0];
+        memset(&producers[i], 0, sizeof(producers[i]));
+        producers[i].stream = i;
+        producers[i].fd = p[1];
+        producers[i].rate_hz = rate;
+        fields = log_stream_fields(i, &n_fields);
+        for (k = 0; k < n_fields; k++)
+            if (strcmp(fields[k].name, "time_sys") == 0)
+                producers[i].time_offset = fields[k].offset;
+        expected[i] = 0;
+        pthread_create(&producers[i].thread, NULL, produce, &producers[i]);
+    }
+    signal(SIGALRM, watchdog);
+    srand(1);
+
+    elapsed = now_s();
+    for (cycle = 0; cycle <= cycles; cycle++) {
+        // O ultimo ciclo esvazia o que sobra nos pipes depois que os produtores param
+        if (cycle == cycles)
+            for (i = 0; i < N_STREAMS; i++) {
+                producers[i].stop = 1;
+                pthread_join(producers[i].thread, NULL);
+            }
+
+        t0 = now_s();
+        // Um START depois de um "change datfile" eh recusado pelo fdc_master, que
+        // encontra o voo rodando: o STOP abaixo ainda precisa terminar a thread
+        if ((cycle % CHANGE_EVERY) == CHANGE_EVERY - 1)
+            r = change_datfile(changes++);
+        else
+            r = start_save_data();
+        if (r != 0) {
+            fprintf(stderr, "Cycle %d: start_save_data() failed\n", cycle);
+            return 1;
+        }
+        t = now_s() - t0;
+        if (t > max_start)
+            max_start = t;
+
+        usleep(rand() % MAX_PAUSE_US);
+        if ((cycle % ROTATE_EVERY) == ROTATE_EVERY - 1) {
+            request_rotation();
+            rotations++;
+            // Uma vez sim, outra nao, um segundo pedido vem logo em seguida, em geral
+            // enquanto o segmento do primeiro ainda esta sendo aberto (e que eh entao
+            // descartado)
+            if ((cycle % (2*ROTATE_EVERY)) == 2*ROTATE_EVERY - 1) {
+                usleep(rand() % 200);
+                request_rotation();
+                rotations++;
+            }
+            usleep(rand() % MAX_PAUSE_US);
+        }
+
+        alarm(STOP_TIMEOUT_S);
+        t0 = now_s();
+        if (stop_save_data() != 0) {
+            fprintf(stderr, "Cycle %d: stop_save_data() failed\n", cycle);
+            return 1;
+        }
+        t = now_s() - t0;
+        alarm(0);
+        total_stop += t;
+        if (t > max_stop)
+            max_stop = t;
+
+        problems += check_flight(global.dir_name, expected);
+        usleep(rand() % MAX_PAUSE_US);
+    }
+    elapsed = now_s() - elapsed;
+
+    for (i = 0; i < N_STREAMS; i++) {
+        if (expected[i] != producers[i].written) {
+            fprintf(stderr, "Stream %s: %llu records saved, %llu written to the FIFO\n", log_stream_name(i),
+                    expected[i], producers[i].written);
+            problems++;
+        }
+        records += expected[i];
+    }
+
+    printf("%d start/stop cycles (%d rotations, %d started by change datfile) in %.2f s, %llu records\n", cycles,
+           rotations, changes, elapsed, records);
+    printf("Longest start %.3f ms, longest stop %.3f ms, mean stop %.3f ms\n", max_start*1e3, max_stop*1e3,
+           total_stop/(cycles + 1)*1e3);
+    if ((problems > 0) || (errors_logged > 0)) {
+        printf("FAILED: %d problems, %d errors logged\n", problems, errors_logged);
+        return 1;
+    }
+    printf("OK\n");
+
+    return 0;
+}
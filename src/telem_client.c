@@ -0,0 +1,210 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            IMPRESSAO DAS AMOSTRAS AO VIVO DO FDC_MASTER (VER TELEMETRY.H) - TELEM_CLIENT
+
+Uso: telem_client [-s socket] [-u porta] [-n registros] [-d ms] [serie decimacao ...]
+
+    Assina as series dadas (p.ex. "ahrs 5 gps 1", todas as series por padrao) pelo socket
+UNIX do fdc_master (TELEM_SOCKET) ou, com -u, pela sua porta UDP em 127.0.0.1, e imprime uma
+linha por registro: serie, numero de sequencia, registros perdidos ate agora e os campos,
+decodificados com o cabecalho enviado pelo servidor. Com -n para depois de tantos registros;
+com -d espera esse tempo depois de cada registro, como faria um cliente lento. As contagens
+de registros por serie vao para stderr no final.
+*********************************************************************************************
+********************************************************************************************/
+
+#include "log_format.h"
+#include "telemetry.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+typedef struct {
+    int known;                  // Cabecalho recebido
+    log_header_t header;
+    log_field_t fields[TELEM_MESSAGE_MAX/sizeof(log_field_t)];
+    unsigned long records;
+} stream_t;
+
+static stream_t streams[N_STREAMS];
+static volatile sig_atomic_t theend;
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void stop(int s)
+{
+    theend = 1;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void print_record(const stream_t *s, const telem_frame_t *f, const char *r)
+{
+    const log_field_t *field;
+    uint32_t i, j;
+
+    printf("%s %llu %u", s->header.stream_name, (unsigned long long)f->seq, f->lost);
+    for (i = 0; i < s->header.n_fields; i++) {
+        field = &s->fields[i];
+        for (j = 0; j < field->count; j++) {
+            const char *v = r + field->offset + j*field->size;
+
+            if (field->offset + (j + 1)*field->size > f->size)
+                break;
+            if ((field->type == LOG_FLOAT) && (field->size == 4))
+                printf(" %g", *(const float *)v);
+            else if ((field->type == LOG_INT) && (field->size == 8))
+                printf(" %lld", (long long)*(const int64_t *)v);
+            else if (field->type == LOG_INT)
+                printf(" %d", *(const int32_t *)v);
+        }
+    }
+    printf("\n");
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int connect_unix(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    if ((fd = socket(AF_UNIX, SOCK_SEQPACKET, 0)) < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int connect_udp(int port)
+{
+    struct sockaddr_in addr;
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int main(int argc, char *argv[])
+{
+    char msg[sizeof(telem_frame_t) + TELEM_MESSAGE_MAX];
+    const telem_frame_t *f = (const telem_frame_t *)msg;
+    const char *path = TELEM_SOCKET;
+    char subscription[256] = "";
+    unsigned long n_records = 0, received = 0;
+    int port = 0, delay_ms = 0, fd, opt, i;
+    uint32_t lost = 0;
+    time_t renewed;
+    ssize_t r;
+    struct timeval tv = { 1, 0 };
+
+    while ((opt = getopt(argc, argv, "s:u:n:d:")) != -1) {
+        switch (opt) {
+        case 's': path = optarg; break;
+        case 'u': port = atoi(optarg); break;
+        case 'n': n_records = strtoul(optarg, NULL, 10); break;
+        case 'd': delay_ms = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-s socket] [-u port] [-n records] [-d ms] [stream decimation ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    for (i = optind; i < argc; i++) {
+        if (strlen(subscription) + strlen(argv[i]) + 2 > sizeof(subscription))
+            break;
+        strcat(subscription, argv[i]);
+        strcat(subscription, " ");
+    }
+    if (subscription[0] == '\0')
+        strcpy(subscription, "all 1");
+
+    fd = (port != 0) ? connect_udp(port) : connect_unix(path);
+    if (fd < 0) {
+        perror((port != 0) ? "udp" : path);
+        return 1;
+    }
+    if (send(fd, subscription, strlen(subscription), 0) < 0) {
+        perror("send");
+        return 1;
+    }
+    renewed = time(NULL);
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    while (!theend && ((n_records == 0) || (received < n_records))) {
+        // A assinatura UDP expira se nao for repetida
+        if ((port != 0) && (time(NULL) - renewed >= TELEM_UDP_TIMEOUT_S/2)) {
+            send(fd, subscription, strlen(subscription), 0);
+            renewed = time(NULL);
+        }
+
+        r = recv(fd, msg, sizeof(msg), 0);
+        if (r == 0)
+            break;
+        if ((r < (ssize_t)sizeof(*f)) || (f->stream >= N_STREAMS) || (sizeof(*f) + f->size > (size_t)r))
+            continue;
+
+        if (f->type == TELEM_HEADER) {
+            stream_t *s = &streams[f->stream];
+
+            if (f->size < sizeof(log_header_t))
+                continue;
+            memcpy(&s->header, msg + sizeof(*f), sizeof(log_header_t));
+            if (s->header.n_fields > sizeof(s->fields)/sizeof(s->fields[0]))
+                s->header.n_fields = sizeof(s->fields)/sizeof(s->fields[0]);
+            memcpy(s->fields, msg + sizeof(*f) + sizeof(log_header_t),
+                   f->size - sizeof(log_header_t) < s->header.n_fields*sizeof(log_field_t)
+                   ? f->size - sizeof(log_header_t) : s->header.n_fields*sizeof(log_field_t));
+            s->known = 1;
+        }
+        else if ((f->type == TELEM_RECORD) && streams[f->stream].known) {
+            print_record(&streams[f->stream], f, msg + sizeof(*f));
+            streams[f->stream].records++;
+            lost = f->lost;
+            received++;
+            if (delay_ms > 0)
+                usleep(delay_ms*1000);
+        }
+    }
+
+    fflush(stdout);
+    for (i = 0; i < N_STREAMS; i++)
+        if (streams[i].known)
+            fprintf(stderr, "%s: %lu records\n", streams[i].header.stream_name, streams[i].records);
+    fprintf(stderr, "lost: %u\n", lost);
+
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,542 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            SERVIDOR DAS AMOSTRAS AO VIVO (VER TELEMETRY.H) - TELEMETRY
+*********************************************************************************************
+********************************************************************************************/
+
+#include "telemetry.h"
+#include "log_format.h"
+#include "messages.h"
+#include "save_data.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define RING_MASK (TELEM_RING_RECORDS - 1)
+
+// Posicao do anel. seq eh 0 enquanto o produtor escreve a posicao, e o numero do seu
+// registro mais um quando o registro esta completo.
+typedef struct {
+    uint64_t seq;
+    uint32_t stream;
+    uint32_t size;
+    char data[TELEM_RECORD_MAX];
+} __attribute__ ((aligned (64))) slot_t;
+
+typedef struct {
+    int fd;                         // Socket UNIX do cliente, -1 para UDP
+    struct sockaddr_in addr;        // Cliente UDP
+    time_t last_seen;               // Ultima assinatura de um cliente UDP
+
+    uint64_t cursor;                // Proximo registro do anel a enviar
+    unsigned decimation[N_STREAMS]; // 0: nao assinada
+    unsigned count[N_STREAMS];      // Registros da serie vistos
+    int headers;                    // Series cujo cabecalho ainda falta enviar (bits)
+    int blocked;                    // Socket cheio, esperando POLLOUT
+
+    unsigned long sent;
+    unsigned long lost;             // Registros pulados por causa de uma volta
+} client_t;
+
+static struct {
+    slot_t slots[TELEM_RING_RECORDS];
+    uint64_t head;                  // Registros publicados (atomico)
+    int subscribers;                // Clientes com alguma serie (atomico)
+
+    int wake;                       // eventfd: registros publicados, ou parada
+    int stop;                       // (atomico)
+    int listen_fd;
+    int udp_fd;
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    int running;
+    pthread_t thread;
+
+    client_t clients[TELEM_MAX_CLIENTS];
+    int n_clients;
+} telem = { .wake = -1, .listen_fd = -1, .udp_fd = -1 };
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void telemetry_publish(int stream, const void *records, int n)
+{
+    size_t size = log_record_size(stream);
+    uint64_t head;
+    uint64_t one = 1;
+    slot_t *s;
+    int i;
+
+    if ((n <= 0) || (__atomic_load_n(&telem.subscribers, __ATOMIC_RELAXED) == 0))
+        return;
+
+    head = __atomic_load_n(&telem.head, __ATOMIC_RELAXED);
+    for (i = 0; i < n; i++, head++) {
+        s = &telem.slots[head & RING_MASK];
+        __atomic_store_n(&s->seq, 0, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        s->stream = stream;
+        s->size = size;
+        memcpy(s->data, (const char *)records + i*size, size);
+        __atomic_store_n(&s->seq, head + 1, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&telem.head, head, __ATOMIC_RELEASE);
+
+    // Um despertar por lote; o contador do eventfd so cresce
+    if (write(telem.wake, &one, sizeof(one)) < 0) {}
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que copia o registro seq do anel para a mensagem depois do quadro, se ele for de
+// uma serie em mask. Retorna a sua serie, -1 se ele foi (ou esta sendo) sobrescrito, ou
+// -2 se ele for de outra serie.
+static int read_slot(uint64_t seq, int mask, char *msg)
+{
+    const slot_t *s = &telem.slots[seq & RING_MASK];
+    telem_frame_t *f = (telem_frame_t *)msg;
+    int stream;
+
+    if (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != seq + 1)
+        return -1;
+    stream = s->stream;
+    if (mask & (1 << stream)) {
+        f->size = s->size;
+        memcpy(msg + sizeof(*f), s->data, s->size);
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) != seq + 1)
+        return -1;
+
+    return (mask & (1 << stream)) ? stream : -2;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que envia uma mensagem. Retorna 0, 1 se o socket estiver cheio, ou -1 se o
+// cliente foi embora.
+static int send_message(client_t *c, const void *msg, size_t len)
+{
+    ssize_t r;
+
+    if (c->fd >= 0)
+        r = send(c->fd, msg, len, MSG_DONTWAIT|MSG_NOSIGNAL);
+    else
+        r = sendto(telem.udp_fd, msg, len, MSG_DONTWAIT, (struct sockaddr *)&c->addr, sizeof(c->addr));
+
+    if (r >= 0)
+        return 0;
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == ENOBUFS))
+        return 1;
+    // Um cliente UDP que nao esta escutando nao termina a sua assinatura
+    return (c->fd >= 0) ? -1 : 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int subscribed(const client_t *c)
+{
+    int i;
+
+    for (i = 0; i < N_STREAMS; i++)
+        if (c->decimation[i] > 0)
+            return 1;
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que envia ao cliente o que ele ainda nao recebeu, ate o seu socket ficar cheio
+static int pump(client_t *c)
+{
+    char msg[sizeof(telem_frame_t) + TELEM_MESSAGE_MAX];
+    telem_frame_t *f = (telem_frame_t *)msg;
+    uint64_t head = __atomic_load_n(&telem.head, __ATOMIC_ACQUIRE);
+    int mask = 0, stream, r, i;
+
+    memset(f, 0, sizeof(*f));
+
+    // Cabecalhos primeiro, para que o cliente possa ler os registros que vem depois
+    for (i = 0; (i < N_STREAMS) && c->headers; i++) {
+        if (!(c->headers & (1 << i)))
+            continue;
+        f->type = TELEM_HEADER;
+        f->stream = i;
+        f->seq = c->cursor;
+        f->lost = c->lost;
+        f->size = log_build_header(msg + sizeof(*f), TELEM_MESSAGE_MAX, i, LOG_RAW, time(NULL));
+        if ((r = send_message(c, msg, sizeof(*f) + f->size)) != 0)
+            return r;
+        c->headers &= ~(1 << i);
+    }
+
+    for (i = 0; i < N_STREAMS; i++)
+        if (c->decimation[i] > 0)
+            mask |= 1 << i;
+    if (mask == 0) {
+        c->cursor = head;
+        return 0;
+    }
+
+    // Ultrapassado pelo produtor: pula o que foi sobrescrito
+    if (head - c->cursor > TELEM_RING_RECORDS) {
+        c->lost += head - TELEM_RING_RECORDS - c->cursor;
+        c->cursor = head - TELEM_RING_RECORDS;
+    }
+
+    f->type = TELEM_RECORD;
+    while (c->cursor != head) {
+        stream = read_slot(c->cursor, mask, msg);
+        if (stream == -1) {
+            c->lost++;
+            c->cursor++;
+            continue;
+        }
+        if ((stream >= 0) && ((c->count[stream] % c->decimation[stream]) == 0)) {
+            f->stream = stream;
+            f->seq = c->cursor;
+            f->lost = c->lost;
+            if ((r = send_message(c, msg, sizeof(*f) + f->size)) != 0)
+                return r;
+            c->sent++;
+        }
+        if (stream >= 0)
+            c->count[stream]++;
+        c->cursor++;
+    }
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void update_subscribers(void)
+{
+    int i, n = 0;
+
+    for (i = 0; i < telem.n_clients; i++)
+        if (subscribed(&telem.clients[i]))
+            n++;
+    __atomic_store_n(&telem.subscribers, n, __ATOMIC_RELAXED);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void drop_client(int i)
+{
+    client_t *c = &telem.clients[i];
+    char texto[MAX_STRLEN+64];
+
+    sprintf(texto, "Telemetry: Cliente desconectado, %lu registros enviados, %lu perdidos.", c->sent, c->lost);
+    master_log(STATUS_LOG, texto);
+
+    if (c->fd >= 0)
+        close(c->fd);
+    telem.clients[i] = telem.clients[--telem.n_clients];
+    update_subscribers();
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que le uma assinatura: pares de nome de serie (ou "all") e decimacao
+static void subscribe(client_t *c, char *text)
+{
+    char *name, *n, *p;
+    unsigned d;
+    int i;
+
+    memset(c->decimation, 0, sizeof(c->decimation));
+    memset(c->count, 0, sizeof(c->count));
+
+    for (name = strtok_r(text, " \t\r\n,", &p); name != NULL; name = strtok_r(NULL, " \t\r\n,", &p)) {
+        n = strtok_r(NULL, " \t\r\n,", &p);
+        d = (n != NULL) ? strtoul(n, NULL, 10) : 1;
+        for (i = 0; i < N_STREAMS; i++)
+            if ((strcasecmp(name, "all") == 0) || (strcasecmp(name, log_stream_name(i)) == 0))
+                c->decimation[i] = d;
+        if (n == NULL)
+            break;
+    }
+
+    c->headers = 0;
+    for (i = 0; i < N_STREAMS; i++)
+        if (c->decimation[i] > 0)
+            c->headers |= 1 << i;
+
+    // Somente os registros publicados de agora em diante
+    c->cursor = __atomic_load_n(&telem.head, __ATOMIC_ACQUIRE);
+    c->blocked = 0;
+    update_subscribers();
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static client_t *new_client(void)
+{
+    client_t *c;
+
+    if (telem.n_clients == TELEM_MAX_CLIENTS)
+        return NULL;
+
+    c = &telem.clients[telem.n_clients++];
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+
+    return c;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void accept_client(void)
+{
+    client_t *c;
+    int fd = accept(telem.listen_fd, NULL, NULL);
+
+    if (fd < 0)
+        return;
+    if ((c = new_client()) == NULL) {
+        master_log(ERROR_LOG, "Telemetry: Numero maximo de clientes atingido.");
+        close(fd);
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    c->fd = fd;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void read_udp(void)
+{
+    char text[256];
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    client_t *c = NULL;
+    ssize_t r;
+    int i;
+
+    while ((r = recvfrom(telem.udp_fd, text, sizeof(text) - 1, MSG_DONTWAIT, (struct sockaddr *)&addr, &len)) >= 0) {
+        text[r] = '\0';
+        len = sizeof(addr);
+        c = NULL;
+        for (i = 0; i < telem.n_clients; i++)
+            if ((telem.clients[i].fd < 0) && (telem.clients[i].addr.sin_port == addr.sin_port)
+                && (telem.clients[i].addr.sin_addr.s_addr == addr.sin_addr.s_addr))
+                c = &telem.clients[i];
+        if ((c == NULL) && ((c = new_client()) == NULL))
+            continue;
+        c->addr = addr;
+        c->last_seen = time(NULL);
+        subscribe(c, text);
+    }
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void *server(void *arg)
+{
+    struct pollfd fds[3 + TELEM_MAX_CLIENTS];
+    client_t *c;
+    char text[256];
+    uint64_t n;
+    ssize_t r;
+    int nfds, first, i;
+
+    while (!__atomic_load_n(&telem.stop, __ATOMIC_ACQUIRE)) {
+        fds[0].fd = telem.wake;
+        fds[0].events = POLLIN;
+        fds[1].fd = telem.listen_fd;
+        fds[1].events = POLLIN;
+        fds[2].fd = telem.udp_fd;   // -1 eh ignorado pelo poll()
+        fds[2].events = POLLIN;
+        first = nfds = 3;
+        for (i = 0; i < telem.n_clients; i++, nfds++) {
+            fds[nfds].fd = telem.clients[i].fd;
+            fds[nfds].events = telem.clients[i].blocked ? (POLLIN|POLLOUT) : POLLIN;
+        }
+
+        if (poll(fds, nfds, (telem.udp_fd >= 0) ? 1000 : -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            master_log(ERROR_LOG, "Telemetry: Falha no poll.");
+            break;
+        }
+
+        if (fds[0].revents & POLLIN)
+            if (read(telem.wake, &n, sizeof(n)) < 0) {}
+
+        // Clientes, antes de a lista mudar
+        for (i = nfds - first - 1; i >= 0; i--) {
+            c = &telem.clients[i];
+            if (fds[first + i].revents & POLLOUT)
+                c->blocked = 0;
+            if (fds[first + i].revents & (POLLIN|POLLHUP|POLLERR)) {
+                r = recv(c->fd, text, sizeof(text) - 1, MSG_DONTWAIT);
+                if ((r == 0) || ((r < 0) && (errno != EAGAIN))) {
+                    drop_client(i);
+                    continue;
+                }
+                if (r > 0) {
+                    text[r] = '\0';
+                    subscribe(c, text);
+                }
+            }
+        }
+
+        if (fds[1].revents & POLLIN)
+            accept_client();
+        if ((telem.udp_fd >= 0) && (fds[2].revents & POLLIN))
+            read_udp();
+
+        for (i = telem.n_clients - 1; i >= 0; i--) {
+            c = &telem.clients[i];
+            if ((c->fd < 0) && (time(NULL) - c->last_seen > TELEM_UDP_TIMEOUT_S)) {
+                drop_client(i);
+                continue;
+            }
+            if (c->blocked)
+                continue;
+            r = pump(c);
+            if (r < 0)
+                drop_client(i);
+            else if (r > 0)
+                c->blocked = (c->fd >= 0);  // UDP: tenta de novo no proximo despertar
+        }
+    }
+
+    return NULL;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int open_unix(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+    strcpy(addr.sun_path, path);
+
+    if ((fd = socket(AF_UNIX, SOCK_SEQPACKET, 0)) < 0)
+        return -1;
+    unlink(path);
+    if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) || (listen(fd, 4) != 0)) {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    return fd;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int open_udp(int port)
+{
+    struct sockaddr_in addr;
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+        return -1;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int telemetry_start(const char *path, int udp_port)
+{
+    char texto[MAX_STRLEN+64];
+    int i;
+
+    for (i = 0; i < N_STREAMS; i++)
+        if (log_record_size(i) > TELEM_RECORD_MAX) {
+            master_log(ERROR_LOG, "Telemetry: Registro maior que TELEM_RECORD_MAX.");
+            return -1;
+        }
+
+    if ((telem.listen_fd = open_unix(path)) < 0) {
+        master_log(ERROR_LOG, "Telemetry: Falha ao abrir o socket do servidor.");
+        return -1;
+    }
+    strcpy(telem.path, path);
+
+    if ((udp_port != 0) && ((telem.udp_fd = open_udp(udp_port)) < 0))
+        master_log(ERROR_LOG, "Telemetry: Falha ao abrir a porta UDP, apenas o socket local sera usado.");
+
+    if ((telem.wake = eventfd(0, EFD_NONBLOCK)) < 0) {
+        master_log(ERROR_LOG, "Telemetry: Falha ao criar o eventfd.");
+        telemetry_stop();
+        return -1;
+    }
+
+    __atomic_store_n(&telem.stop, 0, __ATOMIC_RELEASE);
+    if (pthread_create(&telem.thread, NULL, server, NULL) != 0) {
+        master_log(ERROR_LOG, "Telemetry: Falha ao criar a thread do servidor.");
+        telemetry_stop();
+        return -1;
+    }
+    telem.running = 1;
+
+    if (telem.udp_fd >= 0)
+        sprintf(texto, "Telemetry: Servidor em %s e na porta UDP %d.", path, udp_port);
+    else
+        sprintf(texto, "Telemetry: Servidor em %s.", path);
+    master_log(STATUS_LOG, texto);
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+void telemetry_stop(void)
+{
+    uint64_t one = 1;
+
+    if (telem.running) {
+        __atomic_store_n(&telem.stop, 1, __ATOMIC_RELEASE);
+        if (write(telem.wake, &one, sizeof(one)) < 0) {}
+        pthread_join(telem.thread, NULL);
+        telem.running = 0;
+    }
+
+    while (telem.n_clients > 0)
+        drop_client(telem.n_clients - 1);
+
+    if (telem.listen_fd >= 0) {
+        close(telem.listen_fd);
+        unlink(telem.path);
+        telem.listen_fd = -1;
+    }
+    if (telem.udp_fd >= 0) {
+        close(telem.udp_fd);
+        telem.udp_fd = -1;
+    }
+    if (telem.wake >= 0) {
+        close(telem.wake);
+        telem.wake = -1;
+    }
+}
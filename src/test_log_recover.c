@@ -0,0 +1,270 @@
+/*!*******************************************************************************************
+**********************************************************************************************
+            DANIFICACAO DOS ARQUIVOS DE UM VOO COMO UMA FALTA DE ENERGIA FARIA, CONFERINDO
+            SE O LOG_RECOVER OS REPARA - TEST_LOG_RECOVER
+
+    Um processo filho grava um arquivo de cada tipo com o codigo de gravacao (log_writer,
+log_codec) e morre com _exit() no meio do voo, sem fechar nada:
+
+  - daq_file.bin:   registros brutos em modo mapeado, seguidos dos zeros
+                    do resto da pre-alocacao;
+  - ahrs_file.bin:  registros brutos e metade de mais um;
+  - gps_file.fdj:   blocos com journal em modo mapeado, seguidos de zeros;
+  - nav_file.fdz:   blocos comprimidos, o segundo danificado depois
+                    (o terceiro eh valido mas perdido);
+  - pitot_file.dat: linhas de texto em modo mapeado, metade de mais uma e
+                    zeros.
+
+    O log_recover eh entao executado duas vezes no diretorio: a primeira execucao deve
+cortar cada arquivo nos bytes que o filho tinha gravado por completo, a segunda nao deve
+encontrar mais nada para reparar.
+
+Uso: test_log_recover [caminho do log_recover]
+*********************************************************************************************
+********************************************************************************************/
+
+#include "log_codec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+// Pre-alocacao dos arquivos mapeados, muito mais do que o que eh gravado
+#define PREALLOC (1024*1024)
+
+// Periodo dos registros (ns)
+#define PERIOD_NS 20000000LL
+
+enum { DAQ_BIN, AHRS_BIN, GPS_FDJ, NAV_FDZ, PITOT_DAT, N_FILES };
+
+static const char *names[N_FILES] = {
+    "daq_file.bin", "ahrs_file.bin", "gps_file.fdj", "nav_file.fdz", "pitot_file.dat"
+};
+
+// Bytes que devem sobrar de cada arquivo, e posicao do byte do nav_file.fdz a danificar
+typedef struct {
+    unsigned long long keep[N_FILES];
+    unsigned long long damage;
+} expected_t;
+
+static char dir[] = "/tmp/log_recover_XXXXXX";
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static void path_of(char *path, size_t size, int file)
+{
+    snprintf(path, size, "%s/%s", dir, names[file]);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao que monta um registro da serie de numero i, com time_sys e o resto dele
+// diferente de zero
+static void make_record(log_stream_t stream, long long i, void *record)
+{
+    const log_field_t *fields;
+    int n_fields, k;
+    int64_t t = (i + 1)*PERIOD_NS;
+
+    memset(record, 0x11, log_record_size(stream));
+    fields = log_stream_fields(stream, &n_fields);
+    for (k = 0; k < n_fields; k++)
+        if (strcmp(fields[k].name, "time_sys") == 0)
+            memcpy((char *)record + fields[k].offset, &t, sizeof(t));
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int write_header(log_writer_t *w, log_stream_t stream, log_encoding_t encoding)
+{
+    char header[4096];
+    size_t h = log_build_header(header, sizeof(header), stream, encoding, 0);
+
+    return ((h == 0) || (log_writer_write(w, header, h) < 0)) ? -1 : 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+// Funcao executada pelo processo filho, que morre no final sem fechar os arquivos
+static int write_flight(expected_t *x)
+{
+    char path[256], record[256];
+    log_writer_t w[N_FILES];
+    log_encoder_t gps, nav;
+    int i;
+
+    memset(&gps, 0, sizeof(gps));
+    memset(&nav, 0, sizeof(nav));
+    for (i = 0; i < N_FILES; i++) {
+        path_of(path, sizeof(path), i);
+        if (((i == AHRS_BIN) || (i == NAV_FDZ)) ? log_writer_open(&w[i], path, 0, 0) :
+            log_writer_open_mapped(&w[i], path, PREALLOC, 0, 0)) {
+            perror(path);
+            return -1;
+        }
+    }
+    if ((write_header(&w[DAQ_BIN], STREAM_DAQ, LOG_RAW) < 0) ||
+        (write_header(&w[AHRS_BIN], STREAM_AHRS, LOG_RAW) < 0) ||
+        (write_header(&w[GPS_FDJ], STREAM_GPS, LOG_JOURNAL) < 0) ||
+        (write_header(&w[NAV_FDZ], STREAM_NAV, LOG_DELTA) < 0) ||
+        (log_encoder_init(&gps, STREAM_GPS, LOG_JOURNAL, 1000000, 1000000) < 0) ||
+        (log_encoder_init(&nav, STREAM_NAV, LOG_DELTA, 1000000, 1000000) < 0))
+        return -1;
+
+    for (i = 0; i < 100; i++) {
+        make_record(STREAM_DAQ, i, record);
+        log_writer_write(&w[DAQ_BIN], record, log_record_size(STREAM_DAQ));
+    }
+    x->keep[DAQ_BIN] = w[DAQ_BIN].bytes;
+
+    for (i = 0; i < 50; i++) {
+        make_record(STREAM_AHRS, i, record);
+        log_writer_write(&w[AHRS_BIN], record, log_record_size(STREAM_AHRS));
+    }
+    x->keep[AHRS_BIN] = w[AHRS_BIN].bytes;
+    log_writer_write(&w[AHRS_BIN], record, log_record_size(STREAM_AHRS)/2);
+
+    // Blocos inteiros e um marcador de commit: tudo deve sobreviver
+    for (i = 0; i < 3*LOG_CODEC_BLOCK_RECORDS + 10; i++) {
+        make_record(STREAM_GPS, i, record);
+        log_encoder_add(&gps, &w[GPS_FDJ], record);
+    }
+    log_encoder_commit(&gps, &w[GPS_FDJ]);
+    x->keep[GPS_FDJ] = w[GPS_FDJ].bytes;
+
+    // Tres blocos, dos quais so o primeiro vai sobrar
+    for (i = 0; i < 3*LOG_CODEC_BLOCK_RECORDS; i++) {
+        make_record(STREAM_NAV, i, record);
+        log_encoder_add(&nav, &w[NAV_FDZ], record);
+        if (i == LOG_CODEC_BLOCK_RECORDS - 1)
+            x->keep[NAV_FDZ] = w[NAV_FDZ].bytes;
+    }
+    x->damage = x->keep[NAV_FDZ] + sizeof(log_block_t) + 1;
+
+    for (i = 0; i < 30; i++)
+        log_writer_printf(&w[PITOT_DAT], "%d\t%lld\t1\n", i, (i + 1)*PERIOD_NS);
+    x->keep[PITOT_DAT] = w[PITOT_DAT].bytes;
+    log_writer_printf(&w[PITOT_DAT], "30\t62000");
+
+    // O que uma falta de energia deixa, no que se refere ao cache de paginas: o que foi
+    // entregue ao kernel, e os tamanhos pre-alocados
+    log_writer_flush(&w[AHRS_BIN]);
+    log_writer_flush(&w[NAV_FDZ]);
+
+    return 0;
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+static int run_recover(const char *tool)
+{
+    int status;
+    pid_t pid = fork();
+
+    if (pid < 0)
+        return -1;
+    if (pid == 0) {
+        execl(tool, tool, dir, (char *)NULL);
+        perror(tool);
+        _exit(127);
+    }
+    if ((waitpid(pid, &status, 0) != pid) || !WIFEXITED(status))
+        return -1;
+
+    return WEXITSTATUS(status);
+}
+
+/*!*******************************************************************************************
+*********************************************************************************************/
+int main(int argc, char *argv[])
+{
+    const char *tool = (argc > 1) ? argv[1] : "./log_recover";
+    char path[256];
+    expected_t x;
+    struct stat st;
+    int fd[2], status, problems = 0, run, i;
+    pid_t pid;
+    FILE *f;
+
+    if ((mkdtemp(dir) == NULL) || (pipe(fd) < 0)) {
+        perror("test_log_recover");
+        return 1;
+    }
+
+    memset(&x, 0, sizeof(x));
+    if ((pid = fork()) < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0) {
+        close(fd[0]);
+        status = write_flight(&x);
+        if ((status == 0) && (write(fd[1], &x, sizeof(x)) != sizeof(x)))
+            status = -1;
+        _exit((status == 0) ? 0 : 1);
+    }
+    close(fd[1]);
+    if ((read(fd[0], &x, sizeof(x)) != sizeof(x)) || (waitpid(pid, &status, 0) != pid) ||
+        !WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+        fprintf(stderr, "The flight could not be written\n");
+        return 1;
+    }
+
+    // Os arquivos mapeados ainda estao pre-alocados
+    for (i = 0; i < N_FILES; i++) {
+        path_of(path, sizeof(path), i);
+        if ((stat(path, &st) == 0) && (i != AHRS_BIN) && (i != NAV_FDZ) && (st.st_size != PREALLOC)) {
+            fprintf(stderr, "%s: %lld bytes, the preallocation was %d\n", names[i], (long long)st.st_size, PREALLOC);
+            problems++;
+        }
+    }
+
+    path_of(path, sizeof(path), NAV_FDZ);
+    if ((f = fopen(path, "r+b")) == NULL) {
+        perror(path);
+        return 1;
+    }
+    fseek(f, x.damage, SEEK_SET);
+    status = fgetc(f);
+    fseek(f, x.damage, SEEK_SET);
+    fputc(status ^ 0xff, f);
+    fclose(f);
+
+    for (run = 1; run <= 2; run++) {
+        printf("log_recover, run %d:\n", run);
+        fflush(stdout);
+        if ((status = run_recover(tool)) != 0) {
+            fprintf(stderr, "%s returned %d\n", tool, status);
+            problems++;
+        }
+        for (i = 0; i < N_FILES; i++) {
+            path_of(path, sizeof(path), i);
+            if (stat(path, &st) < 0) {
+                perror(path);
+                problems++;
+            }
+            else if ((unsigned long long)st.st_size != x.keep[i]) {
+                fprintf(stderr, "Run %d: %s has %lld bytes, %llu expected\n", run, names[i],
+                        (long long)st.st_size, x.keep[i]);
+                problems++;
+            }
+        }
+    }
+
+    for (i = 0; i < N_FILES; i++) {
+        path_of(path, sizeof(path), i);
+        unlink(path);
+    }
+    rmdir(dir);
+
+    if (problems > 0) {
+        printf("FAILED: %d problems\n", problems);
+        return 1;
+    }
+    printf("OK\n");
+
+    return 0;
+}
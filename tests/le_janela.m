@@ -0,0 +1,77 @@
+function dados = le_janela(arquivo, t_inicio, t_fim, col_tempo)
+% LE_JANELA Le apenas um trecho de tempo de um arquivo texto (.dat) gravado
+% pelo fdc_master, usando o indice de tempo gravado junto com ele (.dat.idx).
+%
+%   daq = le_janela('daq_file.dat', 120, 150, 17)
+%
+%   t_inicio, t_fim - inicio e fim do trecho, em segundos apos o primeiro
+%                     registro do arquivo
+%   col_tempo       - coluna do tempo do sistema (time_sys) no arquivo
+%
+%   Retorna as linhas do trecho, como load(). Apenas o indice e os bytes do
+%   trecho sao lidos, de forma que um voo de 3 horas eh aberto em
+%   milissegundos. Arquivos binarios, comprimidos e em blocos sao lidos
+%   pelo log_unpack -t, seguido de le_log_binario.
+
+TAM_CABECALHO = 32;
+TAM_ENTRADA = 32;
+
+fid = fopen([arquivo '.idx'], 'r', 'l');
+if fid < 0
+    error('Falha ao abrir o indice %s.idx.', arquivo);
+end
+
+magic = fread(fid, 8, 'uint8=>char')';
+if ~strcmp(magic, sprintf('FDCIDX\r\n'))
+    fclose(fid);
+    error('%s.idx nao eh um indice do FDC.', arquivo);
+end
+
+% Entradas: time_sys (int64), offset (uint64), registro (uint64), GPS_time (single)
+fseek(fid, TAM_CABECALHO, 'bof');
+bruto = fread(fid, inf, 'uint8=>uint8');
+fclose(fid);
+n = floor(numel(bruto)/TAM_ENTRADA);
+if n == 0
+    error('O indice %s.idx esta vazio.', arquivo);
+end
+bruto = reshape(bruto(1:n*TAM_ENTRADA), TAM_ENTRADA, n);
+tempos = double(typecast(reshape(bruto(1:8, :), [], 1), 'int64'));
+offsets = double(typecast(reshape(bruto(9:16, :), [], 1), 'uint64'));
+
+t0 = tempos(1) + t_inicio*1e9;
+t1 = tempos(1) + t_fim*1e9;
+
+% Os registros antes da ultima entrada anterior a t0 sao todos anteriores, e
+% os registros a partir da primeira entrada posterior a t1 sao todos posteriores
+primeira = find(tempos < t0, 1, 'last');
+ultima = find(tempos > t1, 1, 'first');
+if isempty(primeira)
+    inicio = 0;
+else
+    inicio = offsets(primeira);
+end
+
+fid = fopen(arquivo, 'r');
+if fid < 0
+    error('Falha ao abrir o arquivo %s.', arquivo);
+end
+fseek(fid, inicio, 'bof');
+if isempty(ultima)
+    texto = fread(fid, inf, 'uint8=>char')';
+else
+    texto = fread(fid, offsets(ultima) - inicio, 'uint8=>char')';
+end
+fclose(fid);
+
+% As linhas do cabecalho comecam com '%'
+texto = regexprep(texto, '%[^\n]*', '');
+linha = regexp(texto, '[^\n]*[0-9][^\n]*', 'match', 'once');
+if isempty(linha)
+    dados = [];
+    return;
+end
+n_colunas = numel(sscanf(linha, '%f'));
+dados = reshape(sscanf(texto, '%f'), n_colunas, [])';
+
+dados = dados(dados(:, col_tempo) >= t0 & dados(:, col_tempo) <= t1, :);
@@ -0,0 +1,79 @@
+function [dados, nomes, unidades, inicio] = le_log_binario(arquivo)
+% LE_LOG_BINARIO Le um arquivo de dados binario (.bin) gravado pelo fdc_master.
+%
+%   [dados, nomes, unidades, inicio] = le_log_binario('daq_file.bin')
+%
+%   dados    - matriz com uma linha por registro e uma coluna por elemento
+%              de cada campo da estrutura msg_*_t, na ordem da estrutura
+%   nomes    - nome de cada coluna (ex.: 'tensao(3)', 'time_sys')
+%   unidades - unidade de cada coluna
+%   inicio   - instante de inicio da gravacao (segundos desde 01/01/1970)
+%
+%   O layout dos registros eh lido do cabecalho do arquivo, portanto nao
+%   depende da maquina que gravou os dados.
+
+LOG_INT = 1;
+
+fid = fopen(arquivo, 'r', 'l');
+if fid < 0
+    error('Falha ao abrir o arquivo %s.', arquivo);
+end
+
+magic = fread(fid, 8, 'uint8=>char')';
+if ~strcmp(magic, sprintf('FDCLOG\r\n'))
+    fclose(fid);
+    error('%s nao eh um arquivo binario do FDC.', arquivo);
+end
+
+% version, header_size, record_size, n_fields, stream, encoding
+cab = fread(fid, 6, 'uint32');
+inicio = fread(fid, 1, 'int64');
+tam_cabecalho = cab(2);
+tam_registro = cab(3);
+n_campos = cab(4);
+
+% Tabela de campos (56 bytes por campo, logo apos o cabecalho de 64 bytes)
+fseek(fid, 64, 'bof');
+campos = struct('nome', {}, 'unidade', {}, 'tipo', {}, 'n', {}, 'offset', {}, 'tam', {});
+for k = 1:n_campos
+    campos(k).nome = deblank(fread(fid, 24, 'uint8=>char')');
+    campos(k).unidade = deblank(fread(fid, 16, 'uint8=>char')');
+    info = fread(fid, 4, 'uint32');
+    campos(k).tipo = info(1);
+    campos(k).n = info(2);
+    campos(k).offset = info(3);
+    campos(k).tam = info(4);
+end
+
+% Registros (um registro incompleto no final do arquivo eh descartado)
+fseek(fid, tam_cabecalho, 'bof');
+bruto = fread(fid, inf, 'uint8=>uint8');
+fclose(fid);
+n_registros = floor(numel(bruto)/tam_registro);
+bruto = reshape(bruto(1:n_registros*tam_registro), tam_registro, n_registros);
+
+dados = zeros(n_registros, sum([campos.n]));
+nomes = {};
+unidades = {};
+col = 0;
+for k = 1:n_campos
+    c = campos(k);
+    if c.tipo == LOG_INT
+        tipo = sprintf('int%d', 8*c.tam);
+    elseif c.tam == 4
+        tipo = 'single';
+    else
+        tipo = 'double';
+    end
+    for e = 1:c.n
+        col = col + 1;
+        bytes = bruto(c.offset + (e-1)*c.tam + (1:c.tam), :);
+        dados(:, col) = double(typecast(bytes(:), tipo));
+        if c.n > 1
+            nomes{col} = sprintf('%s(%d)', c.nome, e);
+        else
+            nomes{col} = c.nome;
+        end
+        unidades{col} = c.unidade;
+    end
+end
@@ -1,5 +1,7 @@
 clc;
 
+% Para carregar apenas um trecho de um voo longo, sem ler o arquivo inteiro:
+% daq = le_janela('daq_file.dat', 120, 150, 17);
 daq = load daq_file.dat;
 imu = load imu_file.dat;
 gps = load gps_file.dat;